@@ -0,0 +1,133 @@
+#ifndef UTAH_ICG_ARENA_H
+#define UTAH_ICG_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * A linear allocator. Allocation bumps a pointer through large blocks and
+ * nothing is freed individually; instead the arena is rewound to an earlier
+ * Mark, releasing everything allocated since in one step. Not thread safe;
+ * each thread has its own scratch arena.
+ */
+class Arena {
+public:
+  explicit Arena(size_t block_size = 1 << 20);
+
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+  // Give back p if it was the most recent allocation, which lets vectors grow in place. Otherwise a no-op.
+  void deallocate(void *p, size_t bytes);
+
+  // A position to rewind to
+  struct Mark {
+    size_t block;
+    size_t offset;
+    size_t used;
+  };
+
+  Mark mark() const;
+
+  /*
+   * Release everything allocated since mark. Rewinding to empty also frees all
+   * but the first block, so one very large build doesn't pin its memory.
+   */
+  void rewind(const Mark &mark);
+
+  // Bytes handed out and not yet rewound, including alignment padding
+  inline size_t used() const { return used_; }
+
+  // Most bytes in use at once since the last reset_peak
+  inline size_t peak() const { return peak_; }
+
+  inline void reset_peak() { peak_ = used_; }
+
+  // Bytes held in blocks
+  size_t capacity() const;
+
+private:
+  friend class ArenaScope;
+
+  struct Block {
+    char *data;
+    size_t size;
+  };
+
+  size_t block_size_;
+  std::vector<Block> blocks_;
+  size_t current_;
+  size_t offset_;
+  size_t used_;
+  size_t peak_;
+};
+
+// The calling thread's arena for short lived working storage
+Arena &scratch_arena();
+
+/*
+ * Everything allocated from the arena while a scope is alive is released when
+ * it ends. Scopes nest. peak() is the most the scope had in use at once.
+ */
+class ArenaScope {
+public:
+  explicit ArenaScope(Arena &arena = scratch_arena());
+
+  ~ArenaScope();
+
+  ArenaScope(const ArenaScope &) = delete;
+
+  ArenaScope &operator=(const ArenaScope &) = delete;
+
+  inline size_t peak() const { return arena_.peak() - mark_.used; }
+
+private:
+  Arena &arena_;
+  Arena::Mark mark_;
+  size_t outer_peak_;
+};
+
+// A standard allocator drawing on an arena, by default the scratch arena of the thread that makes it
+template<typename T>
+class ArenaAllocator {
+public:
+  typedef T value_type;
+
+  ArenaAllocator() : arena_{&scratch_arena()} {}
+
+  explicit ArenaAllocator(Arena &arena) : arena_{&arena} {}
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_{other.arena()} {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *p, size_t n) {
+    arena_->deallocate(p, n * sizeof(T));
+  }
+
+  inline Arena *arena() const { return arena_; }
+
+private:
+  Arena *arena_;
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() == b.arena(); }
+
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() != b.arena(); }
+
+// A vector in the thread's scratch arena, for working storage that dies with an ArenaScope
+template<typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif //UTAH_ICG_ARENA_H
@@ -0,0 +1,67 @@
+#ifndef UTAH_ICG_BLOCK_COMPRESSION_H
+#define UTAH_ICG_BLOCK_COMPRESSION_H
+
+/*
+ * Block compressed textures. Each 4x4 block of texels is encoded in 8 or 16
+ * bytes that the GPU samples directly, so a texture takes a quarter to an
+ * eighth of the memory and upload bandwidth of RGBA8.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "image.h"
+
+enum class BlockFormat : uint32_t {
+  // Opaque RGB at 4 bits a texel
+  BC1,
+  // RGB with smooth alpha at 8 bits a texel
+  BC3,
+  // One channel at 4 bits a texel
+  BC4,
+  // Two channels at 8 bits a texel
+  BC5
+};
+
+// Bytes in one 4x4 block
+size_t block_bytes(BlockFormat format);
+
+// The format for an image's channels: BC4 for grey, BC5 for grey and alpha, BC3 if any texel isn't opaque, else BC1
+BlockFormat choose_block_format(const Image &image);
+
+struct CompressedImage {
+  CompressedImage();
+
+  uint32_t width;
+  uint32_t height;
+  BlockFormat format;
+
+  // Rows of blocks from the bottom of the image; partial blocks at the edges are padded
+  std::vector<uint8_t> blocks;
+};
+
+/*
+ * Encode image in format. Colour endpoints are fitted along each block's
+ * principal axis. Rows of blocks are encoded concurrently.
+ */
+void compress_image(const Image &image, BlockFormat format, CompressedImage &compressed);
+
+// Decode back to the channels compress_image takes for the format: 3 for BC1, 4 for BC3, 1 for BC4 and 2 for BC5
+void decompress_image(const CompressedImage &compressed, Image &image);
+
+/*
+ * Write a mip chain, level 0 first, in the layout of a KTX2 file: identifier,
+ * header, level index, key/value data and the levels' blocks, smallest level
+ * first. A non empty source_key is stored under the key "utahICGSource", for
+ * a cache to record what it was made from. The data format descriptor is left
+ * out, so other tools may not read it.
+ */
+bool write_ktx2(const std::string &file_name, const std::vector<CompressedImage> &levels,
+                const std::string &source_key = std::string());
+
+// Read a mip chain written by write_ktx2, and its source key, empty if it has none, when asked for
+bool read_ktx2(const std::string &file_name, std::vector<CompressedImage> &levels,
+               std::string *source_key = nullptr);
+
+#endif //UTAH_ICG_BLOCK_COMPRESSION_H
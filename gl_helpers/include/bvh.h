@@ -0,0 +1,79 @@
+#ifndef UTAH_ICG_BVH_H
+#define UTAH_ICG_BVH_H
+
+#include "culling.h"
+
+#include <functional>
+#include <vector>
+
+/*
+ * A BVH node, two to a cache line. Nodes are stored depth first so an inner
+ * node's left child directly follows it and only the right child is recorded.
+ */
+struct BvhNode {
+  float min[3];
+  // Leaves: first entry in Bvh::indices. Inner nodes: index of the right child.
+  uint32_t first;
+  float max[3];
+  // Leaves: number of entries in Bvh::indices. 0 for inner nodes.
+  uint32_t count;
+};
+
+struct Bvh {
+  std::vector<BvhNode> nodes;
+
+  // Object indices, grouped so that every leaf's are contiguous
+  std::vector<uint32_t> indices;
+
+  // Box of the object at each entry of indices as min x, y, z then max x, y, z,
+  // so a leaf's boxes are read from one place rather than gathered
+  std::vector<float> boxes;
+};
+
+/*
+ * Build a BVH over the boxes with binned surface area heuristic splits. Leaves
+ * hold at most max_leaf_size objects.
+ */
+void build_bvh(const ObjectBounds &bounds, Bvh &bvh, uint32_t max_leaf_size = 4);
+
+/*
+ * Recompute every node's box from the boxes of the objects it was built over,
+ * which may have moved. The tree's shape is kept so it degrades as objects move
+ * far from where they were at build time; rebuild when that matters.
+ */
+void refit_bvh(const ObjectBounds &bounds, Bvh &bvh);
+
+/*
+ * frustum_cull by walking the tree. Subtrees outside a plane are skipped whole
+ * and planes a subtree is wholly inside aren't tested again below it.
+ * visible is not in any particular order.
+ * @return the number of objects culled.
+ */
+size_t bvh_frustum_cull(const Bvh &bvh, const glm::mat4 &view_projection,
+                        std::vector<uint32_t> &visible);
+
+/*
+ * Test an object against a ray. Called for objects whose box the ray enters. Returns
+ * true and sets distance, in units of the ray's direction, when the object is hit.
+ */
+typedef std::function<bool(uint32_t object, float &distance)> RayHitTest;
+
+/*
+ * Find the nearest object hit by the ray origin + t * direction, t >= 0. Without
+ * a hit_test an object is hit where the ray enters its box.
+ * @return true if anything was hit, with its index and distance.
+ */
+bool bvh_raycast(const Bvh &bvh,
+                 const glm::vec3 &origin, const glm::vec3 &direction,
+                 uint32_t &object, float &distance,
+                 const RayHitTest &hit_test = nullptr);
+
+/*
+ * The world space ray through window pixel (x, y), with y down as windowing
+ * systems report it, for a width x height window. direction is unit length.
+ */
+void pick_ray(float x, float y, float width, float height,
+              const glm::mat4 &view, const glm::mat4 &projection,
+              glm::vec3 &origin, glm::vec3 &direction);
+
+#endif //UTAH_ICG_BVH_H
@@ -0,0 +1,123 @@
+#ifndef UTAH_ICG_CHUNK_STREAMER_H
+#define UTAH_ICG_CHUNK_STREAMER_H
+
+#include "gl_common.h"
+#include "command_list.h"
+#include "job_system.h"
+#include "mesh_chunks.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ChunkStreamOptions {
+  ChunkStreamOptions();
+
+  // GL memory for chunk buffers. Chunks that don't fit aren't drawn.
+  size_t budget_bytes;
+
+  // Start at most this much uploading a frame, and at least one chunk
+  size_t upload_bytes_per_frame;
+
+  // Chunks being read from the file at once
+  uint32_t max_reads;
+
+  // Attribute the positions are bound to
+  uint32_t pos_attr;
+};
+
+/*
+ * Draws a mesh built by build_chunked_mesh, keeping in GL only the chunks in
+ * view, nearest first, that fit in a memory budget.
+ *
+ * Each frame update() finds the chunks whose boxes are in the frustum and
+ * orders them by distance from the eye. It then reads missing chunks through
+ * jobs on the shared JobSystem and uploads those that have been read. When
+ * the budget is full, chunks out of view are deleted, least recently seen
+ * first, to make room for nearer ones in view.
+ *
+ * Every method must be called on the thread that owns the GL context.
+ */
+class ChunkStreamer {
+public:
+  explicit ChunkStreamer(const ChunkStreamOptions &options = ChunkStreamOptions());
+
+  ~ChunkStreamer();
+
+  ChunkStreamer(const ChunkStreamer &) = delete;
+
+  ChunkStreamer &operator=(const ChunkStreamer &) = delete;
+
+  // Read the chunk table of chunk_file_name, dropping any chunks of a file opened before
+  bool open(const std::string &chunk_file_name);
+
+  /*
+   * Choose the chunks to draw for the model space frustum of mvp and eye, the
+   * camera position in model space, then read, upload and evict. Call once a frame.
+   */
+  void update(const glm::mat4 &mvp, const glm::vec3 &eye);
+
+  // Record a draw of each chunk that is in view and resident. Binds VAOs only; the program is the caller's.
+  void record(CommandList &list) const;
+
+  inline const std::vector<ChunkInfo> &chunks() const { return chunks_; }
+
+  inline const Bounds &bounds() const { return bounds_; }
+
+  inline size_t resident_bytes() const { return resident_bytes_; }
+
+  inline size_t budget() const { return options_.budget_bytes; }
+
+  // Chunks in view at the last update, and how many of them are drawn
+  inline size_t num_visible() const { return visible_.size(); }
+
+  size_t num_drawn() const;
+
+private:
+  enum State : int32_t {
+    UNLOADED, READING, READ, RESIDENT, FAILED
+  };
+
+  struct Entry {
+    Entry();
+
+    // Written by the read job, read on the GL thread
+    std::atomic<int32_t> state;
+    JobHandle job;
+
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+
+    GLuint vao;
+    GLuint vbo;
+    GLuint ebo;
+
+    // Update in which it was last in view
+    uint64_t last_visible;
+  };
+
+  void start_read(uint32_t chunk);
+
+  void upload(uint32_t chunk);
+
+  void evict(uint32_t chunk);
+
+  // Wait for reads in flight and delete everything resident
+  void release();
+
+  ChunkStreamOptions options_;
+  std::string file_name_;
+  std::vector<ChunkInfo> chunks_;
+  Bounds bounds_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+
+  // In view at the last update, nearest first
+  std::vector<uint32_t> visible_;
+
+  size_t resident_bytes_;
+  uint64_t frame_;
+};
+
+#endif //UTAH_ICG_CHUNK_STREAMER_H
@@ -0,0 +1,97 @@
+#ifndef UTAH_ICG_COMMAND_LIST_H
+#define UTAH_ICG_COMMAND_LIST_H
+
+#include "gl_common.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * GL work recorded on any thread, to be replayed later on the thread that owns
+ * the context. Commands are packed into one block of memory that is kept when
+ * the list is reset. Once a list has grown to the size of a frame, recording
+ * allocates nothing. Uniform values and buffer contents are copied in, so the
+ * caller's copies can change as soon as a command has been recorded.
+ *
+ * Recording doesn't touch GL. Binding the program or vertex array that the list
+ * already has bound records nothing.
+ */
+class CommandList {
+public:
+  CommandList();
+
+  // Forget the commands but keep the memory for the next frame
+  void reset();
+
+  void viewport(int32_t x, int32_t y, int32_t width, int32_t height);
+
+  // Clear the colour buffer to colour
+  void clear_colour(const glm::vec4 &colour);
+
+  void use_program(uint32_t program);
+
+  void bind_vertex_array(uint32_t vao);
+
+  // Bind texture to target of GL_TEXTURE0 + unit
+  void bind_texture(uint32_t unit, GLenum target, uint32_t texture);
+
+  // Set a uniform of the program in use. Locations of -1 are skipped as GL would.
+  void uniform(int32_t location, const glm::mat4 &value);
+
+  void uniform(int32_t location, const glm::vec4 &value);
+
+  void uniform(int32_t location, int32_t value);
+
+  void point_size(float size);
+
+  // Draw count indices of the bound element buffer starting at first_index
+  void draw_elements(GLenum mode, uint32_t count, uint32_t first_index);
+
+  // One draw for each of the num_draws ranges of the bound element buffer, as glMultiDrawElements
+  void multi_draw_elements(GLenum mode, const GLsizei *counts, const GLvoid *const *offsets, size_t num_draws);
+
+  // Copy size bytes of data into buffer at offset
+  void update_buffer(uint32_t buffer, size_t offset, const void *data, size_t size);
+
+  // Issue the commands in the order recorded. Needs a current GL context.
+  void replay() const;
+
+  inline size_t num_commands() const { return num_commands_; }
+
+  inline bool empty() const { return num_commands_ == 0; }
+
+  // Bytes recorded, and the bytes the list can hold before it must grow
+  inline size_t size_bytes() const { return bytes_.size(); }
+
+  inline size_t capacity_bytes() const { return bytes_.capacity(); }
+
+private:
+  enum Op : uint32_t {
+    VIEWPORT,
+    CLEAR_COLOUR,
+    USE_PROGRAM,
+    BIND_VERTEX_ARRAY,
+    BIND_TEXTURE,
+    UNIFORM_MAT4,
+    UNIFORM_VEC4,
+    UNIFORM_INT,
+    POINT_SIZE,
+    DRAW_ELEMENTS,
+    MULTI_DRAW_ELEMENTS,
+    UPDATE_BUFFER
+  };
+
+  // Append a command of op with arguments args followed by extra bytes, returning where the extra bytes go
+  template<typename T>
+  uint8_t *push(Op op, const T &args, size_t extra = 0);
+
+  std::vector<uint8_t> bytes_;
+  size_t num_commands_;
+
+  // What the list has bound so far, to drop repeated binds
+  uint32_t program_;
+  uint32_t vao_;
+};
+
+#endif //UTAH_ICG_COMMAND_LIST_H
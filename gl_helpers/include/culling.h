@@ -0,0 +1,50 @@
+#ifndef UTAH_ICG_CULLING_H
+#define UTAH_ICG_CULLING_H
+
+#include "mesh.h"
+#include "gl_common.h"
+
+#include <vector>
+
+/*
+ * The six clip planes (left, right, bottom, top, near, far) of clip, which takes
+ * some space to clip space, as normalised planes in that space. A point p is
+ * inside plane i when dot(planes[i].xyz, p) + planes[i].w >= 0.
+ */
+void frustum_planes(const glm::mat4 &clip, float planes[6][4]);
+
+/*
+ * World space boxes of many objects stored as centres and half extents in
+ * structure of arrays form, padded to a multiple of 8 so that they can be
+ * tested 4 or 8 at a time.
+ */
+struct ObjectBounds {
+  ObjectBounds();
+
+  void resize(size_t count);
+
+  inline size_t size() const { return count; }
+
+  // Set object i's box to the box around local transformed by model
+  void set(size_t i, const Bounds &local, const glm::mat4 &model);
+
+  std::vector<float> center_x, center_y, center_z;
+  std::vector<float> extent_x, extent_y, extent_z;
+  size_t count;
+};
+
+/*
+ * Test every box against the frustum of view_projection, writing the indices of
+ * those that may be visible to visible in increasing order.
+ * Uses AVX when the CPU has it, then SSE or NEON, then plain C++.
+ * @return the number of objects culled.
+ */
+size_t frustum_cull(const ObjectBounds &bounds, const glm::mat4 &view_projection, std::vector<uint32_t> &visible);
+
+// frustum_cull one object at a time, for CPUs without SIMD and for checking the SIMD paths
+size_t frustum_cull_scalar(const ObjectBounds &bounds, const glm::mat4 &view_projection, std::vector<uint32_t> &visible);
+
+// Name of the instruction set frustum_cull uses on this CPU
+const char *frustum_cull_path();
+
+#endif //UTAH_ICG_CULLING_H
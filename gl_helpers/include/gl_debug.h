@@ -0,0 +1,120 @@
+#ifndef UTAH_ICG_GL_DEBUG_H
+#define UTAH_ICG_GL_DEBUG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/*
+ * GL diagnostics through KHR_debug. The driver reports errors and warnings to a
+ * callback as they happen so nothing has to poll glGetError, which stalls the
+ * pipeline on many drivers.
+ *
+ * Everything here is only built when UTAH_ICG_GL_DEBUG is defined, which Debug
+ * builds do. In other builds the calls are empty inlines and compile to nothing.
+ * KHR_debug needs GL 4.3 so on macOS, which stops at 4.1, they do nothing either.
+ */
+
+enum class GlDebugSeverity {
+  NOTIFICATION,
+  LOW,
+  MEDIUM,
+  HIGH
+};
+
+// The kinds of object that can be labelled
+enum class GlObject {
+  BUFFER,
+  VERTEX_ARRAY,
+  PROGRAM,
+  SHADER,
+  TEXTURE
+};
+
+struct GlDebugOptions {
+  GlDebugOptions();
+
+  // Messages less severe than this are dropped by the driver. Defaults to LOW.
+  GlDebugSeverity min_severity;
+
+  // How many times the same message is logged before it is dropped
+  uint32_t max_repeats;
+
+  // Most messages logged in any one second; the rest are counted and dropped
+  uint32_t max_per_second;
+
+  // Report messages on the thread and in the call that caused them, so a breakpoint in
+  // the callback shows the culprit. This stalls the driver so is off by default.
+  bool synchronous;
+};
+
+/*
+ * Decides which debug messages are logged. A message is dropped once it has been
+ * seen max_repeats times, or when max_per_second messages have already been
+ * logged in the current second. Doesn't lock; the callback does.
+ */
+class GlDebugFilter {
+public:
+  enum Verdict {
+    LOG,
+    // Logged, but it's the last time this message will be
+    LOG_LAST,
+    DROP
+  };
+
+  GlDebugFilter(uint32_t max_repeats, uint32_t max_per_second);
+
+  // What to do with the message identified by key arriving at time seconds
+  Verdict accept(uint64_t key, double seconds);
+
+  // Messages dropped by the rate limit since this was last called
+  uint32_t take_rate_dropped();
+
+private:
+  uint32_t max_repeats_;
+  uint32_t max_per_second_;
+  std::unordered_map<uint64_t, uint32_t> seen_;
+  double window_start_;
+  uint32_t in_window_;
+  uint32_t rate_dropped_;
+};
+
+#ifdef UTAH_ICG_GL_DEBUG
+
+// Start logging the driver's debug messages. Needs a current context; for the
+// most messages it should be a debug context. False if KHR_debug isn't available.
+bool install_gl_debug(const GlDebugOptions &options = GlDebugOptions());
+
+// Name an object in debug messages and in tools such as RenderDoc. The name is label followed by suffix.
+void label_gl_object(GlObject type, uint32_t name, const std::string &label, const char *suffix = nullptr);
+
+// Brackets the GL calls made in its lifetime into a named group, usually a pass
+class GlDebugGroup {
+public:
+  explicit GlDebugGroup(const char *name);
+
+  ~GlDebugGroup();
+
+  GlDebugGroup(const GlDebugGroup &) = delete;
+
+  GlDebugGroup &operator=(const GlDebugGroup &) = delete;
+
+private:
+  bool pushed_;
+};
+
+#else
+
+inline bool install_gl_debug(const GlDebugOptions & = GlDebugOptions()) { return false; }
+
+inline void label_gl_object(GlObject, uint32_t, const std::string &, const char * = nullptr) {}
+
+class GlDebugGroup {
+public:
+  explicit GlDebugGroup(const char *) {}
+};
+
+#endif
+
+#endif //UTAH_ICG_GL_DEBUG_H
@@ -0,0 +1,35 @@
+#ifndef UTAH_ICG_IMAGE_H
+#define UTAH_ICG_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// An 8 bit per channel image. Row 0 is the bottom of the image, as glTexImage2D expects.
+struct Image {
+  Image();
+
+  uint32_t width;
+  uint32_t height;
+
+  // 1 grey, 2 grey and alpha, 3 RGB or 4 RGBA
+  uint32_t channels;
+  std::vector<uint8_t> pixels;
+};
+
+// Decode a TGA held in memory: uncompressed or RLE, 8 bit grey or 24/32 bit colour
+bool decode_tga(const uint8_t *data, size_t size, Image &image);
+
+// Decode a binary PPM (P6) or PGM (P5) held in memory, 8 bits per channel
+bool decode_ppm(const uint8_t *data, size_t size, Image &image);
+
+// Read and decode a .tga, .ppm or .pgm file
+bool load_image(const std::string &file_name, Image &image);
+
+/*
+ * levels[0] is the full size image. Append box filtered levels after it, each
+ * half the size of the last (rounded down), until the 1x1 level.
+ */
+void build_mips(std::vector<Image> &levels);
+
+#endif //UTAH_ICG_IMAGE_H
@@ -0,0 +1,104 @@
+#ifndef UTAH_ICG_JOB_SYSTEM_H
+#define UTAH_ICG_JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+/*
+ * A pool of worker threads sharing jobs by work stealing. Each worker has its
+ * own queue: it runs the jobs it queued most recently first, which keeps their
+ * data in its cache, and when that is empty takes the oldest job from another
+ * queue. Jobs queued by threads outside the pool go on a queue of their own
+ * that every worker takes from.
+ *
+ * A job is finished once its function has returned and all of its children
+ * have finished. Jobs that depend on it are queued when it finishes. An
+ * exception thrown by a job's function finishes it all the same, and is passed
+ * up to its parent and rethrown by wait.
+ */
+class JobSystem {
+public:
+  // Run jobs on num_threads threads: num_threads - 1 workers plus whichever thread waits
+  explicit JobSystem(size_t num_threads);
+
+  ~JobSystem();
+
+  // The scheduler shared by everything in the process, with a thread per hardware thread
+  static JobSystem &shared();
+
+  inline size_t num_threads() const { return workers_.size() + 1; }
+
+  /*
+   * Make a job that runs fn. A job with a parent counts towards the parent being
+   * finished, so must be made before the parent is run or by the parent's function.
+   */
+  JobHandle create_job(const std::function<void()> &fn, const JobHandle &parent = nullptr);
+
+  // Don't start job until prerequisite has finished. Call before running job.
+  void add_dependency(const JobHandle &job, const JobHandle &prerequisite);
+
+  // Queue job to start as soon as everything it depends on has finished
+  void run(const JobHandle &job);
+
+  // Run other jobs until job has finished, sleeping when there are none. Rethrows the
+  // first exception thrown by the job or its children.
+  void wait(const JobHandle &job);
+
+  static bool is_finished(const JobHandle &job);
+
+  /*
+   * Run body over [begin, end) in contiguous sub-ranges of at least grain
+   * elements, split finely enough that threads which finish early can take work
+   * from the others. Returns once every sub-range is done, throwing the
+   * first exception body threw if any. May be nested.
+   */
+  void parallel_for(size_t begin, size_t end, size_t grain,
+                    const std::function<void(size_t, size_t)> &body);
+
+private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<JobHandle> jobs;
+  };
+
+  void worker_loop(size_t queue);
+
+  void push(const JobHandle &job);
+
+  // A job from queue, newest first, or else the oldest job of another queue
+  JobHandle next_job(size_t queue);
+
+  void execute(const JobHandle &job);
+
+  // One of job's function or children is done; finish it if that was the last
+  void finish_part(const JobHandle &job);
+
+  // The calling thread's queue in this system: its own for workers, the shared one otherwise
+  size_t queue_index() const;
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> workers_;
+
+  // Jobs sitting in queues. Idle workers sleep until there are some.
+  std::atomic<size_t> queued_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+
+  // Threads asleep in wait, woken when a job finishes or is queued
+  std::atomic<size_t> waiting_;
+  std::condition_variable wait_wake_;
+
+  bool stopping_;
+};
+
+#endif //UTAH_ICG_JOB_SYSTEM_H
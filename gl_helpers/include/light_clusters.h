@@ -0,0 +1,171 @@
+#ifndef UTAH_ICG_LIGHT_CLUSTERS_H
+#define UTAH_ICG_LIGHT_CLUSTERS_H
+
+/*
+ * Clustered forward lighting. The view frustum is cut into a grid of clusters:
+ * tiles across the screen and slices in depth, the slices growing
+ * exponentially so that clusters stay roughly cube shaped. Each frame every
+ * point light is added to the list of each cluster its sphere of influence
+ * touches, on the worker threads. The lists go to GL in buffer textures and
+ * a fragment shader finds its cluster from its window position and depth and
+ * loops over just that cluster's lights.
+ */
+
+#include "command_list.h"
+#include "gl_common.h"
+
+#include <cstdint>
+#include <vector>
+
+struct PointLight {
+  PointLight();
+
+  // World space
+  glm::vec3 position;
+
+  // Distance at which the light has faded to nothing
+  float radius;
+
+  // Linear RGB, scaled by intensity
+  glm::vec3 colour;
+};
+
+struct LightClusterOptions {
+  LightClusterOptions();
+
+  // Tiles across and up the screen, and slices from the near plane to the far
+  uint32_t tiles_x;
+  uint32_t tiles_y;
+  uint32_t slices;
+
+  // Lights past the first max_lights are ignored
+  uint32_t max_lights;
+
+  // Most entries in all cluster lists together. Clusters beyond lose lights.
+  uint32_t max_light_indices;
+};
+
+class LightClusters {
+public:
+  explicit LightClusters(const LightClusterOptions &options = LightClusterOptions());
+
+  /*
+   * Bin lights into the clusters of the frustum of view and projection. The
+   * projection must be a perspective one; its near and far planes bound the slices.
+   */
+  void assign(const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection);
+
+  inline const LightClusterOptions &options() const { return options_; }
+
+  inline size_t num_clusters() const { return static_cast<size_t>(options_.tiles_x) * options_.tiles_y * options_.slices; }
+
+  // Tile y counts up from the bottom of the screen, as gl_FragCoord does
+  inline uint32_t cluster(uint32_t tile_x, uint32_t tile_y, uint32_t slice) const {
+    return (slice * options_.tiles_y + tile_y) * options_.tiles_x + tile_x;
+  }
+
+  // The slice holding view space depth, the distance in front of the eye, clamped to the grid
+  uint32_t slice(float depth) const;
+
+  // View space box of a cluster
+  void cluster_bounds(uint32_t cluster, glm::vec3 &min, glm::vec3 &max) const;
+
+  // Offset into light_indices and number of lights of each cluster, in pairs
+  inline const std::vector<uint32_t> &cluster_ranges() const { return cluster_ranges_; }
+
+  inline const std::vector<uint32_t> &light_indices() const { return light_indices_; }
+
+  // Per light, the view space position and radius, then the colour and a 0
+  inline const std::vector<float> &light_data() const { return light_data_; }
+
+  inline size_t num_lights() const { return light_data_.size() / 8; }
+
+  // Entries left out of the lists by max_light_indices
+  inline size_t num_dropped() const { return num_dropped_; }
+
+  // The light_grid uniform of light_cluster_glsl: tiles across, tiles up and slices
+  glm::vec4 grid_uniform() const;
+
+  // The light_depth uniform of light_cluster_glsl: the viewport size, then the scale and bias giving the slice from log depth
+  glm::vec4 depth_uniform(int32_t viewport_width, int32_t viewport_height) const;
+
+private:
+  // A light's view space sphere and the slices and tiles it may touch; empty if first_slice > last_slice
+  struct LightBin {
+    glm::vec3 center;
+    float radius;
+    uint32_t first_slice, last_slice;
+    uint32_t first_x, last_x, first_y, last_y;
+  };
+
+  // Cluster boxes for a new projection
+  void update_clusters(const glm::mat4 &projection);
+
+  LightClusterOptions options_;
+  glm::mat4 projection_;
+  float near_;
+  float far_;
+  float slice_scale_;
+  float slice_bias_;
+  // Depth of the near side of each slice, and the far plane
+  std::vector<float> slice_depths_;
+  std::vector<glm::vec3> cluster_min_;
+  std::vector<glm::vec3> cluster_max_;
+
+  std::vector<LightBin> bins_;
+  // Each slice's lists, gathered by one job: the cluster and light pairs found, the
+  // lights sorted by cluster, and where each of its clusters' lists ends in them
+  std::vector<std::vector<uint32_t>> slice_hits_;
+  std::vector<std::vector<uint32_t>> slice_indices_;
+  std::vector<std::vector<uint32_t>> slice_ends_;
+
+  std::vector<uint32_t> cluster_ranges_;
+  std::vector<uint32_t> light_indices_;
+  std::vector<float> light_data_;
+  size_t num_dropped_;
+};
+
+/*
+ * The GL side: a buffer and buffer texture each for the lights, the cluster
+ * ranges and the light indices, sized for the options' limits. Every method
+ * but the record ones must be called on the thread that owns the GL context.
+ */
+class LightClusterBuffers {
+public:
+  LightClusterBuffers();
+
+  ~LightClusterBuffers();
+
+  LightClusterBuffers(const LightClusterBuffers &) = delete;
+
+  LightClusterBuffers &operator=(const LightClusterBuffers &) = delete;
+
+  bool create(const LightClusterOptions &options);
+
+  // Record copying the clusters' lists into the buffers
+  void record_upload(const LightClusters &clusters, CommandList &list) const;
+
+  // Record binding the light data, cluster range and light index textures to first_unit and the two after
+  void record_bind(CommandList &list, uint32_t first_unit) const;
+
+  inline bool is_good() const { return textures_[0] != 0; }
+
+private:
+  void destroy();
+
+  uint32_t buffers_[3];
+  uint32_t textures_[3];
+  size_t capacities_[3];
+};
+
+/*
+ * GLSL (410) declaring the light_data, light_clusters and light_indices
+ * samplers and the light_grid and light_depth uniforms, and defining
+ *   vec3 cluster_lighting(vec3 position, vec3 normal)
+ * which sums the diffuse light reaching a view space position with a unit
+ * normal from the lights of its cluster. To be pasted into a fragment shader
+ * after its #version line.
+ */
+const char *light_cluster_glsl();
+
+#endif //UTAH_ICG_LIGHT_CLUSTERS_H
@@ -0,0 +1,42 @@
+#ifndef UTAH_ICG_MAPPED_FILE_H
+#define UTAH_ICG_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * A file mapped read only into memory. Pages are read by the OS as they are
+ * touched and can be dropped again under memory pressure, so files larger than
+ * RAM can be read at random.
+ */
+class MappedFile {
+public:
+  MappedFile();
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // Map file_name, unmapping any file already mapped. False if it can't be.
+  bool open(const std::string &file_name);
+
+  void close();
+
+  inline bool is_open() const { return data_ != nullptr || is_empty_; }
+
+  inline const uint8_t *data() const { return data_; }
+
+  inline size_t size() const { return size_; }
+
+private:
+  const uint8_t *data_;
+  size_t size_;
+
+  // Empty files can't be mapped but are open all the same
+  bool is_empty_;
+};
+
+#endif //UTAH_ICG_MAPPED_FILE_H
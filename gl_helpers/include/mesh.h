@@ -2,6 +2,193 @@
 #define UTAH_ICG_MESH_H
 
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+
+struct TriangleBvh;
+
+// A contiguous range of a mesh's element buffer drawn with one material
+struct SubMesh {
+  SubMesh();
+
+  // Object and/or group name from the OBJ file. May be empty.
+  std::string name;
+
+  // First element of the range in the EBO
+  uint32_t index_offset;
+
+  // Number of elements in the range
+  uint32_t index_count;
+
+  // Index into Mesh::materials or -1 if no material was set
+  int32_t material_id;
+};
+
+// One level of detail. Its index ranges live in the same EBO as every other level.
+struct MeshLod {
+  MeshLod();
+
+  // Fraction of the full resolution triangle count this level was built for
+  float target_ratio;
+
+  // Quadric error of the worst collapse made for this level: the root mean square distance, in model
+  // units, of the merged vertex from the planes of the triangles folded into it. An estimate of how far
+  // the surface moved, not a bound on it.
+  float error;
+
+  std::vector<SubMesh> submeshes;
+};
+
+/*
+ * A spatially coherent cluster of a submesh's triangles. Its triangles are a
+ * contiguous range of the EBO so a cluster is drawn like a tiny submesh.
+ */
+struct Meshlet {
+  Meshlet();
+
+  uint32_t index_offset;
+  uint32_t index_count;
+
+  // Index into Mesh::submeshes of the range the cluster was cut from
+  uint32_t submesh;
+
+  // Bounding sphere
+  float center[3];
+  float radius;
+
+  /*
+   * Cone holding every triangle normal: its axis and the sine of the angle between
+   * the cone's surface and the plane perpendicular to the axis. A cutoff of 1 means
+   * the normals are too spread out for the cluster to ever be wholly back facing.
+   */
+  float cone_axis[3];
+  float cone_cutoff;
+};
+
+// Model space bounds of a mesh's positions
+struct Bounds {
+  Bounds();
+
+  // Axis aligned box
+  float min[3];
+  float max[3];
+
+  // Sphere about the centre of the box
+  float center[3];
+  float radius;
+};
+
+// GL buffers for a loaded mesh plus the submesh ranges that share them
+struct Mesh {
+  Mesh();
+
+  uint32_t vao;
+  uint32_t vbo;
+  uint32_t ebo;
+  uint32_t num_elements;
+
+  // Bytes in the VBO and EBO, 0 if not uploaded
+  size_t gpu_bytes;
+
+  // Floats per vertex in the VBO
+  uint32_t stride;
+
+  // CPU copies of the VBO and EBO contents, when kept
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+
+  Bounds bounds;
+
+  // Full resolution ranges. The same as lods[0].submeshes.
+  std::vector<SubMesh> submeshes;
+
+  // Levels of detail from full resolution down, all indexing the same VBO
+  std::vector<MeshLod> lods;
+
+  // Clusters of the full resolution triangles, in EBO order
+  std::vector<Meshlet> meshlets;
+
+  // BVH over the full resolution triangles for ray queries. Triangle t is EBO
+  // indices 3t to 3t + 2. Null unless asked for.
+  std::shared_ptr<TriangleBvh> triangle_bvh;
+
+  // Material names from usemtl records in order of first use
+  std::vector<std::string> materials;
+
+  // Material library file names from mtllib records
+  std::vector<std::string> material_libs;
+};
+
+// Where vertex normals come from when they are included
+enum class NormalMode {
+  // Use the file's vn records
+  FROM_FILE,
+  // Use the file's vn records, generating normals if it has none
+  GENERATE_IF_MISSING,
+  // Always generate, ignoring any vn records
+  GENERATE
+};
+
+// How face normals are weighted when generated normals are accumulated at a vertex
+enum class NormalWeighting {
+  AREA,
+  ANGLE
+};
+
+struct MeshLoadOptions {
+  MeshLoadOptions();
+
+  uint32_t pos_attr;
+  bool include_normals;
+  uint32_t norm_attr;
+  bool include_textures;
+  uint32_t tx_attr;
+
+  // Per-vertex tangent with handedness in w. Needs normals and textures.
+  bool include_tangents;
+  uint32_t tan_attr;
+
+  // Ear clip concave polygons rather than fanning them
+  bool ear_clip;
+
+  NormalMode normal_mode;
+  NormalWeighting normal_weighting;
+
+  // Faces meeting at more than this angle (degrees) don't share generated normals
+  float crease_angle;
+
+  // Triangle count of each level of detail to build after full resolution, as a
+  // fraction of full resolution. Decreasing. Empty for no simplified levels.
+  std::vector<float> lod_ratios;
+
+  // Most triangles in each meshlet, 0 for no meshlets
+  uint32_t meshlet_triangles;
+
+  // Keep a triangle BVH of full resolution for ray casts against the mesh
+  bool build_triangle_bvh;
+
+  // Create the VAO, VBO and EBO. Off when there is no GL context, e.g. for software
+  // rendering, in which case the vertex and index data are always kept.
+  bool upload;
+
+  // Keep the vertex and index data in the Mesh as well as uploading them
+  bool keep_vertex_data;
+};
+
+bool load_obj(const std::string &obj_file_name,
+              Mesh &mesh,
+              const MeshLoadOptions &options);
+
+bool load_obj(const std::string &obj_file_name,
+              Mesh &mesh,
+              uint32_t pos_attr,
+              bool include_normals = false,
+              uint32_t norm_attr = 0,
+              bool include_textures = false,
+              uint32_t tx_attr = 0,
+              bool ear_clip = false
+);
 
 bool load_obj(const std::string &obj_file_name,
               uint32_t &vao,
@@ -12,7 +199,16 @@ bool load_obj(const std::string &obj_file_name,
               bool include_normals = false,
               uint32_t norm_attr = 0,
               bool include_textures = false,
-              uint32_t tx_attr = 0
+              uint32_t tx_attr = 0,
+              bool ear_clip = false
 );
 
+/*
+ * Choose the coarsest level of detail of mesh whose error, projected on screen,
+ * is at most max_pixel_error pixels when the mesh is distance units from the eye.
+ * pixel_scale is the size in pixels of one unit at distance one; for a perspective
+ * projection P and viewport height h it is h * P[1][1] / 2.
+ */
+size_t select_lod(const Mesh &mesh, float distance, float pixel_scale, float max_pixel_error = 1.0f);
+
 #endif //UTAH_ICG_MESH_H
@@ -0,0 +1,79 @@
+#ifndef UTAH_ICG_MESH_BAKE_H
+#define UTAH_ICG_MESH_BAKE_H
+
+#include "mesh.h"
+#include "mesh_codec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshBakeOptions {
+  MeshBakeOptions();
+
+  // How sources are loaded. The attributes, polygon and normal options count;
+  // attribute locations, levels of detail, meshlets, the BVH and upload don't,
+  // as they aren't part of a baked mesh.
+  MeshLoadOptions load;
+
+  MeshCodecOptions codec;
+
+  // Bake every source even if the manifest says its baked mesh is up to date
+  bool force;
+};
+
+enum class BakeStatus {
+  BAKED,
+  UP_TO_DATE,
+  FAILED
+};
+
+struct BakeResult {
+  BakeResult();
+
+  // Paths relative to the asset and output directories
+  std::string source;
+  std::string output;
+
+  BakeStatus status;
+
+  // Wall time spent on the file, hashing included
+  double ms;
+
+  size_t source_bytes;
+  size_t baked_bytes;
+};
+
+// Name of the manifest bake_meshes keeps in the output directory
+extern const char *const MESH_BAKE_MANIFEST;
+
+/*
+ * Bake every OBJ, PLY and glB file under asset_dir, recursively, into a file
+ * written by save_compressed_mesh at the same relative path under output_dir
+ * with a .mesh extension. Each is loaded as load_mesh would with options.load,
+ * so vertices are deduplicated and normals and tangents generated, then
+ * encoded with options.codec, which puts triangles in vertex cache order.
+ *
+ * Files are baked concurrently on the worker threads, largest first. A
+ * manifest in output_dir records a hash of each source's contents and of the
+ * options it was baked with; a source whose hashes match and whose output is
+ * still there isn't baked again. Outputs are written beside their final name
+ * and renamed into place, and the manifest is rewritten once all are done, so
+ * an interrupted bake leaves nothing that looks up to date but isn't.
+ *
+ * results receives one entry per source in path order. False if the
+ * directories can't be read or made, or any source failed to bake.
+ */
+bool bake_meshes(const std::string &asset_dir,
+                 const std::string &output_dir,
+                 const MeshBakeOptions &options,
+                 std::vector<BakeResult> &results);
+
+// 64 bit FNV-1a style hash of size bytes at data, mixed in eight bytes at a time
+uint64_t hash_bytes(const uint8_t *data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+// Hash of every option that changes what bake_meshes writes
+uint64_t hash_bake_options(const MeshBakeOptions &options);
+
+#endif //UTAH_ICG_MESH_BAKE_H
@@ -0,0 +1,74 @@
+#ifndef UTAH_ICG_MESH_CACHE_H
+#define UTAH_ICG_MESH_CACHE_H
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// A loaded mesh shared by everything drawing it. Its GL buffers are deleted with the last handle.
+typedef std::shared_ptr<const Mesh> MeshHandle;
+
+struct MeshCacheStats {
+  MeshCacheStats();
+
+  // Requests answered by a mesh already loaded or loading, and requests that loaded one
+  size_t hits;
+  size_t misses;
+
+  // Meshes held by at least one handle, and the bytes they take in GL buffers and in memory
+  size_t meshes;
+  size_t gpu_bytes;
+  size_t cpu_bytes;
+
+  // Keys the cache holds. Keys of released meshes are dropped on the next miss.
+  size_t entries;
+
+  float hit_rate() const;
+};
+
+/*
+ * Loads each mesh once however many times it is asked for. Meshes are keyed on
+ * the file's canonical path and the load options, so the same file loaded with
+ * different options is a different mesh. A request for a mesh that another
+ * thread is loading waits for that load rather than starting its own.
+ *
+ * Meshes loaded with options.upload must be requested, and their last handle
+ * released, on the thread with the GL context.
+ */
+class MeshCache {
+public:
+  MeshCache();
+
+  // The cache shared by everything in the process
+  static MeshCache &shared();
+
+  // The mesh in file_name loaded with options by load_mesh, or null if it couldn't be loaded. An exception
+  // from load_mesh is thrown to this caller and any waiting on the same load, and isn't cached.
+  MeshHandle load(const std::string &file_name, const MeshLoadOptions &options);
+
+  MeshCacheStats stats() const;
+
+private:
+  // Counters outlive the cache in case handles do
+  struct State {
+    std::mutex mutex;
+    MeshCacheStats stats;
+  };
+
+  struct Entry {
+    std::weak_ptr<const Mesh> mesh;
+
+    // Set while the mesh is being loaded
+    std::shared_future<MeshHandle> pending;
+  };
+
+  std::shared_ptr<State> state_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
+#endif //UTAH_ICG_MESH_CACHE_H
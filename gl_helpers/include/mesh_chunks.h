@@ -0,0 +1,64 @@
+#ifndef UTAH_ICG_MESH_CHUNKS_H
+#define UTAH_ICG_MESH_CHUNKS_H
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where one chunk of a chunk file is and what it holds
+struct ChunkInfo {
+  ChunkInfo();
+
+  Bounds bounds;
+  uint32_t num_vertices;
+  uint32_t num_triangles;
+
+  // Byte offset in the chunk file of the chunk's positions, which are followed by its indices
+  uint64_t offset;
+
+  // Bytes of positions and indices
+  inline size_t bytes() const {
+    return static_cast<size_t>(num_vertices) * 3 * sizeof(float) + static_cast<size_t>(num_triangles) * 3 * sizeof(uint32_t);
+  }
+};
+
+struct ChunkBuildOptions {
+  ChunkBuildOptions();
+
+  // Most triangles in a chunk
+  uint32_t chunk_triangles;
+
+  // Memory the build may use for buffers, besides the pages of the file it maps
+  size_t memory_bytes;
+};
+
+/*
+ * Split the OBJ file obj_file_name into chunks of nearby triangles, each with
+ * its own deduplicated positions and indices, and write them to chunk_file_name.
+ *
+ * Built out of core, for meshes too big to load whole. The OBJ is read in
+ * three streaming passes. The first writes the positions to a temporary
+ * file and counts the triangles. The second sorts triangles into a grid of
+ * temporary files by their centres. The third builds the chunks cell by cell,
+ * splitting any cell that has too many triangles. Positions are read back
+ * through a memory map. Everything else fits in options.memory_bytes.
+ *
+ * Only positions are kept and faces are fanned. The temporary files are named
+ * after chunk_file_name, replaced when first written and removed by the end.
+ * False, with no chunk file, if any of them can't be written or read back.
+ */
+bool build_chunked_mesh(const std::string &obj_file_name,
+                        const std::string &chunk_file_name,
+                        const ChunkBuildOptions &options = ChunkBuildOptions());
+
+// Read the table of chunks and the bounds of them all from a chunk file
+bool read_chunk_table(const std::string &chunk_file_name, std::vector<ChunkInfo> &chunks, Bounds &bounds);
+
+// Read one chunk's positions, three floats a vertex, and triangle indices
+bool read_chunk(const std::string &chunk_file_name, const ChunkInfo &chunk,
+                std::vector<float> &positions, std::vector<uint32_t> &indices);
+
+#endif //UTAH_ICG_MESH_CHUNKS_H
@@ -0,0 +1,65 @@
+#ifndef UTAH_ICG_MESH_CODEC_H
+#define UTAH_ICG_MESH_CODEC_H
+
+#include "mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshCodecOptions {
+  MeshCodecOptions();
+
+  // Bits each position component is quantised to across its range, 1 to 24. 0 keeps the floats exactly.
+  uint32_t position_bits;
+
+  // As position_bits, for normals, tex coords and tangents
+  uint32_t attribute_bits;
+
+  // Reorder the triangles of each submesh for the post transform vertex cache before encoding
+  bool optimize_vertex_cache;
+};
+
+/*
+ * Compress the full resolution vertices and indices of mesh, which must have
+ * kept its vertex data, with its submeshes and material names.
+ *
+ * Triangles are put in vertex cache order within each submesh (Tipsify) and
+ * vertices are renumbered in order of first use. Each index is then stored as
+ * its distance back from the next unused vertex, which is zero for a vertex
+ * seen for the first time and small for one still in the cache. Vertex
+ * components are quantised to a range of integers, or kept as float bits, and
+ * stored one component at a time as zigzagged deltas from the previous vertex.
+ *
+ * Both streams are then bit packed in groups of 16 values, each group led by
+ * a byte giving the width, 0, 1, 2, 4, 8, 16 or 32 bits, of all its values.
+ * The decoder handles a group with one fixed shift pattern per width, with no
+ * per value branches. Submeshes keep their order, and so do triangles when
+ * the cache isn't optimised. Vertex numbering isn't kept, only the triangles
+ * it makes.
+ */
+bool encode_mesh(const Mesh &mesh, std::vector<uint8_t> &encoded,
+                 const MeshCodecOptions &options = MeshCodecOptions());
+
+/*
+ * Decode the size bytes at data, written by encode_mesh, into the vertex data,
+ * indices, stride, submeshes, materials and bounds of mesh. Nothing is uploaded
+ * and there are no levels of detail, meshlets or BVH. False, with mesh left
+ * empty, if data is truncated or isn't an encoded mesh.
+ */
+bool decode_mesh(const uint8_t *data, size_t size, Mesh &mesh);
+
+// Encode mesh and write it to file_name
+bool save_compressed_mesh(const std::string &file_name, const Mesh &mesh,
+                          const MeshCodecOptions &options = MeshCodecOptions());
+
+/*
+ * Load a file written by save_compressed_mesh as load_obj loads an OBJ file,
+ * building levels of detail, meshlets and the BVH and uploading as options say.
+ * The file is decoded straight from a memory map. Attributes the file has that
+ * options don't include are dropped; asking for one it doesn't have fails.
+ */
+bool load_compressed_mesh(const std::string &file_name, Mesh &mesh, const MeshLoadOptions &options);
+
+#endif //UTAH_ICG_MESH_CODEC_H
@@ -0,0 +1,39 @@
+#ifndef UTAH_ICG_MESH_IMPORT_H
+#define UTAH_ICG_MESH_IMPORT_H
+
+#include "mesh.h"
+
+#include <string>
+
+/*
+ * Importers for binary mesh formats. Files are memory mapped and read straight
+ * from typed views of their buffers. When every attribute asked for is in the
+ * file they are interleaved into the vertex data in one pass, keeping the
+ * file's vertices as they are. Otherwise, to generate normals or tangents, the
+ * geometry goes through the same builder as OBJ files. Either way the mesh is
+ * then finished and uploaded as load_obj does.
+ */
+
+/*
+ * Load a binary little endian PLY file. Vertex x, y and z are required; nx, ny
+ * and nz, and u and v (or s and t), are read when options include them.
+ * Faces come from the vertex_indices list of the face element and are fanned.
+ * Other elements and properties are skipped. One submesh, named for the file.
+ */
+bool load_ply(const std::string &ply_file_name, Mesh &mesh, const MeshLoadOptions &options);
+
+/*
+ * Load the triangle primitives of a binary glTF 2.0 file. The default scene is
+ * walked and each mesh is placed with its node's transform; files without
+ * scenes have each mesh once, untransformed. POSITION, NORMAL and TEXCOORD_0
+ * are read as options include them, with V flipped to GL's bottom-up convention,
+ * and every primitive is a submesh using the material of its glTF material name.
+ * Only the file's own binary chunk is read; buffers with URIs and sparse
+ * accessors aren't supported.
+ */
+bool load_glb(const std::string &glb_file_name, Mesh &mesh, const MeshLoadOptions &options);
+
+// Load file_name with the loader for its extension: .obj, .ply, .glb or .mesh (see load_compressed_mesh)
+bool load_mesh(const std::string &file_name, Mesh &mesh, const MeshLoadOptions &options);
+
+#endif //UTAH_ICG_MESH_IMPORT_H
@@ -2,10 +2,142 @@
 #define UTAH_ICG_MESH_INTERNAL_H
 
 #include "mesh.h"
+#include "arena.h"
 
 #include <string>
 #include <vector>
 #include <fstream>
+#include <cstdint>
+
+// A run of triangles sharing the same object, group and material state
+struct RawGroup {
+  RawGroup();
+
+  std::string object;
+  std::string group;
+  int32_t material_id;
+  uint32_t first_triangle;
+};
+
+/*
+ * Intermediate representation of a parsed OBJ file.
+ * Everything is held as flat structure-of-arrays streams so that parsing
+ * reserves each array once up front and later stages can run straight
+ * passes over contiguous data.
+ */
+struct RawMeshData {
+  RawMeshData();
+
+  // Vertex positions
+  std::vector<float> pos_x;
+  std::vector<float> pos_y;
+  std::vector<float> pos_z;
+
+  // Vertex normals
+  std::vector<float> norm_x;
+  std::vector<float> norm_y;
+  std::vector<float> norm_z;
+
+  // Texture coordinates
+  std::vector<float> tex_u;
+  std::vector<float> tex_v;
+
+  // One entry per face corner. Zero based. Normal and tex indices are -1 when not loaded.
+  std::vector<int32_t> corner_vertex;
+  std::vector<int32_t> corner_normal;
+  std::vector<int32_t> corner_tex;
+
+  // Tangents with handedness in w, indexed by corner_tangent. Only filled by generate_tangents.
+  std::vector<float> tan_x;
+  std::vector<float> tan_y;
+  std::vector<float> tan_z;
+  std::vector<float> tan_w;
+  std::vector<int32_t> corner_tangent;
+
+  // Face f owns corners [face_offsets[f], face_offsets[f+1]). Always num_faces() + 1 long.
+  std::vector<uint32_t> face_offsets;
+
+  // Triangulated faces as corner indices, three per triangle, in face order.
+  std::vector<uint32_t> triangles;
+
+  // Smoothing group of each face from 's' records. 0 when smoothing is off.
+  std::vector<uint32_t> face_smoothing;
+
+  // Triangle runs in file order. Each run ends where the next one starts.
+  std::vector<RawGroup> groups;
+
+  // Names from usemtl records, indexed by RawGroup::material_id
+  std::vector<std::string> materials;
+
+  // File names from mtllib records
+  std::vector<std::string> material_libs;
+
+  inline size_t num_vertices() const { return pos_x.size(); }
+
+  inline size_t num_normals() const { return norm_x.size(); }
+
+  inline size_t num_tex_coords() const { return tex_u.size(); }
+
+  inline size_t num_corners() const { return corner_vertex.size(); }
+
+  inline size_t num_faces() const { return face_offsets.size() - 1; }
+
+  inline size_t num_triangles() const { return triangles.size() / 3; }
+
+  void clear();
+};
+
+// Working storage reused across calls to triangulate_face so it does not allocate per face
+struct TriangulationScratch {
+  ScratchVector<float> u;
+  ScratchVector<float> v;
+  ScratchVector<uint32_t> remaining;
+};
+
+// Scanning helpers shared by the OBJ readers
+inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Narrow [begin, end) to exclude leading and trailing whitespace
+inline void trim_range(const char *&begin, const char *&end) {
+  while (begin < end && is_space(*begin)) ++begin;
+  while (end > begin && is_space(*(end - 1))) --end;
+}
+
+// Compare the leading token of a line against a lower case record type
+inline bool is_type(const char *begin, const char *end, const char *type) {
+  auto p = begin;
+  for (; *type; ++type, ++p) {
+    if (p == end) return false;
+    auto c = (*p >= 'A' && *p <= 'Z') ? static_cast<char>(*p + ('a' - 'A')) : *p;
+    if (c != *type) return false;
+  }
+  return p == end || is_space(*p);
+}
+
+/*
+ * Convert an OBJ index, one based or negative and relative to the count
+ * seen so far, into a zero based index.
+ */
+inline bool resolve_index(int32_t &idx, size_t count) {
+  if (idx > 0) {
+    --idx;
+    return true;
+  }
+  if (idx < 0 && static_cast<size_t>(-static_cast<int64_t>(idx)) <= count) {
+    idx = static_cast<int32_t>(count) + idx;
+    return true;
+  }
+  return false;
+}
+
+/*
+ * Parse up to max_values whitespace separated floats from [begin, end).
+ * @return the number of values present in the range or -1 if one of the
+ * first max_values is not a number.
+ */
+int32_t parse_floats(const char *begin, const char *end, float *values, int32_t max_values);
 
 bool parse_face_elements(const std::string &face_elem,
                          int32_t *vertex_idx,
@@ -15,23 +147,117 @@ bool parse_face_elements(const std::string &face_elem,
                          int32_t *tex_coord_idx = nullptr
 );
 
+// As above but over the character range [begin, end) to avoid building strings per element.
+bool parse_face_elements(const char *begin, const char *end,
+                         int32_t *vertex_idx,
+                         bool include_normal = false,
+                         int32_t *normal_idx = nullptr,
+                         bool include_tex_coord = false,
+                         int32_t *tex_coord_idx = nullptr
+);
+
 bool parse_3f(const std::string &args, float &x, float &y, float &z);
 
 bool parse_2f(const std::string &args, float &x, float &y);
 
-bool parse_face(const std::string &args, int32_t *vertices,
+/*
+ * Parse the corners of a face record (the text after 'f') and append them to data
+ * as a new face. Any number of corners from three up is accepted and indices may be
+ * negative, in which case they count back from the most recently parsed entry.
+ * Nothing is appended if the face is rejected.
+ */
+bool parse_face(const std::string &args, RawMeshData &data,
                 bool include_normals = false,
-                int32_t *normals = nullptr,
-                bool include_tex_coords = false,
-                int32_t *tex_coords = nullptr);
+                bool include_tex_coords = false);
 
+// As above but over the character range [begin, end)
+bool parse_face(const char *begin, const char *end, RawMeshData &data,
+                bool include_normals = false,
+                bool include_tex_coords = false);
+
+/*
+ * Append triangles covering the given face to data.triangles.
+ * Faces are fanned from their first corner. When ear_clip is set, concave faces are
+ * instead ear clipped in the plane of their Newell normal.
+ */
+void triangulate_face(RawMeshData &data, size_t face, bool ear_clip, TriangulationScratch &scratch);
+
+/*
+ * Parse an OBJ file into data. Normals are only read when requested and the file
+ * has vn records; data.num_normals() is zero otherwise.
+ */
 bool parse_raw_data(std::ifstream &f,
-                    std::vector<std::tuple<float, float, float>> &vertices,
-                    std::vector<std::vector<std::tuple<int32_t, int32_t, int32_t>>> &faces,
+                    RawMeshData &data,
                     bool include_normals = false,
-                    std::vector<std::tuple<float, float, float>> *normals = nullptr,
                     bool include_tex_coords = false,
-                    std::vector<std::tuple<float, float>> *tex_coords = nullptr
+                    bool ear_clip = false
+);
+
+/*
+ * Collapse the corners of raw into unique (vertex, normal, tex coord, tangent) combinations.
+ * vertex_data receives the interleaved attributes of each unique vertex in order of
+ * first use and indices receives a triangle list referencing them.
+ * Triangles are ordered so that each distinct object, group and material is one
+ * contiguous range, which is described in submeshes when it is supplied.
+ * Vertices are laid out in the VertexFormat of the attributes asked for, so
+ * tangents need both normals and tex coords.
+ */
+bool build_vertex_data(const RawMeshData &raw,
+                       std::vector<float> &vertex_data,
+                       std::vector<uint32_t> &indices,
+                       bool include_normals = false,
+                       bool include_tex_coords = false,
+                       bool include_tangents = false,
+                       std::vector<SubMesh> *submeshes = nullptr
+);
+
+/*
+ * Replace raw's normals with smooth vertex normals generated from its faces.
+ * Each corner's normal is the weighted sum of the normals of the faces around its
+ * vertex that are within crease_angle degrees of its own face and, when the file
+ * uses smoothing groups, in the same group. Corners of a vertex that end up with
+ * identical normals share one normal index.
+ */
+void generate_normals(RawMeshData &raw, NormalWeighting weighting, float crease_angle);
+
+/*
+ * Generate MikkTSpace style per-corner tangents for raw, which must already have
+ * normals and tex coords. Handedness is stored in the w component. Corners only
+ * share a tangent when they share a normal, a tex coord and a handedness, so UV
+ * seams and mirrored UVs keep distinct vertices.
+ */
+bool generate_tangents(RawMeshData &raw);
+
+/*
+ * Build a chain of simplified levels of detail for each submesh, one per entry in
+ * ratios, each simplified from the one before it. Their indices are appended to
+ * indices, which holds the full resolution triangles, and lods receives every
+ * level including full resolution as level 0.
+ */
+void build_lods(const std::vector<float> &vertex_data, size_t stride,
+                std::vector<uint32_t> &indices,
+                const std::vector<SubMesh> &submeshes,
+                const std::vector<float> &ratios,
+                std::vector<MeshLod> &lods);
+
+// Box and sphere around the positions (the first three floats) of interleaved vertices
+Bounds compute_bounds(const float *vertex_data, size_t num_vertices, size_t stride);
+
+/*
+ * The stages every loader runs once it has interleaved vertices, full
+ * resolution indices and mesh.submeshes: bounds, meshlets, the triangle BVH
+ * and levels of detail as options ask, then the upload, or keeping the data
+ * in mesh when options.upload is off. vertex_data and indices may be consumed.
+ * name labels the GL objects.
+ */
+bool finish_mesh(const std::string &name,
+                 std::vector<float> &vertex_data,
+                 std::vector<uint32_t> &indices,
+                 bool include_normals,
+                 bool include_textures,
+                 bool include_tangents,
+                 const MeshLoadOptions &options,
+                 Mesh &mesh
 );
 
 #endif //UTAH_ICG_MESH_INTERNAL_H
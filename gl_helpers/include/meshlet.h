@@ -0,0 +1,64 @@
+#ifndef UTAH_ICG_MESHLET_H
+#define UTAH_ICG_MESHLET_H
+
+#include "mesh.h"
+#include "gl_common.h"
+
+#include <vector>
+
+/*
+ * Cut each submesh's range of indices into meshlets of at most max_triangles
+ * triangles. Clusters grow across shared edges from seeds taken in Morton order
+ * and prefer triangles near the cluster centre that face the same way, which
+ * keeps both bounding spheres and normal cones tight.
+ *
+ * Triangles are reordered within their submesh so that every meshlet is a
+ * contiguous range of indices; the submesh ranges themselves are unchanged.
+ */
+void build_meshlets(const float *vertex_data, size_t stride,
+                    std::vector<uint32_t> &indices,
+                    const std::vector<SubMesh> &submeshes,
+                    uint32_t max_triangles,
+                    std::vector<Meshlet> &meshlets);
+
+// Same layout as GL's DrawElementsIndirectCommand
+struct DrawElementsIndirectCommand {
+  uint32_t count;
+  uint32_t instance_count;
+  uint32_t first_index;
+  int32_t base_vertex;
+  uint32_t base_instance;
+};
+
+// The visible meshlets of one mesh for one frame. Kept between frames to reuse its storage.
+struct MeshletDrawList {
+  MeshletDrawList();
+
+  // Runs of visible meshlets that are adjacent in the EBO are merged into one command
+  std::vector<DrawElementsIndirectCommand> commands;
+
+  // The same draws as arrays for glMultiDrawElements
+  std::vector<GLsizei> counts;
+  std::vector<const GLvoid *> offsets;
+
+  size_t visible;
+  size_t frustum_culled;
+  size_t backface_culled;
+};
+
+/*
+ * Fill draw_list with the meshlets that may be visible. mvp takes model space to
+ * clip space and eye is the camera position in model space.
+ */
+void cull_meshlets(const std::vector<Meshlet> &meshlets,
+                   const glm::mat4 &mvp,
+                   const glm::vec3 &eye,
+                   MeshletDrawList &draw_list);
+
+/*
+ * Draw the list with the mesh's VAO bound. Multi draw indirect needs GL 4.3 so
+ * on a 4.1 context the commands are issued through glMultiDrawElements.
+ */
+void draw_meshlets(const MeshletDrawList &draw_list);
+
+#endif //UTAH_ICG_MESHLET_H
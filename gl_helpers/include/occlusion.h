@@ -0,0 +1,111 @@
+#ifndef UTAH_ICG_OCCLUSION_H
+#define UTAH_ICG_OCCLUSION_H
+
+/*
+ * Software occlusion culling. The largest objects on screen are chosen as
+ * occluders and a simplified level of each is rasterized, depth only, into a
+ * small depth buffer on the worker threads. A pyramid is built over it in which
+ * each texel holds the farthest depth of the four below, so an object's box can
+ * be tested against a couple of texels of whichever level it covers: if the
+ * nearest point of the box is behind all of them, every pixel the box covers
+ * already has something in front of it and the object needn't be drawn.
+ *
+ * Depths are sampled at pixel centres, so an object seen only through gaps
+ * narrower than a depth buffer pixel may be culled.
+ */
+
+#include "culling.h"
+#include "mesh.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+struct OcclusionOptions {
+  OcclusionOptions();
+
+  // Size of the depth buffer, in pixels. The width is rounded up to a multiple of 8.
+  uint32_t width;
+  uint32_t height;
+
+  // Most occluders drawn each frame. The ones covering the most screen are kept.
+  uint32_t max_occluders;
+
+  // Least height on screen, as a fraction of the viewport, of an occluder's bounding sphere
+  float min_occluder_size;
+
+  // Occluders are drawn at the first level of detail with at most this many triangles, or the coarsest
+  uint32_t occluder_triangles;
+};
+
+// What the last frame's occlusion culling did
+struct OcclusionStats {
+  OcclusionStats();
+
+  size_t num_occluders;
+  size_t num_occluder_triangles;
+  size_t num_tested;
+  size_t num_occluded;
+
+  // Wall time, in milliseconds, drawing the occluders and building the pyramid, and testing objects
+  double raster_ms;
+  double test_ms;
+};
+
+class OcclusionCuller {
+public:
+  explicit OcclusionCuller(const OcclusionOptions &options = OcclusionOptions());
+
+  // Start a frame seen through view and projection, forgetting the last frame's occluders and depth
+  void begin_frame(const glm::mat4 &view, const glm::mat4 &projection);
+
+  /*
+   * Offer a mesh placed by model as an occluder. It is ignored if it is too
+   * small on screen or has no vertex data on the CPU. mesh must outlive
+   * render_occluders.
+   */
+  void add_occluder(const Mesh &mesh, const glm::mat4 &model);
+
+  // Draw the occluders chosen into the depth buffer and build the pyramid
+  void render_occluders();
+
+  // Whether any of the world space box may be visible past the occluders
+  bool test(const float min[3], const float max[3]) const;
+
+  /*
+   * Remove from visible, keeping its order, the objects whose boxes are hidden.
+   * Objects are tested in parallel.
+   * @return the number removed.
+   */
+  size_t cull(const ObjectBounds &bounds, std::vector<uint32_t> &visible);
+
+  inline const OcclusionStats &stats() const { return stats_; }
+
+  inline const OcclusionOptions &options() const { return options_; }
+
+  // Pyramid level 0 is the depth buffer. Row 0 is the top of the screen, depth 1 is the far plane.
+  inline size_t num_levels() const { return levels_.size(); }
+  // Each level is half the size of the one below, rounding up, so every texel below has a parent
+  inline uint32_t level_width(size_t level) const { return ((options_.width - 1) >> level) + 1; }
+  inline uint32_t level_height(size_t level) const { return ((options_.height - 1) >> level) + 1; }
+  inline const std::vector<float> &level(size_t level) const { return levels_[level]; }
+
+private:
+  struct Candidate {
+    const Mesh *mesh;
+    glm::mat4 model;
+    float size;
+  };
+
+  OcclusionOptions options_;
+  glm::mat4 view_projection_;
+  glm::vec3 eye_;
+  float focal_length_;
+
+  std::vector<Candidate> candidates_;
+  std::vector<std::vector<float>> levels_;
+  OcclusionStats stats_;
+};
+
+#endif //UTAH_ICG_OCCLUSION_H
@@ -0,0 +1,19 @@
+#ifndef UTAH_ICG_PARALLEL_H
+#define UTAH_ICG_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads parallel_for spreads work across
+size_t num_worker_threads();
+
+/*
+ * Run body over [begin, end) in contiguous sub-ranges of at least grain elements,
+ * spread over the threads of the shared JobSystem. body receives a half open
+ * sub-range and must be safe to call concurrently. Returns once every sub-range
+ * is done, having run other jobs meanwhile, so calls may be nested.
+ */
+void parallel_for(size_t begin, size_t end, size_t grain,
+                  const std::function<void(size_t, size_t)> &body);
+
+#endif //UTAH_ICG_PARALLEL_H
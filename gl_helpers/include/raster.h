@@ -0,0 +1,86 @@
+#ifndef UTAH_ICG_RASTER_H
+#define UTAH_ICG_RASTER_H
+
+/*
+ * A CPU rasterizer for rendering meshes without a GPU. It draws the same
+ * interleaved vertex data and indices that load_obj uploads, through vertex and
+ * fragment functors that stand in for GLSL shaders, and follows GL's rules for
+ * clipping, facing and depth so its images can be compared with GL's.
+ */
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// Colour and depth buffers. Row 0 is the top of the image, as in image files.
+struct FrameBuffer {
+  FrameBuffer();
+
+  FrameBuffer(uint32_t width, uint32_t height);
+
+  void resize(uint32_t width, uint32_t height);
+
+  // Colour components in [0, 1]; depth in window space, where 1 is the far plane
+  void clear(const glm::vec4 &colour, float depth = 1.0f);
+
+  uint32_t width;
+  uint32_t height;
+
+  // RGBA8 with red in the lowest byte
+  std::vector<uint32_t> colour;
+  std::vector<float> depth;
+};
+
+// Most floats a vertex shader can pass to the fragment shader
+const uint32_t MAX_VARYINGS = 16;
+
+/*
+ * Vertex stage. Given one vertex's floats, write the pipeline's num_varyings
+ * outputs and return the clip space position, as gl_Position.
+ */
+typedef std::function<glm::vec4(const float *vertex, float *varyings)> VertexShader;
+
+// Fragment stage. Given the varyings interpolated with perspective correction, return the colour.
+typedef std::function<glm::vec4(const float *varyings)> FragmentShader;
+
+struct RasterPipeline {
+  RasterPipeline();
+
+  VertexShader vertex_shader;
+  FragmentShader fragment_shader;
+  uint32_t num_varyings;
+
+  // Skip triangles that are clockwise on screen, as glCullFace(GL_BACK) with glFrontFace(GL_CCW)
+  bool cull_back_faces;
+
+  // Keep fragments nearer than the depth buffer and write their depth, as glDepthFunc(GL_LESS)
+  bool depth_test;
+};
+
+/*
+ * Draw the triangle list through the pipeline. Each vertex is shaded once. The
+ * triangles are then clipped and set up in batches, binned into screen tiles,
+ * and the tiles are rasterized concurrently, several pixels at a time. Within a
+ * tile triangles are drawn in order, so the image doesn't depend on the thread count.
+ */
+void rasterize(const RasterPipeline &pipeline,
+               const float *vertex_data, size_t stride, size_t num_vertices,
+               const uint32_t *indices, size_t num_indices,
+               FrameBuffer &frame);
+
+// Write the colour buffer as a binary (P6) PPM, dropping alpha
+bool write_ppm(const std::string &file_name, const FrameBuffer &frame);
+
+// Read a binary (P6) PPM into the colour buffer, with alpha 1 and depth cleared
+bool read_ppm(const std::string &file_name, FrameBuffer &frame);
+
+/*
+ * Count the pixels where any of red, green or blue differ by more than tolerance.
+ * Frames of different sizes differ at every pixel of the larger.
+ */
+size_t count_differing_pixels(const FrameBuffer &a, const FrameBuffer &b, uint8_t tolerance = 0);
+
+#endif //UTAH_ICG_RASTER_H
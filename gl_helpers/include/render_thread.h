@@ -0,0 +1,88 @@
+#ifndef UTAH_ICG_RENDER_THREAD_H
+#define UTAH_ICG_RENDER_THREAD_H
+
+#include "command_list.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Everything recorded for one frame. Lists are replayed in order.
+struct RenderFrame {
+  RenderFrame();
+
+  std::vector<CommandList> lists;
+
+  // Counts up from 0 with each frame begun
+  uint64_t number;
+};
+
+/*
+ * A thread that owns the GL context and replays frames recorded elsewhere.
+ * There are two frames. The app records the next one, on as many threads as it
+ * likes, while this thread replays and presents the one before. begin_frame
+ * waits only when the app is a whole frame ahead.
+ *
+ * GL objects must also be made and destroyed on this thread, through execute.
+ */
+class RenderThread {
+public:
+  /*
+   * Start the thread. make_current is called on it first, to make the context
+   * current there; present is called after each frame has been replayed, usually
+   * to swap buffers. The context mustn't be current on any other thread.
+   */
+  RenderThread(const std::function<void()> &make_current, const std::function<void()> &present);
+
+  // Replays every frame already submitted, then stops the thread
+  ~RenderThread();
+
+  RenderThread(const RenderThread &) = delete;
+
+  RenderThread &operator=(const RenderThread &) = delete;
+
+  // Run fn on the render thread after everything already submitted, and wait for it. Not from the render thread.
+  void execute(const std::function<void()> &fn);
+
+  // The frame to record next, with its lists reset. Waits while the last frame recorded into it is in use.
+  RenderFrame &begin_frame();
+
+  // Hand the frame from begin_frame to the render thread, without waiting
+  void submit();
+
+  // Frames replayed and presented so far
+  uint64_t frames_presented() const;
+
+private:
+  // A frame to replay, or a function to run when frame is negative
+  struct Task {
+    int32_t frame;
+    const std::function<void()> *fn;
+  };
+
+  void loop();
+
+  std::function<void()> make_current_;
+  std::function<void()> present_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable task_queued_;
+  std::condition_variable task_done_;
+  std::deque<Task> tasks_;
+  uint64_t tasks_queued_;
+  uint64_t tasks_done_;
+  bool stop_;
+
+  RenderFrame frames_[2];
+  bool in_flight_[2];
+  uint64_t frames_begun_;
+  uint64_t frames_presented_;
+
+  std::thread thread_;
+};
+
+#endif //UTAH_ICG_RENDER_THREAD_H
@@ -20,8 +20,17 @@ public:
   // use/activate the shader
   void use() const;
 
-  // get_attribute_location
-  uint32_t get_attribute_location(const std::string& attribute_name);
+  // Name the program in GL debug messages
+  void set_label(const std::string &label) const;
+
+  // Location of a vertex attribute, or -1 if there is no such attribute
+  int32_t get_attribute_location(const std::string &attribute_name);
+
+  // Location of a uniform for recording into a CommandList, or -1 if there is no such uniform
+  int32_t get_uniform_location(const std::string &uniform_name) const;
+
+  // The program, for recording into a CommandList
+  inline uint32_t id() const { return id_; }
 
   // utility uniform functions
   void set_uniform(const std::string &name, int32_t value) const;
@@ -0,0 +1,153 @@
+#ifndef UTAH_ICG_SIMD_H
+#define UTAH_ICG_SIMD_H
+
+/*
+ * Lanes of floats worked on together: 8 when compiled for AVX, 4 with SSE or
+ * NEON and 4 plain floats otherwise. Only the handful of operations the ray
+ * packets need. Unlike frustum_cull, which picks AVX at run time, these are
+ * chosen at compile time because they are inlined into the traversal loops.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define UTAH_ICG_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UTAH_ICG_SIMD_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define UTAH_ICG_SIMD_NEON
+#endif
+
+namespace simd {
+
+#if defined(UTAH_ICG_SIMD_AVX)
+  const size_t LANES = 8;
+
+  struct Float { __m256 v; };
+  struct Mask { __m256 v; };
+
+  inline Float set1(float f) { return {_mm256_set1_ps(f)}; }
+  inline Float load(const float *p) { return {_mm256_loadu_ps(p)}; }
+  inline void store(float *p, Float a) { _mm256_storeu_ps(p, a.v); }
+  inline Float operator+(Float a, Float b) { return {_mm256_add_ps(a.v, b.v)}; }
+  inline Float operator-(Float a, Float b) { return {_mm256_sub_ps(a.v, b.v)}; }
+  inline Float operator*(Float a, Float b) { return {_mm256_mul_ps(a.v, b.v)}; }
+  inline Float operator/(Float a, Float b) { return {_mm256_div_ps(a.v, b.v)}; }
+  inline Float min(Float a, Float b) { return {_mm256_min_ps(a.v, b.v)}; }
+  inline Float max(Float a, Float b) { return {_mm256_max_ps(a.v, b.v)}; }
+  inline Float abs(Float a) { return {_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)}; }
+  inline Mask operator<(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+  inline Mask operator<=(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+  inline Mask operator>(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+  inline Mask operator>=(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+  inline Mask operator&(Mask a, Mask b) { return {_mm256_and_ps(a.v, b.v)}; }
+  inline Mask operator|(Mask a, Mask b) { return {_mm256_or_ps(a.v, b.v)}; }
+  inline Float select(Mask m, Float a, Float b) { return {_mm256_blendv_ps(b.v, a.v, m.v)}; }
+  inline uint32_t bits(Mask m) { return static_cast<uint32_t>(_mm256_movemask_ps(m.v)); }
+
+#elif defined(UTAH_ICG_SIMD_SSE)
+  const size_t LANES = 4;
+
+  struct Float { __m128 v; };
+  struct Mask { __m128 v; };
+
+  inline Float set1(float f) { return {_mm_set1_ps(f)}; }
+  inline Float load(const float *p) { return {_mm_loadu_ps(p)}; }
+  inline void store(float *p, Float a) { _mm_storeu_ps(p, a.v); }
+  inline Float operator+(Float a, Float b) { return {_mm_add_ps(a.v, b.v)}; }
+  inline Float operator-(Float a, Float b) { return {_mm_sub_ps(a.v, b.v)}; }
+  inline Float operator*(Float a, Float b) { return {_mm_mul_ps(a.v, b.v)}; }
+  inline Float operator/(Float a, Float b) { return {_mm_div_ps(a.v, b.v)}; }
+  inline Float min(Float a, Float b) { return {_mm_min_ps(a.v, b.v)}; }
+  inline Float max(Float a, Float b) { return {_mm_max_ps(a.v, b.v)}; }
+  inline Float abs(Float a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+  inline Mask operator<(Float a, Float b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+  inline Mask operator<=(Float a, Float b) { return {_mm_cmple_ps(a.v, b.v)}; }
+  inline Mask operator>(Float a, Float b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+  inline Mask operator>=(Float a, Float b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+  inline Mask operator&(Mask a, Mask b) { return {_mm_and_ps(a.v, b.v)}; }
+  inline Mask operator|(Mask a, Mask b) { return {_mm_or_ps(a.v, b.v)}; }
+  inline Float select(Mask m, Float a, Float b) { return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))}; }
+  inline uint32_t bits(Mask m) { return static_cast<uint32_t>(_mm_movemask_ps(m.v)); }
+
+#elif defined(UTAH_ICG_SIMD_NEON)
+  const size_t LANES = 4;
+
+  struct Float { float32x4_t v; };
+  struct Mask { uint32x4_t v; };
+
+  inline Float set1(float f) { return {vdupq_n_f32(f)}; }
+  inline Float load(const float *p) { return {vld1q_f32(p)}; }
+  inline void store(float *p, Float a) { vst1q_f32(p, a.v); }
+  inline Float operator+(Float a, Float b) { return {vaddq_f32(a.v, b.v)}; }
+  inline Float operator-(Float a, Float b) { return {vsubq_f32(a.v, b.v)}; }
+  inline Float operator*(Float a, Float b) { return {vmulq_f32(a.v, b.v)}; }
+  inline Float operator/(Float a, Float b) { return {vdivq_f32(a.v, b.v)}; }
+  inline Float min(Float a, Float b) { return {vminq_f32(a.v, b.v)}; }
+  inline Float max(Float a, Float b) { return {vmaxq_f32(a.v, b.v)}; }
+  inline Float abs(Float a) { return {vabsq_f32(a.v)}; }
+  inline Mask operator<(Float a, Float b) { return {vcltq_f32(a.v, b.v)}; }
+  inline Mask operator<=(Float a, Float b) { return {vcleq_f32(a.v, b.v)}; }
+  inline Mask operator>(Float a, Float b) { return {vcgtq_f32(a.v, b.v)}; }
+  inline Mask operator>=(Float a, Float b) { return {vcgeq_f32(a.v, b.v)}; }
+  inline Mask operator&(Mask a, Mask b) { return {vandq_u32(a.v, b.v)}; }
+  inline Mask operator|(Mask a, Mask b) { return {vorrq_u32(a.v, b.v)}; }
+  inline Float select(Mask m, Float a, Float b) { return {vbslq_f32(m.v, a.v, b.v)}; }
+  inline uint32_t bits(Mask m) {
+    const uint32x4_t weights{1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(m.v, weights));
+  }
+
+#else
+  const size_t LANES = 4;
+
+  struct Float { float v[LANES]; };
+  struct Mask { bool v[LANES]; };
+
+#define UTAH_ICG_SIMD_LANEWISE(type, expr) \
+  type r; \
+  for (size_t i = 0; i < LANES; ++i) r.v[i] = (expr); \
+  return r;
+
+  inline Float set1(float f) { UTAH_ICG_SIMD_LANEWISE(Float, f) }
+  inline Float load(const float *p) { UTAH_ICG_SIMD_LANEWISE(Float, p[i]) }
+  inline void store(float *p, Float a) { for (size_t i = 0; i < LANES; ++i) p[i] = a.v[i]; }
+  inline Float operator+(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Float, a.v[i] + b.v[i]) }
+  inline Float operator-(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Float, a.v[i] - b.v[i]) }
+  inline Float operator*(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Float, a.v[i] * b.v[i]) }
+  inline Float operator/(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Float, a.v[i] / b.v[i]) }
+  inline Float min(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Float, b.v[i] < a.v[i] ? b.v[i] : a.v[i]) }
+  inline Float max(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Float, b.v[i] > a.v[i] ? b.v[i] : a.v[i]) }
+  inline Float abs(Float a) { UTAH_ICG_SIMD_LANEWISE(Float, std::fabs(a.v[i])) }
+  inline Mask operator<(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Mask, a.v[i] < b.v[i]) }
+  inline Mask operator<=(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Mask, a.v[i] <= b.v[i]) }
+  inline Mask operator>(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Mask, a.v[i] > b.v[i]) }
+  inline Mask operator>=(Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Mask, a.v[i] >= b.v[i]) }
+  inline Mask operator&(Mask a, Mask b) { UTAH_ICG_SIMD_LANEWISE(Mask, a.v[i] && b.v[i]) }
+  inline Mask operator|(Mask a, Mask b) { UTAH_ICG_SIMD_LANEWISE(Mask, a.v[i] || b.v[i]) }
+  inline Float select(Mask m, Float a, Float b) { UTAH_ICG_SIMD_LANEWISE(Float, m.v[i] ? a.v[i] : b.v[i]) }
+  inline uint32_t bits(Mask m) {
+    uint32_t r = 0;
+    for (size_t i = 0; i < LANES; ++i) r |= m.v[i] ? (1u << i) : 0;
+    return r;
+  }
+
+#undef UTAH_ICG_SIMD_LANEWISE
+#endif
+
+  // Lanes whose bit is set in b
+  inline Mask from_bits(uint32_t b) {
+    float f[LANES];
+    for (size_t i = 0; i < LANES; ++i) f[i] = (b >> i) & 1 ? 1.0f : 0.0f;
+    return load(f) > set1(0.0f);
+  }
+
+  inline bool any(Mask m) { return bits(m) != 0; }
+}
+
+#endif //UTAH_ICG_SIMD_H
@@ -0,0 +1,28 @@
+#ifndef UTAH_ICG_SIMPLIFY_H
+#define UTAH_ICG_SIMPLIFY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Reduce a triangle list towards target_index_count indices by quadric error
+ * metric edge collapses.
+ *
+ * Vertices are interleaved floats, stride floats apart, with the position in the
+ * first three. Vertices are never moved or created: each collapse folds one vertex
+ * onto a neighbour, so the result indexes the same vertex array. Vertices on open
+ * borders and on attribute seams (several vertices sharing one position) are never
+ * removed, which keeps UV and normal discontinuities intact.
+ *
+ * A collapse's error is the area weighted root mean square distance of the
+ * vertex kept from the planes of the triangles around both ends, in the units of
+ * the positions. Collapses stop at max_error.
+ * @return the largest error of a collapse made.
+ */
+float simplify_mesh(const float *vertex_data, size_t num_vertices, size_t stride,
+                    const uint32_t *indices, size_t num_indices,
+                    size_t target_index_count, float max_error,
+                    std::vector<uint32_t> &result);
+
+#endif //UTAH_ICG_SIMPLIFY_H
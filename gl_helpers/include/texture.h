@@ -0,0 +1,140 @@
+#ifndef UTAH_ICG_TEXTURE_H
+#define UTAH_ICG_TEXTURE_H
+
+#include "gl_common.h"
+#include "block_compression.h"
+#include "image.h"
+#include "job_system.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t TextureHandle;
+
+const TextureHandle NO_TEXTURE = 0xffffffffu;
+
+struct TextureOptions {
+  TextureOptions();
+
+  // Texture memory to keep resident
+  size_t budget_bytes;
+
+  // Start at most this much uploading a frame, and at least one texture
+  size_t upload_bytes_per_frame;
+
+  /*
+   * Block compress textures where GL supports it. The compressed mip chain is
+   * cached in a .ktx2 file so later loads skip decoding and encoding. The
+   * cache records the image's path, size and modification time and is only
+   * used while they match.
+   */
+  bool compress;
+
+  // Where to put the cache files, each named for its image and a hash of the image's full path. Empty puts each next to its image.
+  std::string cache_dir;
+};
+
+/*
+ * Owns the GL textures of a set of image files and keeps the ones in use
+ * resident within a memory budget.
+ *
+ * Files are read, decoded, mipmapped and compressed by jobs on the shared
+ * JobSystem. The GL thread calls update() once a frame, which copies finished
+ * images into pixel buffer objects and has GL fill the textures from them, so
+ * the copy to the GPU doesn't hold up the frame. Textures get immutable storage
+ * where GL supports glTexStorage2D, else a glTexImage2D per level.
+ *
+ * When the textures in GL exceed the budget, those drawn least recently are
+ * deleted. Drawing one again reloads it from its file, or its cache.
+ *
+ * Every method must be called on the thread that owns the GL context.
+ */
+class TextureManager {
+public:
+  explicit TextureManager(const TextureOptions &options = TextureOptions());
+
+  ~TextureManager();
+
+  TextureManager(const TextureManager &) = delete;
+
+  TextureManager &operator=(const TextureManager &) = delete;
+
+  // The texture for file_name, starting to load it if this is the first request
+  TextureHandle request(const std::string &file_name);
+
+  // Upload finished textures then evict down to the budget. Call once a frame.
+  void update();
+
+  /*
+   * Bind the texture to GL_TEXTURE0 + unit and count it as drawn this frame.
+   * Returns false, binding nothing, until it is resident.
+   */
+  bool bind(TextureHandle handle, uint32_t unit);
+
+  bool is_resident(TextureHandle handle) const;
+
+  // True if the file couldn't be loaded
+  bool has_failed(TextureHandle handle) const;
+
+  inline size_t resident_bytes() const { return resident_bytes_; }
+
+  inline size_t budget() const { return options_.budget_bytes; }
+
+  // True if textures are being block compressed
+  inline bool compressing() const { return compress_; }
+
+  // The cache file for an image
+  std::string cache_file_name(const std::string &file_name) const;
+
+private:
+  enum State : int32_t {
+    UNLOADED, DECODING, DECODED, RESIDENT, FAILED
+  };
+
+  struct Entry {
+    std::string file_name;
+
+    // Written by the decode job, read on the GL thread
+    std::atomic<int32_t> state;
+    JobHandle job;
+
+    // One of these holds the mip chain, level 0 first
+    std::vector<Image> levels;
+    std::vector<CompressedImage> compressed_levels;
+    uint32_t channels;
+
+    GLuint texture;
+    size_t bytes;
+
+    // Frame in which it was last bound
+    uint64_t last_used;
+  };
+
+  void start_decode(Entry &entry);
+
+  // Load the entry's mip chain, from the cache when it is current. Runs as a job.
+  bool decode(Entry &entry) const;
+
+  void upload(Entry &entry);
+
+  void evict(Entry &entry);
+
+  TextureOptions options_;
+  bool compress_;
+
+  std::vector<std::unique_ptr<Entry>> entries_;
+  std::unordered_map<std::string, TextureHandle> by_name_;
+
+  // Uploads alternate between these so that filling one doesn't wait on GL reading the other
+  GLuint pbos_[2];
+  uint32_t next_pbo_;
+
+  size_t resident_bytes_;
+  uint64_t frame_;
+};
+
+#endif //UTAH_ICG_TEXTURE_H
@@ -0,0 +1,60 @@
+#ifndef UTAH_ICG_TRIANGLE_BVH_H
+#define UTAH_ICG_TRIANGLE_BVH_H
+
+#include "bvh.h"
+
+#include <cstdint>
+#include <vector>
+
+// A BVH over one mesh's triangles, in the mesh's model space
+struct TriangleBvh {
+  Bvh bvh;
+
+  // Each triangle as a corner p0 and its edges p1 - p0 and p2 - p0, in Bvh::indices order
+  std::vector<float> triangles;
+};
+
+const uint32_t NO_HIT = 0xffffffff;
+
+struct RayHit {
+  RayHit();
+
+  // Triangle number: its corners are indices 3 * triangle to 3 * triangle + 2. NO_HIT for a miss.
+  uint32_t triangle;
+
+  // Barycentric coordinates of the hit, which is (1 - u - v) * p0 + u * p1 + v * p2
+  float u;
+  float v;
+
+  // Distance along the ray in units of the ray's direction
+  float distance;
+};
+
+/*
+ * Build the BVH over the triangles of an indexed triangle list. Vertices are
+ * interleaved floats, stride floats apart, with the position in the first three,
+ * as build_vertex_data makes them. The bounds of the triangles and the subtrees
+ * below the top few levels are computed concurrently.
+ */
+void build_triangle_bvh(const float *vertex_data, size_t stride,
+                        const uint32_t *indices, size_t num_indices,
+                        TriangleBvh &triangle_bvh);
+
+/*
+ * Nearest triangle, either side, hit by origin + t * direction for t >= 0.
+ * @return true if a triangle was hit.
+ */
+bool raycast(const TriangleBvh &triangle_bvh,
+             const glm::vec3 &origin, const glm::vec3 &direction,
+             RayHit &hit);
+
+/*
+ * Cast count rays, traced together in packets of simd::LANES (8 with AVX, 4 with
+ * SSE or NEON) that share one walk of the tree. Packets are spread across threads.
+ * Coherent rays, such as those through neighbouring pixels, share the most work.
+ */
+void raycast(const TriangleBvh &triangle_bvh,
+             const glm::vec3 *origins, const glm::vec3 *directions, size_t count,
+             RayHit *hits);
+
+#endif //UTAH_ICG_TRIANGLE_BVH_H
@@ -0,0 +1,167 @@
+#ifndef UTAH_ICG_VERTEX_FORMAT_H
+#define UTAH_ICG_VERTEX_FORMAT_H
+
+/*
+ * Vertex layouts described at compile time. A VertexFormat lists the
+ * attributes of an interleaved float vertex in order, and from that list
+ * knows its stride, where each attribute sits in it and how to point GL's
+ * vertex attributes at a buffer of them. Loaders pick the format matching
+ * the attributes asked for once per mesh, with dispatch_vertex_format, and
+ * run loops specialised for it, so there is no per vertex test of which
+ * attributes are present.
+ *
+ * A new attribute is a new tag here, a MeshLoadOptions location and an
+ * overload in each loop that fills it.
+ */
+
+#include "gl_common.h"
+#include "mesh.h"
+
+#include <cstdint>
+#include <type_traits>
+
+namespace vertex_attribute {
+  struct Position {
+    static const uint32_t COMPONENTS = 3;
+
+    static uint32_t location(const MeshLoadOptions &options) { return options.pos_attr; }
+  };
+
+  struct Normal {
+    static const uint32_t COMPONENTS = 3;
+
+    static uint32_t location(const MeshLoadOptions &options) { return options.norm_attr; }
+  };
+
+  struct TexCoord {
+    static const uint32_t COMPONENTS = 2;
+
+    static uint32_t location(const MeshLoadOptions &options) { return options.tx_attr; }
+  };
+
+  // Handedness in w
+  struct Tangent {
+    static const uint32_t COMPONENTS = 4;
+
+    static uint32_t location(const MeshLoadOptions &options) { return options.tan_attr; }
+  };
+}
+
+namespace vertex_format_detail {
+  template<typename... Attributes>
+  struct Components {
+    static const uint32_t value = 0;
+  };
+
+  template<typename First, typename... Rest>
+  struct Components<First, Rest...> {
+    static const uint32_t value = First::COMPONENTS + Components<Rest...>::value;
+  };
+
+  // Floats before Attribute in the list; no value if it isn't there
+  template<typename Attribute, typename... Attributes>
+  struct Offset;
+
+  template<typename Attribute, typename... Rest>
+  struct Offset<Attribute, Attribute, Rest...> {
+    static const uint32_t value = 0;
+  };
+
+  template<typename Attribute, typename First, typename... Rest>
+  struct Offset<Attribute, First, Rest...> {
+    static const uint32_t value = First::COMPONENTS + Offset<Attribute, Rest...>::value;
+  };
+
+  template<typename Attribute, typename... Attributes>
+  struct Contains {
+    static const bool value = false;
+  };
+
+  template<typename Attribute, typename First, typename... Rest>
+  struct Contains<Attribute, First, Rest...> {
+    static const bool value = std::is_same<Attribute, First>::value || Contains<Attribute, Rest...>::value;
+  };
+}
+
+template<typename... Attributes>
+struct VertexFormat {
+  // Floats per vertex
+  static const uint32_t STRIDE = vertex_format_detail::Components<Attributes...>::value;
+
+  static const uint32_t NUM_ATTRIBUTES = sizeof...(Attributes);
+
+  template<typename Attribute>
+  static constexpr bool has() { return vertex_format_detail::Contains<Attribute, Attributes...>::value; }
+
+  // Floats from the start of a vertex to the attribute
+  template<typename Attribute>
+  static constexpr uint32_t offset() { return vertex_format_detail::Offset<Attribute, Attributes...>::value; }
+
+  /*
+   * Call visitor(Attribute(), offset) for each attribute in order, offset in
+   * floats. Visitors overload on the attribute tags, so the calls are resolved
+   * and inlined at compile time.
+   */
+  template<typename Visitor>
+  static void for_each_attribute(Visitor &visitor) {
+    int expand[] = {0, (visitor(Attributes(), offset<Attributes>()), 0)...};
+    (void) expand;
+  }
+
+  /*
+   * Enable and point each attribute, at its location in options, into the
+   * buffer bound to GL_ARRAY_BUFFER and the VAO that is bound.
+   */
+  static void enable_attributes(const MeshLoadOptions &options) {
+    EnableAttribute enable{options};
+    for_each_attribute(enable);
+  }
+
+private:
+  struct EnableAttribute {
+    const MeshLoadOptions &options;
+
+    template<typename Attribute>
+    void operator()(Attribute, uint32_t offset) const {
+      const auto location = Attribute::location(options);
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, Attribute::COMPONENTS, GL_FLOAT, GL_FALSE,
+                            STRIDE * sizeof(float), (GLvoid *) (offset * sizeof(float)));
+    }
+  };
+};
+
+template<typename... Attributes> const uint32_t VertexFormat<Attributes...>::STRIDE;
+template<typename... Attributes> const uint32_t VertexFormat<Attributes...>::NUM_ATTRIBUTES;
+
+/*
+ * Call fn(Format()) with the format holding positions and then normals, tex
+ * coords and tangents as asked for, and return what it returns. Tangents are
+ * only laid out after both normals and tex coords; asking for them without
+ * both returns false without calling fn.
+ */
+template<typename Fn>
+bool dispatch_vertex_format(bool include_normals, bool include_textures, bool include_tangents, Fn &&fn) {
+  using namespace vertex_attribute;
+  if (include_tangents) {
+    if (!include_normals || !include_textures) return false;
+    return fn(VertexFormat<Position, Normal, TexCoord, Tangent>());
+  }
+  if (include_normals) {
+    return include_textures ? fn(VertexFormat<Position, Normal, TexCoord>())
+                            : fn(VertexFormat<Position, Normal>());
+  }
+  return include_textures ? fn(VertexFormat<Position, TexCoord>())
+                          : fn(VertexFormat<Position>());
+}
+
+// Floats per vertex with the attributes asked for, 0 if they make no format
+uint32_t vertex_stride(bool include_normals, bool include_textures, bool include_tangents);
+
+// VertexFormat::enable_attributes for the attributes asked for; false if they make no format
+bool enable_vertex_attributes(const MeshLoadOptions &options,
+                              bool include_normals,
+                              bool include_textures,
+                              bool include_tangents);
+
+#endif //UTAH_ICG_VERTEX_FORMAT_H
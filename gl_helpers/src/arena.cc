@@ -0,0 +1,98 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+Arena::Arena(size_t block_size)
+        : block_size_{std::max<size_t>(block_size, 64)}, current_{0}, offset_{0}, used_{0}, peak_{0} {}
+
+Arena::~Arena() {
+  for (auto &b: blocks_) std::free(b.data);
+}
+
+void *Arena::allocate(size_t bytes, size_t alignment) {
+  bytes = std::max<size_t>(bytes, 1);
+  for (;;) {
+    if (current_ < blocks_.size()) {
+      auto &block = blocks_[current_];
+      auto base = reinterpret_cast<uintptr_t>(block.data);
+      auto start = (base + offset_ + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+      auto end = start - base + bytes;
+      if (end <= block.size) {
+        used_ += end - offset_;
+        peak_ = std::max(peak_, used_);
+        offset_ = end;
+        return reinterpret_cast<void *>(start);
+      }
+
+      // The rest of this block is wasted; count it so rewinding stays consistent
+      used_ += block.size - offset_;
+      peak_ = std::max(peak_, used_);
+      ++current_;
+      offset_ = 0;
+      // A later block kept from before a rewind may be too small for this; drop it and those after it
+      if (current_ < blocks_.size() && blocks_[current_].size < bytes + alignment) {
+        for (auto b = current_; b < blocks_.size(); ++b) std::free(blocks_[b].data);
+        blocks_.resize(current_);
+      }
+      continue;
+    }
+
+    Block block;
+    block.size = std::max(block_size_, bytes + alignment);
+    block.data = static_cast<char *>(std::malloc(block.size));
+    if (!block.data) throw std::bad_alloc();
+    blocks_.push_back(block);
+  }
+}
+
+void Arena::deallocate(void *p, size_t bytes) {
+  if (!p || current_ >= blocks_.size()) return;
+  auto *c = static_cast<char *>(p);
+  auto &block = blocks_[current_];
+  if (c >= block.data && c + bytes == block.data + offset_) {
+    auto freed = static_cast<size_t>(block.data + offset_ - c);
+    offset_ -= freed;
+    used_ -= freed;
+  }
+}
+
+Arena::Mark Arena::mark() const {
+  Mark m;
+  m.block = current_;
+  m.offset = offset_;
+  m.used = used_;
+  return m;
+}
+
+void Arena::rewind(const Mark &m) {
+  current_ = m.block;
+  offset_ = m.offset;
+  used_ = m.used;
+  if (used_ == 0 && blocks_.size() > 1) {
+    for (size_t b = 1; b < blocks_.size(); ++b) std::free(blocks_[b].data);
+    blocks_.resize(1);
+  }
+}
+
+size_t Arena::capacity() const {
+  size_t total = 0;
+  for (const auto &b: blocks_) total += b.size;
+  return total;
+}
+
+Arena &scratch_arena() {
+  static thread_local Arena arena;
+  return arena;
+}
+
+ArenaScope::ArenaScope(Arena &arena) : arena_(arena), mark_{arena.mark()}, outer_peak_{arena.peak()} {
+  arena_.reset_peak();
+}
+
+ArenaScope::~ArenaScope() {
+  arena_.rewind(mark_);
+  // The enclosing scope's peak includes whatever this one reached
+  arena_.peak_ = std::max(outer_peak_, arena_.peak_);
+}
@@ -0,0 +1,527 @@
+#include "block_compression.h"
+#include "arena.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  const uint8_t KTX2_IDENTIFIER[12]{0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+  // Key/value entry holding write_ktx2's source key
+  const char KTX2_SOURCE_KEY[] = "utahICGSource";
+
+  // Vulkan's names for the formats, as KTX2 records them
+  const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+  const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+  const uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+  const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+
+  uint32_t vk_format(BlockFormat format) {
+    switch (format) {
+      case BlockFormat::BC1:
+        return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+      case BlockFormat::BC3:
+        return VK_FORMAT_BC3_UNORM_BLOCK;
+      case BlockFormat::BC4:
+        return VK_FORMAT_BC4_UNORM_BLOCK;
+      default:
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    }
+  }
+
+  bool from_vk_format(uint32_t vk, BlockFormat &format) {
+    switch (vk) {
+      case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        format = BlockFormat::BC1;
+        return true;
+      case VK_FORMAT_BC3_UNORM_BLOCK:
+        format = BlockFormat::BC3;
+        return true;
+      case VK_FORMAT_BC4_UNORM_BLOCK:
+        format = BlockFormat::BC4;
+        return true;
+      case VK_FORMAT_BC5_UNORM_BLOCK:
+        format = BlockFormat::BC5;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  inline size_t blocks_across(uint32_t texels) {
+    return (texels + 3) / 4;
+  }
+
+  inline uint16_t pack_565(const float *c) {
+    auto q = [](float v, float levels) {
+      return static_cast<uint32_t>(std::min(std::max(v, 0.0f), 255.0f) * levels / 255.0f + 0.5f);
+    };
+    return static_cast<uint16_t>((q(c[0], 31) << 11) | (q(c[1], 63) << 5) | q(c[2], 31));
+  }
+
+  inline void unpack_565(uint16_t c, int32_t *rgb) {
+    const int32_t r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+  }
+
+  // The four colours of a BC1 block, as the GPU decodes them
+  void bc1_palette(uint16_t c0, uint16_t c1, int32_t palette[4][3]) {
+    unpack_565(c0, palette[0]);
+    unpack_565(c1, palette[1]);
+    for (auto k = 0; k < 3; ++k) {
+      if (c0 > c1) {
+        palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+        palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+      } else {
+        palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+        palette[3][k] = 0;
+      }
+    }
+  }
+
+  // Pick each texel's nearest palette colour. Returns the total squared error.
+  int32_t bc1_indices(const uint8_t texels[16][4], uint16_t c0, uint16_t c1, uint32_t &indices) {
+    int32_t palette[4][3];
+    bc1_palette(c0, c1, palette);
+    int32_t total = 0;
+    indices = 0;
+    for (uint32_t i = 0; i < 16; ++i) {
+      int32_t best = 0, best_error = 0x7fffffff;
+      for (auto p = 0; p < 4; ++p) {
+        int32_t error = 0;
+        for (auto k = 0; k < 3; ++k) {
+          auto d = texels[i][k] - palette[p][k];
+          error += d * d;
+        }
+        if (error < best_error) {
+          best_error = error;
+          best = p;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (2 * i);
+      total += best_error;
+    }
+    return total;
+  }
+
+  /*
+   * Opaque BC1 colour block. The endpoints span the texels' extent along their
+   * principal axis, then are refitted once by least squares to the chosen indices.
+   */
+  void encode_bc1(const uint8_t texels[16][4], uint8_t *out) {
+    float mean[3]{0, 0, 0};
+    for (auto i = 0; i < 16; ++i) {
+      for (auto k = 0; k < 3; ++k) mean[k] += texels[i][k];
+    }
+    for (auto k = 0; k < 3; ++k) mean[k] /= 16.0f;
+    float cov[6]{0, 0, 0, 0, 0, 0};
+    for (auto i = 0; i < 16; ++i) {
+      float d[3]{texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2]};
+      cov[0] += d[0] * d[0];
+      cov[1] += d[0] * d[1];
+      cov[2] += d[0] * d[2];
+      cov[3] += d[1] * d[1];
+      cov[4] += d[1] * d[2];
+      cov[5] += d[2] * d[2];
+    }
+
+    // Power iteration for the principal axis
+    float axis[3]{1, 1, 1};
+    for (auto it = 0; it < 8; ++it) {
+      float next[3]{cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                    cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                    cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+      auto len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+      if (len == 0) break;
+      for (auto k = 0; k < 3; ++k) axis[k] = next[k] / len;
+    }
+    float t_lo = 0, t_hi = 0;
+    for (auto i = 0; i < 16; ++i) {
+      auto t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1]
+               + (texels[i][2] - mean[2]) * axis[2];
+      t_lo = std::min(t_lo, t);
+      t_hi = std::max(t_hi, t);
+    }
+    float e0[3], e1[3];
+    for (auto k = 0; k < 3; ++k) {
+      e0[k] = mean[k] + t_hi * axis[k];
+      e1[k] = mean[k] + t_lo * axis[k];
+    }
+
+    auto c0 = pack_565(e0), c1 = pack_565(e1);
+    // Four colour mode needs c0 > c1; equal endpoints are a solid block
+    if (c0 < c1) std::swap(c0, c1);
+    uint32_t indices = 0;
+    auto error = c0 == c1 ? 0 : bc1_indices(texels, c0, c1, indices);
+
+    if (c0 != c1 && error > 0) {
+      // Each texel is w * e0 + (1 - w) * e1; solve for the endpoints that fit best
+      const float weight[4]{1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+      float aa = 0, ab = 0, bb = 0, ax[3]{0, 0, 0}, bx[3]{0, 0, 0};
+      for (auto i = 0; i < 16; ++i) {
+        auto w = weight[(indices >> (2 * i)) & 3];
+        aa += w * w;
+        ab += w * (1 - w);
+        bb += (1 - w) * (1 - w);
+        for (auto k = 0; k < 3; ++k) {
+          ax[k] += w * texels[i][k];
+          bx[k] += (1 - w) * texels[i][k];
+        }
+      }
+      auto det = aa * bb - ab * ab;
+      if (std::fabs(det) > 1e-6f) {
+        for (auto k = 0; k < 3; ++k) {
+          e0[k] = (bb * ax[k] - ab * bx[k]) / det;
+          e1[k] = (aa * bx[k] - ab * ax[k]) / det;
+        }
+        auto r0 = pack_565(e0), r1 = pack_565(e1);
+        if (r0 < r1) std::swap(r0, r1);
+        if (r0 != r1) {
+          uint32_t refit = 0;
+          if (bc1_indices(texels, r0, r1, refit) < error) {
+            c0 = r0;
+            c1 = r1;
+            indices = refit;
+          }
+        }
+      }
+    }
+
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    for (auto b = 0; b < 4; ++b) out[4 + b] = (indices >> (8 * b)) & 0xff;
+  }
+
+  // One channel BC4 block in its eight value mode, endpoints at the channel's extremes
+  void encode_bc4(const uint8_t texels[16][4], uint32_t channel, uint8_t *out) {
+    uint8_t lo = 255, hi = 0;
+    for (auto i = 0; i < 16; ++i) {
+      lo = std::min(lo, texels[i][channel]);
+      hi = std::max(hi, texels[i][channel]);
+    }
+    out[0] = hi;
+    out[1] = lo;
+    uint64_t indices = 0;
+    if (hi > lo) {
+      for (uint32_t i = 0; i < 16; ++i) {
+        // Position from hi (0) to lo (7); codes 0 and 1 are the endpoints and 2-7 the steps between
+        auto step = (7 * (hi - texels[i][channel]) + (hi - lo) / 2) / (hi - lo);
+        uint64_t code = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+        indices |= code << (3 * i);
+      }
+    }
+    for (auto b = 0; b < 6; ++b) out[2 + b] = (indices >> (8 * b)) & 0xff;
+  }
+
+  void decode_bc1(const uint8_t *in, uint8_t texels[16][4]) {
+    const uint16_t c0 = in[0] | (in[1] << 8), c1 = in[2] | (in[3] << 8);
+    int32_t palette[4][3];
+    bc1_palette(c0, c1, palette);
+    const uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (static_cast<uint32_t>(in[7]) << 24);
+    for (auto i = 0; i < 16; ++i) {
+      const auto p = (indices >> (2 * i)) & 3;
+      for (auto k = 0; k < 3; ++k) texels[i][k] = static_cast<uint8_t>(palette[p][k]);
+      texels[i][3] = (c0 <= c1 && p == 3) ? 0 : 255;
+    }
+  }
+
+  void decode_bc4(const uint8_t *in, uint32_t channel, uint8_t texels[16][4]) {
+    const int32_t r0 = in[0], r1 = in[1];
+    int32_t values[8]{r0, r1};
+    for (auto k = 1; k < 7; ++k) {
+      if (r0 > r1) {
+        values[k + 1] = ((7 - k) * r0 + k * r1) / 7;
+      } else if (k < 5) {
+        values[k + 1] = ((5 - k) * r0 + k * r1) / 5;
+      }
+    }
+    if (r0 <= r1) {
+      values[6] = 0;
+      values[7] = 255;
+    }
+    uint64_t indices = 0;
+    for (auto b = 0; b < 6; ++b) indices |= static_cast<uint64_t>(in[2 + b]) << (8 * b);
+    for (auto i = 0; i < 16; ++i) texels[i][channel] = static_cast<uint8_t>(values[(indices >> (3 * i)) & 7]);
+  }
+
+  inline void put_u32(std::vector<uint8_t> &out, uint32_t v) {
+    for (auto b = 0; b < 4; ++b) out.push_back((v >> (8 * b)) & 0xff);
+  }
+
+  inline void put_u64(std::vector<uint8_t> &out, uint64_t v) {
+    for (auto b = 0; b < 8; ++b) out.push_back((v >> (8 * b)) & 0xff);
+  }
+
+  inline uint64_t get_le(const uint8_t *p, uint32_t bytes) {
+    uint64_t v = 0;
+    for (uint32_t b = 0; b < bytes; ++b) v |= static_cast<uint64_t>(p[b]) << (8 * b);
+    return v;
+  }
+
+  inline size_t level_size(const CompressedImage &level) {
+    return blocks_across(level.width) * blocks_across(level.height) * block_bytes(level.format);
+  }
+}
+
+size_t block_bytes(BlockFormat format) {
+  return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+BlockFormat choose_block_format(const Image &image) {
+  if (image.channels == 1) return BlockFormat::BC4;
+  if (image.channels == 2) return BlockFormat::BC5;
+  if (image.channels == 4) {
+    for (size_t i = 3; i < image.pixels.size(); i += 4) {
+      if (image.pixels[i] != 255) return BlockFormat::BC3;
+    }
+  }
+  return BlockFormat::BC1;
+}
+
+CompressedImage::CompressedImage() : width{0}, height{0}, format{BlockFormat::BC1} {}
+
+void compress_image(const Image &image, BlockFormat format, CompressedImage &compressed) {
+  const auto bx = blocks_across(image.width), by = blocks_across(image.height);
+  const auto bytes = block_bytes(format);
+  compressed.width = image.width;
+  compressed.height = image.height;
+  compressed.format = format;
+  compressed.blocks.resize(bx * by * bytes);
+  if (compressed.blocks.empty()) return;
+
+  parallel_for(0, by, 4, [&](size_t row_begin, size_t row_end) {
+    uint8_t texels[16][4];
+    const auto c = image.channels;
+    for (auto row = row_begin; row < row_end; ++row) {
+      for (size_t col = 0; col < bx; ++col) {
+        // Gather as RGBA, repeating the last row and column into partial blocks
+        for (uint32_t i = 0; i < 16; ++i) {
+          auto x = std::min<size_t>(4 * col + i % 4, image.width - 1);
+          auto y = std::min<size_t>(4 * row + i / 4, image.height - 1);
+          const auto *px = image.pixels.data() + (y * image.width + x) * c;
+          for (uint32_t k = 0; k < 4; ++k) texels[i][k] = k < c ? px[k] : (k == 3 ? 255 : px[0]);
+        }
+        auto *out = compressed.blocks.data() + (row * bx + col) * bytes;
+        switch (format) {
+          case BlockFormat::BC1:
+            encode_bc1(texels, out);
+            break;
+          case BlockFormat::BC3:
+            encode_bc4(texels, 3, out);
+            encode_bc1(texels, out + 8);
+            break;
+          case BlockFormat::BC4:
+            encode_bc4(texels, 0, out);
+            break;
+          case BlockFormat::BC5:
+            encode_bc4(texels, 0, out);
+            encode_bc4(texels, 1, out + 8);
+            break;
+        }
+      }
+    }
+  });
+}
+
+void decompress_image(const CompressedImage &compressed, Image &image) {
+  const auto bx = blocks_across(compressed.width);
+  const auto bytes = block_bytes(compressed.format);
+  const uint32_t channels[]{3, 4, 1, 2};
+  const auto c = channels[static_cast<uint32_t>(compressed.format)];
+  image.width = compressed.width;
+  image.height = compressed.height;
+  image.channels = c;
+  image.pixels.resize(static_cast<size_t>(image.width) * image.height * c);
+
+  uint8_t texels[16][4];
+  for (uint32_t y = 0; y < image.height; y += 4) {
+    for (uint32_t x = 0; x < image.width; x += 4) {
+      const auto *in = compressed.blocks.data() + ((y / 4) * bx + x / 4) * bytes;
+      switch (compressed.format) {
+        case BlockFormat::BC1:
+          decode_bc1(in, texels);
+          break;
+        case BlockFormat::BC3:
+          decode_bc1(in + 8, texels);
+          decode_bc4(in, 3, texels);
+          break;
+        case BlockFormat::BC4:
+          decode_bc4(in, 0, texels);
+          break;
+        case BlockFormat::BC5:
+          decode_bc4(in, 0, texels);
+          decode_bc4(in + 8, 1, texels);
+          break;
+      }
+      for (uint32_t i = 0; i < 16; ++i) {
+        if (x + i % 4 >= image.width || y + i / 4 >= image.height) continue;
+        auto *px = image.pixels.data() + ((y + i / 4) * static_cast<size_t>(image.width) + x + i % 4) * c;
+        for (uint32_t k = 0; k < c; ++k) px[k] = texels[i][k];
+      }
+    }
+  }
+}
+
+bool write_ktx2(const std::string &file_name, const std::vector<CompressedImage> &levels,
+                const std::string &source_key) {
+  if (levels.empty()) {
+    spdlog::error("  no levels to write to {}", file_name);
+    return false;
+  }
+  const auto num_levels = static_cast<uint32_t>(levels.size());
+  const auto alignment = block_bytes(levels[0].format);
+
+  std::vector<uint8_t> header(KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+  put_u32(header, vk_format(levels[0].format));
+  put_u32(header, 1);                 // type size
+  put_u32(header, levels[0].width);
+  put_u32(header, levels[0].height);
+  put_u32(header, 0);                 // depth
+  put_u32(header, 0);                 // layers
+  put_u32(header, 1);                 // faces
+  put_u32(header, num_levels);
+  put_u32(header, 0);                 // no supercompression
+
+  // One key/value entry: its length, the key and value each NUL terminated, padded to 4 bytes
+  std::vector<uint8_t> key_values;
+  if (!source_key.empty()) {
+    put_u32(key_values, static_cast<uint32_t>(sizeof(KTX2_SOURCE_KEY) + source_key.size() + 1));
+    key_values.insert(key_values.end(), KTX2_SOURCE_KEY, KTX2_SOURCE_KEY + sizeof(KTX2_SOURCE_KEY));
+    key_values.insert(key_values.end(), source_key.begin(), source_key.end());
+    key_values.push_back(0);
+    while (key_values.size() % 4) key_values.push_back(0);
+  }
+  const auto key_values_offset = header.size() + 4 * 4 + 2 * 8 + 24 * static_cast<size_t>(num_levels);
+
+  // No data format descriptor or supercompression data
+  put_u32(header, 0);
+  put_u32(header, 0);
+  put_u32(header, key_values.empty() ? 0 : static_cast<uint32_t>(key_values_offset));
+  put_u32(header, static_cast<uint32_t>(key_values.size()));
+  put_u64(header, 0);
+  put_u64(header, 0);
+
+  // Levels are stored smallest first, each aligned to a block
+  std::vector<uint64_t> offsets(num_levels);
+  auto offset = key_values_offset + key_values.size();
+  for (auto l = num_levels; l-- > 0;) {
+    offset = (offset + alignment - 1) / alignment * alignment;
+    offsets[l] = offset;
+    offset += levels[l].blocks.size();
+  }
+  for (uint32_t l = 0; l < num_levels; ++l) {
+    put_u64(header, offsets[l]);
+    put_u64(header, levels[l].blocks.size());
+    put_u64(header, levels[l].blocks.size());
+  }
+  header.insert(header.end(), key_values.begin(), key_values.end());
+
+  std::ofstream out(file_name, std::ios::binary);
+  if (!out.is_open()) {
+    spdlog::error("Couldn't create texture cache {}", file_name);
+    return false;
+  }
+  out.write(reinterpret_cast<const char *>(header.data()), static_cast<std::streamsize>(header.size()));
+  auto written = header.size();
+  const char padding[16]{};
+  for (auto l = num_levels; l-- > 0;) {
+    out.write(padding, static_cast<std::streamsize>(offsets[l] - written));
+    out.write(reinterpret_cast<const char *>(levels[l].blocks.data()),
+              static_cast<std::streamsize>(levels[l].blocks.size()));
+    written = offsets[l] + levels[l].blocks.size();
+  }
+  if (!out) {
+    spdlog::error("  failed writing texture cache {}", file_name);
+    return false;
+  }
+  return true;
+}
+
+bool read_ktx2(const std::string &file_name, std::vector<CompressedImage> &levels, std::string *source_key) {
+  std::ifstream in(file_name, std::ios::binary);
+  if (!in.is_open()) {
+    spdlog::error("Couldn't open texture cache {}", file_name);
+    return false;
+  }
+  in.seekg(0, std::ios::end);
+  auto file_size = static_cast<std::streamoff>(in.tellg());
+  in.seekg(0, std::ios::beg);
+  if (file_size < 0) {
+    spdlog::error("  couldn't determine size of {}", file_name);
+    return false;
+  }
+
+  ArenaScope scope;
+  ScratchVector<uint8_t> bytes(static_cast<size_t>(file_size));
+  in.read(reinterpret_cast<char *>(bytes.data()), file_size);
+  const auto size = static_cast<size_t>(in.gcount());
+  const auto *data = bytes.data();
+
+  const size_t HEADER_SIZE = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+  if (size < HEADER_SIZE || std::memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+    spdlog::error("  {} is not a KTX2 file", file_name);
+    return false;
+  }
+  BlockFormat format;
+  if (!from_vk_format(static_cast<uint32_t>(get_le(data + 12, 4)), format)) {
+    spdlog::error("  {} has an unsupported format", file_name);
+    return false;
+  }
+  const auto width = static_cast<uint32_t>(get_le(data + 20, 4));
+  const auto height = static_cast<uint32_t>(get_le(data + 24, 4));
+  const auto num_levels = static_cast<uint32_t>(get_le(data + 40, 4));
+  const auto supercompression = get_le(data + 44, 4);
+  if (!width || !height || !num_levels || num_levels > 32 || supercompression != 0
+      || size < HEADER_SIZE + 24 * static_cast<size_t>(num_levels)) {
+    spdlog::error("  {} has an unsupported layout", file_name);
+    return false;
+  }
+
+  if (source_key) {
+    source_key->clear();
+    const auto kv_offset = get_le(data + 56, 4), kv_length = get_le(data + 60, 4);
+    if (kv_offset > size || kv_length > size - kv_offset) {
+      spdlog::error("  {} has corrupt key/value data", file_name);
+      return false;
+    }
+    // Entries are a length then a NUL terminated key and the value, padded to 4 bytes
+    const auto *kv = data + kv_offset, *kv_end = kv + kv_length;
+    while (kv_end - kv >= 4) {
+      const auto length = get_le(kv, 4);
+      if (length > static_cast<uint64_t>(kv_end - kv - 4)) break;
+      const auto *key = reinterpret_cast<const char *>(kv + 4);
+      const auto key_length = strnlen(key, length);
+      if (key_length + 1 < length && std::strcmp(key, KTX2_SOURCE_KEY) == 0) {
+        const auto *value = key + key_length + 1;
+        source_key->assign(value, strnlen(value, length - key_length - 1));
+      }
+      kv += 4 + (length + 3) / 4 * 4;
+    }
+  }
+
+  levels.assign(num_levels, CompressedImage());
+  for (uint32_t l = 0; l < num_levels; ++l) {
+    auto &level = levels[l];
+    level.width = std::max<uint32_t>(width >> l, 1);
+    level.height = std::max<uint32_t>(height >> l, 1);
+    level.format = format;
+    const auto *entry = data + HEADER_SIZE + 24 * static_cast<size_t>(l);
+    const auto offset = get_le(entry, 8), length = get_le(entry + 8, 8);
+    if (length != level_size(level) || offset > size || length > size - offset) {
+      spdlog::error("  {} level {} is corrupt", file_name, l);
+      levels.clear();
+      return false;
+    }
+    level.blocks.assign(data + offset, data + offset + length);
+  }
+  return true;
+}
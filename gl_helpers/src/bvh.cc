@@ -0,0 +1,431 @@
+#include "bvh.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+  const uint32_t NUM_BINS = 16;
+
+  // Deeper subtrees become one leaf, which bounds the traversal stacks
+  const uint32_t MAX_DEPTH = 60;
+  const uint32_t STACK_SIZE = MAX_DEPTH + 2;
+
+  struct Box {
+    float min[3];
+    float max[3];
+
+    Box() : min{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()},
+            max{-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()} {}
+
+    inline void grow(const float *lo, const float *hi) {
+      for (auto k = 0; k < 3; ++k) {
+        min[k] = std::min(min[k], lo[k]);
+        max[k] = std::max(max[k], hi[k]);
+      }
+    }
+
+    inline void grow(const Box &o) { grow(o.min, o.max); }
+
+    // Half the surface area, which is all the SAH needs
+    inline float half_area() const {
+      float d[3]{max[0] - min[0], max[1] - min[1], max[2] - min[2]};
+      if (d[0] < 0) return 0;
+      return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+    }
+  };
+
+  inline Box object_box(const ObjectBounds &bounds, uint32_t i) {
+    Box b;
+    b.min[0] = bounds.center_x[i] - bounds.extent_x[i];
+    b.min[1] = bounds.center_y[i] - bounds.extent_y[i];
+    b.min[2] = bounds.center_z[i] - bounds.extent_z[i];
+    b.max[0] = bounds.center_x[i] + bounds.extent_x[i];
+    b.max[1] = bounds.center_y[i] + bounds.extent_y[i];
+    b.max[2] = bounds.center_z[i] + bounds.extent_z[i];
+    return b;
+  }
+
+  // Copy the objects' boxes into the order of bvh.indices
+  void gather_boxes(const ObjectBounds &bounds, Bvh &bvh) {
+    bvh.boxes.resize(6 * bvh.indices.size());
+    auto *out = bvh.boxes.data();
+    for (auto o: bvh.indices) {
+      auto box = object_box(bounds, o);
+      for (auto k = 0; k < 3; ++k) out[k] = box.min[k];
+      for (auto k = 0; k < 3; ++k) out[3 + k] = box.max[k];
+      out += 6;
+    }
+  }
+
+  inline void set_node_box(BvhNode &node, const Box &box) {
+    for (auto k = 0; k < 3; ++k) {
+      node.min[k] = box.min[k];
+      node.max[k] = box.max[k];
+    }
+  }
+
+  // A subtree left for a worker thread to build
+  struct SubtreeTask {
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t depth;
+    std::vector<BvhNode> nodes;
+  };
+
+  struct Builder {
+    const std::vector<Box> &boxes;
+    const std::vector<float> &centroids;
+    std::vector<uint32_t> &indices;
+    uint32_t max_leaf_size;
+    std::vector<BvhNode> &nodes;
+
+    // When set, subtrees over at most task_size objects are left as tasks
+    std::vector<SubtreeTask> *tasks;
+    uint32_t task_size;
+
+    // Build the subtree over indices [begin, end) and return its root
+    uint32_t build(uint32_t begin, uint32_t end, uint32_t depth) {
+      using namespace std;
+
+      auto node_index = static_cast<uint32_t>(nodes.size());
+      nodes.emplace_back();
+      Box box, centroid_box;
+      for (auto i = begin; i < end; ++i) {
+        auto o = indices[i];
+        box.grow(boxes[o]);
+        centroid_box.grow(&centroids[3 * o], &centroids[3 * o]);
+      }
+      set_node_box(nodes[node_index], box);
+
+      const auto count = end - begin;
+      if (count <= max_leaf_size || depth == MAX_DEPTH) return make_leaf(node_index, begin, count);
+      if (tasks && count <= task_size) {
+        tasks->push_back(SubtreeTask{node_index, begin, end, depth, {}});
+        return node_index;
+      }
+
+      // Cheapest binned split over the three axes
+      auto best_cost = numeric_limits<float>::max();
+      auto best_axis = -1;
+      uint32_t best_bin = 0;
+      for (auto axis = 0; axis < 3; ++axis) {
+        auto lo = centroid_box.min[axis], extent = centroid_box.max[axis] - lo;
+        if (extent <= 0) continue;
+        auto scale = NUM_BINS / extent;
+        Box bin_box[NUM_BINS];
+        uint32_t bin_count[NUM_BINS]{};
+        for (auto i = begin; i < end; ++i) {
+          auto o = indices[i];
+          auto b = min(NUM_BINS - 1, static_cast<uint32_t>((centroids[3 * o + axis] - lo) * scale));
+          ++bin_count[b];
+          bin_box[b].grow(boxes[o]);
+        }
+        // Sweep from the right to get the cost of every right hand side, then from the left
+        float right_area[NUM_BINS];
+        uint32_t right_count[NUM_BINS];
+        Box acc;
+        uint32_t n = 0;
+        for (auto b = NUM_BINS - 1; b > 0; --b) {
+          acc.grow(bin_box[b]);
+          n += bin_count[b];
+          right_area[b] = acc.half_area();
+          right_count[b] = n;
+        }
+        acc = Box();
+        n = 0;
+        for (uint32_t b = 0; b < NUM_BINS - 1; ++b) {
+          acc.grow(bin_box[b]);
+          n += bin_count[b];
+          if (!n || !right_count[b + 1]) continue;
+          auto cost = n * acc.half_area() + right_count[b + 1] * right_area[b + 1];
+          if (cost < best_cost) {
+            best_cost = cost;
+            best_axis = axis;
+            best_bin = b;
+          }
+        }
+      }
+
+      uint32_t mid;
+      if (best_axis < 0) {
+        // Every centroid is in the same place so any split is as good as another
+        mid = begin + count / 2;
+      } else {
+        auto lo = centroid_box.min[best_axis];
+        auto scale = NUM_BINS / (centroid_box.max[best_axis] - lo);
+        auto axis = best_axis;
+        auto split = best_bin;
+        auto *first = indices.data() + begin;
+        mid = static_cast<uint32_t>(partition(first, indices.data() + end, [&](uint32_t o) {
+          return min(NUM_BINS - 1, static_cast<uint32_t>((centroids[3 * o + axis] - lo) * scale)) <= split;
+        }) - indices.data());
+      }
+
+      build(begin, mid, depth + 1);
+      auto right = build(mid, end, depth + 1);
+      nodes[node_index].first = right;
+      nodes[node_index].count = 0;
+      return node_index;
+    }
+
+    uint32_t make_leaf(uint32_t node_index, uint32_t begin, uint32_t count) {
+      nodes[node_index].first = begin;
+      nodes[node_index].count = count;
+      return node_index;
+    }
+  };
+
+  /*
+   * Copy the top of the tree depth first into out, splicing in each task's subtree
+   * in place of the node it was left at. task_of_node maps top nodes to tasks.
+   */
+  void splice(const std::vector<BvhNode> &top, uint32_t node,
+              const std::vector<uint32_t> &task_of_node, const std::vector<SubtreeTask> &tasks,
+              std::vector<BvhNode> &out) {
+    if (task_of_node[node] != std::numeric_limits<uint32_t>::max()) {
+      auto base = static_cast<uint32_t>(out.size());
+      for (auto n: tasks[task_of_node[node]].nodes) {
+        if (!n.count) n.first += base;
+        out.push_back(n);
+      }
+      return;
+    }
+    auto index = out.size();
+    out.push_back(top[node]);
+    if (top[node].count) return;
+    splice(top, node + 1, task_of_node, tasks, out);
+    out[index].first = static_cast<uint32_t>(out.size());
+    splice(top, top[node].first, task_of_node, tasks, out);
+  }
+
+  // Range of Bvh::indices under a node. Subtrees are built over contiguous ranges.
+  void subtree_range(const Bvh &bvh, uint32_t node, uint32_t &begin, uint32_t &end) {
+    auto left = node;
+    while (!bvh.nodes[left].count) ++left;
+    auto right = node;
+    while (!bvh.nodes[right].count) right = bvh.nodes[right].first;
+    begin = bvh.nodes[left].first;
+    end = bvh.nodes[right].first + bvh.nodes[right].count;
+  }
+
+  // Distance along the ray to where it enters the box or false if it misses it or enters after max_t.
+  // Branch free as the outcome is close to random for the boxes of a traversal.
+  inline bool ray_box(const float *lo, const float *hi, const float *origin, const float *inv_dir,
+                      float max_t, float &t_enter) {
+    using std::min;
+    using std::max;
+    auto x0 = (lo[0] - origin[0]) * inv_dir[0], x1 = (hi[0] - origin[0]) * inv_dir[0];
+    auto y0 = (lo[1] - origin[1]) * inv_dir[1], y1 = (hi[1] - origin[1]) * inv_dir[1];
+    auto z0 = (lo[2] - origin[2]) * inv_dir[2], z1 = (hi[2] - origin[2]) * inv_dir[2];
+    auto t0 = max(max(min(x0, x1), min(y0, y1)), max(min(z0, z1), 0.0f));
+    auto t1 = min(min(max(x0, x1), max(y0, y1)), min(max(z0, z1), max_t));
+    t_enter = t0;
+    return t0 <= t1;
+  }
+}
+
+void build_bvh(const ObjectBounds &bounds, Bvh &bvh, uint32_t max_leaf_size) {
+  using namespace std;
+
+  bvh.nodes.clear();
+  bvh.indices.resize(bounds.count);
+  if (!bounds.count) return;
+  const auto count = static_cast<uint32_t>(bounds.count);
+  for (uint32_t i = 0; i < count; ++i) bvh.indices[i] = i;
+
+  vector<Box> boxes(count);
+  vector<float> centroids(3 * count);
+  parallel_for(0, count, 4096, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      boxes[i] = object_box(bounds, static_cast<uint32_t>(i));
+      centroids[3 * i] = bounds.center_x[i];
+      centroids[3 * i + 1] = bounds.center_y[i];
+      centroids[3 * i + 2] = bounds.center_z[i];
+    }
+  });
+  max_leaf_size = max(1u, max_leaf_size);
+
+  // The top of the tree is split on this thread until there are enough
+  // subtrees to keep every worker busy, then those are built concurrently
+  const auto workers = static_cast<uint32_t>(num_worker_threads());
+  vector<BvhNode> top;
+  vector<SubtreeTask> tasks;
+  Builder top_builder{boxes, centroids, bvh.indices, max_leaf_size, top,
+                      workers > 1 ? &tasks : nullptr, max(count / (4 * workers), 1024u)};
+  top_builder.build(0, count, 0);
+  if (tasks.empty()) {
+    bvh.nodes.swap(top);
+  } else {
+    parallel_for(0, tasks.size(), 1, [&](size_t begin, size_t end) {
+      for (auto t = begin; t < end; ++t) {
+        auto &task = tasks[t];
+        Builder builder{boxes, centroids, bvh.indices, max_leaf_size, task.nodes, nullptr, 0};
+        builder.build(task.begin, task.end, task.depth);
+      }
+    });
+    vector<uint32_t> task_of_node(top.size(), numeric_limits<uint32_t>::max());
+    for (uint32_t t = 0; t < tasks.size(); ++t) task_of_node[tasks[t].node] = t;
+    bvh.nodes.reserve(2 * count);
+    splice(top, 0, task_of_node, tasks, bvh.nodes);
+  }
+  gather_boxes(bounds, bvh);
+}
+
+void refit_bvh(const ObjectBounds &bounds, Bvh &bvh) {
+  gather_boxes(bounds, bvh);
+  // Children always follow their parent so a reverse walk sees them first
+  for (auto n = bvh.nodes.size(); n-- > 0;) {
+    auto &node = bvh.nodes[n];
+    Box box;
+    if (node.count) {
+      for (auto i = node.first; i < node.first + node.count; ++i) {
+        box.grow(&bvh.boxes[6 * i], &bvh.boxes[6 * i + 3]);
+      }
+    } else {
+      const auto &left = bvh.nodes[n + 1];
+      const auto &right = bvh.nodes[node.first];
+      box.grow(left.min, left.max);
+      box.grow(right.min, right.max);
+    }
+    set_node_box(node, box);
+  }
+}
+
+size_t bvh_frustum_cull(const Bvh &bvh, const glm::mat4 &view_projection,
+                        std::vector<uint32_t> &visible) {
+  using namespace std;
+
+  visible.clear();
+  if (bvh.nodes.empty()) return 0;
+
+  float planes[6][4], abs_normal[6][3];
+  frustum_planes(view_projection, planes);
+  for (auto p = 0; p < 6; ++p) {
+    for (auto k = 0; k < 3; ++k) abs_normal[p][k] = fabs(planes[p][k]);
+  }
+
+  // Whether the box at min, max may be inside the planes in mask and which planes
+  // it is wholly inside, which are cleared from mask
+  auto box_inside = [&](const float *min, const float *max, uint32_t &mask) {
+    float c[3], e[3];
+    for (auto k = 0; k < 3; ++k) {
+      c[k] = (min[k] + max[k]) * 0.5f;
+      e[k] = (max[k] - min[k]) * 0.5f;
+    }
+    for (auto p = 0; p < 6; ++p) {
+      if (!(mask & (1u << p))) continue;
+      auto dist = planes[p][0] * c[0] + planes[p][1] * c[1] + planes[p][2] * c[2] + planes[p][3];
+      auto radius = abs_normal[p][0] * e[0] + abs_normal[p][1] * e[1] + abs_normal[p][2] * e[2];
+      if (dist + radius < 0) return false;
+      if (dist - radius >= 0) mask &= ~(1u << p);
+    }
+    return true;
+  };
+
+  // Stack of nodes with the planes still to test against them, one bit each
+  const uint32_t ALL_PLANES = 0x3f;
+  pair<uint32_t, uint32_t> stack[STACK_SIZE];
+  uint32_t top = 0;
+  stack[top++] = {0, ALL_PLANES};
+  while (top) {
+    auto node_index = stack[--top].first;
+    auto mask = stack[top].second;
+    const auto &node = bvh.nodes[node_index];
+    if (!box_inside(node.min, node.max, mask)) continue;
+
+    if (!mask) {
+      // Wholly inside: everything below is visible
+      uint32_t begin, end;
+      subtree_range(bvh, node_index, begin, end);
+      visible.insert(visible.end(), bvh.indices.begin() + begin, bvh.indices.begin() + end);
+    } else if (!node.count) {
+      stack[top++] = {node.first, mask};
+      stack[top++] = {node_index + 1, mask};
+    } else {
+      for (auto i = node.first; i < node.first + node.count; ++i) {
+        auto object_mask = mask;
+        if (box_inside(&bvh.boxes[6 * i], &bvh.boxes[6 * i + 3], object_mask)) visible.push_back(bvh.indices[i]);
+      }
+    }
+  }
+  return bvh.indices.size() - visible.size();
+}
+
+bool bvh_raycast(const Bvh &bvh,
+                 const glm::vec3 &origin, const glm::vec3 &direction,
+                 uint32_t &object, float &distance,
+                 const RayHitTest &hit_test) {
+  using namespace std;
+
+  if (bvh.nodes.empty()) return false;
+  const float o[3]{origin.x, origin.y, origin.z};
+  const float inv_dir[3]{1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+
+  auto best = numeric_limits<float>::max();
+  auto found = false;
+
+  // Nodes still to visit with where the ray enters them, so that those beyond a hit found since are skipped
+  pair<uint32_t, float> stack[STACK_SIZE];
+  uint32_t top = 0;
+  float t_root;
+  if (ray_box(bvh.nodes[0].min, bvh.nodes[0].max, o, inv_dir, best, t_root)) stack[top++] = {0, t_root};
+  while (top) {
+    --top;
+    if (stack[top].second > best) continue;
+    auto node_index = stack[top].first;
+    const auto &node = bvh.nodes[node_index];
+
+    if (node.count) {
+      for (auto i = node.first; i < node.first + node.count; ++i) {
+        auto obj = bvh.indices[i];
+        float t_box;
+        if (!ray_box(&bvh.boxes[6 * i], &bvh.boxes[6 * i + 3], o, inv_dir, best, t_box)) continue;
+        float t_hit = t_box;
+        if (hit_test && !hit_test(obj, t_hit)) continue;
+        if (t_hit < best) {
+          best = t_hit;
+          object = obj;
+          found = true;
+        }
+      }
+      continue;
+    }
+
+    // Visit the nearer child first so that its hits prune the other
+    auto left = node_index + 1;
+    auto right = node.first;
+    float t_left, t_right;
+    auto hit_left = ray_box(bvh.nodes[left].min, bvh.nodes[left].max, o, inv_dir, best, t_left);
+    auto hit_right = ray_box(bvh.nodes[right].min, bvh.nodes[right].max, o, inv_dir, best, t_right);
+    if (hit_left && hit_right) {
+      if (t_left <= t_right) {
+        stack[top++] = {right, t_right};
+        stack[top++] = {left, t_left};
+      } else {
+        stack[top++] = {left, t_left};
+        stack[top++] = {right, t_right};
+      }
+    } else if (hit_left) {
+      stack[top++] = {left, t_left};
+    } else if (hit_right) {
+      stack[top++] = {right, t_right};
+    }
+  }
+  if (found) distance = best;
+  return found;
+}
+
+void pick_ray(float x, float y, float width, float height,
+              const glm::mat4 &view, const glm::mat4 &projection,
+              glm::vec3 &origin, glm::vec3 &direction) {
+  auto ndc_x = 2.0f * x / width - 1.0f;
+  auto ndc_y = 1.0f - 2.0f * y / height;
+  auto inv = glm::inverse(projection * view);
+  auto near_point = inv * glm::vec4{ndc_x, ndc_y, -1.0f, 1.0f};
+  auto far_point = inv * glm::vec4{ndc_x, ndc_y, 1.0f, 1.0f};
+  origin = glm::vec3(near_point) / near_point.w;
+  direction = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+}
@@ -0,0 +1,201 @@
+#include "chunk_streamer.h"
+#include "culling.h"
+#include "gl_debug.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  // False when the box lies wholly outside one of the planes
+  bool box_in_frustum(const Bounds &bounds, const float planes[6][4]) {
+    for (auto i = 0; i < 6; ++i) {
+      // The corner furthest along the plane's normal
+      float d = planes[i][3];
+      for (auto k = 0; k < 3; ++k) d += planes[i][k] * (planes[i][k] >= 0.0f ? bounds.max[k] : bounds.min[k]);
+      if (d < 0.0f) return false;
+    }
+    return true;
+  }
+}
+
+ChunkStreamOptions::ChunkStreamOptions()
+        : budget_bytes{256u << 20}, upload_bytes_per_frame{16u << 20}, max_reads{8}, pos_attr{0} {}
+
+ChunkStreamer::Entry::Entry() : state{UNLOADED}, vao{0}, vbo{0}, ebo{0}, last_visible{0} {}
+
+ChunkStreamer::ChunkStreamer(const ChunkStreamOptions &options)
+        : options_{options}, resident_bytes_{0}, frame_{0} {}
+
+ChunkStreamer::~ChunkStreamer() {
+  release();
+}
+
+bool ChunkStreamer::open(const std::string &chunk_file_name) {
+  release();
+  entries_.clear();
+  visible_.clear();
+  if (!read_chunk_table(chunk_file_name, chunks_, bounds_)) {
+    chunks_.clear();
+    return false;
+  }
+  file_name_ = chunk_file_name;
+  entries_.reserve(chunks_.size());
+  for (size_t c = 0; c < chunks_.size(); ++c) entries_.emplace_back(new Entry());
+  spdlog::info("Streaming {} chunks of {}", chunks_.size(), chunk_file_name);
+  return true;
+}
+
+void ChunkStreamer::update(const glm::mat4 &mvp, const glm::vec3 &eye) {
+  ++frame_;
+  auto &jobs = JobSystem::shared();
+
+  // In view, nearest first
+  float planes[6][4];
+  frustum_planes(mvp, planes);
+  visible_.clear();
+  std::vector<float> distance(chunks_.size(), 0.0f);
+  for (uint32_t c = 0; c < chunks_.size(); ++c) {
+    const auto &b = chunks_[c].bounds;
+    if (!box_in_frustum(b, planes)) continue;
+    distance[c] = std::max(0.0f, glm::length(eye - glm::vec3(b.center[0], b.center[1], b.center[2])) - b.radius);
+    entries_[c]->last_visible = frame_;
+    visible_.push_back(c);
+  }
+  std::sort(visible_.begin(), visible_.end(), [&distance](uint32_t a, uint32_t b) { return distance[a] < distance[b]; });
+
+  // Without worker threads nothing else runs the reads
+  if (jobs.num_threads() == 1) {
+    for (auto &e: entries_) {
+      if (e->state == READING) jobs.wait(e->job);
+    }
+  }
+
+  // The nearest chunks in view that fit in the budget are wanted; start reading those that aren't loaded
+  std::vector<bool> wanted(chunks_.size(), false);
+  size_t planned = 0;
+  uint32_t reading = 0;
+  for (const auto &e: entries_) if (e->state == READING) ++reading;
+  for (auto c: visible_) {
+    planned += chunks_[c].bytes();
+    if (planned > options_.budget_bytes) break;
+    wanted[c] = true;
+    if (entries_[c]->state == UNLOADED && reading < options_.max_reads) {
+      start_read(c);
+      ++reading;
+    }
+  }
+
+  // Chunks read but no longer wanted aren't kept in memory
+  for (uint32_t c = 0; c < chunks_.size(); ++c) {
+    auto &e = *entries_[c];
+    if (!wanted[c] && e.state.load(std::memory_order_acquire) == READ) {
+      std::vector<float>().swap(e.positions);
+      std::vector<uint32_t>().swap(e.indices);
+      e.state = UNLOADED;
+    }
+  }
+
+  // Residents that aren't wanted, least recently in view first, make way for those that are
+  std::vector<uint32_t> evictable;
+  for (uint32_t c = 0; c < chunks_.size(); ++c) {
+    if (!wanted[c] && entries_[c]->state == RESIDENT) evictable.push_back(c);
+  }
+  std::sort(evictable.begin(), evictable.end(), [this, &distance](uint32_t a, uint32_t b) {
+    auto la = entries_[a]->last_visible, lb = entries_[b]->last_visible;
+    return la != lb ? la < lb : distance[a] > distance[b];
+  });
+  size_t next_evict = 0;
+
+  size_t uploaded = 0;
+  for (auto c: visible_) {
+    if (!wanted[c]) break;
+    if (uploaded && uploaded >= options_.upload_bytes_per_frame) break;
+    if (entries_[c]->state.load(std::memory_order_acquire) != READ) continue;
+    const auto bytes = chunks_[c].bytes();
+    while (resident_bytes_ + bytes > options_.budget_bytes && next_evict < evictable.size()) {
+      evict(evictable[next_evict++]);
+    }
+    if (resident_bytes_ + bytes > options_.budget_bytes) break;
+    upload(c);
+    uploaded += bytes;
+  }
+}
+
+void ChunkStreamer::record(CommandList &list) const {
+  for (auto c: visible_) {
+    const auto &e = *entries_[c];
+    if (e.state != RESIDENT) continue;
+    list.bind_vertex_array(e.vao);
+    list.draw_elements(GL_TRIANGLES, chunks_[c].num_triangles * 3, 0);
+  }
+}
+
+size_t ChunkStreamer::num_drawn() const {
+  size_t drawn = 0;
+  for (auto c: visible_) {
+    if (entries_[c]->state == RESIDENT) ++drawn;
+  }
+  return drawn;
+}
+
+void ChunkStreamer::start_read(uint32_t chunk) {
+  auto &e = *entries_[chunk];
+  e.state = READING;
+  auto file_name = file_name_;
+  auto info = chunks_[chunk];
+  auto *entry = &e;
+  auto &jobs = JobSystem::shared();
+  e.job = jobs.create_job([entry, file_name, info]() {
+    auto ok = read_chunk(file_name, info, entry->positions, entry->indices);
+    entry->state.store(ok ? READ : FAILED, std::memory_order_release);
+  });
+  jobs.run(e.job);
+}
+
+void ChunkStreamer::upload(uint32_t chunk) {
+  auto &e = *entries_[chunk];
+  glGenVertexArrays(1, &e.vao);
+  glBindVertexArray(e.vao);
+  glGenBuffers(1, &e.vbo);
+  glGenBuffers(1, &e.ebo);
+
+  glBindBuffer(GL_ARRAY_BUFFER, e.vbo);
+  glBufferData(GL_ARRAY_BUFFER, e.positions.size() * sizeof(float), e.positions.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(options_.pos_attr);
+  glVertexAttribPointer(options_.pos_attr, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (GLvoid *) nullptr);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, e.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, e.indices.size() * sizeof(uint32_t), e.indices.data(), GL_STATIC_DRAW);
+  glBindVertexArray(0);
+
+  const auto label = file_name_ + " chunk " + std::to_string(chunk);
+  label_gl_object(GlObject::VERTEX_ARRAY, e.vao, label);
+  label_gl_object(GlObject::BUFFER, e.vbo, label, "vertices");
+  label_gl_object(GlObject::BUFFER, e.ebo, label, "indices");
+
+  // GL has its own copy now
+  std::vector<float>().swap(e.positions);
+  std::vector<uint32_t>().swap(e.indices);
+  resident_bytes_ += chunks_[chunk].bytes();
+  e.state = RESIDENT;
+}
+
+void ChunkStreamer::evict(uint32_t chunk) {
+  auto &e = *entries_[chunk];
+  glDeleteBuffers(1, &e.vbo);
+  glDeleteBuffers(1, &e.ebo);
+  glDeleteVertexArrays(1, &e.vao);
+  e.vao = e.vbo = e.ebo = 0;
+  resident_bytes_ -= chunks_[chunk].bytes();
+  e.state = UNLOADED;
+}
+
+void ChunkStreamer::release() {
+  auto &jobs = JobSystem::shared();
+  for (uint32_t c = 0; c < entries_.size(); ++c) {
+    auto &e = *entries_[c];
+    if (e.job) jobs.wait(e.job);
+    if (e.state == RESIDENT) evict(c);
+  }
+}
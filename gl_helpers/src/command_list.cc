@@ -0,0 +1,258 @@
+#include "command_list.h"
+
+#include <cstring>
+
+#include "glm/gtc/type_ptr.hpp"
+
+namespace {
+  // Every command starts on an 8 byte boundary so offsets written into the list can be passed to GL in place
+  const size_t ALIGNMENT = 8;
+
+  // size counts the header and is a multiple of ALIGNMENT
+  struct Header {
+    uint32_t op;
+    uint32_t size;
+  };
+
+  struct ViewportArgs {
+    int32_t x, y, width, height;
+  };
+
+  struct ColourArgs {
+    float rgba[4];
+  };
+
+  struct NameArgs {
+    uint32_t name;
+  };
+
+  struct TextureArgs {
+    uint32_t unit;
+    uint32_t target;
+    uint32_t texture;
+  };
+
+  struct Mat4Args {
+    int32_t location;
+    float value[16];
+  };
+
+  struct Vec4Args {
+    int32_t location;
+    float value[4];
+  };
+
+  struct IntArgs {
+    int32_t location;
+    int32_t value;
+  };
+
+  struct FloatArgs {
+    float value;
+  };
+
+  struct DrawArgs {
+    uint32_t mode;
+    uint32_t count;
+    uint32_t first_index;
+  };
+
+  // Followed by num_draws offsets then num_draws counts
+  struct MultiDrawArgs {
+    uint32_t mode;
+    uint32_t num_draws;
+  };
+
+  // Followed by size bytes of data
+  struct BufferArgs {
+    uint32_t buffer;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  inline size_t aligned(size_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  }
+
+  inline size_t args_offset() {
+    return aligned(sizeof(Header));
+  }
+
+  template<typename T>
+  inline T read(const uint8_t *command) {
+    T args;
+    std::memcpy(&args, command + args_offset(), sizeof(T));
+    return args;
+  }
+
+  inline const uint8_t *extra(const uint8_t *command, size_t args_size) {
+    return command + args_offset() + aligned(args_size);
+  }
+}
+
+CommandList::CommandList() : num_commands_{0}, program_{0}, vao_{0} {}
+
+void CommandList::reset() {
+  // clear keeps the capacity
+  bytes_.clear();
+  num_commands_ = 0;
+  program_ = 0;
+  vao_ = 0;
+}
+
+template<typename T>
+uint8_t *CommandList::push(Op op, const T &args, size_t extra) {
+  Header header{op, static_cast<uint32_t>(args_offset() + aligned(sizeof(T)) + aligned(extra))};
+  auto at = bytes_.size();
+  bytes_.resize(at + header.size);
+  auto *command = bytes_.data() + at;
+  std::memcpy(command, &header, sizeof(Header));
+  std::memcpy(command + args_offset(), &args, sizeof(T));
+  ++num_commands_;
+  return command + args_offset() + aligned(sizeof(T));
+}
+
+void CommandList::viewport(int32_t x, int32_t y, int32_t width, int32_t height) {
+  push(VIEWPORT, ViewportArgs{x, y, width, height});
+}
+
+void CommandList::clear_colour(const glm::vec4 &colour) {
+  push(CLEAR_COLOUR, ColourArgs{{colour.x, colour.y, colour.z, colour.w}});
+}
+
+void CommandList::use_program(uint32_t program) {
+  // Starts at zero so the first bind of a list is always recorded; nothing binds program 0 to draw
+  if (program == program_ && program) return;
+  program_ = program;
+  push(USE_PROGRAM, NameArgs{program});
+}
+
+void CommandList::bind_vertex_array(uint32_t vao) {
+  if (vao == vao_ && vao) return;
+  vao_ = vao;
+  push(BIND_VERTEX_ARRAY, NameArgs{vao});
+}
+
+void CommandList::bind_texture(uint32_t unit, GLenum target, uint32_t texture) {
+  push(BIND_TEXTURE, TextureArgs{unit, target, texture});
+}
+
+void CommandList::uniform(int32_t location, const glm::mat4 &value) {
+  if (location < 0) return;
+  Mat4Args args;
+  args.location = location;
+  std::memcpy(args.value, glm::value_ptr(value), sizeof(args.value));
+  push(UNIFORM_MAT4, args);
+}
+
+void CommandList::uniform(int32_t location, const glm::vec4 &value) {
+  if (location < 0) return;
+  push(UNIFORM_VEC4, Vec4Args{location, {value.x, value.y, value.z, value.w}});
+}
+
+void CommandList::uniform(int32_t location, int32_t value) {
+  if (location < 0) return;
+  push(UNIFORM_INT, IntArgs{location, value});
+}
+
+void CommandList::point_size(float size) {
+  push(POINT_SIZE, FloatArgs{size});
+}
+
+void CommandList::draw_elements(GLenum mode, uint32_t count, uint32_t first_index) {
+  if (!count) return;
+  push(DRAW_ELEMENTS, DrawArgs{mode, count, first_index});
+}
+
+void CommandList::multi_draw_elements(GLenum mode, const GLsizei *counts, const GLvoid *const *offsets,
+                                      size_t num_draws) {
+  if (!num_draws) return;
+  auto *dst = push(MULTI_DRAW_ELEMENTS, MultiDrawArgs{mode, static_cast<uint32_t>(num_draws)},
+                   aligned(num_draws * sizeof(GLvoid *)) + num_draws * sizeof(GLsizei));
+  std::memcpy(dst, offsets, num_draws * sizeof(GLvoid *));
+  std::memcpy(dst + aligned(num_draws * sizeof(GLvoid *)), counts, num_draws * sizeof(GLsizei));
+}
+
+void CommandList::update_buffer(uint32_t buffer, size_t offset, const void *data, size_t size) {
+  if (!size) return;
+  auto *dst = push(UPDATE_BUFFER, BufferArgs{buffer, offset, size}, size);
+  std::memcpy(dst, data, size);
+}
+
+void CommandList::replay() const {
+  const auto *command = bytes_.data();
+  const auto *end = command + bytes_.size();
+  while (command < end) {
+    Header header;
+    std::memcpy(&header, command, sizeof(Header));
+    switch (header.op) {
+      case VIEWPORT: {
+        auto args = read<ViewportArgs>(command);
+        glViewport(args.x, args.y, args.width, args.height);
+        break;
+      }
+      case CLEAR_COLOUR: {
+        auto args = read<ColourArgs>(command);
+        glClearColor(args.rgba[0], args.rgba[1], args.rgba[2], args.rgba[3]);
+        glClear(GL_COLOR_BUFFER_BIT);
+        break;
+      }
+      case USE_PROGRAM:
+        glUseProgram(read<NameArgs>(command).name);
+        break;
+      case BIND_VERTEX_ARRAY:
+        glBindVertexArray(read<NameArgs>(command).name);
+        break;
+      case BIND_TEXTURE: {
+        auto args = read<TextureArgs>(command);
+        glActiveTexture(GL_TEXTURE0 + args.unit);
+        glBindTexture(args.target, args.texture);
+        break;
+      }
+      case UNIFORM_MAT4: {
+        auto args = read<Mat4Args>(command);
+        glUniformMatrix4fv(args.location, 1, GL_FALSE, args.value);
+        break;
+      }
+      case UNIFORM_VEC4: {
+        auto args = read<Vec4Args>(command);
+        glUniform4fv(args.location, 1, args.value);
+        break;
+      }
+      case UNIFORM_INT: {
+        auto args = read<IntArgs>(command);
+        glUniform1i(args.location, args.value);
+        break;
+      }
+      case POINT_SIZE:
+        glPointSize(read<FloatArgs>(command).value);
+        break;
+      case DRAW_ELEMENTS: {
+        auto args = read<DrawArgs>(command);
+        glDrawElements(args.mode, static_cast<GLsizei>(args.count), GL_UNSIGNED_INT,
+                       reinterpret_cast<const GLvoid *>(args.first_index * sizeof(GLuint)));
+        break;
+      }
+      case MULTI_DRAW_ELEMENTS: {
+        auto args = read<MultiDrawArgs>(command);
+        const auto *offsets = extra(command, sizeof(MultiDrawArgs));
+        const auto *counts = offsets + aligned(args.num_draws * sizeof(GLvoid *));
+        glMultiDrawElements(args.mode, reinterpret_cast<const GLsizei *>(counts), GL_UNSIGNED_INT,
+                            reinterpret_cast<const GLvoid *const *>(offsets), static_cast<GLsizei>(args.num_draws));
+        break;
+      }
+      case UPDATE_BUFFER: {
+        // Through the copy target so the element buffer bound to the current VAO isn't disturbed
+        auto args = read<BufferArgs>(command);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, args.buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(args.offset),
+                        static_cast<GLsizeiptr>(args.size), extra(command, sizeof(BufferArgs)));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        break;
+      }
+      default:
+        break;
+    }
+    command += header.size;
+  }
+}
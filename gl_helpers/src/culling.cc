@@ -0,0 +1,219 @@
+#include "culling.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define UTAH_ICG_CULL_SSE
+#include <immintrin.h>
+#if defined(__GNUC__)
+// AVX is compiled per function and only called when the CPU reports it
+#define UTAH_ICG_CULL_AVX
+#endif
+#elif defined(__ARM_NEON)
+#define UTAH_ICG_CULL_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+  // Objects are padded to a multiple of this so that every SIMD load is in bounds
+  const size_t BATCH = 8;
+
+  // A plane with the absolute values of its normal, for box tests
+  struct CullPlane {
+    float a, b, c, d;
+    float abs_a, abs_b, abs_c;
+  };
+
+  void cull_planes(const glm::mat4 &view_projection, CullPlane planes[6]) {
+    float p[6][4];
+    frustum_planes(view_projection, p);
+    for (auto i = 0; i < 6; ++i) {
+      planes[i] = CullPlane{p[i][0], p[i][1], p[i][2], p[i][3],
+                            std::fabs(p[i][0]), std::fabs(p[i][1]), std::fabs(p[i][2])};
+    }
+  }
+
+  // Append the objects in a batch starting at first whose bit in inside_mask is set
+  inline void emit(size_t first, uint32_t inside_mask, size_t lanes, size_t count, std::vector<uint32_t> &visible) {
+    for (size_t lane = 0; lane < lanes; ++lane) {
+      if ((inside_mask >> lane) & 1 && first + lane < count) visible.push_back(static_cast<uint32_t>(first + lane));
+    }
+  }
+
+#ifdef UTAH_ICG_CULL_SSE
+  void cull_sse(const ObjectBounds &bounds, const CullPlane planes[6], std::vector<uint32_t> &visible) {
+    const auto zero = _mm_setzero_ps();
+    for (size_t i = 0; i < bounds.count; i += 4) {
+      auto cx = _mm_loadu_ps(&bounds.center_x[i]);
+      auto cy = _mm_loadu_ps(&bounds.center_y[i]);
+      auto cz = _mm_loadu_ps(&bounds.center_z[i]);
+      auto ex = _mm_loadu_ps(&bounds.extent_x[i]);
+      auto ey = _mm_loadu_ps(&bounds.extent_y[i]);
+      auto ez = _mm_loadu_ps(&bounds.extent_z[i]);
+      auto outside = zero;
+      for (auto p = 0; p < 6; ++p) {
+        const auto &pl = planes[p];
+        auto dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(pl.a)), _mm_mul_ps(cy, _mm_set1_ps(pl.b))),
+                               _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(pl.c)), _mm_set1_ps(pl.d)));
+        auto radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(pl.abs_a)), _mm_mul_ps(ey, _mm_set1_ps(pl.abs_b))),
+                                 _mm_mul_ps(ez, _mm_set1_ps(pl.abs_c)));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+      }
+      emit(i, ~static_cast<uint32_t>(_mm_movemask_ps(outside)), 4, bounds.count, visible);
+    }
+  }
+#endif
+
+#ifdef UTAH_ICG_CULL_AVX
+  __attribute__((target("avx")))
+  void cull_avx(const ObjectBounds &bounds, const CullPlane planes[6], std::vector<uint32_t> &visible) {
+    const auto zero = _mm256_setzero_ps();
+    for (size_t i = 0; i < bounds.count; i += 8) {
+      auto cx = _mm256_loadu_ps(&bounds.center_x[i]);
+      auto cy = _mm256_loadu_ps(&bounds.center_y[i]);
+      auto cz = _mm256_loadu_ps(&bounds.center_z[i]);
+      auto ex = _mm256_loadu_ps(&bounds.extent_x[i]);
+      auto ey = _mm256_loadu_ps(&bounds.extent_y[i]);
+      auto ez = _mm256_loadu_ps(&bounds.extent_z[i]);
+      auto outside = zero;
+      for (auto p = 0; p < 6; ++p) {
+        const auto &pl = planes[p];
+        auto dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, _mm256_set1_ps(pl.a)),
+                                                _mm256_mul_ps(cy, _mm256_set1_ps(pl.b))),
+                                  _mm256_add_ps(_mm256_mul_ps(cz, _mm256_set1_ps(pl.c)), _mm256_set1_ps(pl.d)));
+        auto radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(pl.abs_a)),
+                                                  _mm256_mul_ps(ey, _mm256_set1_ps(pl.abs_b))),
+                                    _mm256_mul_ps(ez, _mm256_set1_ps(pl.abs_c)));
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_LT_OQ));
+      }
+      emit(i, ~static_cast<uint32_t>(_mm256_movemask_ps(outside)), 8, bounds.count, visible);
+    }
+  }
+
+  bool has_avx() {
+    static const bool avx = __builtin_cpu_supports("avx");
+    return avx;
+  }
+#endif
+
+#ifdef UTAH_ICG_CULL_NEON
+  void cull_neon(const ObjectBounds &bounds, const CullPlane planes[6], std::vector<uint32_t> &visible) {
+    const auto zero = vdupq_n_f32(0);
+    for (size_t i = 0; i < bounds.count; i += 4) {
+      auto cx = vld1q_f32(&bounds.center_x[i]);
+      auto cy = vld1q_f32(&bounds.center_y[i]);
+      auto cz = vld1q_f32(&bounds.center_z[i]);
+      auto ex = vld1q_f32(&bounds.extent_x[i]);
+      auto ey = vld1q_f32(&bounds.extent_y[i]);
+      auto ez = vld1q_f32(&bounds.extent_z[i]);
+      auto outside = vdupq_n_u32(0);
+      for (auto p = 0; p < 6; ++p) {
+        const auto &pl = planes[p];
+        auto dist = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(pl.d), cx, pl.a), cy, pl.b), cz, pl.c);
+        auto radius = vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(ex, pl.abs_a), ey, pl.abs_b), ez, pl.abs_c);
+        outside = vorrq_u32(outside, vcltq_f32(vaddq_f32(dist, radius), zero));
+      }
+      uint32_t inside_mask = (vgetq_lane_u32(outside, 0) ? 0 : 1) | (vgetq_lane_u32(outside, 1) ? 0 : 2)
+                             | (vgetq_lane_u32(outside, 2) ? 0 : 4) | (vgetq_lane_u32(outside, 3) ? 0 : 8);
+      emit(i, inside_mask, 4, bounds.count, visible);
+    }
+  }
+#endif
+}
+
+void frustum_planes(const glm::mat4 &clip, float planes[6][4]) {
+  // Gribb and Hartmann: each plane is the fourth row of clip plus or minus another row
+  for (auto p = 0; p < 6; ++p) {
+    auto row = p / 2;
+    auto sign = (p & 1) ? -1.0f : 1.0f;
+    for (auto c = 0; c < 4; ++c) planes[p][c] = clip[c][3] + sign * clip[c][row];
+    auto len = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+    auto inv = len > 0 ? 1.0f / len : 0.0f;
+    for (auto c = 0; c < 4; ++c) planes[p][c] *= inv;
+  }
+}
+
+ObjectBounds::ObjectBounds() : count{0} {}
+
+void ObjectBounds::resize(size_t new_count) {
+  count = new_count;
+  auto padded = (new_count + BATCH - 1) / BATCH * BATCH;
+  for (auto v: {&center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z}) v->resize(padded, 0.0f);
+}
+
+void ObjectBounds::set(size_t i, const Bounds &local, const glm::mat4 &model) {
+  // Arvo: the transformed box's half extent along each axis is the sum of the
+  // local half extents scaled by the absolute values of that row of the matrix
+  float c[3], e[3];
+  for (auto k = 0; k < 3; ++k) {
+    c[k] = (local.min[k] + local.max[k]) * 0.5f;
+    e[k] = (local.max[k] - local.min[k]) * 0.5f;
+  }
+  float wc[3], we[3];
+  for (auto r = 0; r < 3; ++r) {
+    wc[r] = model[3][r];
+    we[r] = 0;
+    for (auto k = 0; k < 3; ++k) {
+      wc[r] += model[k][r] * c[k];
+      we[r] += std::fabs(model[k][r]) * e[k];
+    }
+  }
+  center_x[i] = wc[0];
+  center_y[i] = wc[1];
+  center_z[i] = wc[2];
+  extent_x[i] = we[0];
+  extent_y[i] = we[1];
+  extent_z[i] = we[2];
+}
+
+size_t frustum_cull_scalar(const ObjectBounds &bounds, const glm::mat4 &view_projection, std::vector<uint32_t> &visible) {
+  CullPlane planes[6];
+  cull_planes(view_projection, planes);
+  visible.clear();
+  for (size_t i = 0; i < bounds.count; ++i) {
+    auto outside = false;
+    for (auto p = 0; p < 6 && !outside; ++p) {
+      const auto &pl = planes[p];
+      auto dist = pl.a * bounds.center_x[i] + pl.b * bounds.center_y[i] + pl.c * bounds.center_z[i] + pl.d;
+      auto radius = pl.abs_a * bounds.extent_x[i] + pl.abs_b * bounds.extent_y[i] + pl.abs_c * bounds.extent_z[i];
+      outside = dist + radius < 0;
+    }
+    if (!outside) visible.push_back(static_cast<uint32_t>(i));
+  }
+  return bounds.count - visible.size();
+}
+
+size_t frustum_cull(const ObjectBounds &bounds, const glm::mat4 &view_projection, std::vector<uint32_t> &visible) {
+#if defined(UTAH_ICG_CULL_SSE) || defined(UTAH_ICG_CULL_NEON)
+  CullPlane planes[6];
+  cull_planes(view_projection, planes);
+  visible.clear();
+#if defined(UTAH_ICG_CULL_AVX)
+  if (has_avx()) {
+    cull_avx(bounds, planes, visible);
+    return bounds.count - visible.size();
+  }
+#endif
+#if defined(UTAH_ICG_CULL_SSE)
+  cull_sse(bounds, planes, visible);
+#else
+  cull_neon(bounds, planes, visible);
+#endif
+  return bounds.count - visible.size();
+#else
+  return frustum_cull_scalar(bounds, view_projection, visible);
+#endif
+}
+
+const char *frustum_cull_path() {
+#if defined(UTAH_ICG_CULL_AVX)
+  if (has_avx()) return "avx";
+#endif
+#if defined(UTAH_ICG_CULL_SSE)
+  return "sse";
+#elif defined(UTAH_ICG_CULL_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
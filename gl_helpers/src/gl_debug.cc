@@ -0,0 +1,191 @@
+#include "gl_debug.h"
+#include "gl_common.h"
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+#include "spdlog/spdlog-inl.h"
+
+GlDebugOptions::GlDebugOptions()
+        : min_severity{GlDebugSeverity::LOW}, max_repeats{5}, max_per_second{50}, synchronous{false} {}
+
+GlDebugFilter::GlDebugFilter(uint32_t max_repeats, uint32_t max_per_second)
+        : max_repeats_{max_repeats}, max_per_second_{max_per_second}, window_start_{0.0}, in_window_{0},
+          rate_dropped_{0} {}
+
+GlDebugFilter::Verdict GlDebugFilter::accept(uint64_t key, double seconds) {
+  auto &seen = seen_[key];
+  if (seen >= max_repeats_) return DROP;
+
+  if (seconds - window_start_ >= 1.0) {
+    window_start_ = seconds;
+    in_window_ = 0;
+  }
+  if (in_window_ >= max_per_second_) {
+    ++rate_dropped_;
+    return DROP;
+  }
+  // Only messages actually logged count as repeats, so one dropped by the rate limit can still be seen later
+  ++in_window_;
+  ++seen;
+  return seen == max_repeats_ ? LOG_LAST : LOG;
+}
+
+uint32_t GlDebugFilter::take_rate_dropped() {
+  auto dropped = rate_dropped_;
+  rate_dropped_ = 0;
+  return dropped;
+}
+
+#if defined(UTAH_ICG_GL_DEBUG) && !defined(__APPLE__)
+
+namespace {
+  // KHR_debug may call back from driver threads
+  struct DebugState {
+    DebugState(const GlDebugOptions &options)
+            : filter{options.max_repeats, options.max_per_second}, start{std::chrono::steady_clock::now()} {}
+
+    std::mutex mutex;
+    GlDebugFilter filter;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  // Set once installed; labels and groups are skipped until then
+  DebugState *g_debug_state = nullptr;
+
+  const char *source_name(GLenum source) {
+    switch (source) {
+      case GL_DEBUG_SOURCE_API: return "API";
+      case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+      case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+      case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+      case GL_DEBUG_SOURCE_APPLICATION: return "application";
+      default: return "other";
+    }
+  }
+
+  const char *type_name(GLenum type) {
+    switch (type) {
+      case GL_DEBUG_TYPE_ERROR: return "error";
+      case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+      case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behaviour";
+      case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+      case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+      case GL_DEBUG_TYPE_MARKER: return "marker";
+      default: return "other";
+    }
+  }
+
+  GLenum to_gl(GlDebugSeverity severity) {
+    switch (severity) {
+      case GlDebugSeverity::HIGH: return GL_DEBUG_SEVERITY_HIGH;
+      case GlDebugSeverity::MEDIUM: return GL_DEBUG_SEVERITY_MEDIUM;
+      case GlDebugSeverity::LOW: return GL_DEBUG_SEVERITY_LOW;
+      default: return GL_DEBUG_SEVERITY_NOTIFICATION;
+    }
+  }
+
+  GLenum to_gl(GlObject type) {
+    switch (type) {
+      case GlObject::BUFFER: return GL_BUFFER;
+      case GlObject::VERTEX_ARRAY: return GL_VERTEX_ARRAY;
+      case GlObject::PROGRAM: return GL_PROGRAM;
+      case GlObject::SHADER: return GL_SHADER;
+      default: return GL_TEXTURE;
+    }
+  }
+
+  void GLAPIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                 GLsizei length, const GLchar *message, const void *user) {
+    auto &state = *static_cast<DebugState *>(const_cast<void *>(user));
+    std::string text = length < 0 ? std::string(message) : std::string(message, static_cast<size_t>(length));
+
+    // The same id can carry different messages so the text is part of what makes one a repeat
+    auto key = static_cast<uint64_t>(std::hash<std::string>()(text));
+    key ^= (static_cast<uint64_t>(source) << 48) ^ (static_cast<uint64_t>(type) << 32) ^ id;
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - state.start).count();
+
+    GlDebugFilter::Verdict verdict;
+    uint32_t dropped;
+    {
+      std::lock_guard<std::mutex> lock(state.mutex);
+      verdict = state.filter.accept(key, seconds);
+      if (verdict == GlDebugFilter::DROP) return;
+      dropped = state.filter.take_rate_dropped();
+    }
+
+    if (dropped) spdlog::warn("GL debug: {} messages dropped by the rate limit", dropped);
+    auto level = severity == GL_DEBUG_SEVERITY_HIGH ? spdlog::level::err
+                 : severity == GL_DEBUG_SEVERITY_MEDIUM ? spdlog::level::warn
+                 : severity == GL_DEBUG_SEVERITY_LOW ? spdlog::level::info
+                 : spdlog::level::debug;
+    spdlog::log(level, "GL {} {} [{}]: {}{}", source_name(source), type_name(type), id, text,
+                verdict == GlDebugFilter::LOG_LAST ? " (further repeats suppressed)" : "");
+  }
+}
+
+bool install_gl_debug(const GlDebugOptions &options) {
+  if (!GLEW_KHR_debug && !GLEW_VERSION_4_3) {
+    spdlog::warn("KHR_debug isn't available; GL debug messages are off");
+    return false;
+  }
+
+  // Left in place for the life of the process since the driver may still call back with it
+  static DebugState *state = nullptr;
+  if (!state) {
+    state = new DebugState(options);
+  } else {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->filter = GlDebugFilter(options.max_repeats, options.max_per_second);
+  }
+
+  glEnable(GL_DEBUG_OUTPUT);
+  if (options.synchronous) {
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  } else {
+    glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  }
+  glDebugMessageCallback(debug_callback, state);
+
+  // Severity is filtered in the driver so unwanted messages cost nothing here
+  const GlDebugSeverity severities[] = {GlDebugSeverity::NOTIFICATION, GlDebugSeverity::LOW,
+                                        GlDebugSeverity::MEDIUM, GlDebugSeverity::HIGH};
+  for (auto s: severities) {
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, to_gl(s), 0, nullptr,
+                          s >= options.min_severity ? GL_TRUE : GL_FALSE);
+  }
+  g_debug_state = state;
+  spdlog::info("GL debug messages on");
+  return true;
+}
+
+void label_gl_object(GlObject type, uint32_t name, const std::string &label, const char *suffix) {
+  if (!g_debug_state || !name) return;
+  auto full = suffix ? label + " " + suffix : label;
+  glObjectLabel(to_gl(type), name, static_cast<GLsizei>(full.size()), full.c_str());
+}
+
+GlDebugGroup::GlDebugGroup(const char *name) : pushed_{g_debug_state != nullptr} {
+  if (pushed_) glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+GlDebugGroup::~GlDebugGroup() {
+  if (pushed_) glPopDebugGroup();
+}
+
+#elif defined(UTAH_ICG_GL_DEBUG)
+
+// GL on macOS stops at 4.1, before KHR_debug
+bool install_gl_debug(const GlDebugOptions &) {
+  spdlog::warn("KHR_debug isn't available; GL debug messages are off");
+  return false;
+}
+
+void label_gl_object(GlObject, uint32_t, const std::string &, const char *) {}
+
+GlDebugGroup::GlDebugGroup(const char *) : pushed_{false} {}
+
+GlDebugGroup::~GlDebugGroup() {}
+
+#endif
@@ -0,0 +1,247 @@
+#include "image.h"
+#include "arena.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  inline uint32_t read_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+  }
+
+  // Reverse the order of the rows
+  void flip_rows(Image &image) {
+    const size_t row = static_cast<size_t>(image.width) * image.channels;
+    for (uint32_t y = 0; y < image.height / 2; ++y) {
+      std::swap_ranges(image.pixels.begin() + y * row, image.pixels.begin() + (y + 1) * row,
+                       image.pixels.begin() + (image.height - 1 - y) * row);
+    }
+  }
+
+  // Reverse the order of the pixels in each row
+  void flip_columns(Image &image) {
+    const auto c = image.channels;
+    for (uint32_t y = 0; y < image.height; ++y) {
+      auto *row = image.pixels.data() + static_cast<size_t>(y) * image.width * c;
+      for (uint32_t x = 0; x < image.width / 2; ++x) {
+        std::swap_ranges(row + x * c, row + (x + 1) * c, row + (image.width - 1 - x) * c);
+      }
+    }
+  }
+
+  inline bool ends_with(const std::string &s, const char *suffix) {
+    auto n = std::strlen(suffix);
+    if (s.size() < n) return false;
+    for (size_t i = 0; i < n; ++i) {
+      if (std::tolower(static_cast<unsigned char>(s[s.size() - n + i])) != suffix[i]) return false;
+    }
+    return true;
+  }
+}
+
+Image::Image() : width{0}, height{0}, channels{0} {}
+
+bool decode_tga(const uint8_t *data, size_t size, Image &image) {
+  const size_t HEADER_SIZE = 18;
+  if (size < HEADER_SIZE) {
+    spdlog::error("  TGA is truncated");
+    return false;
+  }
+  const auto id_length = data[0];
+  const auto colour_map_type = data[1];
+  const auto image_type = data[2];
+  const auto colour_map_length = read_u16(data + 5);
+  const auto colour_map_bits = data[7];
+  const auto width = read_u16(data + 12);
+  const auto height = read_u16(data + 14);
+  const auto bits = data[16];
+  const auto descriptor = data[17];
+
+  const auto rle = image_type == 10 || image_type == 11;
+  const auto grey = image_type == 3 || image_type == 11;
+  if (colour_map_type != 0 || !(image_type == 2 || image_type == 3 || rle)) {
+    spdlog::error("  TGA image type {} is not supported, only true colour and grey", image_type);
+    return false;
+  }
+  if ((grey && bits != 8) || (!grey && bits != 24 && bits != 32)) {
+    spdlog::error("  TGA with {} bits per pixel is not supported", bits);
+    return false;
+  }
+  if (width == 0 || height == 0) {
+    spdlog::error("  TGA has no pixels");
+    return false;
+  }
+
+  const uint32_t bytes_per_pixel = bits / 8;
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  auto p = data + HEADER_SIZE + id_length + colour_map_length * ((colour_map_bits + 7) / 8);
+  const auto end = data + size;
+
+  image.width = width;
+  image.height = height;
+  image.channels = bytes_per_pixel;
+  image.pixels.resize(num_pixels * bytes_per_pixel);
+  auto *out = image.pixels.data();
+
+  // Pixels are stored BGR(A)
+  auto put = [&out, bytes_per_pixel](const uint8_t *px) {
+    if (bytes_per_pixel == 1) {
+      *out++ = px[0];
+      return;
+    }
+    *out++ = px[2];
+    *out++ = px[1];
+    *out++ = px[0];
+    if (bytes_per_pixel == 4) *out++ = px[3];
+  };
+
+  if (!rle) {
+    if (p > end || static_cast<size_t>(end - p) < num_pixels * bytes_per_pixel) {
+      spdlog::error("  TGA is truncated");
+      return false;
+    }
+    for (size_t i = 0; i < num_pixels; ++i, p += bytes_per_pixel) put(p);
+  } else {
+    // Packets of a repeated pixel or of literal pixels, either of up to 128, which may cross rows
+    size_t decoded = 0;
+    while (decoded < num_pixels) {
+      if (p >= end) {
+        spdlog::error("  TGA is truncated");
+        return false;
+      }
+      const auto header = *p++;
+      const size_t count = std::min<size_t>((header & 0x7f) + 1, num_pixels - decoded);
+      const auto repeat = (header & 0x80) != 0;
+      const size_t needed = repeat ? bytes_per_pixel : count * bytes_per_pixel;
+      if (static_cast<size_t>(end - p) < needed) {
+        spdlog::error("  TGA is truncated");
+        return false;
+      }
+      for (size_t i = 0; i < count; ++i) put(repeat ? p : p + i * bytes_per_pixel);
+      p += needed;
+      decoded += count;
+    }
+  }
+
+  // Bit 5 of the descriptor puts the first row at the top and bit 4 the first column at the right
+  if (descriptor & 0x20) flip_rows(image);
+  if (descriptor & 0x10) flip_columns(image);
+  return true;
+}
+
+bool decode_ppm(const uint8_t *data, size_t size, Image &image) {
+  const auto end = data + size;
+  auto p = data;
+
+  // Header fields are separated by whitespace and may be interleaved with # comments
+  auto next_field = [&p, end](uint32_t &value) -> bool {
+    for (;;) {
+      while (p < end && std::isspace(*p)) ++p;
+      if (p < end && *p == '#') {
+        while (p < end && *p != '\n') ++p;
+        continue;
+      }
+      break;
+    }
+    if (p == end || !std::isdigit(*p)) return false;
+    value = 0;
+    while (p < end && std::isdigit(*p)) value = value * 10 + (*p++ - '0');
+    return true;
+  };
+
+  uint32_t width, height, max_value;
+  if (size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+    spdlog::error("  not a binary PPM or PGM");
+    return false;
+  }
+  const uint32_t channels = data[1] == '6' ? 3 : 1;
+  p += 2;
+  if (!next_field(width) || !next_field(height) || !next_field(max_value) || p == end) {
+    spdlog::error("  PPM header is malformed");
+    return false;
+  }
+  if (max_value != 255) {
+    spdlog::error("  PPM has {} levels, only 8 bit PPMs are supported", max_value + 1);
+    return false;
+  }
+  // A single whitespace character ends the header
+  ++p;
+
+  const size_t bytes = static_cast<size_t>(width) * height * channels;
+  if (static_cast<size_t>(end - p) < bytes) {
+    spdlog::error("  PPM is truncated");
+    return false;
+  }
+  image.width = width;
+  image.height = height;
+  image.channels = channels;
+  image.pixels.assign(p, p + bytes);
+  // PPM rows run from the top
+  flip_rows(image);
+  return true;
+}
+
+bool load_image(const std::string &file_name, Image &image) {
+  std::ifstream in(file_name, std::ios::binary);
+  if (!in.is_open()) {
+    spdlog::error("Couldn't open image file {}", file_name);
+    return false;
+  }
+  in.seekg(0, std::ios::end);
+  auto file_size = static_cast<std::streamoff>(in.tellg());
+  in.seekg(0, std::ios::beg);
+  if (file_size < 0) {
+    spdlog::error("  couldn't determine size of {}", file_name);
+    return false;
+  }
+
+  ArenaScope scope;
+  ScratchVector<uint8_t> bytes(static_cast<size_t>(file_size));
+  in.read(reinterpret_cast<char *>(bytes.data()), file_size);
+  const auto size = static_cast<size_t>(in.gcount());
+
+  bool ok;
+  if (ends_with(file_name, ".tga")) {
+    ok = decode_tga(bytes.data(), size, image);
+  } else if (ends_with(file_name, ".ppm") || ends_with(file_name, ".pgm")) {
+    ok = decode_ppm(bytes.data(), size, image);
+  } else {
+    spdlog::error("  {} is not a TGA, PPM or PGM file", file_name);
+    return false;
+  }
+  if (!ok) spdlog::error("  while reading {}", file_name);
+  return ok;
+}
+
+void build_mips(std::vector<Image> &levels) {
+  if (levels.empty()) return;
+  levels.resize(1);
+  while (levels.back().width > 1 || levels.back().height > 1) {
+    const auto &src = levels.back();
+    Image dst;
+    dst.width = std::max<uint32_t>(src.width / 2, 1);
+    dst.height = std::max<uint32_t>(src.height / 2, 1);
+    dst.channels = src.channels;
+    dst.pixels.resize(static_cast<size_t>(dst.width) * dst.height * dst.channels);
+
+    // Average each 2x2 block, repeating the last row or column where the source is only one wide
+    const auto c = src.channels;
+    auto *out = dst.pixels.data();
+    for (uint32_t y = 0; y < dst.height; ++y) {
+      const auto y0 = std::min(2 * y, src.height - 1), y1 = std::min(2 * y + 1, src.height - 1);
+      const auto *row0 = src.pixels.data() + static_cast<size_t>(y0) * src.width * c;
+      const auto *row1 = src.pixels.data() + static_cast<size_t>(y1) * src.width * c;
+      for (uint32_t x = 0; x < dst.width; ++x) {
+        const auto x0 = std::min(2 * x, src.width - 1) * c, x1 = std::min(2 * x + 1, src.width - 1) * c;
+        for (uint32_t k = 0; k < c; ++k) {
+          *out++ = static_cast<uint8_t>((row0[x0 + k] + row0[x1 + k] + row1[x0 + k] + row1[x1 + k] + 2) / 4);
+        }
+      }
+    }
+    levels.push_back(std::move(dst));
+  }
+}
@@ -0,0 +1,228 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <exception>
+
+struct Job {
+  std::function<void()> fn;
+  JobHandle parent;
+
+  // The job's own function plus its unfinished children
+  std::atomic<int32_t> unfinished;
+
+  // Unfinished prerequisites, plus one until the job is run
+  std::atomic<int32_t> waiting_for;
+
+  std::atomic<bool> finished;
+
+  // Jobs to release when this one finishes
+  std::mutex mutex;
+  std::vector<JobHandle> dependents;
+
+  // The first exception thrown by the function or a child, rethrown by wait
+  std::exception_ptr exception;
+};
+
+namespace {
+  // The system whose worker this thread is, if any, and the worker's queue
+  thread_local const JobSystem *this_thread_system = nullptr;
+  thread_local size_t this_thread_queue = 0;
+
+  // Times wait finds nothing to run, yielding each time, before it sleeps
+  const int32_t WAIT_SPINS = 64;
+}
+
+JobSystem::JobSystem(size_t num_threads) : queued_{0}, waiting_{0}, stopping_{false} {
+  num_threads = std::max<size_t>(num_threads, 1);
+
+  // A queue per worker and the last for every other thread
+  for (size_t q = 0; q < num_threads; ++q) queues_.emplace_back(new WorkQueue());
+  for (size_t w = 0; w + 1 < num_threads; ++w) {
+    workers_.emplace_back(&JobSystem::worker_loop, this, w);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &w: workers_) w.join();
+}
+
+JobSystem &JobSystem::shared() {
+  static JobSystem system(std::max<size_t>(std::thread::hardware_concurrency(), 1));
+  return system;
+}
+
+JobHandle JobSystem::create_job(const std::function<void()> &fn, const JobHandle &parent) {
+  auto job = std::make_shared<Job>();
+  job->fn = fn;
+  job->parent = parent;
+  job->unfinished = 1;
+  job->waiting_for = 1;
+  job->finished = false;
+  if (parent) ++parent->unfinished;
+  return job;
+}
+
+void JobSystem::add_dependency(const JobHandle &job, const JobHandle &prerequisite) {
+  std::lock_guard<std::mutex> lock(prerequisite->mutex);
+  if (prerequisite->finished) return;
+  ++job->waiting_for;
+  prerequisite->dependents.push_back(job);
+}
+
+void JobSystem::run(const JobHandle &job) {
+  if (--job->waiting_for == 0) push(job);
+}
+
+void JobSystem::wait(const JobHandle &job) {
+  const auto queue = queue_index();
+  int32_t idle = 0;
+  while (!job->finished) {
+    auto next = next_job(queue);
+    if (next) {
+      execute(next);
+      idle = 0;
+    } else if (++idle < WAIT_SPINS) {
+      std::this_thread::yield();
+    } else {
+      // Nothing to run for a while, most likely because the job's last parts are running elsewhere
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      ++waiting_;
+      wait_wake_.wait(lock, [this, &job]() { return job->finished || queued_ > 0; });
+      --waiting_;
+      idle = 0;
+    }
+  }
+
+  std::exception_ptr exception;
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    exception = job->exception;
+  }
+  if (exception) std::rethrow_exception(exception);
+}
+
+bool JobSystem::is_finished(const JobHandle &job) {
+  return job->finished;
+}
+
+void JobSystem::parallel_for(size_t begin, size_t end, size_t grain,
+                             const std::function<void(size_t, size_t)> &body) {
+  if (end <= begin) return;
+
+  // Four chunks a thread leaves room to even out uneven chunks by stealing
+  const auto count = end - begin;
+  grain = std::max<size_t>(grain, 1);
+  const auto num_chunks = std::min(4 * num_threads(), count / grain);
+  if (num_chunks <= 1) {
+    body(begin, end);
+    return;
+  }
+
+  const auto chunk = (count + num_chunks - 1) / num_chunks;
+  auto all = create_job([]() {});
+  for (auto b = begin; b < end; b += chunk) {
+    auto e = std::min(end, b + chunk);
+    run(create_job([&body, b, e]() { body(b, e); }, all));
+  }
+  run(all);
+  wait(all);
+}
+
+void JobSystem::worker_loop(size_t queue) {
+  this_thread_system = this;
+  this_thread_queue = queue;
+  for (;;) {
+    auto job = next_job(queue);
+    if (job) {
+      execute(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [this]() { return stopping_ || queued_ > 0; });
+    if (stopping_) return;
+  }
+}
+
+void JobSystem::push(const JobHandle &job) {
+  // Counted first so that the count can't drop below zero when the job is taken straight away
+  ++queued_;
+  auto &queue = *queues_[queue_index()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(job);
+  }
+
+  // Taking the lock orders this with a worker deciding to sleep, so the wake up isn't lost
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+  wake_.notify_one();
+  if (waiting_ > 0) wait_wake_.notify_all();
+}
+
+JobHandle JobSystem::next_job(size_t queue) {
+  JobHandle job;
+  {
+    auto &own = *queues_[queue];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = own.jobs.back();
+      own.jobs.pop_back();
+    }
+  }
+  for (size_t i = 1; !job && i < queues_.size(); ++i) {
+    auto &other = *queues_[(queue + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(other.mutex);
+    if (!other.jobs.empty()) {
+      job = other.jobs.front();
+      other.jobs.pop_front();
+    }
+  }
+  if (job) --queued_;
+  return job;
+}
+
+void JobSystem::execute(const JobHandle &job) {
+  try {
+    job->fn();
+  } catch (...) {
+    // Kept for wait, so a worker isn't terminated and the job still finishes
+    std::lock_guard<std::mutex> lock(job->mutex);
+    if (!job->exception) job->exception = std::current_exception();
+  }
+  // Let go of whatever the function holds now rather than when the last handle goes
+  job->fn = nullptr;
+  finish_part(job);
+}
+
+void JobSystem::finish_part(const JobHandle &job) {
+  if (--job->unfinished > 0) return;
+
+  std::vector<JobHandle> dependents;
+  std::exception_ptr exception;
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->finished = true;
+    dependents.swap(job->dependents);
+    exception = job->exception;
+  }
+  if (waiting_ > 0) {
+    { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+    wait_wake_.notify_all();
+  }
+  for (const auto &d: dependents) run(d);
+  if (job->parent) {
+    if (exception) {
+      std::lock_guard<std::mutex> lock(job->parent->mutex);
+      if (!job->parent->exception) job->parent->exception = exception;
+    }
+    finish_part(job->parent);
+  }
+}
+
+size_t JobSystem::queue_index() const {
+  return this_thread_system == this ? this_thread_queue : queues_.size() - 1;
+}
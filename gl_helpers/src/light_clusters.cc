@@ -0,0 +1,352 @@
+#include "light_clusters.h"
+#include "gl_debug.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  const char *LIGHT_CLUSTER_GLSL = R"(
+uniform samplerBuffer light_data;
+uniform usamplerBuffer light_clusters;
+uniform usamplerBuffer light_indices;
+
+// Tiles across, tiles up, slices
+uniform vec4 light_grid;
+// Viewport width and height, then slice = log(depth) * z + w
+uniform vec4 light_depth;
+
+vec3 cluster_lighting(vec3 position, vec3 normal) {
+  vec2 tile = clamp(floor(gl_FragCoord.xy / light_depth.xy * light_grid.xy), vec2(0.0), light_grid.xy - 1.0);
+  float slice = clamp(floor(log(max(-position.z, 1e-6)) * light_depth.z + light_depth.w), 0.0, light_grid.z - 1.0);
+  int cluster = int((slice * light_grid.y + tile.y) * light_grid.x + tile.x);
+  uvec2 range = texelFetch(light_clusters, cluster).xy;
+
+  vec3 total = vec3(0.0);
+  for (uint i = 0u; i < range.y; ++i) {
+    int light = int(texelFetch(light_indices, int(range.x + i)).x);
+    vec4 position_radius = texelFetch(light_data, 2 * light);
+    vec3 to_light = position_radius.xyz - position;
+    float to_light_length = length(to_light);
+    float falloff = clamp(1.0 - to_light_length / position_radius.w, 0.0, 1.0);
+    float diffuse = max(dot(normal, to_light / max(to_light_length, 1e-6)), 0.0);
+    total += texelFetch(light_data, 2 * light + 1).rgb * diffuse * falloff * falloff;
+  }
+  return total;
+}
+)";
+
+  // Tile of a normalised device coordinate along an axis with count tiles
+  inline uint32_t tile_of(float ndc, uint32_t count) {
+    auto t = std::floor((ndc * 0.5f + 0.5f) * static_cast<float>(count));
+    return static_cast<uint32_t>(std::min(std::max(t, 0.0f), static_cast<float>(count - 1)));
+  }
+
+  // Whether a sphere reaches a box
+  inline bool touches(const glm::vec3 &center, float radius, const glm::vec3 &min, const glm::vec3 &max) {
+    auto d2 = 0.0f;
+    for (auto k = 0; k < 3; ++k) {
+      auto d = std::max(std::max(min[k] - center[k], center[k] - max[k]), 0.0f);
+      d2 += d * d;
+    }
+    return d2 <= radius * radius;
+  }
+}
+
+PointLight::PointLight() : position{0.0f}, radius{1.0f}, colour{1.0f} {}
+
+LightClusterOptions::LightClusterOptions()
+        : tiles_x{16}, tiles_y{9}, slices{24}, max_lights{4096}, max_light_indices{1u << 20} {}
+
+LightClusters::LightClusters(const LightClusterOptions &options)
+        : options_{options}, projection_{0.0f}, near_{0.1f}, far_{100.0f}, slice_scale_{0}, slice_bias_{0},
+          num_dropped_{0} {
+  options_.tiles_x = std::max(options_.tiles_x, 1u);
+  options_.tiles_y = std::max(options_.tiles_y, 1u);
+  options_.slices = std::max(options_.slices, 1u);
+  slice_hits_.resize(options_.slices);
+  slice_indices_.resize(options_.slices);
+  slice_ends_.resize(options_.slices);
+  cluster_ranges_.assign(2 * num_clusters(), 0);
+}
+
+uint32_t LightClusters::slice(float depth) const {
+  if (depth <= near_) return 0;
+  auto s = std::floor(std::log(depth) * slice_scale_ + slice_bias_);
+  return static_cast<uint32_t>(std::min(std::max(s, 0.0f), static_cast<float>(options_.slices - 1)));
+}
+
+void LightClusters::cluster_bounds(uint32_t cluster, glm::vec3 &min, glm::vec3 &max) const {
+  min = cluster_min_[cluster];
+  max = cluster_max_[cluster];
+}
+
+glm::vec4 LightClusters::grid_uniform() const {
+  return glm::vec4{static_cast<float>(options_.tiles_x), static_cast<float>(options_.tiles_y),
+                   static_cast<float>(options_.slices), 0.0f};
+}
+
+glm::vec4 LightClusters::depth_uniform(int32_t viewport_width, int32_t viewport_height) const {
+  return glm::vec4{static_cast<float>(viewport_width), static_cast<float>(viewport_height), slice_scale_, slice_bias_};
+}
+
+void LightClusters::update_clusters(const glm::mat4 &projection) {
+  projection_ = projection;
+  // A GL perspective matrix has z_clip = p22 z + p32 and w = -z
+  near_ = projection[3][2] / (projection[2][2] - 1.0f);
+  far_ = projection[3][2] / (projection[2][2] + 1.0f);
+  if (!(near_ > 0.0f) || !(far_ > near_)) {
+    spdlog::error("Light clusters need a perspective projection, near {} far {}", near_, far_);
+    near_ = 0.1f;
+    far_ = 100.0f;
+  }
+  const auto slices = static_cast<float>(options_.slices);
+  slice_scale_ = slices / std::log(far_ / near_);
+  slice_bias_ = -std::log(near_) * slice_scale_;
+
+  // At depth d, normalised device x is x p00 / d - p20, and y likewise
+  slice_depths_.resize(options_.slices + 1);
+  for (uint32_t s = 0; s <= options_.slices; ++s) {
+    slice_depths_[s] = near_ * std::pow(far_ / near_, static_cast<float>(s) / slices);
+  }
+  cluster_min_.resize(num_clusters());
+  cluster_max_.resize(num_clusters());
+  for (uint32_t s = 0; s < options_.slices; ++s) {
+    const float depths[2] = {slice_depths_[s], slice_depths_[s + 1]};
+    for (uint32_t ty = 0; ty < options_.tiles_y; ++ty) {
+      for (uint32_t tx = 0; tx < options_.tiles_x; ++tx) {
+        const float ndc_x[2] = {-1.0f + 2.0f * tx / options_.tiles_x, -1.0f + 2.0f * (tx + 1) / options_.tiles_x};
+        const float ndc_y[2] = {-1.0f + 2.0f * ty / options_.tiles_y, -1.0f + 2.0f * (ty + 1) / options_.tiles_y};
+        glm::vec3 min{std::numeric_limits<float>::max()}, max{-std::numeric_limits<float>::max()};
+        for (auto d: depths) {
+          for (auto k = 0; k < 2; ++k) {
+            auto x = d * (ndc_x[k] + projection[2][0]) / projection[0][0];
+            auto y = d * (ndc_y[k] + projection[2][1]) / projection[1][1];
+            min.x = std::min(min.x, x);
+            max.x = std::max(max.x, x);
+            min.y = std::min(min.y, y);
+            max.y = std::max(max.y, y);
+          }
+        }
+        min.z = -depths[1];
+        max.z = -depths[0];
+        auto c = cluster(tx, ty, s);
+        cluster_min_[c] = min;
+        cluster_max_[c] = max;
+      }
+    }
+  }
+}
+
+void LightClusters::assign(const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection) {
+  if (cluster_min_.empty() || projection != projection_) update_clusters(projection);
+
+  // Each light's view space sphere and the range of clusters it may reach
+  const auto num_lights = std::min(lights.size(), static_cast<size_t>(options_.max_lights));
+  bins_.resize(num_lights);
+  light_data_.resize(8 * num_lights);
+  parallel_for(0, num_lights, 256, [&](size_t begin, size_t end) {
+    for (auto l = begin; l < end; ++l) {
+      const auto &light = lights[l];
+      auto &bin = bins_[l];
+      bin.center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+      bin.radius = light.radius;
+      auto *data = &light_data_[8 * l];
+      data[0] = bin.center.x;
+      data[1] = bin.center.y;
+      data[2] = bin.center.z;
+      data[3] = light.radius;
+      data[4] = light.colour.x;
+      data[5] = light.colour.y;
+      data[6] = light.colour.z;
+      data[7] = 0.0f;
+
+      bin.first_slice = 1;
+      bin.last_slice = 0;
+      const auto depth = -bin.center.z, r = bin.radius;
+      if (!(r > 0.0f) || depth + r < near_ || depth - r > far_) continue;
+
+      // Spheres reaching the near plane may cover any part of the screen; the others cover their box's projection
+      bin.first_x = bin.first_y = 0;
+      bin.last_x = options_.tiles_x - 1;
+      bin.last_y = options_.tiles_y - 1;
+      if (depth - r > near_) {
+        auto min_x = std::numeric_limits<float>::max(), min_y = min_x, max_x = -min_x, max_y = -min_x;
+        for (auto c = 0; c < 8; ++c) {
+          auto corner = bin.center + glm::vec3{(c & 1) ? r : -r, (c & 2) ? r : -r, (c & 4) ? r : -r};
+          auto clip = projection * glm::vec4(corner, 1.0f);
+          min_x = std::min(min_x, clip.x / clip.w);
+          max_x = std::max(max_x, clip.x / clip.w);
+          min_y = std::min(min_y, clip.y / clip.w);
+          max_y = std::max(max_y, clip.y / clip.w);
+        }
+        if (max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f) continue;
+        bin.first_x = tile_of(min_x, options_.tiles_x);
+        bin.last_x = tile_of(max_x, options_.tiles_x);
+        bin.first_y = tile_of(min_y, options_.tiles_y);
+        bin.last_y = tile_of(max_y, options_.tiles_y);
+      }
+      bin.first_slice = slice(std::max(depth - r, near_));
+      bin.last_slice = slice(depth + r);
+    }
+  });
+
+  // Each slice gathers its own clusters' lists, so no two jobs write the same list. The lights
+  // reaching a cluster are collected in light order, then sorted by cluster keeping that order.
+  const auto per_slice = options_.tiles_x * options_.tiles_y;
+  const auto p00 = projection[0][0], p11 = projection[1][1], p20 = projection[2][0], p21 = projection[2][1];
+  parallel_for(0, options_.slices, 1, [&](size_t begin, size_t end) {
+    for (auto s = static_cast<uint32_t>(begin); s < end; ++s) {
+      auto &ends = slice_ends_[s];
+      auto &hits = slice_hits_[s];
+      auto &indices = slice_indices_[s];
+      ends.assign(per_slice, 0);
+      hits.clear();
+      const auto *min = &cluster_min_[s * per_slice], *max = &cluster_max_[s * per_slice];
+      for (uint32_t l = 0; l < bins_.size(); ++l) {
+        const auto &bin = bins_[l];
+        if (s < bin.first_slice || s > bin.last_slice) continue;
+
+        // The part of the sphere in the slice lies in a box no wider than its widest section there,
+        // whose corners bound its projection. Near the eye this is much tighter than the whole sphere.
+        const auto depth = -bin.center.z, r = bin.radius;
+        const auto d0 = std::max(slice_depths_[s], depth - r), d1 = std::min(slice_depths_[s + 1], depth + r);
+        const auto dz = depth < d0 ? d0 - depth : (depth > d1 ? depth - d1 : 0.0f);
+        const auto h = std::sqrt(std::max(r * r - dz * dz, 0.0f));
+        float ndc_min[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+        float ndc_max[2] = {-ndc_min[0], -ndc_min[1]};
+        for (auto d: {d0, d1}) {
+          for (auto sign: {-1.0f, 1.0f}) {
+            auto x = p00 * (bin.center.x + sign * h) / d - p20;
+            auto y = p11 * (bin.center.y + sign * h) / d - p21;
+            ndc_min[0] = std::min(ndc_min[0], x);
+            ndc_max[0] = std::max(ndc_max[0], x);
+            ndc_min[1] = std::min(ndc_min[1], y);
+            ndc_max[1] = std::max(ndc_max[1], y);
+          }
+        }
+        if (ndc_max[0] < -1.0f || ndc_min[0] > 1.0f || ndc_max[1] < -1.0f || ndc_min[1] > 1.0f) continue;
+        const auto x0 = std::max(tile_of(ndc_min[0], options_.tiles_x), bin.first_x);
+        const auto x1 = std::min(tile_of(ndc_max[0], options_.tiles_x), bin.last_x);
+        const auto y0 = std::max(tile_of(ndc_min[1], options_.tiles_y), bin.first_y);
+        const auto y1 = std::min(tile_of(ndc_max[1], options_.tiles_y), bin.last_y);
+        for (auto ty = y0; ty <= y1; ++ty) {
+          for (auto tx = x0; tx <= x1; ++tx) {
+            auto c = ty * options_.tiles_x + tx;
+            if (!touches(bin.center, bin.radius, min[c], max[c])) continue;
+            ++ends[c];
+            hits.push_back(c);
+            hits.push_back(l);
+          }
+        }
+      }
+      uint32_t total = 0;
+      for (auto &e: ends) {
+        auto count = e;
+        e = total;
+        total += count;
+      }
+      indices.resize(total);
+      for (size_t h = 0; h < hits.size(); h += 2) indices[ends[hits[h]]++] = hits[h + 1];
+    }
+  });
+
+  // Place the lists one after another, cutting them short once the index limit is reached
+  num_dropped_ = 0;
+  size_t total = 0;
+  for (uint32_t s = 0; s < options_.slices; ++s) {
+    const auto &ends = slice_ends_[s];
+    for (uint32_t c = 0; c < per_slice; ++c) {
+      auto count = ends[c] - (c ? ends[c - 1] : 0);
+      auto kept = static_cast<uint32_t>(std::min<size_t>(count, options_.max_light_indices - total));
+      num_dropped_ += count - kept;
+      cluster_ranges_[2 * (s * per_slice + c)] = static_cast<uint32_t>(total);
+      cluster_ranges_[2 * (s * per_slice + c) + 1] = kept;
+      total += kept;
+    }
+  }
+  light_indices_.resize(total);
+  parallel_for(0, options_.slices, 1, [&](size_t begin, size_t end) {
+    for (auto s = static_cast<uint32_t>(begin); s < end; ++s) {
+      const auto &ends = slice_ends_[s];
+      for (uint32_t c = 0; c < per_slice; ++c) {
+        const auto *range = &cluster_ranges_[2 * (s * per_slice + c)];
+        if (!range[1]) continue;
+        std::memcpy(&light_indices_[range[0]], &slice_indices_[s][c ? ends[c - 1] : 0], range[1] * sizeof(uint32_t));
+      }
+    }
+  });
+}
+
+LightClusterBuffers::LightClusterBuffers() : buffers_{0, 0, 0}, textures_{0, 0, 0}, capacities_{0, 0, 0} {}
+
+LightClusterBuffers::~LightClusterBuffers() {
+  destroy();
+}
+
+void LightClusterBuffers::destroy() {
+  if (textures_[0]) glDeleteTextures(3, textures_);
+  if (buffers_[0]) glDeleteBuffers(3, buffers_);
+  for (auto k = 0; k < 3; ++k) {
+    textures_[k] = buffers_[k] = 0;
+    capacities_[k] = 0;
+  }
+}
+
+bool LightClusterBuffers::create(const LightClusterOptions &options) {
+  destroy();
+  const size_t clusters = static_cast<size_t>(options.tiles_x) * options.tiles_y * options.slices;
+  capacities_[0] = static_cast<size_t>(options.max_lights) * 8 * sizeof(float);
+  capacities_[1] = clusters * 2 * sizeof(uint32_t);
+  capacities_[2] = static_cast<size_t>(options.max_light_indices) * sizeof(uint32_t);
+  const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+  const char *labels[3] = {"Light data", "Light clusters", "Light indices"};
+
+  glGenBuffers(3, buffers_);
+  glGenTextures(3, textures_);
+  for (auto k = 0; k < 3; ++k) {
+    if (!buffers_[k] || !textures_[k]) {
+      spdlog::error("Couldn't create light cluster buffers");
+      destroy();
+      return false;
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers_[k]);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(std::max(capacities_[k], sizeof(float))), nullptr,
+                 GL_DYNAMIC_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, textures_[k]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[k], buffers_[k]);
+    label_gl_object(GlObject::BUFFER, buffers_[k], labels[k]);
+    label_gl_object(GlObject::TEXTURE, textures_[k], labels[k]);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+  return true;
+}
+
+void LightClusterBuffers::record_upload(const LightClusters &clusters, CommandList &list) const {
+  if (!is_good()) return;
+  const void *data[3] = {clusters.light_data().data(), clusters.cluster_ranges().data(),
+                         clusters.light_indices().data()};
+  const size_t sizes[3] = {clusters.light_data().size() * sizeof(float),
+                           clusters.cluster_ranges().size() * sizeof(uint32_t),
+                           clusters.light_indices().size() * sizeof(uint32_t)};
+  for (auto k = 0; k < 3; ++k) {
+    if (sizes[k] > capacities_[k]) {
+      spdlog::error("Light clusters need {} bytes but the buffers were made for {}", sizes[k], capacities_[k]);
+      return;
+    }
+  }
+  for (auto k = 0; k < 3; ++k) list.update_buffer(buffers_[k], 0, data[k], sizes[k]);
+}
+
+void LightClusterBuffers::record_bind(CommandList &list, uint32_t first_unit) const {
+  for (uint32_t k = 0; k < 3; ++k) list.bind_texture(first_unit + k, GL_TEXTURE_BUFFER, textures_[k]);
+}
+
+const char *light_cluster_glsl() {
+  return LIGHT_CLUSTER_GLSL;
+}
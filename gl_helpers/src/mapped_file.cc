@@ -0,0 +1,52 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog-inl.h"
+
+MappedFile::MappedFile() : data_{nullptr}, size_{0}, is_empty_{false} {}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+bool MappedFile::open(const std::string &file_name) {
+  close();
+  auto fd = ::open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    spdlog::error("Couldn't open {}", file_name);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    spdlog::error("Couldn't stat {}", file_name);
+    ::close(fd);
+    return false;
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  if (!size_) {
+    is_empty_ = true;
+    ::close(fd);
+    return true;
+  }
+  auto *mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping holds its own reference to the file
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    spdlog::error("Couldn't map {}", file_name);
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<const uint8_t *>(mapped);
+  return true;
+}
+
+void MappedFile::close() {
+  if (data_) munmap(const_cast<uint8_t *>(data_), size_);
+  data_ = nullptr;
+  size_ = 0;
+  is_empty_ = false;
+}
@@ -2,35 +2,113 @@
 #include "gl_common.h"
 
 #include <string>
-#include <map>
-#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <limits>
 
+#include "arena.h"
+#include "gl_debug.h"
 #include "string_utils.h"
+#include "simplify.h"
+#include "meshlet.h"
+#include "triangle_bvh.h"
+#include "parallel.h"
+#include "vertex_format.h"
 #include "spdlog/spdlog-inl.h"
 
 
+namespace {
+  /*
+   * Parse exactly n floats, logging if there are too few.
+   * Surplus values are logged unless extra is supplied, in which case it is set instead.
+   */
+  bool parse_nf(const char *begin, const char *end, float *values, int32_t n, const char *n_txt,
+                bool *extra = nullptr) {
+    auto count = parse_floats(begin, end, values, n);
+    if (count < 0) {
+      spdlog::error("  invalid value in : {}", std::string(begin, end));
+      return false;
+    }
+    if (count < n) {
+      spdlog::error("  expected {} values in : {}", n_txt, std::string(begin, end));
+      return false;
+    }
+    if (extra) {
+      *extra = count > n;
+    } else if (count > n) {
+      spdlog::warn("  found {} values, expected only {} in : {}", count, n_txt, std::string(begin, end));
+    }
+    return true;
+  }
+
+  // Parse a decimal integer from [begin, end) which is known to be an optional '-' then digits
+  inline int32_t parse_index(const char *begin, const char *end) {
+    const bool negative = (begin < end && *begin == '-');
+    int32_t v = 0;
+    for (auto p = negative ? begin + 1 : begin; p < end; ++p) v = v * 10 + (*p - '0');
+    return negative ? -v : v;
+  }
+}
+
+int32_t parse_floats(const char *begin, const char *end, float *values, int32_t max_values) {
+  int32_t count = 0;
+  auto p = begin;
+  while (true) {
+    while (p < end && is_space(*p)) ++p;
+    if (p == end) break;
+    if (count < max_values) {
+      char *next;
+      values[count] = std::strtof(p, &next);
+      if (next == p || next > end) return -1;
+      p = next;
+    }
+    while (p < end && !is_space(*p)) ++p;
+    ++count;
+  }
+  return count;
+}
+
 bool parse_face_elements(const std::string &face_elem,
                          int32_t *vertex_idx,
                          bool include_normal,
                          int32_t *normal_idx,
                          bool include_tex_coord,
                          int32_t *tex_coord_idx
+) {
+  return parse_face_elements(face_elem.data(), face_elem.data() + face_elem.size(),
+                             vertex_idx,
+                             include_normal, normal_idx,
+                             include_tex_coord, tex_coord_idx);
+}
+
+bool parse_face_elements(const char *begin, const char *end,
+                         int32_t *vertex_idx,
+                         bool include_normal,
+                         int32_t *normal_idx,
+                         bool include_tex_coord,
+                         int32_t *tex_coord_idx
 ) {
   using namespace std;
 
-  if (face_elem.empty()) {
+  if (begin == end) {
     spdlog::error("  invalid (empty) element string");
     return false;
   }
 
-  auto f = face_elem;
-  trim(f);
+  trim_range(begin, end);
+  const int32_t len = static_cast<int32_t>(end - begin);
 
   int32_t idx1 = -1, idx2 = -1;
-  for (auto i = 0; i < f.size(); ++i) {
-    const char c = f[i];
-    if (!isdigit(c) && (c != '/')) {
-      spdlog::error("  invalid element string: {}", f);
+  for (auto i = 0; i < len; ++i) {
+    const char c = begin[i];
+    // A '-' may only open an index, making it relative to the end of the list so far
+    const bool is_sign = (c == '-')
+                         && (i == 0 || begin[i - 1] == '/')
+                         && (i + 1 < len && isdigit(begin[i + 1]));
+    if (!isdigit(c) && (c != '/') && !is_sign) {
+      spdlog::error("  invalid element string: {}", string(begin, end));
       return false;
     }
     if (c == '/') {
@@ -39,20 +117,21 @@ bool parse_face_elements(const std::string &face_elem,
       } else if (idx2 == -1) {
         idx2 = i;
       } else {
-        spdlog::error("  invalid form. Too many '/'. {}", f);
+        spdlog::error("  invalid form. Too many '/'. {}", string(begin, end));
         return false;
       }
     }
   }
 
   // Sanity check slash positions
-  if (idx1 == 0 || idx1 == f.size() - 1 || idx2 == f.size() - 1) {
-    spdlog::error("  invalid form: {}", f);
+  if (len == 0 || idx1 == 0 || idx1 == len - 1 || idx2 == len - 1) {
+    spdlog::error("  invalid form: {}", string(begin, end));
     return false;
   }
 
-  bool normal_idx_present = (idx1 != -1 && ((idx2 == -1) || (idx2 - idx1 > 1)));
-  bool tex_coord_idx_present = (idx2 != -1);
+  // Elements are v, v/vt, v//vn or v/vt/vn
+  bool tex_coord_idx_present = (idx1 != -1 && ((idx2 == -1) || (idx2 - idx1 > 1)));
+  bool normal_idx_present = (idx2 != -1);
 
 
   if (vertex_idx == nullptr) {
@@ -60,8 +139,8 @@ bool parse_face_elements(const std::string &face_elem,
     return false;
   }
   *vertex_idx = (idx1 == -1)
-                ? stoi(f)
-                : stoi(f.substr(0, idx1));
+                ? parse_index(begin, end)
+                : parse_index(begin, begin + idx1);
   if (!include_tex_coord && !include_normal) return true;
 
 
@@ -71,12 +150,10 @@ bool parse_face_elements(const std::string &face_elem,
       return false;
     }
     if (!normal_idx_present) {
-      spdlog::error("  normal_idx requested but not present: {}", f);
+      spdlog::error("  normal_idx requested but not present: {}", string(begin, end));
       return false;
     }
-    *normal_idx = (idx2 == -1)
-                  ? stoi(f.substr(idx1 + 1))
-                  : stoi(f.substr(idx1 + 1, idx2 - idx1 - 1));
+    *normal_idx = parse_index(begin + idx2 + 1, end);
   }
   if (!include_tex_coord) return true;
 
@@ -85,189 +162,797 @@ bool parse_face_elements(const std::string &face_elem,
     return false;
   }
   if (!tex_coord_idx_present) {
-    spdlog::error("  tex_coord_idx requested but not present: {}", f);
+    spdlog::error("  tex_coord_idx requested but not present: {}", string(begin, end));
     return false;
   }
-  *tex_coord_idx = stoi(f.substr(idx2 + 1));
+  *tex_coord_idx = (idx2 == -1)
+                   ? parse_index(begin + idx1 + 1, end)
+                   : parse_index(begin + idx1 + 1, begin + idx2);
   return true;
 }
 
 bool parse_3f(const std::string &args, float &x, float &y, float &z) {
-  std::string t_args = args;
-  trim(t_args);
-  auto tokens = tokenise(t_args, ' ');
-  if (tokens.size() < 3) {
-    spdlog::error("  expected three values in : {}", args);
-    return false;
-  }
-  if (tokens.size() > 3) {
-    spdlog::warn("  found {} values, expected only three in : {}", tokens.size(), args);
-  }
-  x = std::stof(tokens[0]);
-  y = std::stof(tokens[1]);
-  z = std::stof(tokens[2]);
+  float values[3];
+  if (!parse_nf(args.data(), args.data() + args.size(), values, 3, "three")) return false;
+  x = values[0];
+  y = values[1];
+  z = values[2];
   return true;
 }
 
 bool parse_2f(const std::string &args, float &x, float &y) {
-  std::string t_args = args;
-  trim(t_args);
-  auto tokens = tokenise(t_args, ' ');
-  if (tokens.size() < 2) {
-    spdlog::error("  expected two values in : {}", args);
-    return false;
-  }
-  if (tokens.size() > 2) {
-    spdlog::warn("  found {} values, expected only two in : {}", tokens.size(), args);
-  }
-  x = std::stof(tokens[0]);
-  y = std::stof(tokens[1]);
+  float values[2];
+  if (!parse_nf(args.data(), args.data() + args.size(), values, 2, "two")) return false;
+  x = values[0];
+  y = values[1];
   return true;
 }
 
-bool parse_face(const std::string &args, int32_t *vertices,
+bool parse_face(const std::string &args, RawMeshData &data,
                 bool include_normals,
-                int32_t *normals,
-                bool include_tex_coords,
-                int32_t *tex_coords) {
-  auto args_t = args;
-  trim(args_t);
-  auto face_elems = tokenise(args_t, ' ');
-  if (face_elems.size() != 3) {
-    spdlog::error("  ignoring {}, expected 3 tokens", args_t);
-    return false;
+                bool include_tex_coords) {
+  return parse_face(args.data(), args.data() + args.size(), data,
+                    include_normals, include_tex_coords);
+}
+
+bool parse_face(const char *begin, const char *end, RawMeshData &data,
+                bool include_normals,
+                bool include_tex_coords) {
+  trim_range(begin, end);
+
+  const auto first_corner = data.corner_vertex.size();
+  auto rollback = [&data, first_corner]() {
+    data.corner_vertex.resize(first_corner);
+    data.corner_normal.resize(first_corner);
+    data.corner_tex.resize(first_corner);
+  };
+
+  auto num_elems = 0;
+  for (auto p = begin; p < end;) {
+    while (p < end && is_space(*p)) ++p;
+    if (p == end) break;
+    auto e = p;
+    while (e < end && !is_space(*e)) ++e;
+
+    int32_t v = -1, n = -1, t = -1;
+    auto ok = parse_face_elements(p, e, &v,
+                                  include_normals, &n,
+                                  include_tex_coords, &t);
+    if (!ok) {
+      spdlog::error("  failed to parse entry {} in {}", num_elems, std::string(begin, end));
+      rollback();
+      return false;
+    }
+    // Correct indices as they are one based or relative in the OBJ file
+    ok = resolve_index(v, data.num_vertices())
+         && (!include_normals || resolve_index(n, data.num_normals()))
+         && (!include_tex_coords || resolve_index(t, data.num_tex_coords()));
+    if (!ok) {
+      spdlog::error("  invalid index in entry {} in {}", num_elems, std::string(begin, end));
+      rollback();
+      return false;
+    }
+    data.corner_vertex.push_back(v);
+    data.corner_normal.push_back(n);
+    data.corner_tex.push_back(t);
+    ++num_elems;
+    p = e;
   }
-  if (include_normals && normals == nullptr) {
-    spdlog::error("  normals requested but normalIdx is null");
+  if (num_elems < 3) {
+    spdlog::error("  ignoring {}, expected at least 3 tokens", std::string(begin, end));
+    rollback();
     return false;
   }
-  if (include_tex_coords && tex_coords == nullptr) {
-    spdlog::error("  tex coords requested but tex_coords is null");
-    return false;
+  data.face_offsets.push_back(static_cast<uint32_t>(data.corner_vertex.size()));
+  return true;
+}
+
+namespace {
+  // Twice the signed area of the 2D triangle (a, b, c). Positive when counter clockwise.
+  inline float cross_2d(const float *u, const float *v, uint32_t a, uint32_t b, uint32_t c) {
+    return (u[b] - u[a]) * (v[c] - v[a]) - (v[b] - v[a]) * (u[c] - u[a]);
   }
+}
 
-  for (auto i = 0; i < 3; ++i) {
-    bool ok = true;
-    if (include_normals && include_tex_coords) {
-      ok = parse_face_elements(face_elems[i], vertices + i,
-                               true, normals + i,
-                               true, tex_coords + i);
-    } else if (include_normals) {
-      ok = parse_face_elements(face_elems[i], vertices + i,
-                               true, normals + i,
-                               false, nullptr);
-    } else if (include_tex_coords) {
-      ok = parse_face_elements(face_elems[i], vertices + i,
-                               false, nullptr,
-                               true, tex_coords + i);
-    } else {
-      ok = parse_face_elements(face_elems[i], vertices + i);
+void triangulate_face(RawMeshData &data, size_t face, bool ear_clip, TriangulationScratch &scratch) {
+  const auto first = data.face_offsets[face];
+  const auto n = data.face_offsets[face + 1] - first;
+  auto &tris = data.triangles;
+  auto emit = [&tris, first](uint32_t a, uint32_t b, uint32_t c) {
+    tris.push_back(first + a);
+    tris.push_back(first + b);
+    tris.push_back(first + c);
+  };
+  auto fan = [&emit, n]() {
+    for (uint32_t c = 1; c + 1 < n; ++c) emit(0, c, c + 1);
+  };
+  if (n == 3 || !ear_clip) {
+    fan();
+    return;
+  }
+
+  // Newell normal; its components are twice the polygon's area projected on each axis plane
+  const auto *cv = data.corner_vertex.data() + first;
+  const auto *px = data.pos_x.data(), *py = data.pos_y.data(), *pz = data.pos_z.data();
+  float nx = 0, ny = 0, nz = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    auto a = cv[i], b = cv[(i + 1) % n];
+    nx += (py[a] - py[b]) * (pz[a] + pz[b]);
+    ny += (pz[a] - pz[b]) * (px[a] + px[b]);
+    nz += (px[a] - px[b]) * (py[a] + py[b]);
+  }
+
+  // Project onto the plane of the dominant axis, oriented so the polygon winds counter clockwise
+  const float *src_u, *src_v;
+  float orientation;
+  if (std::fabs(nx) >= std::fabs(ny) && std::fabs(nx) >= std::fabs(nz)) {
+    src_u = py, src_v = pz, orientation = nx;
+  } else if (std::fabs(ny) >= std::fabs(nz)) {
+    src_u = pz, src_v = px, orientation = ny;
+  } else {
+    src_u = px, src_v = py, orientation = nz;
+  }
+  if (orientation == 0) {
+    fan();
+    return;
+  }
+  scratch.u.resize(n);
+  scratch.v.resize(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    scratch.u[i] = (orientation < 0) ? -src_u[cv[i]] : src_u[cv[i]];
+    scratch.v[i] = src_v[cv[i]];
+  }
+  const auto *u = scratch.u.data(), *v = scratch.v.data();
+
+  auto convex = true;
+  for (uint32_t i = 0; i < n && convex; ++i) {
+    convex = cross_2d(u, v, (i + n - 1) % n, i, (i + 1) % n) >= 0;
+  }
+  if (convex) {
+    fan();
+    return;
+  }
+
+  auto &remaining = scratch.remaining;
+  remaining.resize(n);
+  for (uint32_t i = 0; i < n; ++i) remaining[i] = i;
+
+  while (remaining.size() > 3) {
+    const auto count = remaining.size();
+    auto clipped = false;
+    for (size_t k = 0; k < count && !clipped; ++k) {
+      auto ip = remaining[(k + count - 1) % count], ic = remaining[k], in = remaining[(k + 1) % count];
+      // Reflex or degenerate corners can't be ears
+      if (cross_2d(u, v, ip, ic, in) <= 0) continue;
+
+      auto contains_other = false;
+      for (size_t m = 0; m < count && !contains_other; ++m) {
+        auto im = remaining[m];
+        if (im == ip || im == ic || im == in) continue;
+        contains_other = cross_2d(u, v, ip, ic, im) >= 0
+                         && cross_2d(u, v, ic, in, im) >= 0
+                         && cross_2d(u, v, in, ip, im) >= 0;
+      }
+      if (contains_other) continue;
+
+      emit(ip, ic, in);
+      remaining.erase(remaining.begin() + static_cast<std::ptrdiff_t>(k));
+      clipped = true;
     }
-    if (!ok) {
-      spdlog::error("  failed to parse entry {} in {}", i, args_t);
-      return false;
+    // Self intersecting or otherwise degenerate; fan what is left rather than loop forever
+    if (!clipped) break;
+  }
+  for (size_t k = 1; k + 1 < remaining.size(); ++k) {
+    emit(remaining[0], remaining[k], remaining[k + 1]);
+  }
+}
+
+RawGroup::RawGroup() : material_id{-1}, first_triangle{0} {}
+
+RawMeshData::RawMeshData() : face_offsets(1, 0) {}
+
+void RawMeshData::clear() {
+  pos_x.clear();
+  pos_y.clear();
+  pos_z.clear();
+  norm_x.clear();
+  norm_y.clear();
+  norm_z.clear();
+  tex_u.clear();
+  tex_v.clear();
+  corner_vertex.clear();
+  corner_normal.clear();
+  corner_tex.clear();
+  tan_x.clear();
+  tan_y.clear();
+  tan_z.clear();
+  tan_w.clear();
+  corner_tangent.clear();
+  face_offsets.assign(1, 0);
+  triangles.clear();
+  face_smoothing.clear();
+  groups.clear();
+  materials.clear();
+  material_libs.clear();
+}
+
+namespace {
+  /*
+   * Begin a new triangle run with the given state. A run that has no triangles
+   * yet is updated in place so that runs of consecutive state records collapse.
+   */
+  void start_group(RawMeshData &data, const RawGroup &state) {
+    auto first = static_cast<uint32_t>(data.num_triangles());
+    if (data.groups.empty() || data.groups.back().first_triangle != first) {
+      data.groups.push_back(state);
+    } else {
+      data.groups.back() = state;
     }
+    data.groups.back().first_triangle = first;
   }
-  // Correct all indices as they are off by one from OBJ file
-  for (auto i = 0; i < 3; ++i) {
-    vertices[i]--;
-    if (include_normals) normals[i]--;
-    if (include_tex_coords) tex_coords[i]--;
+
+  // The remainder of a record after its type token, trimmed
+  inline std::string record_args(const char *b, const char *e, size_t type_len) {
+    b += type_len;
+    trim_range(b, e);
+    return std::string(b, e);
   }
-  return true;
 }
 
 bool parse_raw_data(std::ifstream &f,
-                    std::vector<std::tuple<float, float, float>> &vertices,
-                    std::vector<std::vector<std::tuple<int32_t, int32_t, int32_t>>> &faces,
+                    RawMeshData &data,
                     bool include_normals,
-                    std::vector<std::tuple<float, float, float>> *normals,
                     bool include_tex_coords,
-                    std::vector<std::tuple<float, float>> *tex_coords
+                    bool ear_clip
 ) {
   using namespace std;
 
-  string line;
-  while (getline(f, line)) {
-    trim(line);
-    if (line.empty()) continue;
-    if (line[0] == '#') continue;
-
-    istringstream is(line);
-    string type;
-    is >> type;
-    to_lower(type);
-    if ("v" == type) {
-      float x, y, z;
-      auto ok = parse_3f(line.substr(1), x, y, z);
-      if (!ok) {
-        spdlog::error("  ignored vertex line: {}", line);
+  // Slurp the file so that we can size every stream before parsing
+  f.seekg(0, ios::end);
+  auto file_size = static_cast<streamoff>(f.tellg());
+  f.seekg(0, ios::beg);
+  if (file_size < 0) {
+    spdlog::error("  couldn't determine file size");
+    return false;
+  }
+  ArenaScope scope;
+  ScratchVector<char> buffer(static_cast<size_t>(file_size));
+  f.read(buffer.data(), file_size);
+  const char *const buf_begin = buffer.data();
+  const char *const buf_end = buf_begin + f.gcount();
+
+  // First pass counts records so each array is allocated once.
+  size_t num_v = 0, num_vn = 0, num_vt = 0, num_f = 0, num_corners = 0;
+  for (auto p = buf_begin; p < buf_end;) {
+    auto eol = static_cast<const char *>(memchr(p, '\n', buf_end - p));
+    if (!eol) eol = buf_end;
+    auto b = p, e = eol;
+    p = eol + 1;
+    trim_range(b, e);
+    if (b == e) continue;
+    if (is_type(b, e, "v")) ++num_v;
+    else if (is_type(b, e, "vn")) ++num_vn;
+    else if (is_type(b, e, "vt")) ++num_vt;
+    else if (is_type(b, e, "f")) {
+      ++num_f;
+      // Count the space separated corners after the 'f'
+      for (auto q = b + 1; q < e;) {
+        while (q < e && is_space(*q)) ++q;
+        if (q == e) break;
+        ++num_corners;
+        while (q < e && !is_space(*q)) ++q;
+      }
+    }
+  }
+  if (include_normals && num_vn == 0) {
+    // Faces can't reference normals that don't exist; leave them for the caller to generate
+    spdlog::info("  normals requested but the file has none");
+    include_normals = false;
+  }
+  data.pos_x.reserve(num_v);
+  data.pos_y.reserve(num_v);
+  data.pos_z.reserve(num_v);
+  if (include_normals) {
+    data.norm_x.reserve(num_vn);
+    data.norm_y.reserve(num_vn);
+    data.norm_z.reserve(num_vn);
+  }
+  if (include_tex_coords) {
+    data.tex_u.reserve(num_vt);
+    data.tex_v.reserve(num_vt);
+  }
+  data.corner_vertex.reserve(num_corners);
+  data.corner_normal.reserve(num_corners);
+  data.corner_tex.reserve(num_corners);
+  data.face_offsets.reserve(num_f + 1);
+  data.triangles.reserve(num_corners > 2 * num_f ? 3 * (num_corners - 2 * num_f) : 0);
+  data.face_smoothing.reserve(num_f);
+
+  TriangulationScratch scratch;
+  RawGroup state;
+  uint32_t smoothing = 0;
+  start_group(data, state);
+
+  // Tallies of records that would otherwise be logged one line at a time
+  size_t num_ignored = 0, num_extra_values = 0;
+  string first_ignored;
+  bool extra;
+
+  for (auto p = buf_begin; p < buf_end;) {
+    auto eol = static_cast<const char *>(memchr(p, '\n', buf_end - p));
+    if (!eol) eol = buf_end;
+    auto b = p, e = eol;
+    p = eol + 1;
+    trim_range(b, e);
+    if (b == e) continue;
+    if (*b == '#') continue;
+
+    if (is_type(b, e, "v")) {
+      float xyz[3];
+      if (!parse_nf(b + 1, e, xyz, 3, "three", &extra)) {
+        spdlog::error("  ignored vertex line: {}", string(b, e));
         continue;
       }
-      vertices.emplace_back(x, y, z);
-    } else if ("vt" == type) {
+      if (extra) ++num_extra_values;
+      data.pos_x.push_back(xyz[0]);
+      data.pos_y.push_back(xyz[1]);
+      data.pos_z.push_back(xyz[2]);
+    } else if (is_type(b, e, "vt")) {
       if (!include_tex_coords) continue;
 
-      float u, v;
-      auto ok = parse_2f(line.substr(2), u, v);
-      if (!ok) {
-        spdlog::error("  ignored texture coord line: {}", line);
+      float uv[2];
+      if (!parse_nf(b + 2, e, uv, 2, "two", &extra)) {
+        spdlog::error("  ignored texture coord line: {}", string(b, e));
         continue;
       }
-      tex_coords->emplace_back(u, v);
-    } else if ("vn" == type) {
+      if (extra) ++num_extra_values;
+      data.tex_u.push_back(uv[0]);
+      data.tex_v.push_back(uv[1]);
+    } else if (is_type(b, e, "vn")) {
       if (!include_normals) continue;
 
-      float x, y, z;
-      auto ok = parse_3f(line.substr(2), x, y, z);
-      if (!ok) {
-        spdlog::error("  ignored normal line: {}", line);
+      float xyz[3];
+      if (!parse_nf(b + 2, e, xyz, 3, "three", &extra)) {
+        spdlog::error("  ignored normal line: {}", string(b, e));
         continue;
       }
-      normals->emplace_back(x, y, z);
-    } else if ("f" == type) {
-      int32_t v[3]{-1, -1, -1},
-              n[3]{-1, -1, -1},
-              t[3]{-1, -1, -1};
-      auto ok = parse_face(line.substr(1), v,
-                           include_normals, n,
-                           include_tex_coords, t);
-      if (!ok) {
-        spdlog::error("  ignored bad face definition: {}", line);
+      if (extra) ++num_extra_values;
+      data.norm_x.push_back(xyz[0]);
+      data.norm_y.push_back(xyz[1]);
+      data.norm_z.push_back(xyz[2]);
+    } else if (is_type(b, e, "f")) {
+      if (!parse_face(b + 1, e, data, include_normals, include_tex_coords)) {
+        spdlog::error("  ignored bad face definition: {}", string(b, e));
         continue;
       }
-      faces.emplace_back();
-      faces.back().emplace_back(v[0], n[0], t[0]);
-      faces.back().emplace_back(v[1], n[1], t[1]);
-      faces.back().emplace_back(v[2], n[2], t[2]);
+      triangulate_face(data, data.num_faces() - 1, ear_clip, scratch);
+      data.face_smoothing.push_back(smoothing);
+    } else if (is_type(b, e, "o")) {
+      state.object = record_args(b, e, 1);
+      state.group.clear();
+      start_group(data, state);
+    } else if (is_type(b, e, "g")) {
+      state.group = record_args(b, e, 1);
+      start_group(data, state);
+    } else if (is_type(b, e, "usemtl")) {
+      auto name = record_args(b, e, 6);
+      auto it = find(data.materials.begin(), data.materials.end(), name);
+      state.material_id = static_cast<int32_t>(it - data.materials.begin());
+      if (it == data.materials.end()) data.materials.push_back(name);
+      start_group(data, state);
+    } else if (is_type(b, e, "mtllib")) {
+      // One or more space separated file names
+      for (auto q = b + 6; q < e;) {
+        while (q < e && is_space(*q)) ++q;
+        if (q == e) break;
+        auto qe = q;
+        while (qe < e && !is_space(*qe)) ++qe;
+        data.material_libs.emplace_back(q, qe);
+        q = qe;
+      }
+    } else if (is_type(b, e, "s")) {
+      auto arg = record_args(b, e, 1);
+      to_lower(arg);
+      smoothing = (arg.empty() || arg == "off") ? 0 : static_cast<uint32_t>(strtoul(arg.c_str(), nullptr, 10));
     } else {
-      // Ignore l, object, vp, materials etc.
-      spdlog::warn("  ignored : {}", line);
+      // Ignore l, vp, curves etc.
+      if (num_ignored++ == 0) first_ignored.assign(b, e);
     }
   }
-  if (vertices.empty()) {
+  if (num_extra_values) {
+    spdlog::warn("  {} lines had more values than expected, extras ignored", num_extra_values);
+  }
+  if (num_ignored) {
+    spdlog::warn("  ignored {} unsupported records, first was : {}", num_ignored, first_ignored);
+  }
+  // Drop a trailing run with no triangles, unless it is the only one
+  if (data.groups.size() > 1 && data.groups.back().first_triangle == data.num_triangles()) {
+    data.groups.pop_back();
+  }
+  if (data.pos_x.empty()) {
     spdlog::error("  no vertices found.");
     return false;
   }
   return true;
 }
 
+namespace {
+  // Report the first out of range entry in a corner index stream
+  bool check_indices(const std::vector<int32_t> &idx, size_t limit, const char *what) {
+    for (size_t c = 0; c < idx.size(); ++c) {
+      if (idx[c] < 0 || static_cast<size_t>(idx[c]) >= limit) {
+        spdlog::error("  corner {} references {} {} of {}", c, what, idx[c], limit);
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+namespace {
+  // Where each attribute of a vertex comes from in raw: its corner index stream, the
+  // multiplier that mixes that index into the corner's hash, and the values it indexes
+  template<typename Attribute>
+  struct RawAttribute;
+
+  template<>
+  struct RawAttribute<vertex_attribute::Position> {
+    static const uint32_t HASH = 0x9E3779B1u;
+
+    static const int32_t *corners(const RawMeshData &raw) { return raw.corner_vertex.data(); }
+
+    static void copy(const RawMeshData &raw, int32_t i, float *out) {
+      out[0] = raw.pos_x[i];
+      out[1] = raw.pos_y[i];
+      out[2] = raw.pos_z[i];
+    }
+  };
+
+  template<>
+  struct RawAttribute<vertex_attribute::Normal> {
+    static const uint32_t HASH = 0x85EBCA77u;
+
+    static const int32_t *corners(const RawMeshData &raw) { return raw.corner_normal.data(); }
+
+    static void copy(const RawMeshData &raw, int32_t i, float *out) {
+      out[0] = raw.norm_x[i];
+      out[1] = raw.norm_y[i];
+      out[2] = raw.norm_z[i];
+    }
+  };
+
+  template<>
+  struct RawAttribute<vertex_attribute::TexCoord> {
+    static const uint32_t HASH = 0xC2B2AE3Du;
+
+    static const int32_t *corners(const RawMeshData &raw) { return raw.corner_tex.data(); }
+
+    static void copy(const RawMeshData &raw, int32_t i, float *out) {
+      out[0] = raw.tex_u[i];
+      out[1] = raw.tex_v[i];
+    }
+  };
+
+  template<>
+  struct RawAttribute<vertex_attribute::Tangent> {
+    static const uint32_t HASH = 0x27D4EB2Fu;
+
+    static const int32_t *corners(const RawMeshData &raw) { return raw.corner_tangent.data(); }
+
+    static void copy(const RawMeshData &raw, int32_t i, float *out) {
+      out[0] = raw.tan_x[i];
+      out[1] = raw.tan_y[i];
+      out[2] = raw.tan_z[i];
+      out[3] = raw.tan_w[i];
+    }
+  };
+
+  // The corner index streams of a list of attributes, which together key a unique vertex
+  template<typename... Attributes>
+  struct CornerKey {
+    explicit CornerKey(const RawMeshData &) {}
+
+    uint32_t hash(size_t) const { return 0; }
+
+    bool same(size_t, size_t) const { return true; }
+  };
+
+  template<typename First, typename... Rest>
+  struct CornerKey<First, Rest...> {
+    explicit CornerKey(const RawMeshData &raw) : stream{RawAttribute<First>::corners(raw)}, rest{raw} {}
+
+    uint32_t hash(size_t c) const {
+      return static_cast<uint32_t>(stream[c]) * RawAttribute<First>::HASH ^ rest.hash(c);
+    }
+
+    bool same(size_t a, size_t b) const { return (stream[a] == stream[b]) & rest.same(a, b); }
+
+    const int32_t *stream;
+    CornerKey<Rest...> rest;
+  };
+
+  // Copies each attribute of one corner into an interleaved vertex
+  struct GatherCorner {
+    const RawMeshData &raw;
+    uint32_t corner;
+    float *out;
+
+    template<typename Attribute>
+    void operator()(Attribute, uint32_t offset) const {
+      RawAttribute<Attribute>::copy(raw, RawAttribute<Attribute>::corners(raw)[corner], out + offset);
+    }
+  };
+
+  /*
+   * Number the distinct combinations of the format's attribute indices over the
+   * corners of raw in order of first use and interleave the attributes of each.
+   * The key of a corner is just the streams of the format, so the hash, compare
+   * and gather loops have no test of which attributes are wanted.
+   */
+  template<typename... Attributes>
+  void build_unique_vertices(const RawMeshData &raw,
+                             VertexFormat<Attributes...>,
+                             ScratchVector<uint32_t> &corner_to_vertex,
+                             std::vector<float> &vertex_data) {
+    typedef VertexFormat<Attributes...> Format;
+    const CornerKey<Attributes...> key(raw);
+    const auto num_corners = raw.num_corners();
+
+    // Hash every corner key in a single straight pass
+    ScratchVector<uint32_t> hashes(num_corners);
+    for (size_t c = 0; c < num_corners; ++c) hashes[c] = key.hash(c);
+
+    // Open addressed table of unique vertex ids, keyed through each vertex's first corner
+    size_t table_size = 16;
+    while (table_size < num_corners * 2) table_size <<= 1;
+    const auto mask = table_size - 1;
+    ScratchVector<int32_t> table(table_size, -1);
+    ScratchVector<uint32_t> first_corner;
+    first_corner.reserve(num_corners);
+
+    for (size_t c = 0; c < num_corners; ++c) {
+      auto slot = hashes[c] & mask;
+      while (true) {
+        auto id = table[slot];
+        if (id == -1) {
+          id = static_cast<int32_t>(first_corner.size());
+          table[slot] = id;
+          first_corner.push_back(static_cast<uint32_t>(c));
+          corner_to_vertex[c] = id;
+          break;
+        }
+        if (key.same(first_corner[id], c)) {
+          corner_to_vertex[c] = id;
+          break;
+        }
+        slot = (slot + 1) & mask;
+      }
+    }
+
+    // Gather attributes for each unique vertex
+    const auto num_vertices = first_corner.size();
+    vertex_data.resize(num_vertices * Format::STRIDE);
+    for (size_t v = 0; v < num_vertices; ++v) {
+      GatherCorner gather{raw, first_corner[v], vertex_data.data() + v * Format::STRIDE};
+      Format::for_each_attribute(gather);
+    }
+  }
+
+  struct BuildUniqueVertices {
+    const RawMeshData &raw;
+    ScratchVector<uint32_t> &corner_to_vertex;
+    std::vector<float> &vertex_data;
+
+    template<typename Format>
+    bool operator()(Format format) const {
+      build_unique_vertices(raw, format, corner_to_vertex, vertex_data);
+      return true;
+    }
+  };
+}
+
+bool build_vertex_data(const RawMeshData &raw,
+                       std::vector<float> &vertex_data,
+                       std::vector<uint32_t> &indices,
+                       bool include_normals,
+                       bool include_tex_coords,
+                       bool include_tangents,
+                       std::vector<SubMesh> *submeshes
+) {
+  using namespace std;
+
+  ArenaScope scope;
+  if (!check_indices(raw.corner_vertex, raw.num_vertices(), "vertex")) return false;
+  if (include_normals && !check_indices(raw.corner_normal, raw.num_normals(), "normal")) return false;
+  if (include_tex_coords && !check_indices(raw.corner_tex, raw.num_tex_coords(), "tex coord")) return false;
+  if (include_tangents && (raw.corner_tangent.size() != raw.num_corners()
+                           || !check_indices(raw.corner_tangent, raw.tan_x.size(), "tangent"))) {
+    spdlog::error("  tangents requested but not generated");
+    return false;
+  }
+
+  ScratchVector<uint32_t> corner_to_vertex(raw.num_corners());
+  if (!dispatch_vertex_format(include_normals, include_tex_coords, include_tangents,
+                              BuildUniqueVertices{raw, corner_to_vertex, vertex_data})) {
+    spdlog::error("  tangents need both normals and tex coords");
+    return false;
+  }
+
+  // Map each run of triangles onto a submesh, merging runs with the same object, group and material
+  const auto num_triangles = static_cast<uint32_t>(raw.num_triangles());
+  ScratchVector<RawGroup> runs(raw.groups.begin(), raw.groups.end());
+  if (runs.empty()) runs.emplace_back();
+  ScratchVector<SubMesh> ranges;
+  ScratchVector<const RawGroup *> range_keys;
+  ScratchVector<uint32_t> run_range(runs.size());
+  for (size_t r = 0; r < runs.size(); ++r) {
+    const auto &run = runs[r];
+    auto end = (r + 1 < runs.size()) ? runs[r + 1].first_triangle : num_triangles;
+    size_t id = 0;
+    while (id < range_keys.size()
+           && !(range_keys[id]->object == run.object
+                && range_keys[id]->group == run.group
+                && range_keys[id]->material_id == run.material_id)) {
+      ++id;
+    }
+    if (id == range_keys.size()) {
+      range_keys.push_back(&run);
+      ranges.emplace_back();
+      ranges.back().name = run.object.empty() || run.group.empty()
+                           ? run.object + run.group
+                           : run.object + "/" + run.group;
+      ranges.back().material_id = run.material_id;
+    }
+    ranges[id].index_count += 3 * (end - run.first_triangle);
+    run_range[r] = static_cast<uint32_t>(id);
+  }
+  uint32_t offset = 0;
+  for (auto &range: ranges) {
+    range.index_offset = offset;
+    offset += range.index_count;
+  }
+
+  // Emit each run's triangles at the next free position in its range
+  const auto *tris = raw.triangles.data();
+  indices.resize(raw.triangles.size());
+  ScratchVector<uint32_t> cursor(ranges.size());
+  for (size_t id = 0; id < ranges.size(); ++id) cursor[id] = ranges[id].index_offset;
+  for (size_t r = 0; r < runs.size(); ++r) {
+    auto begin = 3 * runs[r].first_triangle;
+    auto end = 3 * ((r + 1 < runs.size()) ? runs[r + 1].first_triangle : num_triangles);
+    auto &out = cursor[run_range[r]];
+    for (auto i = begin; i < end; ++i) {
+      indices[out++] = corner_to_vertex[tris[i]];
+    }
+  }
+
+  if (submeshes) {
+    submeshes->clear();
+    for (const auto &range: ranges) {
+      if (range.index_count) submeshes->push_back(range);
+    }
+  }
+  return true;
+}
+
+SubMesh::SubMesh() : index_offset{0}, index_count{0}, material_id{-1} {}
+
+MeshLod::MeshLod() : target_ratio{1.0f}, error{0.0f} {}
+
+void build_lods(const std::vector<float> &vertex_data, size_t stride,
+                std::vector<uint32_t> &indices,
+                const std::vector<SubMesh> &submeshes,
+                const std::vector<float> &ratios,
+                std::vector<MeshLod> &lods) {
+  using namespace std;
+
+  lods.assign(1, MeshLod());
+  lods[0].submeshes = submeshes;
+  if (ratios.empty()) return;
+
+  // Submeshes are independent so simplify them concurrently, each as its own chain
+  const auto num_vertices = vertex_data.size() / stride;
+  const auto num_levels = ratios.size();
+  vector<vector<vector<uint32_t>>> level_indices(submeshes.size(), vector<vector<uint32_t>>(num_levels));
+  vector<vector<float>> level_error(submeshes.size(), vector<float>(num_levels, 0));
+  parallel_for(0, submeshes.size(), 1, [&](size_t begin, size_t end) {
+    for (auto s = begin; s < end; ++s) {
+      const auto &sm = submeshes[s];
+      const uint32_t *src = indices.data() + sm.index_offset;
+      auto src_count = static_cast<size_t>(sm.index_count);
+      float error = 0;
+      for (size_t l = 0; l < num_levels; ++l) {
+        auto target = 3 * static_cast<size_t>(ratios[l] * static_cast<float>(sm.index_count / 3));
+        // Errors accumulate down the chain so the level's error is at least its parent's
+        error = max(error, simplify_mesh(vertex_data.data(), num_vertices, stride,
+                                         src, src_count, target, numeric_limits<float>::max(),
+                                         level_indices[s][l]));
+        level_error[s][l] = error;
+        src = level_indices[s][l].data();
+        src_count = level_indices[s][l].size();
+      }
+    }
+  });
+
+  for (size_t l = 0; l < num_levels; ++l) {
+    MeshLod lod;
+    lod.target_ratio = ratios[l];
+    for (size_t s = 0; s < submeshes.size(); ++s) {
+      SubMesh sm = submeshes[s];
+      sm.index_offset = static_cast<uint32_t>(indices.size());
+      sm.index_count = static_cast<uint32_t>(level_indices[s][l].size());
+      indices.insert(indices.end(), level_indices[s][l].begin(), level_indices[s][l].end());
+      lod.error = max(lod.error, level_error[s][l]);
+      lod.submeshes.push_back(sm);
+    }
+    lods.push_back(lod);
+  }
+}
+
+size_t select_lod(const Mesh &mesh, float distance, float pixel_scale, float max_pixel_error) {
+  if (mesh.lods.empty()) return 0;
+  // Nothing can be coarsened for a camera inside the mesh
+  if (distance <= 0) return 0;
+  size_t level = 0;
+  for (size_t l = 1; l < mesh.lods.size(); ++l) {
+    if (mesh.lods[l].error * pixel_scale / distance > max_pixel_error) break;
+    level = l;
+  }
+  return level;
+}
+
+Bounds::Bounds() : min{0, 0, 0}, max{0, 0, 0}, center{0, 0, 0}, radius{0} {}
+
+Bounds compute_bounds(const float *vertex_data, size_t num_vertices, size_t stride) {
+  using namespace std;
+
+  Bounds bounds;
+  if (!num_vertices) return bounds;
+  for (auto k = 0; k < 3; ++k) bounds.min[k] = bounds.max[k] = vertex_data[k];
+  for (size_t v = 1; v < num_vertices; ++v) {
+    const auto *p = vertex_data + v * stride;
+    for (auto k = 0; k < 3; ++k) {
+      bounds.min[k] = min(bounds.min[k], p[k]);
+      bounds.max[k] = max(bounds.max[k], p[k]);
+    }
+  }
+  for (auto k = 0; k < 3; ++k) bounds.center[k] = (bounds.min[k] + bounds.max[k]) * 0.5f;
+
+  // Tighter than the box's circumsphere whenever the mesh doesn't fill the corners
+  float r2 = 0;
+  for (size_t v = 0; v < num_vertices; ++v) {
+    const auto *p = vertex_data + v * stride;
+    float dx = p[0] - bounds.center[0], dy = p[1] - bounds.center[1], dz = p[2] - bounds.center[2];
+    r2 = max(r2, dx * dx + dy * dy + dz * dz);
+  }
+  bounds.radius = sqrt(r2);
+  return bounds;
+}
+
+Mesh::Mesh() : vao{0}, vbo{0}, ebo{0}, num_elements{0}, gpu_bytes{0}, stride{0} {}
+
+MeshLoadOptions::MeshLoadOptions()
+        : pos_attr{0}, include_normals{false}, norm_attr{0},
+          include_textures{false}, tx_attr{0},
+          include_tangents{false}, tan_attr{0}, ear_clip{false},
+          normal_mode{NormalMode::GENERATE_IF_MISSING},
+          normal_weighting{NormalWeighting::AREA},
+          crease_angle{180.0f}, meshlet_triangles{0},
+          build_triangle_bvh{false}, upload{true}, keep_vertex_data{false} {}
+
 /*
  * Load meshes from OBJ files and then
+ * * Generate vertex normals if they are wanted and not supplied
  * * Remap vertices to allow use of ELEMENT indexing for unique vertices
- * * Reorder vertices into triangle strips to optimise draw calls/render time.
+ * * Group triangles into one contiguous range per object, group and material
+ *   so that every submesh is drawn from the same VBO and EBO.
+ * * Optionally cut each range into meshlets, build a triangle BVH for ray casts
+ *   and build simplified levels of detail.
  *
  */
 bool load_obj(const std::string &obj_file_name,
-              uint32_t &vao,
-              uint32_t &vbo,
-              uint32_t &ebo,
-              uint32_t &num_elements,
-              uint32_t pos_attr,
-              bool include_normals,
-              uint32_t norm_attr,
-              bool include_textures,
-              uint32_t tx_attr
+              Mesh &mesh,
+              const MeshLoadOptions &options
 ) {
   using namespace std;
 
@@ -279,88 +964,184 @@ bool load_obj(const std::string &obj_file_name,
     return false;
   }
 
-  vector<tuple<float, float, float>> vertices;
-  vector<tuple<float, float, float>> normals;
-  vector<tuple<float, float>> tex_coords;
-  vector<vector<tuple<int32_t, int32_t, int32_t>>> faces;
+  // Build stages take their working storage from this thread's scratch arena; it is all released on return
+  ArenaScope scope;
+  const auto include_normals = options.include_normals;
+  const auto include_textures = options.include_textures;
+  RawMeshData raw;
 
   spdlog::info("1. Parse raw data");
-  if (!parse_raw_data(f, vertices, faces, include_normals, &normals,
-                      include_textures, &tex_coords)) {
+  auto parse_normals = include_normals && options.normal_mode != NormalMode::GENERATE;
+  if (!parse_raw_data(f, raw, parse_normals, include_textures, options.ear_clip)) {
     return false;
   }
-  spdlog::info("Found {:3} vertices", vertices.size());
-  if (include_normals) spdlog::info("      {:3} normals", normals.size());
-  if (include_textures) spdlog::info("      {:3} tex_coords", tex_coords.size());
-  spdlog::info("      {:3} faces", faces.size());
+  spdlog::info("Found {:3} vertices", raw.num_vertices());
+  if (include_normals) spdlog::info("      {:3} normals", raw.num_normals());
+  if (include_textures) spdlog::info("      {:3} tex_coords", raw.num_tex_coords());
+  spdlog::info("      {:3} faces", raw.num_faces());
+  spdlog::info("      {:3} triangles", raw.num_triangles());
+
+  if (include_normals && raw.num_normals() == 0) {
+    if (options.normal_mode == NormalMode::FROM_FILE) {
+      spdlog::error("Normals requested but {} has none", obj_file_name);
+      return false;
+    }
+    spdlog::info("   Generating normals");
+    generate_normals(raw, options.normal_weighting, options.crease_angle);
+  }
+  const auto include_tangents = options.include_tangents;
+  if (include_tangents) {
+    if (!include_normals || !include_textures) {
+      spdlog::error("Tangents need both normals and tex coords to be included");
+      return false;
+    }
+    spdlog::info("   Generating tangents");
+    if (!generate_tangents(raw)) return false;
+  }
 
   spdlog::info("2. Identifying unique faces");
   vector<float> vertex_data;
-  vector<int32_t> eidx;
-
-  map<tuple<int32_t, int32_t, int32_t>, int32_t> vtx_lookup;
-  auto gidx = 0;
-  for (const auto &face: faces) {
-    for (const auto &face_elem: face) {
-      auto it = vtx_lookup.find(face_elem);
-      if (it != vtx_lookup.end()) {
-        eidx.push_back(it->second);
-        continue;
-      }
-      // New combo. Create a new vertex.
-      auto vidx = get<0>(face_elem);
-      vertex_data.push_back(get<0>(vertices.at(vidx)));
-      vertex_data.push_back(get<1>(vertices.at(vidx)));
-      vertex_data.push_back(get<2>(vertices.at(vidx)));
-
-      if (include_normals) {
-        auto nidx = get<1>(face_elem);
-        vertex_data.push_back(get<0>(normals.at(nidx)));
-        vertex_data.push_back(get<1>(normals.at(nidx)));
-        vertex_data.push_back(get<2>(normals.at(nidx)));
-      }
-      if (include_textures) {
-        auto tidx = get<2>(face_elem);
-        vertex_data.push_back(get<0>(tex_coords.at(tidx)));
-        vertex_data.push_back(get<1>(tex_coords.at(tidx)));
-      }
+  vector<uint32_t> eidx;
+  if (!build_vertex_data(raw, vertex_data, eidx,
+                         include_normals, include_textures, include_tangents,
+                         &mesh.submeshes)) {
+    return false;
+  }
+  spdlog::info("      {:3} submeshes", mesh.submeshes.size());
+  mesh.materials = raw.materials;
+  mesh.material_libs = raw.material_libs;
 
-      vtx_lookup.emplace(face_elem, gidx);
-      eidx.push_back(gidx);
-      ++gidx;
-    }
+  if (!finish_mesh(obj_file_name, vertex_data, eidx, include_normals, include_textures, include_tangents,
+                   options, mesh)) {
+    return false;
+  }
+  spdlog::info("   Peak scratch memory {} KB", (scope.peak() + 1023) / 1024);
+  return true;
+}
+
+bool finish_mesh(const std::string &name,
+                 std::vector<float> &vertex_data,
+                 std::vector<uint32_t> &eidx,
+                 bool include_normals,
+                 bool include_textures,
+                 bool include_tangents,
+                 const MeshLoadOptions &options,
+                 Mesh &mesh
+) {
+  using namespace std;
+
+  const auto stride = vertex_stride(include_normals, include_textures, include_tangents);
+  if (!stride) {
+    spdlog::error("Tangents need both normals and tex coords to be included");
+    return false;
+  }
+  mesh.bounds = compute_bounds(vertex_data.data(), vertex_data.size() / stride, stride);
+  mesh.meshlets.clear();
+  if (options.meshlet_triangles) {
+    build_meshlets(vertex_data.data(), stride, eidx, mesh.submeshes, options.meshlet_triangles, mesh.meshlets);
+    spdlog::info("      {:3} meshlets", mesh.meshlets.size());
+  }
+  mesh.triangle_bvh.reset();
+  if (options.build_triangle_bvh) {
+    mesh.triangle_bvh = std::make_shared<TriangleBvh>();
+    build_triangle_bvh(vertex_data.data(), stride, eidx.data(), eidx.size(), *mesh.triangle_bvh);
+    spdlog::info("      {:3} triangle BVH nodes", mesh.triangle_bvh->bvh.nodes.size());
+  }
+  if (!options.lod_ratios.empty()) {
+    spdlog::info("   Building {} levels of detail", options.lod_ratios.size());
+  }
+  build_lods(vertex_data, stride, eidx, mesh.submeshes, options.lod_ratios, mesh.lods);
+  for (size_t l = 1; l < mesh.lods.size(); ++l) {
+    uint32_t count = 0;
+    for (const auto &sm: mesh.lods[l].submeshes) count += sm.index_count;
+    spdlog::info("      LOD {} : {:3} triangles, error {}", l, count / 3, mesh.lods[l].error);
+  }
+
+  // Elements of the full resolution mesh; simplified levels follow them in the EBO
+  mesh.num_elements = 0;
+  for (const auto &sm: mesh.submeshes) mesh.num_elements += sm.index_count;
+  mesh.stride = stride;
+  mesh.gpu_bytes = 0;
+  mesh.vertex_data.clear();
+  mesh.indices.clear();
+  if (!options.upload) {
+    mesh.vertex_data.swap(vertex_data);
+    mesh.indices.swap(eidx);
+    return true;
   }
 
   spdlog::info("3. Building VAO, VBO and EBO");
   // VAO
 
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
+  glGenVertexArrays(1, &mesh.vao);
+  glBindVertexArray(mesh.vao);
 
-  auto vtx_sz = 4 * (3 + (include_normals ? 3 : 0) + (include_textures ? 2 : 0));
-  auto num_vertices = gidx;
+  auto vtx_sz = 4 * stride;
+  auto num_vertices = vertex_data.size() * 4 / vtx_sz;
 
   // Vertex locations
-  glGenBuffers(1, &vbo);
-  glGenBuffers(1, &ebo);
+  glGenBuffers(1, &mesh.vbo);
+  glGenBuffers(1, &mesh.ebo);
 
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
   glBufferData(GL_ARRAY_BUFFER, vtx_sz * num_vertices, vertex_data.data(), GL_STATIC_DRAW);
-  glEnableVertexAttribArray(pos_attr);
-  glVertexAttribPointer(pos_attr, 3, GL_FLOAT, GL_FALSE, vtx_sz, (GLvoid *) nullptr);
+  enable_vertex_attributes(options, include_normals, include_textures, include_tangents);
 
-  if (include_normals) {
-    glEnableVertexAttribArray(norm_attr);
-    glVertexAttribPointer(norm_attr, 3, GL_FLOAT, GL_FALSE, vtx_sz, (GLvoid *) 12);
-  }
-  if (include_textures) {
-    glEnableVertexAttribArray(tx_attr);
-    glVertexAttribPointer(tx_attr, 2, GL_FLOAT, GL_FALSE, vtx_sz, (GLvoid *) 24);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, eidx.size() * sizeof(uint32_t), eidx.data(), GL_STATIC_DRAW);
+  label_gl_object(GlObject::VERTEX_ARRAY, mesh.vao, name);
+  label_gl_object(GlObject::BUFFER, mesh.vbo, name, "vertices");
+  label_gl_object(GlObject::BUFFER, mesh.ebo, name, "indices");
+  mesh.gpu_bytes = vtx_sz * num_vertices + eidx.size() * sizeof(uint32_t);
+
+  if (options.keep_vertex_data) {
+    mesh.vertex_data.swap(vertex_data);
+    mesh.indices.swap(eidx);
   }
+  return true;
+}
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, eidx.size() * sizeof(int32_t), eidx.data(), GL_STATIC_DRAW);
+bool load_obj(const std::string &obj_file_name,
+              Mesh &mesh,
+              uint32_t pos_attr,
+              bool include_normals,
+              uint32_t norm_attr,
+              bool include_textures,
+              uint32_t tx_attr,
+              bool ear_clip
+) {
+  MeshLoadOptions options;
+  options.pos_attr = pos_attr;
+  options.include_normals = include_normals;
+  options.norm_attr = norm_attr;
+  options.include_textures = include_textures;
+  options.tx_attr = tx_attr;
+  options.ear_clip = ear_clip;
+  return load_obj(obj_file_name, mesh, options);
+}
 
-  num_elements = eidx.size();
+bool load_obj(const std::string &obj_file_name,
+              uint32_t &vao,
+              uint32_t &vbo,
+              uint32_t &ebo,
+              uint32_t &num_elements,
+              uint32_t pos_attr,
+              bool include_normals,
+              uint32_t norm_attr,
+              bool include_textures,
+              uint32_t tx_attr,
+              bool ear_clip
+) {
+  Mesh mesh;
+  if (!load_obj(obj_file_name, mesh, pos_attr,
+                include_normals, norm_attr,
+                include_textures, tx_attr,
+                ear_clip)) {
+    return false;
+  }
+  vao = mesh.vao;
+  vbo = mesh.vbo;
+  ebo = mesh.ebo;
+  num_elements = mesh.num_elements;
   return true;
-}
\ No newline at end of file
+}
@@ -0,0 +1,274 @@
+#include "mesh_bake.h"
+#include "mesh_import.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "string_utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "spdlog/spdlog-inl.h"
+
+const char *const MESH_BAKE_MANIFEST = "bake_manifest.txt";
+
+namespace {
+  // First line of a manifest. Bumping the version rebakes everything.
+  const char *const MANIFEST_HEADER = "mesh_bake 1";
+
+  // What a source was last baked from
+  struct ManifestEntry {
+    uint64_t content_hash;
+    uint64_t options_hash;
+  };
+
+  std::string extension_of(const std::string &name) {
+    auto dot = name.find_last_of('.');
+    auto slash = name.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return std::string();
+    auto extension = name.substr(dot);
+    return to_lower(extension);
+  }
+
+  inline bool is_source(const std::string &name) {
+    const auto extension = extension_of(name);
+    return extension == ".obj" || extension == ".ply" || extension == ".glb";
+  }
+
+  std::string join(const std::string &dir, const std::string &name) {
+    if (dir.empty()) return name;
+    if (name.empty()) return dir;
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+  }
+
+  // The baked name of a source: its path with the extension replaced
+  std::string baked_name(const std::string &source) {
+    return source.substr(0, source.size() - extension_of(source).size()) + ".mesh";
+  }
+
+  bool file_size(const std::string &path, size_t &size) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    size = static_cast<size_t>(st.st_size);
+    return true;
+  }
+
+  // Add the sources under dir/relative to sources, by their paths relative to dir. Hidden entries are skipped.
+  bool list_sources(const std::string &dir, const std::string &relative, std::vector<std::string> &sources) {
+    const auto path = join(dir, relative);
+    auto *d = opendir(path.c_str());
+    if (!d) {
+      spdlog::error("Couldn't read directory {} : {}", path, std::strerror(errno));
+      return false;
+    }
+    auto ok = true;
+    while (auto *entry = readdir(d)) {
+      const std::string name = entry->d_name;
+      if (name.empty() || name[0] == '.') continue;
+      const auto child = join(relative, name);
+      struct stat st;
+      if (stat(join(dir, child).c_str(), &st) != 0) continue;
+      if (S_ISDIR(st.st_mode)) {
+        ok = list_sources(dir, child, sources) && ok;
+      } else if (S_ISREG(st.st_mode) && is_source(name)) {
+        sources.push_back(child);
+      }
+    }
+    closedir(d);
+    return ok;
+  }
+
+  // mkdir -p. Safe to race with another thread making the same directories.
+  bool make_directories(const std::string &path) {
+    for (size_t end = 1; end <= path.size(); ++end) {
+      if (end < path.size() && path[end] != '/') continue;
+      const auto prefix = path.substr(0, end);
+      if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+        spdlog::error("Couldn't make directory {} : {}", prefix, std::strerror(errno));
+        return false;
+      }
+    }
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+      spdlog::error("{} isn't a directory", path);
+      return false;
+    }
+    return true;
+  }
+
+  /*
+   * Lines of the content hash, options hash and source path, the hashes as 16
+   * hex digits. A missing or unreadable manifest is an empty one.
+   */
+  void read_manifest(const std::string &file_name, std::unordered_map<std::string, ManifestEntry> &entries) {
+    std::ifstream in(file_name);
+    std::string line;
+    if (!std::getline(in, line) || line != MANIFEST_HEADER) return;
+    while (std::getline(in, line)) {
+      if (line.size() < 35 || line[16] != ' ' || line[33] != ' ') continue;
+      ManifestEntry entry;
+      entry.content_hash = std::strtoull(line.substr(0, 16).c_str(), nullptr, 16);
+      entry.options_hash = std::strtoull(line.substr(17, 16).c_str(), nullptr, 16);
+      entries[line.substr(34)] = entry;
+    }
+  }
+
+  bool write_manifest(const std::string &file_name,
+                      const std::vector<BakeResult> &results,
+                      const std::vector<uint64_t> &content_hashes,
+                      uint64_t options_hash) {
+    const auto temp_name = file_name + ".tmp";
+    {
+      std::ofstream out(temp_name);
+      out << MANIFEST_HEADER << '\n';
+      char hashes[40];
+      for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i].status == BakeStatus::FAILED) continue;
+        std::snprintf(hashes, sizeof(hashes), "%016llx %016llx ",
+                      static_cast<unsigned long long>(content_hashes[i]),
+                      static_cast<unsigned long long>(options_hash));
+        out << hashes << results[i].source << '\n';
+      }
+      if (!out) {
+        spdlog::error("Couldn't write {}", temp_name);
+        return false;
+      }
+    }
+    if (std::rename(temp_name.c_str(), file_name.c_str()) != 0) {
+      spdlog::error("Couldn't replace {} : {}", file_name, std::strerror(errno));
+      return false;
+    }
+    return true;
+  }
+}
+
+MeshBakeOptions::MeshBakeOptions() : force{false} {}
+
+BakeResult::BakeResult() : status{BakeStatus::FAILED}, ms{0}, source_bytes{0}, baked_bytes{0} {}
+
+uint64_t hash_bytes(const uint8_t *data, size_t size, uint64_t seed) {
+  const uint64_t prime = 0x100000001b3ull;
+  auto hash = seed;
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * prime;
+  }
+  for (; i < size; ++i) hash = (hash ^ data[i]) * prime;
+  return (hash ^ size) * prime;
+}
+
+uint64_t hash_bake_options(const MeshBakeOptions &options) {
+  const auto &o = options.load;
+  const auto &c = options.codec;
+  std::ostringstream key;
+  key << MANIFEST_HEADER << '|' << o.include_normals << ',' << o.include_textures << ',' << o.include_tangents << ','
+      << o.ear_clip << ',' << static_cast<int32_t>(o.normal_mode) << ',' << static_cast<int32_t>(o.normal_weighting) << ','
+      << o.crease_angle << '|' << c.position_bits << ',' << c.attribute_bits << ',' << c.optimize_vertex_cache;
+  const auto text = key.str();
+  return hash_bytes(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+}
+
+bool bake_meshes(const std::string &asset_dir,
+                 const std::string &output_dir,
+                 const MeshBakeOptions &options,
+                 std::vector<BakeResult> &results) {
+  using namespace std;
+
+  results.clear();
+  vector<string> sources;
+  if (!list_sources(asset_dir, string(), sources)) return false;
+  sort(sources.begin(), sources.end());
+  if (!make_directories(output_dir)) return false;
+
+  const auto manifest_name = join(output_dir, MESH_BAKE_MANIFEST);
+  unordered_map<string, ManifestEntry> manifest;
+  read_manifest(manifest_name, manifest);
+  const auto options_hash = hash_bake_options(options);
+
+  // Sources whose baked names clash, e.g. head.obj and head.glb, after the first fail
+  results.resize(sources.size());
+  unordered_set<string> outputs;
+  vector<bool> clashes(sources.size(), false);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    results[i].source = sources[i];
+    results[i].output = baked_name(sources[i]);
+    if (!outputs.insert(results[i].output).second) {
+      spdlog::error("{} would overwrite the bake of another source as {}", sources[i], results[i].output);
+      clashes[i] = true;
+    }
+    file_size(join(asset_dir, sources[i]), results[i].source_bytes);
+  }
+
+  // Largest first, so that a big file isn't left running on its own at the end
+  vector<size_t> order(sources.size());
+  for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+  stable_sort(order.begin(), order.end(), [&results](size_t a, size_t b) {
+    return results[a].source_bytes > results[b].source_bytes;
+  });
+
+  MeshLoadOptions load = options.load;
+  load.upload = false;
+  load.keep_vertex_data = true;
+  load.lod_ratios.clear();
+  load.meshlet_triangles = 0;
+  load.build_triangle_bvh = false;
+
+  vector<uint64_t> content_hashes(sources.size(), 0);
+  parallel_for(0, order.size(), 1, [&](size_t begin, size_t end) {
+    for (auto o = begin; o < end; ++o) {
+      const auto i = order[o];
+      auto &result = results[i];
+      if (clashes[i]) continue;
+      const auto start = chrono::steady_clock::now();
+      const auto source_name = join(asset_dir, result.source);
+      const auto output_name = join(output_dir, result.output);
+
+      MappedFile file;
+      if (!file.open(source_name)) {
+        spdlog::error("Couldn't open {}", source_name);
+        continue;
+      }
+      content_hashes[i] = hash_bytes(file.data(), file.size());
+      result.source_bytes = file.size();
+      file.close();
+
+      auto entry = manifest.find(result.source);
+      if (!options.force && entry != manifest.end()
+          && entry->second.content_hash == content_hashes[i]
+          && entry->second.options_hash == options_hash
+          && file_size(output_name, result.baked_bytes)) {
+        result.status = BakeStatus::UP_TO_DATE;
+      } else {
+        const auto temp_name = output_name + ".tmp";
+        Mesh mesh;
+        if (make_directories(output_name.substr(0, output_name.find_last_of('/')))
+            && load_mesh(source_name, mesh, load)
+            && save_compressed_mesh(temp_name, mesh, options.codec)
+            && rename(temp_name.c_str(), output_name.c_str()) == 0
+            && file_size(output_name, result.baked_bytes)) {
+          result.status = BakeStatus::BAKED;
+        } else {
+          spdlog::error("Couldn't bake {}", source_name);
+          remove(temp_name.c_str());
+        }
+      }
+      result.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+  });
+
+  auto ok = write_manifest(manifest_name, results, content_hashes, options_hash);
+  for (const auto &result: results) ok = ok && result.status != BakeStatus::FAILED;
+  return ok;
+}
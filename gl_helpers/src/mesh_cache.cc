@@ -0,0 +1,152 @@
+#include "mesh_cache.h"
+#include "gl_common.h"
+#include "mesh_import.h"
+#include "triangle_bvh.h"
+
+#include <climits>
+#include <cstdlib>
+#include <exception>
+#include <sstream>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  std::string canonical_path(const std::string &file_name) {
+    char resolved[PATH_MAX];
+    return realpath(file_name.c_str(), resolved) ? std::string(resolved) : file_name;
+  }
+
+  // Every option that changes what is loaded
+  std::string cache_key(const std::string &path, const MeshLoadOptions &o) {
+    std::ostringstream key;
+    key << path << '|' << o.pos_attr << ',' << o.include_normals << ',' << o.norm_attr << ','
+        << o.include_textures << ',' << o.tx_attr << ',' << o.include_tangents << ',' << o.tan_attr << ','
+        << o.ear_clip << ',' << static_cast<int32_t>(o.normal_mode) << ',' << static_cast<int32_t>(o.normal_weighting) << ','
+        << o.crease_angle << ',' << o.meshlet_triangles << ',' << o.build_triangle_bvh << ','
+        << o.upload << ',' << o.keep_vertex_data << '|';
+    for (auto r: o.lod_ratios) key << r << ',';
+    return key.str();
+  }
+
+  template<typename T>
+  inline size_t vector_bytes(const std::vector<T> &v) {
+    return v.capacity() * sizeof(T);
+  }
+
+  size_t cpu_bytes(const Mesh &mesh) {
+    auto bytes = vector_bytes(mesh.vertex_data) + vector_bytes(mesh.indices)
+                 + vector_bytes(mesh.submeshes) + vector_bytes(mesh.meshlets);
+    for (const auto &lod: mesh.lods) bytes += vector_bytes(lod.submeshes);
+    if (mesh.triangle_bvh) {
+      const auto &tb = *mesh.triangle_bvh;
+      bytes += vector_bytes(tb.bvh.nodes) + vector_bytes(tb.bvh.indices) + vector_bytes(tb.bvh.boxes)
+               + vector_bytes(tb.triangles);
+    }
+    return bytes;
+  }
+}
+
+MeshCacheStats::MeshCacheStats() : hits{0}, misses{0}, meshes{0}, gpu_bytes{0}, cpu_bytes{0}, entries{0} {}
+
+float MeshCacheStats::hit_rate() const {
+  auto requests = hits + misses;
+  return requests ? static_cast<float>(hits) / static_cast<float>(requests) : 0.0f;
+}
+
+MeshCache::MeshCache() : state_{std::make_shared<State>()} {}
+
+MeshCache &MeshCache::shared() {
+  static MeshCache cache;
+  return cache;
+}
+
+MeshHandle MeshCache::load(const std::string &file_name, const MeshLoadOptions &options) {
+  const auto key = cache_key(canonical_path(file_name), options);
+
+  std::promise<MeshHandle> loaded;
+  {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    auto &entry = entries_[key];
+    auto mesh = entry.mesh.lock();
+    if (mesh) {
+      ++state_->stats.hits;
+      return mesh;
+    }
+    if (entry.pending.valid()) {
+      // Someone else is loading it; wait for them outside the lock
+      ++state_->stats.hits;
+      auto pending = entry.pending;
+      lock.unlock();
+      return pending.get();
+    }
+    ++state_->stats.misses;
+    entry.pending = loaded.get_future().share();
+
+    // Drop the keys of meshes since released, so loading many meshes in turn doesn't grow the map. A miss is
+    // about to load a file, which dwarfs the sweep.
+    for (auto e = entries_.begin(); e != entries_.end();) {
+      if (!e->second.pending.valid() && e->second.mesh.expired()) {
+        e = entries_.erase(e);
+      } else {
+        ++e;
+      }
+    }
+  }
+
+  MeshHandle handle;
+  size_t gpu = 0, cpu = 0;
+  try {
+    std::unique_ptr<Mesh> mesh(new Mesh());
+    if (load_mesh(file_name, *mesh, options)) {
+      gpu = mesh->gpu_bytes;
+      cpu = cpu_bytes(*mesh);
+      auto state = state_;
+      handle = MeshHandle(mesh.release(), [state, gpu, cpu](const Mesh *m) {
+        if (m->vao) {
+          glDeleteBuffers(1, &m->vbo);
+          glDeleteBuffers(1, &m->ebo);
+          glDeleteVertexArrays(1, &m->vao);
+        }
+        delete m;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        --state->stats.meshes;
+        state->stats.gpu_bytes -= gpu;
+        state->stats.cpu_bytes -= cpu;
+      });
+    }
+  } catch (...) {
+    // Clear the entry so a later load tries again, and pass the failure to anyone waiting on this one
+    {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      entries_.erase(key);
+    }
+    loaded.set_exception(std::current_exception());
+    throw;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    auto &entry = entries_[key];
+    entry.pending = std::shared_future<MeshHandle>();
+    if (handle) {
+      entry.mesh = handle;
+      ++state_->stats.meshes;
+      state_->stats.gpu_bytes += gpu;
+      state_->stats.cpu_bytes += cpu;
+      spdlog::info("   Mesh cache: {} meshes, {} KB GPU, {} KB CPU, {:.0f}% hits", state_->stats.meshes,
+                   state_->stats.gpu_bytes / 1024, state_->stats.cpu_bytes / 1024, 100 * state_->stats.hit_rate());
+    } else {
+      // Failures aren't cached so a fixed file can be loaded
+      entries_.erase(key);
+    }
+  }
+  loaded.set_value(handle);
+  return handle;
+}
+
+MeshCacheStats MeshCache::stats() const {
+  std::lock_guard<std::mutex> lock(state_->mutex);
+  auto stats = state_->stats;
+  stats.entries = entries_.size();
+  return stats;
+}
@@ -0,0 +1,570 @@
+#include "mesh_chunks.h"
+#include "mesh_internal.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  const char CHUNK_MAGIC[8] = {'I', 'C', 'G', 'C', 'H', 'U', 'N', 'K'};
+  const uint32_t CHUNK_VERSION = 1;
+
+  // Magic, version, number of chunks, offset of the table, bounds of every chunk
+  const size_t HEADER_BYTES = sizeof(CHUNK_MAGIC) + 2 * sizeof(uint32_t) + sizeof(uint64_t) + 10 * sizeof(float);
+
+  // Lines are read this much at a time
+  const size_t READ_BLOCK_BYTES = 1 << 20;
+
+  template<typename T>
+  inline void write_value(std::ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  template<typename T>
+  inline bool read_value(std::istream &in, T &value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+  }
+
+  void write_bounds(std::ostream &out, const Bounds &bounds) {
+    out.write(reinterpret_cast<const char *>(bounds.min), 3 * sizeof(float));
+    out.write(reinterpret_cast<const char *>(bounds.max), 3 * sizeof(float));
+    out.write(reinterpret_cast<const char *>(bounds.center), 3 * sizeof(float));
+    write_value(out, bounds.radius);
+  }
+
+  bool read_bounds(std::istream &in, Bounds &bounds) {
+    in.read(reinterpret_cast<char *>(bounds.min), 3 * sizeof(float));
+    in.read(reinterpret_cast<char *>(bounds.max), 3 * sizeof(float));
+    in.read(reinterpret_cast<char *>(bounds.center), 3 * sizeof(float));
+    return read_value(in, bounds.radius);
+  }
+
+  /*
+   * Call fn with the range [begin, end) of each line of file_name, holding only
+   * a block of the file at a time. A line longer than a block grows the block.
+   */
+  template<typename F>
+  bool for_each_line(const std::string &file_name, F fn) {
+    std::ifstream f(file_name, std::ios::binary);
+    if (!f) {
+      spdlog::error("  couldn't open {}", file_name);
+      return false;
+    }
+    std::vector<char> block(READ_BLOCK_BYTES);
+    size_t carry = 0;
+    for (;;) {
+      f.read(block.data() + carry, static_cast<std::streamsize>(block.size() - carry));
+      const char *p = block.data();
+      const char *end = p + carry + static_cast<size_t>(f.gcount());
+      for (;;) {
+        auto eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol) break;
+        fn(p, eol);
+        p = eol + 1;
+      }
+      carry = static_cast<size_t>(end - p);
+      if (!f) {
+        if (carry) fn(p, end);
+        return true;
+      }
+      std::memmove(block.data(), p, carry);
+      if (carry == block.size()) block.resize(block.size() * 2);
+    }
+  }
+
+  /*
+   * The zero based vertex index of each corner of the face record [begin, end),
+   * with num_vertices seen so far. False if any corner is bad or there are fewer than three.
+   */
+  bool face_corners(const char *begin, const char *end, size_t num_vertices, std::vector<uint32_t> &corners) {
+    corners.clear();
+    for (auto p = begin; p < end;) {
+      while (p < end && is_space(*p)) ++p;
+      if (p == end) break;
+      auto e = p;
+      while (e < end && !is_space(*e)) ++e;
+      int32_t v = -1;
+      if (!parse_face_elements(p, e, &v) || !resolve_index(v, num_vertices)
+          || static_cast<size_t>(v) >= num_vertices) {
+        return false;
+      }
+      corners.push_back(static_cast<uint32_t>(v));
+      p = e;
+    }
+    return corners.size() >= 3;
+  }
+
+  /*
+   * Append values to file_name, or replace whatever is there when first, so a
+   * file left behind by an interrupted build is never read as part of this one.
+   */
+  bool append_to_file(const std::string &file_name, const std::vector<uint32_t> &values, bool first) {
+    std::ofstream out(file_name, std::ios::binary | (first ? std::ios::trunc : std::ios::app));
+    out.write(reinterpret_cast<const char *>(values.data()),
+              static_cast<std::streamsize>(values.size() * sizeof(uint32_t)));
+    if (!out) {
+      spdlog::error("  couldn't write {}", file_name);
+      return false;
+    }
+    return true;
+  }
+
+  // Builds the chunks of the cells, writing each to the chunk file as it is finished
+  class ChunkWriter {
+  public:
+    ChunkWriter(const MappedFile &positions, std::ofstream &out, const ChunkBuildOptions &options,
+                const std::string &temp_prefix)
+            : positions_{reinterpret_cast<const float *>(positions.data())}, out_{out}, options_{options},
+              temp_prefix_{temp_prefix}, num_temp_files_{0} {}
+
+    // Build chunks from the count triangles in file_name, then delete it. False if it couldn't be read.
+    bool build(const std::string &file_name, size_t count) {
+      const auto limit = options_.chunk_triangles;
+      if (count * (3 * sizeof(uint32_t) + 4 * sizeof(float)) <= options_.memory_bytes || count <= limit) {
+        std::vector<uint32_t> triangles(count * 3);
+        std::ifstream in(file_name, std::ios::binary);
+        in.read(reinterpret_cast<char *>(triangles.data()),
+                static_cast<std::streamsize>(triangles.size() * sizeof(uint32_t)));
+        const auto ok = static_cast<bool>(in);
+        in.close();
+        std::remove(file_name.c_str());
+        if (!ok) {
+          spdlog::error("  couldn't read {} triangles from {}", count, file_name);
+          return false;
+        }
+        split_in_memory(triangles);
+        return true;
+      }
+      return split_on_disk(file_name, count);
+    }
+
+    std::vector<ChunkInfo> chunks;
+
+  private:
+    inline float centroid(const uint32_t *triangle, int32_t axis) const {
+      return (positions_[static_cast<size_t>(triangle[0]) * 3 + axis] + positions_[static_cast<size_t>(triangle[1]) * 3 + axis]
+              + positions_[static_cast<size_t>(triangle[2]) * 3 + axis]) * (1.0f / 3.0f);
+    }
+
+    // Halve at the median centre along the longest axis of the centres until every part fits in a chunk
+    void split_in_memory(const std::vector<uint32_t> &triangles) {
+      const auto count = triangles.size() / 3;
+      std::vector<uint32_t> order(count);
+      std::vector<float> centres(count * 3);
+      for (size_t t = 0; t < count; ++t) {
+        order[t] = static_cast<uint32_t>(t);
+        for (int32_t k = 0; k < 3; ++k) centres[t * 3 + k] = centroid(&triangles[t * 3], k);
+      }
+      std::vector<uint32_t> gathered;
+      split_range(triangles, centres, order.begin(), order.end(), gathered);
+    }
+
+    void split_range(const std::vector<uint32_t> &triangles, const std::vector<float> &centres,
+                     std::vector<uint32_t>::iterator first, std::vector<uint32_t>::iterator last,
+                     std::vector<uint32_t> &gathered) {
+      const auto count = static_cast<size_t>(last - first);
+      if (count <= options_.chunk_triangles) {
+        gathered.clear();
+        for (auto it = first; it != last; ++it) {
+          gathered.insert(gathered.end(), &triangles[*it * 3], &triangles[*it * 3] + 3);
+        }
+        emit(gathered.data(), count);
+        return;
+      }
+      float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+      for (auto it = first; it != last; ++it) {
+        for (int32_t k = 0; k < 3; ++k) {
+          lo[k] = std::min(lo[k], centres[*it * 3 + k]);
+          hi[k] = std::max(hi[k], centres[*it * 3 + k]);
+        }
+      }
+      int32_t axis = 0;
+      for (int32_t k = 1; k < 3; ++k) if (hi[k] - lo[k] > hi[axis] - lo[axis]) axis = k;
+      auto middle = first + count / 2;
+      std::nth_element(first, middle, last, [&centres, axis](uint32_t a, uint32_t b) {
+        return centres[a * 3 + axis] < centres[b * 3 + axis];
+      });
+      split_range(triangles, centres, first, middle, gathered);
+      split_range(triangles, centres, middle, last, gathered);
+    }
+
+    // A cell too big for memory is streamed into two halves about the middle of its centres
+    bool split_on_disk(const std::string &file_name, size_t count) {
+      const size_t block_triangles = std::max<size_t>(options_.chunk_triangles, 1024);
+      std::vector<uint32_t> block;
+      float lo[3] = {INFINITY, INFINITY, INFINITY}, hi[3] = {-INFINITY, -INFINITY, -INFINITY};
+      auto read = for_each_block(file_name, block_triangles, block, [this, &lo, &hi](const std::vector<uint32_t> &b) {
+        for (size_t i = 0; i < b.size(); i += 3) {
+          for (int32_t k = 0; k < 3; ++k) {
+            auto c = centroid(&b[i], k);
+            lo[k] = std::min(lo[k], c);
+            hi[k] = std::max(hi[k], c);
+          }
+        }
+      });
+      if (read != count) return short_read(file_name, count);
+      int32_t axis = 0;
+      for (int32_t k = 1; k < 3; ++k) if (hi[k] - lo[k] > hi[axis] - lo[axis]) axis = k;
+
+      if (!(hi[axis] > lo[axis])) {
+        // Every centre is the same point so there's no better split than runs in file order
+        return emit_in_file_order(file_name, count, block);
+      }
+
+      const auto split = (lo[axis] + hi[axis]) * 0.5f;
+      const std::string halves[2] = {temp_file_name(), temp_file_name()};
+      size_t counts[2] = {0, 0};
+      std::vector<uint32_t> out[2];
+      auto written = true, first = true;
+      read = for_each_block(file_name, block_triangles, block, [&](const std::vector<uint32_t> &b) {
+        for (size_t i = 0; i < b.size(); i += 3) {
+          auto side = centroid(&b[i], axis) < split ? 0 : 1;
+          out[side].insert(out[side].end(), &b[i], &b[i] + 3);
+          ++counts[side];
+        }
+        for (int32_t s = 0; s < 2; ++s) {
+          written = written && append_to_file(halves[s], out[s], first);
+          out[s].clear();
+        }
+        first = false;
+      });
+      if (read != count || !written) {
+        for (const auto &half: halves) std::remove(half.c_str());
+        if (read != count) return short_read(file_name, count);
+        std::remove(file_name.c_str());
+        return false;
+      }
+      std::remove(file_name.c_str());
+      spdlog::debug("   split {} triangles into {} and {}", count, counts[0], counts[1]);
+      if (!counts[0] || !counts[1]) {
+        // The centres span adjacent floats and the middle rounded to one end; splitting again would recurse forever
+        const auto full = counts[0] ? 0 : 1;
+        std::remove(halves[1 - full].c_str());
+        return emit_in_file_order(halves[full], count, block);
+      }
+      if (!build(halves[0], counts[0])) {
+        std::remove(halves[1].c_str());
+        return false;
+      }
+      return build(halves[1], counts[1]);
+    }
+
+    // Emit the count triangles of file_name as runs of chunk_triangles in the order they are stored, then remove it
+    bool emit_in_file_order(const std::string &file_name, size_t count, std::vector<uint32_t> &block) {
+      const auto read = for_each_block(file_name, options_.chunk_triangles, block, [this](const std::vector<uint32_t> &b) {
+        emit(b.data(), b.size() / 3);
+      });
+      if (read != count) return short_read(file_name, count);
+      std::remove(file_name.c_str());
+      return true;
+    }
+
+    bool short_read(const std::string &file_name, size_t count) {
+      spdlog::error("  couldn't read {} triangles from {}", count, file_name);
+      std::remove(file_name.c_str());
+      return false;
+    }
+
+    // Call fn with successive runs of up to block_triangles triangles of file_name. The number of triangles read.
+    template<typename F>
+    size_t for_each_block(const std::string &file_name, size_t block_triangles, std::vector<uint32_t> &block, F fn) {
+      std::ifstream in(file_name, std::ios::binary);
+      size_t read = 0;
+      while (in) {
+        block.resize(block_triangles * 3);
+        in.read(reinterpret_cast<char *>(block.data()), static_cast<std::streamsize>(block.size() * sizeof(uint32_t)));
+        block.resize(static_cast<size_t>(in.gcount()) / sizeof(uint32_t) / 3 * 3);
+        if (block.empty()) break;
+        read += block.size() / 3;
+        fn(block);
+      }
+      return read;
+    }
+
+    // Write count triangles of global vertex indices as a chunk with its own vertices
+    void emit(const uint32_t *triangles, size_t count) {
+      if (!count) return;
+      used_.assign(triangles, triangles + count * 3);
+      std::sort(used_.begin(), used_.end());
+      used_.erase(std::unique(used_.begin(), used_.end()), used_.end());
+
+      vertices_.resize(used_.size() * 3);
+      for (size_t v = 0; v < used_.size(); ++v) {
+        std::memcpy(&vertices_[v * 3], positions_ + static_cast<size_t>(used_[v]) * 3, 3 * sizeof(float));
+      }
+      indices_.resize(count * 3);
+      for (size_t i = 0; i < indices_.size(); ++i) {
+        indices_[i] = static_cast<uint32_t>(std::lower_bound(used_.begin(), used_.end(), triangles[i]) - used_.begin());
+      }
+
+      ChunkInfo chunk;
+      chunk.bounds = compute_bounds(vertices_.data(), used_.size(), 3);
+      chunk.num_vertices = static_cast<uint32_t>(used_.size());
+      chunk.num_triangles = static_cast<uint32_t>(count);
+      chunk.offset = static_cast<uint64_t>(out_.tellp());
+      out_.write(reinterpret_cast<const char *>(vertices_.data()),
+                 static_cast<std::streamsize>(vertices_.size() * sizeof(float)));
+      out_.write(reinterpret_cast<const char *>(indices_.data()),
+                 static_cast<std::streamsize>(indices_.size() * sizeof(uint32_t)));
+      chunks.push_back(chunk);
+    }
+
+    std::string temp_file_name() {
+      return temp_prefix_ + ".split" + std::to_string(num_temp_files_++) + ".tmp";
+    }
+
+    const float *positions_;
+    std::ofstream &out_;
+    const ChunkBuildOptions &options_;
+    std::string temp_prefix_;
+    uint32_t num_temp_files_;
+
+    // Reused by each chunk
+    std::vector<uint32_t> used_;
+    std::vector<float> vertices_;
+    std::vector<uint32_t> indices_;
+  };
+}
+
+ChunkInfo::ChunkInfo() : num_vertices{0}, num_triangles{0}, offset{0} {}
+
+ChunkBuildOptions::ChunkBuildOptions() : chunk_triangles{1 << 16}, memory_bytes{256u << 20} {}
+
+bool build_chunked_mesh(const std::string &obj_file_name,
+                        const std::string &chunk_file_name,
+                        const ChunkBuildOptions &options) {
+  spdlog::info("build_chunked_mesh( \"{}\" )", obj_file_name);
+  if (!options.chunk_triangles) {
+    spdlog::error("  chunks must hold at least one triangle");
+    return false;
+  }
+  const auto positions_file_name = chunk_file_name + ".positions.tmp";
+
+  // 1. Positions out to a file of their own, and a count of the triangles
+  size_t num_vertices = 0, num_triangles = 0, num_bad_vertices = 0;
+  Bounds bounds;
+  for (auto k = 0; k < 3; ++k) {
+    bounds.min[k] = INFINITY;
+    bounds.max[k] = -INFINITY;
+  }
+  {
+    std::ofstream positions(positions_file_name, std::ios::binary | std::ios::trunc);
+    auto ok = for_each_line(obj_file_name, [&](const char *b, const char *e) {
+      trim_range(b, e);
+      if (is_type(b, e, "v")) {
+        float xyz[3];
+        if (parse_floats(b + 1, e, xyz, 3) < 3) {
+          // Written all the same so later indices still line up
+          xyz[0] = xyz[1] = xyz[2] = 0.0f;
+          ++num_bad_vertices;
+        }
+        positions.write(reinterpret_cast<const char *>(xyz), sizeof(xyz));
+        for (auto k = 0; k < 3; ++k) {
+          bounds.min[k] = std::min(bounds.min[k], xyz[k]);
+          bounds.max[k] = std::max(bounds.max[k], xyz[k]);
+        }
+        ++num_vertices;
+      } else if (is_type(b, e, "f")) {
+        size_t corners = 0;
+        for (auto q = b + 1; q < e;) {
+          while (q < e && is_space(*q)) ++q;
+          if (q == e) break;
+          ++corners;
+          while (q < e && !is_space(*q)) ++q;
+        }
+        if (corners >= 3) num_triangles += corners - 2;
+      }
+    });
+    if (!ok || !positions) {
+      std::remove(positions_file_name.c_str());
+      return false;
+    }
+  }
+  if (num_bad_vertices) spdlog::warn("  {} vertex lines couldn't be read", num_bad_vertices);
+  if (!num_vertices || !num_triangles || num_vertices > static_cast<size_t>(INT32_MAX)) {
+    spdlog::error("  {} vertices and {} triangles can't be chunked", num_vertices, num_triangles);
+    std::remove(positions_file_name.c_str());
+    return false;
+  }
+  spdlog::info("   {} vertices, {} triangles", num_vertices, num_triangles);
+  for (auto k = 0; k < 3; ++k) bounds.center[k] = (bounds.min[k] + bounds.max[k]) * 0.5f;
+  bounds.radius = 0.5f * std::sqrt((bounds.max[0] - bounds.min[0]) * (bounds.max[0] - bounds.min[0])
+                                   + (bounds.max[1] - bounds.min[1]) * (bounds.max[1] - bounds.min[1])
+                                   + (bounds.max[2] - bounds.min[2]) * (bounds.max[2] - bounds.min[2]));
+
+  MappedFile positions;
+  if (!positions.open(positions_file_name) || positions.size() < num_vertices * 3 * sizeof(float)) {
+    std::remove(positions_file_name.c_str());
+    return false;
+  }
+  const auto *pos = reinterpret_cast<const float *>(positions.data());
+
+  // 2. Triangles into a grid of cells, about a chunk to a cell were they spread evenly.
+  // The axis with the widest cells is split until there are enough.
+  const size_t wanted_cells = (num_triangles + options.chunk_triangles - 1) / options.chunk_triangles;
+  size_t dims[3] = {1, 1, 1};
+  float extent[3];
+  for (auto k = 0; k < 3; ++k) extent[k] = bounds.max[k] - bounds.min[k];
+  while (dims[0] * dims[1] * dims[2] < wanted_cells) {
+    auto axis = 0;
+    for (auto k = 1; k < 3; ++k) if (extent[k] / dims[k] > extent[axis] / dims[axis]) axis = k;
+    if (!(extent[axis] > 0.0f)) break;
+    dims[axis] *= 2;
+  }
+  const size_t num_cells = dims[0] * dims[1] * dims[2];
+  auto cell_file_name = [&chunk_file_name](size_t cell) {
+    return chunk_file_name + ".cell" + std::to_string(cell) + ".tmp";
+  };
+  std::vector<size_t> cell_triangles(num_cells, 0);
+  std::vector<bool> cell_on_disk(num_cells, false);
+  auto fail = [&](const char *what) {
+    spdlog::error("  couldn't {} {}", what, chunk_file_name);
+    for (size_t cell = 0; cell < num_cells; ++cell) {
+      if (cell_on_disk[cell]) std::remove(cell_file_name(cell).c_str());
+    }
+    positions.close();
+    std::remove(positions_file_name.c_str());
+    return false;
+  };
+
+  // Half the memory goes on buffering cells, flushed to their files when full
+  const size_t buffer_triangles = std::max<size_t>(16, std::min<size_t>(4096, options.memory_bytes / 2 / num_cells / 12));
+  std::vector<std::vector<uint32_t>> buffers(num_cells);
+  std::vector<uint32_t> corners;
+  size_t seen_vertices = 0, num_bad_faces = 0;
+  auto written = true;
+  auto flush = [&](size_t cell) {
+    written = written && append_to_file(cell_file_name(cell), buffers[cell], !cell_on_disk[cell]);
+    cell_on_disk[cell] = true;
+    buffers[cell].clear();
+  };
+  auto read = for_each_line(obj_file_name, [&](const char *b, const char *e) {
+    trim_range(b, e);
+    if (is_type(b, e, "v")) {
+      ++seen_vertices;
+      return;
+    }
+    if (!is_type(b, e, "f")) return;
+    if (!face_corners(b + 1, e, seen_vertices, corners)) {
+      ++num_bad_faces;
+      return;
+    }
+    for (size_t c = 2; c < corners.size(); ++c) {
+      const uint32_t triangle[3] = {corners[0], corners[c - 1], corners[c]};
+      size_t cell = 0;
+      for (auto k = 2; k >= 0; --k) {
+        auto centre = (pos[static_cast<size_t>(triangle[0]) * 3 + k] + pos[static_cast<size_t>(triangle[1]) * 3 + k]
+                       + pos[static_cast<size_t>(triangle[2]) * 3 + k]) / 3.0f;
+        auto f = extent[k] > 0.0f ? (centre - bounds.min[k]) / extent[k] * static_cast<float>(dims[k]) : 0.0f;
+        auto i = f > 0.0f ? std::min(static_cast<size_t>(f), dims[k] - 1) : 0;
+        cell = cell * dims[k] + i;
+      }
+      auto &buffer = buffers[cell];
+      buffer.insert(buffer.end(), triangle, triangle + 3);
+      ++cell_triangles[cell];
+      if (buffer.size() >= buffer_triangles * 3) flush(cell);
+    }
+  });
+  for (size_t cell = 0; cell < num_cells; ++cell) {
+    if (!buffers[cell].empty()) flush(cell);
+    std::vector<uint32_t>().swap(buffers[cell]);
+  }
+  if (!read || !written) return fail("sort the triangles of");
+  if (num_bad_faces) spdlog::warn("  ignored {} bad faces", num_bad_faces);
+
+  // 3. Chunks built a cell at a time, after a header that's filled in once the table is known
+  std::ofstream out(chunk_file_name, std::ios::binary | std::ios::trunc);
+  if (!out) return fail("write");
+  std::vector<char> header(HEADER_BYTES, 0);
+  out.write(header.data(), static_cast<std::streamsize>(header.size()));
+  ChunkWriter writer(positions, out, options, chunk_file_name);
+  for (size_t cell = 0; cell < num_cells; ++cell) {
+    if (!cell_triangles[cell]) continue;
+    cell_on_disk[cell] = false;
+    if (!writer.build(cell_file_name(cell), cell_triangles[cell])) {
+      out.close();
+      std::remove(chunk_file_name.c_str());
+      return fail("build the chunks of");
+    }
+  }
+  positions.close();
+  std::remove(positions_file_name.c_str());
+
+  const auto table_offset = static_cast<uint64_t>(out.tellp());
+  for (const auto &chunk: writer.chunks) {
+    write_bounds(out, chunk.bounds);
+    write_value(out, chunk.num_vertices);
+    write_value(out, chunk.num_triangles);
+    write_value(out, chunk.offset);
+  }
+  out.seekp(0);
+  out.write(CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+  write_value(out, CHUNK_VERSION);
+  write_value(out, static_cast<uint32_t>(writer.chunks.size()));
+  write_value(out, table_offset);
+  write_bounds(out, bounds);
+  if (!out) {
+    spdlog::error("  couldn't write {}", chunk_file_name);
+    return false;
+  }
+  spdlog::info("   {} chunks from {} cells", writer.chunks.size(), num_cells);
+  return true;
+}
+
+bool read_chunk_table(const std::string &chunk_file_name, std::vector<ChunkInfo> &chunks, Bounds &bounds) {
+  std::ifstream in(chunk_file_name, std::ios::binary);
+  char magic[sizeof(CHUNK_MAGIC)];
+  uint32_t version = 0, num_chunks = 0;
+  uint64_t table_offset = 0;
+  if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, CHUNK_MAGIC, sizeof(magic)) != 0) {
+    spdlog::error("{} isn't a chunk file", chunk_file_name);
+    return false;
+  }
+  if (!read_value(in, version) || version != CHUNK_VERSION) {
+    spdlog::error("{} is chunk file version {}, expected {}", chunk_file_name, version, CHUNK_VERSION);
+    return false;
+  }
+  if (!read_value(in, num_chunks) || !read_value(in, table_offset) || !read_bounds(in, bounds)) {
+    spdlog::error("{} has a short header", chunk_file_name);
+    return false;
+  }
+
+  chunks.resize(num_chunks);
+  in.seekg(static_cast<std::streamoff>(table_offset));
+  for (auto &chunk: chunks) {
+    if (!read_bounds(in, chunk.bounds) || !read_value(in, chunk.num_vertices) || !read_value(in, chunk.num_triangles)
+        || !read_value(in, chunk.offset)) {
+      spdlog::error("{} has a short chunk table", chunk_file_name);
+      chunks.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool read_chunk(const std::string &chunk_file_name, const ChunkInfo &chunk,
+                std::vector<float> &positions, std::vector<uint32_t> &indices) {
+  std::ifstream in(chunk_file_name, std::ios::binary);
+  in.seekg(static_cast<std::streamoff>(chunk.offset));
+  positions.resize(static_cast<size_t>(chunk.num_vertices) * 3);
+  indices.resize(static_cast<size_t>(chunk.num_triangles) * 3);
+  in.read(reinterpret_cast<char *>(positions.data()), static_cast<std::streamsize>(positions.size() * sizeof(float)));
+  in.read(reinterpret_cast<char *>(indices.data()), static_cast<std::streamsize>(indices.size() * sizeof(uint32_t)));
+  if (!in) {
+    spdlog::error("Couldn't read chunk at {} of {}", chunk.offset, chunk_file_name);
+    return false;
+  }
+  for (auto i: indices) {
+    if (i >= chunk.num_vertices) {
+      spdlog::error("Chunk at {} of {} has an index out of range", chunk.offset, chunk_file_name);
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,638 @@
+#include "mesh_codec.h"
+#include "mesh_internal.h"
+#include "arena.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  const char MESH_MAGIC[8] = {'I', 'C', 'G', 'M', 'E', 'S', 'H', 'Z'};
+  const uint32_t MESH_VERSION = 1;
+
+  // Values packed together at one width
+  const uint32_t GROUP_SIZE = 16;
+
+  // Bits per value for each group width code
+  const uint32_t GROUP_BITS[] = {0, 1, 2, 4, 8, 16, 32};
+  const uint32_t NUM_GROUP_CODES = sizeof(GROUP_BITS) / sizeof(GROUP_BITS[0]);
+
+  // Entries in the vertex cache triangles are ordered for
+  const uint32_t CACHE_SIZE = 16;
+
+  // Most bits a component can be quantised to and still be held exactly by a float
+  const uint32_t MAX_QUANTISE_BITS = 24;
+
+  const uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+
+  // How one float of each vertex is stored
+  struct Component {
+    // 0 for exact float bits
+    uint8_t bits;
+    float min;
+    float step;
+  };
+
+  // Small magnitudes of either sign to small unsigned values
+  inline uint32_t zigzag(uint32_t delta) {
+    return (delta << 1) ^ (0u - (delta >> 31));
+  }
+
+  inline uint32_t unzigzag(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1u));
+  }
+
+  inline bool is_layout(uint32_t stride) {
+    return stride == 3 || stride == 5 || stride == 6 || stride == 8 || stride == 12;
+  }
+
+  // Attributes follow positions in the order normals, tex coords, tangents; each layout has its own stride
+  inline bool has_normals(uint32_t stride) { return stride == 6 || stride >= 8; }
+
+  inline bool has_textures(uint32_t stride) { return stride == 5 || stride >= 8; }
+
+  inline bool has_tangents(uint32_t stride) { return stride == 12; }
+
+  template<typename T>
+  inline void append(std::vector<uint8_t> &out, const T &value) {
+    const auto at = out.size();
+    out.resize(at + sizeof(T));
+    std::memcpy(out.data() + at, &value, sizeof(T));
+  }
+
+  inline void append(std::vector<uint8_t> &out, const std::string &s) {
+    append(out, static_cast<uint32_t>(s.size()));
+    out.insert(out.end(), s.begin(), s.end());
+  }
+
+  // Bounds checked reads of an encoded mesh
+  class Reader {
+  public:
+    Reader(const uint8_t *data, size_t size) : p_{data}, end_{data + size} {}
+
+    template<typename T>
+    bool read(T &value) {
+      if (remaining() < sizeof(T)) return false;
+      std::memcpy(&value, p_, sizeof(T));
+      p_ += sizeof(T);
+      return true;
+    }
+
+    bool read(std::string &s) {
+      uint32_t length = 0;
+      if (!read(length) || remaining() < length) return false;
+      s.assign(reinterpret_cast<const char *>(p_), length);
+      p_ += length;
+      return true;
+    }
+
+    // The next bytes bytes, which are then skipped
+    const uint8_t *take(size_t bytes) {
+      if (remaining() < bytes) return nullptr;
+      auto start = p_;
+      p_ += bytes;
+      return start;
+    }
+
+    inline size_t remaining() const { return static_cast<size_t>(end_ - p_); }
+
+  private:
+    const uint8_t *p_;
+    const uint8_t *end_;
+  };
+
+  /*
+   * Append values in groups of GROUP_SIZE, each a width code byte followed by
+   * every value of the group at that width, little endian, least significant
+   * bits first. The last group is padded with zeros.
+   */
+  void pack_stream(const uint32_t *values, size_t count, std::vector<uint8_t> &out) {
+    for (size_t i = 0; i < count; i += GROUP_SIZE) {
+      const auto n = std::min<size_t>(GROUP_SIZE, count - i);
+      uint32_t all = 0;
+      for (size_t k = 0; k < n; ++k) all |= values[i + k];
+      uint32_t code = 0;
+      while (GROUP_BITS[code] < 32 && (all >> GROUP_BITS[code]) != 0) ++code;
+      out.push_back(static_cast<uint8_t>(code));
+
+      const auto bits = GROUP_BITS[code];
+      const auto at = out.size();
+      out.resize(at + GROUP_SIZE * bits / 8, 0);
+      auto *payload = out.data() + at;
+      for (size_t k = 0; k < n; ++k) {
+        const auto v = values[i + k];
+        if (bits < 8) {
+          payload[k * bits / 8] |= static_cast<uint8_t>(v << (k * bits % 8));
+        } else {
+          for (uint32_t b = 0; b < bits / 8; ++b) payload[k * bits / 8 + b] = static_cast<uint8_t>(v >> (8 * b));
+        }
+      }
+    }
+  }
+
+  // Unpack the group at p into values, moving p past it. False if it runs past end or has a bad code.
+  inline bool unpack_group(const uint8_t *&p, const uint8_t *end, uint32_t *values) {
+    if (p == end || *p >= NUM_GROUP_CODES) return false;
+    const auto code = *p++;
+    const auto bytes = GROUP_SIZE * GROUP_BITS[code] / 8;
+    if (static_cast<size_t>(end - p) < bytes) return false;
+    switch (code) {
+      case 0:
+        for (uint32_t k = 0; k < GROUP_SIZE; ++k) values[k] = 0;
+        break;
+      case 1:
+        for (uint32_t k = 0; k < GROUP_SIZE; ++k) values[k] = (p[k >> 3] >> (k & 7)) & 1u;
+        break;
+      case 2:
+        for (uint32_t k = 0; k < GROUP_SIZE; ++k) values[k] = (p[k >> 2] >> ((k & 3) * 2)) & 3u;
+        break;
+      case 3:
+        for (uint32_t k = 0; k < GROUP_SIZE; ++k) values[k] = (p[k >> 1] >> ((k & 1) * 4)) & 15u;
+        break;
+      case 4:
+        for (uint32_t k = 0; k < GROUP_SIZE; ++k) values[k] = p[k];
+        break;
+      case 5:
+        for (uint32_t k = 0; k < GROUP_SIZE; ++k) values[k] = p[2 * k] | (static_cast<uint32_t>(p[2 * k + 1]) << 8);
+        break;
+      default:
+        for (uint32_t k = 0; k < GROUP_SIZE; ++k) {
+          values[k] = p[4 * k] | (static_cast<uint32_t>(p[4 * k + 1]) << 8)
+                      | (static_cast<uint32_t>(p[4 * k + 2]) << 16) | (static_cast<uint32_t>(p[4 * k + 3]) << 24);
+        }
+        break;
+    }
+    p += bytes;
+    return true;
+  }
+
+  // Groups take at least their code byte, which bounds what a header can claim before anything is allocated
+  inline size_t min_stream_bytes(size_t count) {
+    return (count + GROUP_SIZE - 1) / GROUP_SIZE;
+  }
+
+  /*
+   * Reorder the triangles of indices[0, count) for a vertex cache of CACHE_SIZE
+   * entries, after Sander, Nehab and Barczak's Tipsify. Starting from a vertex,
+   * every triangle around it is emitted, then the next vertex is chosen from
+   * those just emitted, preferring ones that are still in the cache and have
+   * few triangles left. local must hold NO_VERTEX for every vertex and is left so.
+   */
+  void optimize_vertex_cache(uint32_t *indices, size_t count, std::vector<uint32_t> &local) {
+    const auto num_triangles = count / 3;
+    if (num_triangles < 2) return;
+    ArenaScope scope;
+
+    // Number the range's vertices from zero
+    ScratchVector<uint32_t> global;
+    ScratchVector<uint32_t> triangles(count);
+    for (size_t i = 0; i < count; ++i) {
+      auto &l = local[indices[i]];
+      if (l == NO_VERTEX) {
+        l = static_cast<uint32_t>(global.size());
+        global.push_back(indices[i]);
+      }
+      triangles[i] = l;
+    }
+    for (auto g: global) local[g] = NO_VERTEX;
+    const auto num_vertices = global.size();
+
+    // Triangles around each vertex
+    ScratchVector<uint32_t> live(num_vertices, 0);
+    for (auto v: triangles) ++live[v];
+    ScratchVector<uint32_t> first(num_vertices + 1, 0);
+    for (size_t v = 0; v < num_vertices; ++v) first[v + 1] = first[v] + live[v];
+    ScratchVector<uint32_t> fill(first.begin(), first.end() - 1);
+    ScratchVector<uint32_t> adjacent(count);
+    for (size_t i = 0; i < count; ++i) adjacent[fill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+
+    ScratchVector<uint32_t> cache_time(num_vertices, 0);
+    ScratchVector<uint8_t> emitted(num_triangles, 0);
+    ScratchVector<uint32_t> dead_end;
+    ScratchVector<uint32_t> candidates;
+    ScratchVector<uint32_t> order;
+    order.reserve(count);
+    uint32_t time = CACHE_SIZE + 1;
+    size_t cursor = 0;
+    auto fan = static_cast<int64_t>(triangles[0]);
+    while (fan >= 0) {
+      candidates.clear();
+      for (auto a = first[fan]; a < first[fan + 1]; ++a) {
+        const auto t = adjacent[a];
+        if (emitted[t]) continue;
+        for (auto k = 0; k < 3; ++k) {
+          const auto v = triangles[3 * t + k];
+          order.push_back(v);
+          dead_end.push_back(v);
+          candidates.push_back(v);
+          --live[v];
+          if (time - cache_time[v] > CACHE_SIZE) cache_time[v] = time++;
+        }
+        emitted[t] = 1;
+      }
+
+      // Of the candidates with triangles left, the one longest in the cache that will still be in it once they're emitted
+      fan = -1;
+      int64_t best = -1;
+      for (auto v: candidates) {
+        if (!live[v]) continue;
+        int64_t priority = 0;
+        if (time - cache_time[v] + 2 * live[v] <= CACHE_SIZE) priority = time - cache_time[v];
+        if (priority > best) {
+          best = priority;
+          fan = v;
+        }
+      }
+      // Otherwise the latest vertex emitted with triangles left, then any vertex that has some
+      while (fan < 0 && !dead_end.empty()) {
+        const auto v = dead_end.back();
+        dead_end.pop_back();
+        if (live[v]) fan = v;
+      }
+      while (fan < 0 && cursor < num_vertices) {
+        if (live[cursor]) fan = static_cast<int64_t>(cursor);
+        ++cursor;
+      }
+    }
+    for (size_t i = 0; i < count; ++i) indices[i] = global[order[i]];
+  }
+
+  Component quantise_component(const float *values, size_t num_vertices, size_t stride, uint32_t bits) {
+    Component c;
+    c.bits = static_cast<uint8_t>(bits);
+    c.min = 0.0f;
+    c.step = 0.0f;
+    if (!bits || !num_vertices) return c;
+    auto lo = values[0], hi = values[0];
+    for (size_t v = 1; v < num_vertices; ++v) {
+      lo = std::min(lo, values[v * stride]);
+      hi = std::max(hi, values[v * stride]);
+    }
+    c.min = lo;
+    c.step = (hi - lo) / static_cast<float>((1u << bits) - 1);
+    return c;
+  }
+
+  inline uint32_t quantise(float value, const Component &c) {
+    if (!c.bits) {
+      uint32_t raw;
+      std::memcpy(&raw, &value, sizeof(raw));
+      return raw;
+    }
+    if (c.step <= 0.0f) return 0;
+    const auto q = std::floor((value - c.min) / c.step + 0.5f);
+    return static_cast<uint32_t>(std::min(std::max(q, 0.0f), static_cast<float>((1u << c.bits) - 1)));
+  }
+
+  // Decode one component of every vertex into out, which holds stride floats a vertex
+  bool decode_component(const uint8_t *&p, const uint8_t *end, const Component &c,
+                        size_t num_vertices, size_t stride, float *out) {
+    uint32_t group[GROUP_SIZE];
+    uint32_t value = 0;
+    for (size_t i = 0; i < num_vertices; i += GROUP_SIZE) {
+      if (!unpack_group(p, end, group)) return false;
+      const auto n = std::min<size_t>(GROUP_SIZE, num_vertices - i);
+      auto *dst = out + i * stride;
+      if (c.bits) {
+        for (size_t k = 0; k < n; ++k) {
+          value += unzigzag(group[k]);
+          dst[k * stride] = c.min + static_cast<float>(value) * c.step;
+        }
+      } else {
+        for (size_t k = 0; k < n; ++k) {
+          value += unzigzag(group[k]);
+          std::memcpy(dst + k * stride, &value, sizeof(float));
+        }
+      }
+    }
+    return true;
+  }
+
+  // Each index is next - code, and a code of 0 is the next new vertex. Branch free within a group.
+  bool decode_indices(const uint8_t *&p, const uint8_t *end, size_t num_vertices,
+                      size_t num_indices, uint32_t *out) {
+    uint32_t group[GROUP_SIZE];
+    uint32_t next = 0;
+    for (size_t i = 0; i < num_indices; i += GROUP_SIZE) {
+      if (!unpack_group(p, end, group)) return false;
+      const auto n = std::min<size_t>(GROUP_SIZE, num_indices - i);
+      uint32_t bad = 0;
+      for (size_t k = 0; k < n; ++k) {
+        const auto code = group[k];
+        bad |= static_cast<uint32_t>(code > next);
+        out[i + k] = next - code;
+        next += static_cast<uint32_t>(code == 0);
+      }
+      if (bad || next > num_vertices) return false;
+    }
+    return true;
+  }
+
+  bool decode(const uint8_t *data, size_t size, Mesh &mesh) {
+    Reader in(data, size);
+    char magic[sizeof(MESH_MAGIC)];
+    uint32_t version = 0;
+    if (!in.read(magic) || std::memcmp(magic, MESH_MAGIC, sizeof(magic)) != 0) {
+      spdlog::error("Not an encoded mesh");
+      return false;
+    }
+    if (!in.read(version) || version != MESH_VERSION) {
+      spdlog::error("Encoded mesh is version {}, expected {}", version, MESH_VERSION);
+      return false;
+    }
+
+    uint32_t stride = 0, num_vertices = 0, num_indices = 0;
+    uint32_t num_submeshes = 0, num_materials = 0, num_material_libs = 0;
+    if (!in.read(stride) || !in.read(num_vertices) || !in.read(num_indices)
+        || !in.read(num_submeshes) || !in.read(num_materials) || !in.read(num_material_libs)) {
+      spdlog::error("Encoded mesh has a short header");
+      return false;
+    }
+    if (!is_layout(stride) || num_indices % 3) {
+      spdlog::error("Encoded mesh has stride {} and {} indices", stride, num_indices);
+      return false;
+    }
+
+    Component components[12];
+    for (uint32_t c = 0; c < stride; ++c) {
+      auto &comp = components[c];
+      if (!in.read(comp.bits) || !in.read(comp.min) || !in.read(comp.step) || comp.bits > MAX_QUANTISE_BITS) {
+        spdlog::error("Encoded mesh has a bad vertex component");
+        return false;
+      }
+    }
+
+    // Every entry takes at least its string's length
+    if (in.remaining() / sizeof(uint32_t) < static_cast<size_t>(num_submeshes) + num_materials + num_material_libs) {
+      spdlog::error("Encoded mesh is truncated");
+      return false;
+    }
+    mesh.submeshes.resize(num_submeshes);
+    for (auto &sm: mesh.submeshes) {
+      if (!in.read(sm.name) || !in.read(sm.index_offset) || !in.read(sm.index_count) || !in.read(sm.material_id)
+          || sm.index_offset > num_indices || sm.index_count > num_indices - sm.index_offset) {
+        spdlog::error("Encoded mesh has a bad submesh");
+        return false;
+      }
+    }
+    mesh.materials.resize(num_materials);
+    mesh.material_libs.resize(num_material_libs);
+    for (auto *names: {&mesh.materials, &mesh.material_libs}) {
+      for (auto &name: *names) {
+        if (!in.read(name)) {
+          spdlog::error("Encoded mesh is truncated");
+          return false;
+        }
+      }
+    }
+
+    uint64_t vertex_bytes = 0, index_bytes = 0;
+    const uint8_t *vertex_stream = nullptr, *index_stream = nullptr;
+    if (!in.read(vertex_bytes) || !(vertex_stream = in.take(vertex_bytes))
+        || !in.read(index_bytes) || !(index_stream = in.take(index_bytes))
+        || vertex_bytes < min_stream_bytes(num_vertices) * stride || index_bytes < min_stream_bytes(num_indices)) {
+      spdlog::error("Encoded mesh is truncated");
+      return false;
+    }
+
+    mesh.vertex_data.resize(static_cast<size_t>(num_vertices) * stride);
+    auto p = vertex_stream, end = vertex_stream + vertex_bytes;
+    for (uint32_t c = 0; c < stride; ++c) {
+      if (!decode_component(p, end, components[c], num_vertices, stride, mesh.vertex_data.data() + c)) {
+        spdlog::error("Encoded mesh has a bad vertex stream");
+        return false;
+      }
+    }
+    mesh.indices.resize(num_indices);
+    p = index_stream;
+    end = index_stream + index_bytes;
+    if (!decode_indices(p, end, num_vertices, num_indices, mesh.indices.data())) {
+      spdlog::error("Encoded mesh has a bad index stream");
+      return false;
+    }
+
+    mesh.stride = stride;
+    mesh.num_elements = num_indices;
+    mesh.bounds = compute_bounds(mesh.vertex_data.data(), num_vertices, stride);
+    return true;
+  }
+}
+
+MeshCodecOptions::MeshCodecOptions() : position_bits{16}, attribute_bits{14}, optimize_vertex_cache{true} {}
+
+bool encode_mesh(const Mesh &mesh, std::vector<uint8_t> &encoded, const MeshCodecOptions &options) {
+  encoded.clear();
+  const auto stride = mesh.stride;
+  if (!is_layout(stride) || mesh.vertex_data.empty() || mesh.vertex_data.size() % stride) {
+    spdlog::error("Can't encode a mesh without its vertex data");
+    return false;
+  }
+  if (options.position_bits > MAX_QUANTISE_BITS || options.attribute_bits > MAX_QUANTISE_BITS) {
+    spdlog::error("Vertex components can be quantised to at most {} bits", MAX_QUANTISE_BITS);
+    return false;
+  }
+  const auto num_vertices = mesh.vertex_data.size() / stride;
+
+  ArenaScope scope;
+
+  // Full resolution triangles of each submesh, packed in submesh order
+  std::vector<SubMesh> submeshes = mesh.submeshes;
+  ScratchVector<uint32_t> indices;
+  for (auto &sm: submeshes) {
+    if (sm.index_count % 3 || static_cast<size_t>(sm.index_offset) + sm.index_count > mesh.indices.size()) {
+      spdlog::error("Submesh {} isn't within the mesh's indices", sm.name);
+      return false;
+    }
+    const auto offset = static_cast<uint32_t>(indices.size());
+    indices.insert(indices.end(), mesh.indices.begin() + sm.index_offset,
+                   mesh.indices.begin() + sm.index_offset + sm.index_count);
+    sm.index_offset = offset;
+  }
+  for (auto i: indices) {
+    if (i >= num_vertices) {
+      spdlog::error("Mesh has an index out of range");
+      return false;
+    }
+  }
+
+  std::vector<uint32_t> remap(num_vertices, NO_VERTEX);
+  if (options.optimize_vertex_cache) {
+    for (const auto &sm: submeshes) optimize_vertex_cache(indices.data() + sm.index_offset, sm.index_count, remap);
+  }
+
+  // Renumber vertices in order of first use, which drops any only used by simplified levels
+  ScratchVector<uint32_t> vertex_order;
+  ScratchVector<uint32_t> codes(indices.size());
+  uint32_t next = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    auto &r = remap[indices[i]];
+    if (r == NO_VERTEX) {
+      r = next;
+      vertex_order.push_back(indices[i]);
+      codes[i] = 0;
+      ++next;
+    } else {
+      codes[i] = next - r;
+    }
+  }
+
+  const auto is_position = [](uint32_t c) { return c < 3; };
+  Component components[12];
+  for (uint32_t c = 0; c < stride; ++c) {
+    components[c] = quantise_component(mesh.vertex_data.data() + c, num_vertices, stride,
+                                       is_position(c) ? options.position_bits : options.attribute_bits);
+  }
+
+  append(encoded, MESH_MAGIC);
+  append(encoded, MESH_VERSION);
+  append(encoded, stride);
+  append(encoded, static_cast<uint32_t>(vertex_order.size()));
+  append(encoded, static_cast<uint32_t>(indices.size()));
+  append(encoded, static_cast<uint32_t>(submeshes.size()));
+  append(encoded, static_cast<uint32_t>(mesh.materials.size()));
+  append(encoded, static_cast<uint32_t>(mesh.material_libs.size()));
+  for (uint32_t c = 0; c < stride; ++c) {
+    append(encoded, components[c].bits);
+    append(encoded, components[c].min);
+    append(encoded, components[c].step);
+  }
+  for (const auto &sm: submeshes) {
+    append(encoded, sm.name);
+    append(encoded, sm.index_offset);
+    append(encoded, sm.index_count);
+    append(encoded, sm.material_id);
+  }
+  for (const auto &m: mesh.materials) append(encoded, m);
+  for (const auto &m: mesh.material_libs) append(encoded, m);
+
+  // Each component of every vertex in turn, as deltas from the vertex before
+  const auto vertex_bytes_at = encoded.size();
+  append(encoded, static_cast<uint64_t>(0));
+  ScratchVector<uint32_t> deltas(vertex_order.size());
+  for (uint32_t c = 0; c < stride; ++c) {
+    uint32_t previous = 0;
+    for (size_t v = 0; v < vertex_order.size(); ++v) {
+      const auto q = quantise(mesh.vertex_data[static_cast<size_t>(vertex_order[v]) * stride + c], components[c]);
+      deltas[v] = zigzag(q - previous);
+      previous = q;
+    }
+    pack_stream(deltas.data(), deltas.size(), encoded);
+  }
+  const uint64_t vertex_bytes = encoded.size() - vertex_bytes_at - sizeof(uint64_t);
+  std::memcpy(encoded.data() + vertex_bytes_at, &vertex_bytes, sizeof(vertex_bytes));
+
+  append(encoded, static_cast<uint64_t>(0));
+  const auto index_start = encoded.size();
+  pack_stream(codes.data(), codes.size(), encoded);
+  const uint64_t index_bytes = encoded.size() - index_start;
+  std::memcpy(encoded.data() + index_start - sizeof(uint64_t), &index_bytes, sizeof(index_bytes));
+
+  const auto raw_bytes = vertex_order.size() * stride * sizeof(float) + indices.size() * sizeof(uint32_t);
+  spdlog::info("   Encoded {} vertices and {} triangles in {} KB, {:.1f}% of {} KB", vertex_order.size(),
+               indices.size() / 3, encoded.size() / 1024, 100.0 * encoded.size() / raw_bytes, raw_bytes / 1024);
+  return true;
+}
+
+bool decode_mesh(const uint8_t *data, size_t size, Mesh &mesh) {
+  mesh.vertex_data.clear();
+  mesh.indices.clear();
+  mesh.submeshes.clear();
+  mesh.lods.clear();
+  mesh.meshlets.clear();
+  mesh.triangle_bvh.reset();
+  mesh.materials.clear();
+  mesh.material_libs.clear();
+  mesh.num_elements = 0;
+  mesh.stride = 0;
+  mesh.bounds = Bounds();
+  if (decode(data, size, mesh)) return true;
+
+  mesh.vertex_data.clear();
+  mesh.indices.clear();
+  mesh.submeshes.clear();
+  mesh.materials.clear();
+  mesh.material_libs.clear();
+  mesh.num_elements = 0;
+  mesh.stride = 0;
+  return false;
+}
+
+bool save_compressed_mesh(const std::string &file_name, const Mesh &mesh, const MeshCodecOptions &options) {
+  std::vector<uint8_t> encoded;
+  if (!encode_mesh(mesh, encoded, options)) return false;
+  std::ofstream out(file_name, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+  if (!out) {
+    spdlog::error("Couldn't write {}", file_name);
+    return false;
+  }
+  return true;
+}
+
+bool load_compressed_mesh(const std::string &file_name, Mesh &mesh, const MeshLoadOptions &options) {
+  spdlog::info("load_compressed_mesh( \"{}\" )", file_name);
+
+  MappedFile file;
+  if (!file.open(file_name)) {
+    spdlog::error("Couldn't open mesh file {}", file_name);
+    return false;
+  }
+  if (!decode_mesh(file.data(), file.size(), mesh)) {
+    spdlog::error("Couldn't decode {}", file_name);
+    return false;
+  }
+  file.close();
+
+  const auto stride = mesh.stride;
+  const auto include_normals = options.include_normals;
+  const auto include_textures = options.include_textures;
+  const auto include_tangents = options.include_tangents;
+  if (include_tangents && (!include_normals || !include_textures)) {
+    spdlog::error("Tangents need both normals and tex coords to be included");
+    return false;
+  }
+  if ((include_normals && !has_normals(stride)) || (include_textures && !has_textures(stride))
+      || (include_tangents && !has_tangents(stride))) {
+    spdlog::error("{} doesn't have every attribute requested", file_name);
+    return false;
+  }
+
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  vertex_data.swap(mesh.vertex_data);
+  indices.swap(mesh.indices);
+
+  // Keep only the attributes asked for
+  uint32_t keep[12];
+  uint32_t kept = 0;
+  for (uint32_t c = 0; c < 3; ++c) keep[kept++] = c;
+  auto offset = 3u;
+  if (has_normals(stride)) {
+    if (include_normals) for (uint32_t c = 0; c < 3; ++c) keep[kept++] = offset + c;
+    offset += 3;
+  }
+  if (has_textures(stride)) {
+    if (include_textures) for (uint32_t c = 0; c < 2; ++c) keep[kept++] = offset + c;
+    offset += 2;
+  }
+  if (include_tangents) for (uint32_t c = 0; c < 4; ++c) keep[kept++] = offset + c;
+  if (kept != stride) {
+    const auto num_vertices = vertex_data.size() / stride;
+    for (size_t v = 0; v < num_vertices; ++v) {
+      for (uint32_t c = 0; c < kept; ++c) vertex_data[v * kept + c] = vertex_data[v * stride + keep[c]];
+    }
+    vertex_data.resize(num_vertices * kept);
+  }
+  spdlog::info("Found {:3} vertices", vertex_data.size() / kept);
+  spdlog::info("      {:3} triangles", indices.size() / 3);
+  spdlog::info("      {:3} submeshes", mesh.submeshes.size());
+
+  ArenaScope scope;
+  return finish_mesh(file_name, vertex_data, indices, include_normals, include_textures, include_tangents,
+                     options, mesh);
+}
@@ -0,0 +1,1219 @@
+#include "mesh_import.h"
+#include "mesh_internal.h"
+#include "mesh_codec.h"
+#include "mapped_file.h"
+#include "string_utils.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+
+#include "glm/glm.hpp"
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  enum class ComponentType {
+    INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT, DOUBLE
+  };
+
+  inline size_t component_size(ComponentType type) {
+    switch (type) {
+      case ComponentType::INT8:
+      case ComponentType::UINT8:
+        return 1;
+      case ComponentType::INT16:
+      case ComponentType::UINT16:
+        return 2;
+      case ComponentType::DOUBLE:
+        return 8;
+      default:
+        return 4;
+    }
+  }
+
+  template<typename T>
+  inline T load(const uint8_t *p) {
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    return value;
+  }
+
+  // One value as a float. Normalised integers map to [0, 1], or [-1, 1] when signed.
+  inline float read_float(const uint8_t *p, ComponentType type, bool normalized) {
+    switch (type) {
+      case ComponentType::FLOAT:
+        return load<float>(p);
+      case ComponentType::DOUBLE:
+        return static_cast<float>(load<double>(p));
+      case ComponentType::INT8: {
+        const auto v = static_cast<float>(load<int8_t>(p));
+        return normalized ? std::max(v / 127.0f, -1.0f) : v;
+      }
+      case ComponentType::UINT8: {
+        const auto v = static_cast<float>(load<uint8_t>(p));
+        return normalized ? v / 255.0f : v;
+      }
+      case ComponentType::INT16: {
+        const auto v = static_cast<float>(load<int16_t>(p));
+        return normalized ? std::max(v / 32767.0f, -1.0f) : v;
+      }
+      case ComponentType::UINT16: {
+        const auto v = static_cast<float>(load<uint16_t>(p));
+        return normalized ? v / 65535.0f : v;
+      }
+      case ComponentType::INT32:
+        return static_cast<float>(load<int32_t>(p));
+      default:
+        return static_cast<float>(load<uint32_t>(p));
+    }
+  }
+
+  // One integer value; false for float types and negative values
+  inline bool read_index(const uint8_t *p, ComponentType type, uint32_t &index) {
+    switch (type) {
+      case ComponentType::UINT8:
+        index = load<uint8_t>(p);
+        return true;
+      case ComponentType::UINT16:
+        index = load<uint16_t>(p);
+        return true;
+      case ComponentType::UINT32:
+        index = load<uint32_t>(p);
+        return true;
+      case ComponentType::INT8:
+        index = static_cast<uint32_t>(load<int8_t>(p));
+        return load<int8_t>(p) >= 0;
+      case ComponentType::INT16:
+        index = static_cast<uint32_t>(load<int16_t>(p));
+        return load<int16_t>(p) >= 0;
+      case ComponentType::INT32:
+        index = static_cast<uint32_t>(load<int32_t>(p));
+        return load<int32_t>(p) >= 0;
+      default:
+        return false;
+    }
+  }
+
+  // A typed, strided array of vectors in a mapped file
+  struct AttributeView {
+    AttributeView();
+
+    const uint8_t *data;
+    size_t count;
+
+    // Bytes from one vector to the next, and from the start of a vector to each component
+    size_t stride;
+    size_t offsets[4];
+
+    ComponentType type;
+    bool normalized;
+
+    inline bool empty() const { return data == nullptr; }
+
+    inline float get(size_t i, uint32_t component) const {
+      return read_float(data + i * stride + offsets[component], type, normalized);
+    }
+  };
+
+  AttributeView::AttributeView()
+          : data{nullptr}, count{0}, stride{0}, offsets{0, 0, 0, 0}, type{ComponentType::FLOAT}, normalized{false} {}
+
+  // The geometry of one draw from an imported file, indexing its own vertices
+  struct ImportPart {
+    ImportPart();
+
+    std::string name;
+    int32_t material_id;
+
+    // Model space placement. Normals go through its inverse transpose.
+    glm::mat4 transform;
+    bool has_transform;
+
+    AttributeView positions;
+    AttributeView normals;
+    AttributeView tex_coords;
+
+    // V runs down the image in the file, the opposite of GL
+    bool flip_v;
+
+    std::vector<uint32_t> indices;
+  };
+
+  ImportPart::ImportPart() : material_id{-1}, transform{1.0f}, has_transform{false}, flip_v{false} {}
+
+  // Positions of a part, transformed
+  inline glm::vec3 part_position(const ImportPart &part, size_t v) {
+    glm::vec3 p{part.positions.get(v, 0), part.positions.get(v, 1), part.positions.get(v, 2)};
+    return part.has_transform ? glm::vec3(part.transform * glm::vec4(p, 1.0f)) : p;
+  }
+
+  inline glm::vec3 part_normal(const ImportPart &part, const glm::mat3 &normal_matrix, size_t v) {
+    glm::vec3 n{part.normals.get(v, 0), part.normals.get(v, 1), part.normals.get(v, 2)};
+    if (!part.has_transform) return n;
+    n = normal_matrix * n;
+    const auto len = glm::length(n);
+    return len > 0 ? n / len : n;
+  }
+
+  inline glm::vec2 part_tex_coord(const ImportPart &part, size_t v) {
+    glm::vec2 t{part.tex_coords.get(v, 0), part.tex_coords.get(v, 1)};
+    if (part.flip_v) t.y = 1.0f - t.y;
+    return t;
+  }
+
+  // Writes each attribute of one vertex of a part into an interleaved vertex
+  struct CopyPartVertex {
+    const ImportPart &part;
+    const glm::mat3 &normal_matrix;
+    size_t vertex;
+    float *out;
+
+    void operator()(vertex_attribute::Position, uint32_t offset) const {
+      const auto p = part_position(part, vertex);
+      out[offset] = p.x;
+      out[offset + 1] = p.y;
+      out[offset + 2] = p.z;
+    }
+
+    void operator()(vertex_attribute::Normal, uint32_t offset) const {
+      const auto n = part_normal(part, normal_matrix, vertex);
+      out[offset] = n.x;
+      out[offset + 1] = n.y;
+      out[offset + 2] = n.z;
+    }
+
+    void operator()(vertex_attribute::TexCoord, uint32_t offset) const {
+      const auto t = part_tex_coord(part, vertex);
+      out[offset] = t.x;
+      out[offset + 1] = t.y;
+    }
+  };
+
+  // Copies every vertex of the parts in the format, one submesh a part
+  struct CopyParts {
+    const std::vector<ImportPart> &parts;
+    size_t num_vertices;
+    std::vector<float> &vertex_data;
+    std::vector<uint32_t> &eidx;
+    std::vector<SubMesh> &submeshes;
+
+    template<typename Format>
+    bool operator()(Format) const {
+      vertex_data.resize(num_vertices * Format::STRIDE);
+      auto *out = vertex_data.data();
+      uint32_t base = 0;
+      for (const auto &part: parts) {
+        const auto normal_matrix = glm::transpose(glm::inverse(glm::mat3(part.transform)));
+        for (size_t v = 0; v < part.positions.count; ++v) {
+          CopyPartVertex copy{part, normal_matrix, v, out};
+          Format::for_each_attribute(copy);
+          out += Format::STRIDE;
+        }
+        SubMesh sm;
+        sm.name = part.name;
+        sm.material_id = part.material_id;
+        sm.index_offset = static_cast<uint32_t>(eidx.size());
+        sm.index_count = static_cast<uint32_t>(part.indices.size());
+        for (auto i: part.indices) eidx.push_back(i + base);
+        submeshes.push_back(sm);
+        base += static_cast<uint32_t>(part.positions.count);
+      }
+      return true;
+    }
+
+    // Tangents are generated, so they always go through the builder
+    bool operator()(VertexFormat<vertex_attribute::Position, vertex_attribute::Normal,
+                                 vertex_attribute::TexCoord, vertex_attribute::Tangent>) const {
+      return false;
+    }
+  };
+
+  /*
+   * Interleave the parts into a mesh and finish it as load_obj does. Parts
+   * with every attribute asked for are copied in one pass; normals or tangents
+   * to generate send everything through the OBJ builder.
+   */
+  bool build_mesh(const std::string &file_name,
+                  const std::vector<ImportPart> &parts,
+                  const std::vector<std::string> &materials,
+                  const MeshLoadOptions &options,
+                  Mesh &mesh) {
+    const auto include_normals = options.include_normals;
+    const auto include_textures = options.include_textures;
+    const auto include_tangents = options.include_tangents;
+    if (include_tangents && (!include_normals || !include_textures)) {
+      spdlog::error("Tangents need both normals and tex coords to be included");
+      return false;
+    }
+
+    size_t num_vertices = 0, num_indices = 0;
+    auto file_normals = true, file_tex_coords = true;
+    for (const auto &part: parts) {
+      for (auto i: part.indices) {
+        if (i >= part.positions.count) {
+          spdlog::error("{} has an index {} past its {} vertices", file_name, i, part.positions.count);
+          return false;
+        }
+      }
+      num_vertices += part.positions.count;
+      num_indices += part.indices.size();
+      file_normals = file_normals && !part.normals.empty();
+      file_tex_coords = file_tex_coords && !part.tex_coords.empty();
+    }
+    if (parts.empty() || !num_indices) {
+      spdlog::error("{} has no triangles", file_name);
+      return false;
+    }
+    if (num_vertices > std::numeric_limits<uint32_t>::max()) {
+      spdlog::error("{} has too many vertices", file_name);
+      return false;
+    }
+    if (include_textures && !file_tex_coords) {
+      spdlog::error("Tex coords requested but {} has none", file_name);
+      return false;
+    }
+    if (include_normals && !file_normals && options.normal_mode == NormalMode::FROM_FILE) {
+      spdlog::error("Normals requested but {} has none", file_name);
+      return false;
+    }
+    const auto generate = include_normals && (!file_normals || options.normal_mode == NormalMode::GENERATE);
+    spdlog::info("Found {:3} vertices", num_vertices);
+    spdlog::info("      {:3} triangles", num_indices / 3);
+
+    ArenaScope scope;
+    std::vector<float> vertex_data;
+    std::vector<uint32_t> eidx;
+    mesh.submeshes.clear();
+    if (!generate && !include_tangents) {
+      eidx.reserve(num_indices);
+      dispatch_vertex_format(include_normals, include_textures, false,
+                             CopyParts{parts, num_vertices, vertex_data, eidx, mesh.submeshes});
+    } else {
+      // Each vertex is its own normal and tex coord; the builder merges what it can
+      RawMeshData raw;
+      raw.materials = materials;
+      const auto read_normals = include_normals && !generate;
+      for (const auto &part: parts) {
+        const auto base = static_cast<int32_t>(raw.num_vertices());
+        const auto normal_matrix = glm::transpose(glm::inverse(glm::mat3(part.transform)));
+        for (size_t v = 0; v < part.positions.count; ++v) {
+          const auto p = part_position(part, v);
+          raw.pos_x.push_back(p.x);
+          raw.pos_y.push_back(p.y);
+          raw.pos_z.push_back(p.z);
+          if (read_normals) {
+            const auto n = part_normal(part, normal_matrix, v);
+            raw.norm_x.push_back(n.x);
+            raw.norm_y.push_back(n.y);
+            raw.norm_z.push_back(n.z);
+          }
+          if (include_textures) {
+            const auto t = part_tex_coord(part, v);
+            raw.tex_u.push_back(t.x);
+            raw.tex_v.push_back(t.y);
+          }
+        }
+        RawGroup group;
+        group.object = part.name;
+        group.material_id = part.material_id;
+        group.first_triangle = static_cast<uint32_t>(raw.num_triangles());
+        raw.groups.push_back(group);
+        for (auto i: part.indices) {
+          const auto corner = static_cast<uint32_t>(raw.num_corners());
+          const auto index = base + static_cast<int32_t>(i);
+          raw.corner_vertex.push_back(index);
+          raw.corner_normal.push_back(read_normals ? index : -1);
+          raw.corner_tex.push_back(include_textures ? index : -1);
+          raw.triangles.push_back(corner);
+          if (raw.num_corners() % 3 == 0) raw.face_offsets.push_back(corner + 1);
+        }
+      }
+      if (generate) {
+        spdlog::info("   Generating normals");
+        generate_normals(raw, options.normal_weighting, options.crease_angle);
+      }
+      if (include_tangents) {
+        spdlog::info("   Generating tangents");
+        if (!generate_tangents(raw)) return false;
+      }
+      if (!build_vertex_data(raw, vertex_data, eidx, include_normals, include_textures, include_tangents,
+                             &mesh.submeshes)) {
+        return false;
+      }
+    }
+    spdlog::info("      {:3} submeshes", mesh.submeshes.size());
+    mesh.materials = materials;
+    mesh.material_libs.clear();
+
+    if (!finish_mesh(file_name, vertex_data, eidx, include_normals, include_textures, include_tangents,
+                     options, mesh)) {
+      return false;
+    }
+    spdlog::info("   Peak scratch memory {} KB", (scope.peak() + 1023) / 1024);
+    return true;
+  }
+
+  // PLY
+
+  struct PlyProperty {
+    PlyProperty();
+
+    std::string name;
+    ComponentType type;
+
+    // Lists are a count of count_type followed by that many values of type
+    bool is_list;
+    ComponentType count_type;
+  };
+
+  PlyProperty::PlyProperty() : type{ComponentType::FLOAT}, is_list{false}, count_type{ComponentType::UINT8} {}
+
+  struct PlyElement {
+    PlyElement();
+
+    std::string name;
+    size_t count;
+    std::vector<PlyProperty> properties;
+  };
+
+  PlyElement::PlyElement() : count{0} {}
+
+  bool ply_type(const std::string &name, ComponentType &type) {
+    static const std::pair<const char *, ComponentType> TYPES[] = {
+            {"char",   ComponentType::INT8},
+            {"int8",   ComponentType::INT8},
+            {"uchar",  ComponentType::UINT8},
+            {"uint8",  ComponentType::UINT8},
+            {"short",  ComponentType::INT16},
+            {"int16",  ComponentType::INT16},
+            {"ushort", ComponentType::UINT16},
+            {"uint16", ComponentType::UINT16},
+            {"int",    ComponentType::INT32},
+            {"int32",  ComponentType::INT32},
+            {"uint",   ComponentType::UINT32},
+            {"uint32", ComponentType::UINT32},
+            {"float",  ComponentType::FLOAT},
+            {"float32", ComponentType::FLOAT},
+            {"double", ComponentType::DOUBLE},
+            {"float64", ComponentType::DOUBLE},
+    };
+    for (const auto &t: TYPES) {
+      if (name == t.first) {
+        type = t.second;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Parse the header at [p, end), leaving p after end_header
+  bool parse_ply_header(const uint8_t *&p, const uint8_t *end, std::vector<PlyElement> &elements) {
+    auto first_line = true, binary_le = false;
+    for (;;) {
+      auto eol = static_cast<const uint8_t *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+      if (!eol) {
+        spdlog::error("  PLY header has no end_header");
+        return false;
+      }
+      std::string line(reinterpret_cast<const char *>(p), reinterpret_cast<const char *>(eol));
+      p = eol + 1;
+      auto tokens = tokenise(line, ' ');
+      for (auto &t: tokens) trim(t);
+      tokens.erase(std::remove(tokens.begin(), tokens.end(), std::string()), tokens.end());
+      if (first_line) {
+        if (tokens.size() != 1 || tokens[0] != "ply") {
+          spdlog::error("  Not a PLY file");
+          return false;
+        }
+        first_line = false;
+        continue;
+      }
+      if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info") continue;
+      if (tokens[0] == "end_header") break;
+      if (tokens[0] == "format") {
+        binary_le = tokens.size() >= 2 && tokens[1] == "binary_little_endian";
+        if (!binary_le) {
+          spdlog::error("  Only binary little endian PLY files are supported, not {}",
+                        tokens.size() >= 2 ? tokens[1] : "");
+          return false;
+        }
+      } else if (tokens[0] == "element" && tokens.size() == 3) {
+        PlyElement element;
+        element.name = tokens[1];
+        element.count = std::strtoull(tokens[2].c_str(), nullptr, 10);
+        elements.push_back(element);
+      } else if (tokens[0] == "property" && !elements.empty()) {
+        PlyProperty property;
+        auto ok = false;
+        if (tokens.size() == 5 && tokens[1] == "list") {
+          property.is_list = true;
+          ok = ply_type(tokens[2], property.count_type) && ply_type(tokens[3], property.type);
+          property.name = tokens[4];
+        } else if (tokens.size() == 3) {
+          ok = ply_type(tokens[1], property.type);
+          property.name = tokens[2];
+        }
+        if (!ok) {
+          spdlog::error("  Bad PLY property: {}", line);
+          return false;
+        }
+        elements.back().properties.push_back(property);
+      } else {
+        spdlog::error("  Bad PLY header line: {}", line);
+        return false;
+      }
+    }
+    if (!binary_le) {
+      spdlog::error("  PLY header has no format");
+      return false;
+    }
+    return true;
+  }
+
+  // Index of the property called one of names, or -1
+  int32_t find_property(const PlyElement &element, std::initializer_list<const char *> names) {
+    for (size_t i = 0; i < element.properties.size(); ++i) {
+      for (auto name: names) {
+        if (element.properties[i].name == name && !element.properties[i].is_list) return static_cast<int32_t>(i);
+      }
+    }
+    return -1;
+  }
+
+  // A view of the named scalar properties of an element that has no lists, or an empty view if any is missing
+  AttributeView ply_view(const PlyElement &element, const uint8_t *data,
+                         std::initializer_list<std::initializer_list<const char *>> names) {
+    AttributeView view;
+    size_t offset = 0;
+    std::vector<size_t> offsets;
+    for (const auto &p: element.properties) {
+      offsets.push_back(offset);
+      offset += component_size(p.type);
+    }
+    uint32_t c = 0;
+    ComponentType type = ComponentType::FLOAT;
+    for (auto alternatives: names) {
+      const auto i = find_property(element, alternatives);
+      if (i < 0) return AttributeView();
+      // Components must share a type, which the common layouts all do
+      if (c && element.properties[i].type != type) return AttributeView();
+      type = element.properties[i].type;
+      view.offsets[c++] = offsets[i];
+    }
+    view.data = data;
+    view.count = element.count;
+    view.stride = offset;
+    view.type = type;
+    return view;
+  }
+
+  bool read_ply(const std::string &file_name, const MappedFile &file, const MeshLoadOptions &options, ImportPart &part) {
+    const auto *p = file.data();
+    const auto *end = p + file.size();
+    std::vector<PlyElement> elements;
+    if (!p || !parse_ply_header(p, end, elements)) return false;
+
+    auto have_vertices = false, have_faces = false;
+    for (const auto &element: elements) {
+      const auto remaining = static_cast<size_t>(end - p);
+      const auto has_lists = std::any_of(element.properties.begin(), element.properties.end(),
+                                         [](const PlyProperty &q) { return q.is_list; });
+      if (!has_lists) {
+        size_t size = 0;
+        for (const auto &q: element.properties) size += component_size(q.type);
+        if (size && element.count > remaining / size) {
+          spdlog::error("  PLY {} element is truncated", element.name);
+          return false;
+        }
+        if (element.name == "vertex") {
+          part.positions = ply_view(element, p, {{"x"}, {"y"}, {"z"}});
+          if (part.positions.empty()) {
+            spdlog::error("  PLY vertices need x, y and z of one type");
+            return false;
+          }
+          if (options.include_normals) part.normals = ply_view(element, p, {{"nx"}, {"ny"}, {"nz"}});
+          if (options.include_textures) {
+            part.tex_coords = ply_view(element, p, {{"u", "s", "texture_u", "texture_s"},
+                                                    {"v", "t", "texture_v", "texture_t"}});
+          }
+          have_vertices = true;
+        }
+        p += element.count * size;
+        continue;
+      }
+
+      // Lists have to be walked
+      const auto is_faces = element.name == "face";
+      int32_t corners = -1;
+      for (size_t i = 0; i < element.properties.size() && is_faces; ++i) {
+        const auto &q = element.properties[i];
+        if (q.is_list && (q.name == "vertex_indices" || q.name == "vertex_index")) corners = static_cast<int32_t>(i);
+      }
+      if (is_faces && corners < 0) {
+        spdlog::error("  PLY faces have no vertex_indices");
+        return false;
+      }
+      if (is_faces) {
+        part.indices.clear();
+        part.indices.reserve(element.count * 3);
+        have_faces = true;
+      }
+      for (size_t e = 0; e < element.count; ++e) {
+        for (size_t i = 0; i < element.properties.size(); ++i) {
+          const auto &q = element.properties[i];
+          const auto count_size = component_size(q.count_type), size = component_size(q.type);
+          uint32_t n = 1;
+          if (q.is_list) {
+            if (static_cast<size_t>(end - p) < count_size || !read_index(p, q.count_type, n)) {
+              spdlog::error("  PLY {} element is truncated", element.name);
+              return false;
+            }
+            p += count_size;
+          }
+          if (static_cast<size_t>(end - p) / size < n) {
+            spdlog::error("  PLY {} element is truncated", element.name);
+            return false;
+          }
+          if (static_cast<int32_t>(i) == corners && n >= 3) {
+            uint32_t first = 0, previous = 0, index = 0;
+            for (uint32_t k = 0; k < n; ++k) {
+              if (!read_index(p + k * size, q.type, index)) {
+                spdlog::error("  PLY face has a bad vertex index");
+                return false;
+              }
+              if (k >= 2) {
+                part.indices.push_back(first);
+                part.indices.push_back(previous);
+                part.indices.push_back(index);
+              }
+              if (k == 0) first = index;
+              previous = index;
+            }
+          }
+          p += n * size;
+        }
+      }
+    }
+    if (!have_vertices || !have_faces) {
+      spdlog::error("  PLY file needs vertex and face elements");
+      return false;
+    }
+    return true;
+  }
+
+  // glTF
+
+  // A parsed JSON value. Objects keep their members in file order.
+  struct JsonValue {
+    enum Type {
+      NONE, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT
+    };
+
+    JsonValue();
+
+    Type type;
+    bool boolean;
+    double number;
+    std::string string;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    // The member called key, or null if there isn't one or this isn't an object
+    const JsonValue *find(const char *key) const;
+
+    // The member called key if it's a number, otherwise fallback
+    double number_or(const char *key, double fallback) const;
+
+    // The member called key if it's an array, otherwise null
+    const std::vector<JsonValue> *array(const char *key) const;
+  };
+
+  JsonValue::JsonValue() : type{NONE}, boolean{false}, number{0} {}
+
+  const JsonValue *JsonValue::find(const char *key) const {
+    for (const auto &m: members) {
+      if (m.first == key) return &m.second;
+    }
+    return nullptr;
+  }
+
+  double JsonValue::number_or(const char *key, double fallback) const {
+    auto v = find(key);
+    return v && v->type == NUMBER ? v->number : fallback;
+  }
+
+  const std::vector<JsonValue> *JsonValue::array(const char *key) const {
+    auto v = find(key);
+    return v && v->type == ARRAY ? &v->items : nullptr;
+  }
+
+  // value as an index into an array of size items, if it's a whole number within it
+  bool json_index(const JsonValue &value, size_t size, size_t &index) {
+    if (value.type != JsonValue::NUMBER || !(value.number >= 0) || value.number >= static_cast<double>(size)
+        || value.number != std::floor(value.number)) {
+      return false;
+    }
+    index = static_cast<size_t>(value.number);
+    return true;
+  }
+
+  // Recursive descent over [p, end). Nesting is limited so bad input can't exhaust the stack.
+  class JsonParser {
+  public:
+    JsonParser(const char *begin, const char *end) : p_{begin}, end_{end} {}
+
+    bool parse(JsonValue &value) {
+      if (!parse_value(value, 0)) return false;
+      skip_space();
+      return p_ == end_;
+    }
+
+  private:
+    static const int32_t MAX_DEPTH = 64;
+
+    void skip_space() {
+      while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n')) ++p_;
+    }
+
+    bool literal(const char *word) {
+      const auto n = std::strlen(word);
+      if (static_cast<size_t>(end_ - p_) < n || std::strncmp(p_, word, n) != 0) return false;
+      p_ += n;
+      return true;
+    }
+
+    bool parse_value(JsonValue &value, int32_t depth) {
+      skip_space();
+      if (p_ == end_ || depth > MAX_DEPTH) return false;
+      switch (*p_) {
+        case '{':
+          return parse_object(value, depth);
+        case '[':
+          return parse_array(value, depth);
+        case '"':
+          value.type = JsonValue::STRING;
+          return parse_string(value.string);
+        case 't':
+          value.type = JsonValue::BOOLEAN;
+          value.boolean = true;
+          return literal("true");
+        case 'f':
+          value.type = JsonValue::BOOLEAN;
+          return literal("false");
+        case 'n':
+          return literal("null");
+        default:
+          return parse_number(value);
+      }
+    }
+
+    bool parse_object(JsonValue &value, int32_t depth) {
+      value.type = JsonValue::OBJECT;
+      ++p_;
+      skip_space();
+      if (p_ < end_ && *p_ == '}') {
+        ++p_;
+        return true;
+      }
+      for (;;) {
+        skip_space();
+        value.members.emplace_back();
+        auto &member = value.members.back();
+        if (p_ == end_ || *p_ != '"' || !parse_string(member.first)) return false;
+        skip_space();
+        if (p_ == end_ || *p_++ != ':') return false;
+        if (!parse_value(member.second, depth + 1)) return false;
+        skip_space();
+        if (p_ == end_) return false;
+        if (*p_ == '}') {
+          ++p_;
+          return true;
+        }
+        if (*p_++ != ',') return false;
+      }
+    }
+
+    bool parse_array(JsonValue &value, int32_t depth) {
+      value.type = JsonValue::ARRAY;
+      ++p_;
+      skip_space();
+      if (p_ < end_ && *p_ == ']') {
+        ++p_;
+        return true;
+      }
+      for (;;) {
+        value.items.emplace_back();
+        if (!parse_value(value.items.back(), depth + 1)) return false;
+        skip_space();
+        if (p_ == end_) return false;
+        if (*p_ == ']') {
+          ++p_;
+          return true;
+        }
+        if (*p_++ != ',') return false;
+      }
+    }
+
+    bool parse_string(std::string &s) {
+      ++p_;
+      s.clear();
+      while (p_ < end_ && *p_ != '"') {
+        if (*p_ != '\\') {
+          s.push_back(*p_++);
+          continue;
+        }
+        if (++p_ == end_) return false;
+        const auto c = *p_++;
+        switch (c) {
+          case 'b':
+            s.push_back('\b');
+            break;
+          case 'f':
+            s.push_back('\f');
+            break;
+          case 'n':
+            s.push_back('\n');
+            break;
+          case 'r':
+            s.push_back('\r');
+            break;
+          case 't':
+            s.push_back('\t');
+            break;
+          case 'u': {
+            // Each UTF-16 unit becomes UTF-8 on its own; names don't need surrogate pairs put together
+            if (end_ - p_ < 4) return false;
+            uint32_t code = 0;
+            for (auto k = 0; k < 4; ++k) {
+              const auto h = *p_++;
+              code <<= 4;
+              if (h >= '0' && h <= '9') code |= static_cast<uint32_t>(h - '0');
+              else if (h >= 'a' && h <= 'f') code |= static_cast<uint32_t>(h - 'a' + 10);
+              else if (h >= 'A' && h <= 'F') code |= static_cast<uint32_t>(h - 'A' + 10);
+              else return false;
+            }
+            if (code < 0x80) {
+              s.push_back(static_cast<char>(code));
+            } else if (code < 0x800) {
+              s.push_back(static_cast<char>(0xc0 | (code >> 6)));
+              s.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+            } else {
+              s.push_back(static_cast<char>(0xe0 | (code >> 12)));
+              s.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+              s.push_back(static_cast<char>(0x80 | (code & 0x3f)));
+            }
+            break;
+          }
+          default:
+            s.push_back(c);
+            break;
+        }
+      }
+      if (p_ == end_) return false;
+      ++p_;
+      return true;
+    }
+
+    bool parse_number(JsonValue &value) {
+      // strtod needs a terminated string; numbers are short
+      char buffer[64];
+      size_t n = 0;
+      while (p_ + n < end_ && n + 1 < sizeof(buffer) && std::strchr("+-0123456789.eE", p_[n])) {
+        buffer[n] = p_[n];
+        ++n;
+      }
+      if (!n) return false;
+      buffer[n] = 0;
+      char *stop = nullptr;
+      value.type = JsonValue::NUMBER;
+      value.number = std::strtod(buffer, &stop);
+      if (stop != buffer + n) return false;
+      p_ += n;
+      return true;
+    }
+
+    const char *p_;
+    const char *end_;
+  };
+
+  const uint32_t GLB_MAGIC = 0x46546C67;
+  const uint32_t GLB_JSON = 0x4E4F534A;
+  const uint32_t GLB_BIN = 0x004E4942;
+  const uint32_t GLTF_TRIANGLES = 4;
+
+  bool gltf_component_type(double code, ComponentType &type) {
+    switch (static_cast<int32_t>(code)) {
+      case 5120:
+        type = ComponentType::INT8;
+        return true;
+      case 5121:
+        type = ComponentType::UINT8;
+        return true;
+      case 5122:
+        type = ComponentType::INT16;
+        return true;
+      case 5123:
+        type = ComponentType::UINT16;
+        return true;
+      case 5125:
+        type = ComponentType::UINT32;
+        return true;
+      case 5126:
+        type = ComponentType::FLOAT;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  uint32_t gltf_components(const std::string &type) {
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+  }
+
+  // The parsed JSON and binary chunk of a .glb file
+  struct GlbFile {
+    JsonValue json;
+    const uint8_t *bin;
+    size_t bin_size;
+  };
+
+  bool read_glb(const MappedFile &file, GlbFile &glb) {
+    const auto *p = file.data();
+    const auto size = file.size();
+    if (size < 20 || load<uint32_t>(p) != GLB_MAGIC) {
+      spdlog::error("  Not a binary glTF file");
+      return false;
+    }
+    if (load<uint32_t>(p + 4) != 2) {
+      spdlog::error("  glTF version {} isn't supported", load<uint32_t>(p + 4));
+      return false;
+    }
+    const auto length = std::min<size_t>(load<uint32_t>(p + 8), size);
+
+    // Chunks follow the 12 byte header: JSON first, then an optional binary chunk
+    size_t at = 12;
+    glb.bin = nullptr;
+    glb.bin_size = 0;
+    auto have_json = false;
+    while (at + 8 <= length) {
+      const auto chunk_length = load<uint32_t>(p + at);
+      const auto chunk_type = load<uint32_t>(p + at + 4);
+      at += 8;
+      if (chunk_length > length - at) {
+        spdlog::error("  glTF chunk is truncated");
+        return false;
+      }
+      const auto *chunk = p + at;
+      if (!have_json) {
+        if (chunk_type != GLB_JSON) {
+          spdlog::error("  glTF file doesn't start with JSON");
+          return false;
+        }
+        JsonParser parser(reinterpret_cast<const char *>(chunk), reinterpret_cast<const char *>(chunk + chunk_length));
+        if (!parser.parse(glb.json) || glb.json.type != JsonValue::OBJECT) {
+          spdlog::error("  glTF JSON is malformed");
+          return false;
+        }
+        have_json = true;
+      } else if (chunk_type == GLB_BIN && !glb.bin) {
+        glb.bin = chunk;
+        glb.bin_size = chunk_length;
+      }
+      at += chunk_length;
+    }
+    if (!have_json) {
+      spdlog::error("  glTF file has no JSON chunk");
+      return false;
+    }
+    return true;
+  }
+
+  // A view of accessor index over the binary chunk, checked to lie within it
+  bool gltf_view(const GlbFile &glb, size_t index, AttributeView &view, uint32_t &components) {
+    const auto *accessors = glb.json.array("accessors");
+    const auto *views = glb.json.array("bufferViews");
+    const auto *buffers = glb.json.array("buffers");
+    if (!accessors || index >= accessors->size()) return false;
+    const auto &accessor = (*accessors)[index];
+    if (accessor.find("sparse")) {
+      spdlog::error("  glTF sparse accessors aren't supported");
+      return false;
+    }
+    const auto *view_value = accessor.find("bufferView");
+    size_t view_index;
+    if (!views || !view_value || !json_index(*view_value, views->size(), view_index)) return false;
+    const auto &buffer_view = (*views)[view_index];
+    const auto buffer = buffer_view.number_or("buffer", -1);
+    if (buffer != 0 || !buffers || buffers->empty() || (*buffers)[0].find("uri") || !glb.bin) {
+      spdlog::error("  glTF buffers other than the binary chunk aren't supported");
+      return false;
+    }
+
+    ComponentType type;
+    const auto *type_name = accessor.find("type");
+    components = type_name && type_name->type == JsonValue::STRING ? gltf_components(type_name->string) : 0;
+    if (!components || !gltf_component_type(accessor.number_or("componentType", 0), type)) return false;
+
+    const auto count = accessor.number_or("count", -1);
+    const auto view_offset = buffer_view.number_or("byteOffset", 0);
+    const auto view_length = buffer_view.number_or("byteLength", -1);
+    const auto accessor_offset = accessor.number_or("byteOffset", 0);
+    const auto element_size = static_cast<double>(component_size(type) * components);
+    const auto stride = buffer_view.number_or("byteStride", element_size);
+    if (count < 0 || view_offset < 0 || view_length < 0 || accessor_offset < 0 || stride < element_size
+        || view_offset + view_length > static_cast<double>(glb.bin_size)
+        || (count > 0 && accessor_offset + stride * (count - 1) + element_size > view_length)) {
+      spdlog::error("  glTF accessor {} is out of range", index);
+      return false;
+    }
+    view.data = glb.bin + static_cast<size_t>(view_offset + accessor_offset);
+    view.count = static_cast<size_t>(count);
+    view.stride = static_cast<size_t>(stride);
+    for (uint32_t c = 0; c < components; ++c) view.offsets[c] = c * component_size(type);
+    view.type = type;
+    auto normalized = accessor.find("normalized");
+    view.normalized = normalized && normalized->type == JsonValue::BOOLEAN && normalized->boolean;
+    return true;
+  }
+
+  // A node's own transform, from its matrix or its translation, rotation and scale
+  glm::mat4 gltf_local_transform(const JsonValue &node) {
+    glm::mat4 m{1.0f};
+    const auto *matrix = node.array("matrix");
+    if (matrix && matrix->size() == 16) {
+      for (auto i = 0; i < 16; ++i) m[i / 4][i % 4] = static_cast<float>((*matrix)[i].number);
+      return m;
+    }
+    const auto *t = node.array("translation");
+    const auto *r = node.array("rotation");
+    const auto *s = node.array("scale");
+    if (r && r->size() == 4) {
+      // Unit quaternion x, y, z, w to a rotation
+      const auto x = static_cast<float>((*r)[0].number), y = static_cast<float>((*r)[1].number);
+      const auto z = static_cast<float>((*r)[2].number), w = static_cast<float>((*r)[3].number);
+      m[0] = glm::vec4(1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w), 0);
+      m[1] = glm::vec4(2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w), 0);
+      m[2] = glm::vec4(2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y), 0);
+    }
+    if (s && s->size() == 3) {
+      for (auto c = 0; c < 3; ++c) m[c] *= static_cast<float>((*s)[c].number);
+    }
+    if (t && t->size() == 3) {
+      m[3] = glm::vec4((*t)[0].number, (*t)[1].number, (*t)[2].number, 1);
+    }
+    return m;
+  }
+
+  // Append a part for each triangle primitive of mesh index placed by transform
+  bool gltf_mesh_parts(const GlbFile &glb, size_t index, const glm::mat4 &transform, bool has_transform,
+                       const MeshLoadOptions &options, std::vector<ImportPart> &parts) {
+    const auto *meshes = glb.json.array("meshes");
+    if (!meshes || index >= meshes->size()) {
+      spdlog::error("  glTF mesh {} doesn't exist", index);
+      return false;
+    }
+    const auto &mesh = (*meshes)[index];
+    const auto *name = mesh.find("name");
+    const auto mesh_name = name && name->type == JsonValue::STRING ? name->string : "mesh" + std::to_string(index);
+    const auto *primitives = mesh.array("primitives");
+    if (!primitives) return true;
+    for (const auto &primitive: *primitives) {
+      if (primitive.number_or("mode", GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+        spdlog::warn("  Skipping a primitive of {} that isn't triangles", mesh_name);
+        continue;
+      }
+      const auto *attributes = primitive.find("attributes");
+      if (!attributes || !attributes->find("POSITION")) {
+        spdlog::error("  glTF primitive of {} has no positions", mesh_name);
+        return false;
+      }
+
+      ImportPart part;
+      part.name = mesh_name;
+      part.transform = transform;
+      part.has_transform = has_transform;
+      part.flip_v = true;
+      const auto *material = primitive.find("material");
+      size_t material_index = 0;
+      if (material && !json_index(*material, static_cast<size_t>(std::numeric_limits<int32_t>::max()), material_index)) {
+        spdlog::error("  glTF material of {} isn't an index", mesh_name);
+        return false;
+      }
+      part.material_id = material ? static_cast<int32_t>(material_index) : -1;
+
+      // Accessor indices are checked against the accessors by gltf_view
+      const auto max_index = std::numeric_limits<size_t>::max();
+      const auto *position = attributes->find("POSITION");
+      const auto *normal = attributes->find("NORMAL");
+      const auto *tex_coord = attributes->find("TEXCOORD_0");
+      size_t accessor = 0;
+      uint32_t components = 0;
+      if (!json_index(*position, max_index, accessor) || !gltf_view(glb, accessor, part.positions, components)
+          || components != 3) {
+        spdlog::error("  glTF positions of {} are bad", mesh_name);
+        return false;
+      }
+      if (options.include_normals && normal
+          && (!json_index(*normal, max_index, accessor) || !gltf_view(glb, accessor, part.normals, components)
+              || components != 3 || part.normals.count != part.positions.count)) {
+        spdlog::error("  glTF normals of {} are bad", mesh_name);
+        return false;
+      }
+      if (options.include_textures && tex_coord
+          && (!json_index(*tex_coord, max_index, accessor) || !gltf_view(glb, accessor, part.tex_coords, components)
+              || components != 2 || part.tex_coords.count != part.positions.count)) {
+        spdlog::error("  glTF tex coords of {} are bad", mesh_name);
+        return false;
+      }
+
+      const auto *index_accessor = primitive.find("indices");
+      if (index_accessor) {
+        AttributeView indices;
+        if (!json_index(*index_accessor, max_index, accessor) || !gltf_view(glb, accessor, indices, components)
+            || components != 1 || indices.count % 3) {
+          spdlog::error("  glTF indices of {} are bad", mesh_name);
+          return false;
+        }
+        part.indices.resize(indices.count);
+        for (size_t i = 0; i < indices.count; ++i) {
+          if (!read_index(indices.data + i * indices.stride, indices.type, part.indices[i])) {
+            spdlog::error("  glTF indices of {} are bad", mesh_name);
+            return false;
+          }
+        }
+      } else {
+        part.indices.resize(part.positions.count - part.positions.count % 3);
+        for (size_t i = 0; i < part.indices.size(); ++i) part.indices[i] = static_cast<uint32_t>(i);
+      }
+      parts.push_back(std::move(part));
+    }
+    return true;
+  }
+
+  /*
+   * Parts for the meshes under node value and its children. glTF nodes form
+   * a forest, so a node reached twice, through a cycle or a second parent, is
+   * an error rather than a subgraph to import again; visited marks the nodes
+   * seen so far and has an entry per node.
+   */
+  bool gltf_node_parts(const GlbFile &glb, const JsonValue &value, const glm::mat4 &parent, int32_t depth,
+                       std::vector<bool> &visited, const MeshLoadOptions &options, std::vector<ImportPart> &parts) {
+    const auto *nodes = glb.json.array("nodes");
+    size_t index;
+    if (!nodes || !json_index(value, nodes->size(), index) || depth > 64) {
+      spdlog::error("  glTF node {} doesn't exist or is nested too deeply", value.number);
+      return false;
+    }
+    if (visited[index]) {
+      spdlog::error("  glTF node {} is reached more than once", index);
+      return false;
+    }
+    visited[index] = true;
+    const auto &node = (*nodes)[index];
+    const auto transform = parent * gltf_local_transform(node);
+    const auto *mesh = node.find("mesh");
+    size_t mesh_index;
+    if (mesh) {
+      if (!json_index(*mesh, std::numeric_limits<size_t>::max(), mesh_index)) {
+        spdlog::error("  glTF mesh of node {} isn't an index", index);
+        return false;
+      }
+      if (!gltf_mesh_parts(glb, mesh_index, transform, true, options, parts)) return false;
+    }
+    const auto *children = node.array("children");
+    if (children) {
+      for (const auto &child: *children) {
+        if (!gltf_node_parts(glb, child, transform, depth + 1, visited, options, parts)) return false;
+      }
+    }
+    return true;
+  }
+
+}
+
+bool load_ply(const std::string &ply_file_name, Mesh &mesh, const MeshLoadOptions &options) {
+  spdlog::info("load_ply( \"{}\" )", ply_file_name);
+
+  MappedFile file;
+  if (!file.open(ply_file_name)) {
+    spdlog::error("Couldn't open PLY file {}", ply_file_name);
+    return false;
+  }
+  std::vector<ImportPart> parts(1);
+  if (!read_ply(ply_file_name, file, options, parts[0])) return false;
+  auto slash = ply_file_name.find_last_of('/');
+  parts[0].name = slash == std::string::npos ? ply_file_name : ply_file_name.substr(slash + 1);
+  return build_mesh(ply_file_name, parts, std::vector<std::string>(), options, mesh);
+}
+
+bool load_glb(const std::string &glb_file_name, Mesh &mesh, const MeshLoadOptions &options) {
+  spdlog::info("load_glb( \"{}\" )", glb_file_name);
+
+  MappedFile file;
+  if (!file.open(glb_file_name)) {
+    spdlog::error("Couldn't open glTF file {}", glb_file_name);
+    return false;
+  }
+  GlbFile glb;
+  if (!read_glb(file, glb)) return false;
+
+  std::vector<ImportPart> parts;
+  const auto *scenes = glb.json.array("scenes");
+  if (scenes && !scenes->empty()) {
+    const auto *scene_value = glb.json.find("scene");
+    size_t scene = 0;
+    if (scene_value && !json_index(*scene_value, scenes->size(), scene)) {
+      spdlog::error("  glTF scene {} doesn't exist", scene_value->number);
+      return false;
+    }
+    const auto *nodes = (*scenes)[scene].array("nodes");
+    const auto *all_nodes = glb.json.array("nodes");
+    std::vector<bool> visited(all_nodes ? all_nodes->size() : 0, false);
+    if (nodes) {
+      for (const auto &node: *nodes) {
+        if (!gltf_node_parts(glb, node, glm::mat4{1.0f}, 0, visited, options, parts)) return false;
+      }
+    }
+  } else {
+    const auto *meshes = glb.json.array("meshes");
+    for (size_t m = 0; meshes && m < meshes->size(); ++m) {
+      if (!gltf_mesh_parts(glb, m, glm::mat4{1.0f}, false, options, parts)) return false;
+    }
+  }
+
+  std::vector<std::string> materials;
+  const auto *gltf_materials = glb.json.array("materials");
+  if (gltf_materials) {
+    for (size_t m = 0; m < gltf_materials->size(); ++m) {
+      const auto *name = (*gltf_materials)[m].find("name");
+      materials.push_back(name && name->type == JsonValue::STRING ? name->string : "material" + std::to_string(m));
+    }
+  }
+  for (auto &part: parts) {
+    if (part.material_id >= static_cast<int32_t>(materials.size())) {
+      spdlog::error("  glTF material {} doesn't exist", part.material_id);
+      return false;
+    }
+  }
+  return build_mesh(glb_file_name, parts, materials, options, mesh);
+}
+
+bool load_mesh(const std::string &file_name, Mesh &mesh, const MeshLoadOptions &options) {
+  auto dot = file_name.find_last_of('.');
+  auto extension = dot == std::string::npos ? std::string() : file_name.substr(dot);
+  to_lower(extension);
+  if (extension == ".ply") return load_ply(file_name, mesh, options);
+  if (extension == ".glb") return load_glb(file_name, mesh, options);
+  if (extension == ".mesh") return load_compressed_mesh(file_name, mesh, options);
+  return load_obj(file_name, mesh, options);
+}
@@ -0,0 +1,297 @@
+#include "mesh_internal.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  // Faces are processed in blocks of this many per task
+  const size_t FACE_GRAIN = 4096;
+  const size_t VERTEX_GRAIN = 2048;
+
+  // Interior angle of the polygon at corner c, which is part of the face [first, last]
+  float corner_angle(const RawMeshData &raw, uint32_t first, uint32_t last, uint32_t c) {
+    auto prev = (c == first) ? last : c - 1;
+    auto next = (c == last) ? first : c + 1;
+    auto v = raw.corner_vertex[c], vp = raw.corner_vertex[prev], vn = raw.corner_vertex[next];
+    float ax = raw.pos_x[vp] - raw.pos_x[v], ay = raw.pos_y[vp] - raw.pos_y[v], az = raw.pos_z[vp] - raw.pos_z[v];
+    float bx = raw.pos_x[vn] - raw.pos_x[v], by = raw.pos_y[vn] - raw.pos_y[v], bz = raw.pos_z[vn] - raw.pos_z[v];
+    auto la = std::sqrt(ax * ax + ay * ay + az * az);
+    auto lb = std::sqrt(bx * bx + by * by + bz * bz);
+    if (la == 0 || lb == 0) return 0;
+    auto c_theta = (ax * bx + ay * by + az * bz) / (la * lb);
+    return std::acos(std::max(-1.0f, std::min(1.0f, c_theta)));
+  }
+
+  /*
+   * Counting sort of corners by vertex. The corners of vertex v are
+   * corners[start[v]] to corners[start[v+1] - 1], in corner order so that
+   * gathers over them are deterministic.
+   */
+  void build_vertex_corners(const RawMeshData &raw, ScratchVector<uint32_t> &start, ScratchVector<uint32_t> &corners) {
+    const auto num_corners = raw.num_corners();
+    const auto num_vertices = raw.num_vertices();
+    const auto *cv = raw.corner_vertex.data();
+    start.assign(num_vertices + 1, 0);
+    for (size_t c = 0; c < num_corners; ++c) ++start[cv[c] + 1];
+    for (size_t v = 0; v < num_vertices; ++v) start[v + 1] += start[v];
+    corners.resize(num_corners);
+    ScratchVector<uint32_t> cursor(start.begin(), start.end() - 1);
+    for (size_t c = 0; c < num_corners; ++c) corners[cursor[cv[c]]++] = static_cast<uint32_t>(c);
+  }
+
+  inline bool same_bits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+  }
+}
+
+/*
+ * Normals are generated without any scattered accumulation so that every pass
+ * can be split across threads with no atomics or per-thread buffers:
+ * 1. Per face: unit Newell normal, area and, if needed, corner angles.
+ * 2. Vertex to corner adjacency as a compressed (CSR) list via a counting sort.
+ * 3. Per vertex: each corner gathers the weighted normals of its compatible
+ *    neighbour faces and writes only its own slot.
+ */
+void generate_normals(RawMeshData &raw, NormalWeighting weighting, float crease_angle) {
+  using namespace std;
+
+  ArenaScope scope;
+
+  const auto num_faces = raw.num_faces();
+  const auto num_corners = raw.num_corners();
+  const auto num_vertices = raw.num_vertices();
+  const auto *offsets = raw.face_offsets.data();
+  const auto *cv = raw.corner_vertex.data();
+
+  // 1. Face normals and weights
+  ScratchVector<float> fnx(num_faces), fny(num_faces), fnz(num_faces), farea(num_faces);
+  ScratchVector<uint32_t> corner_face(num_corners);
+  ScratchVector<float> angle(weighting == NormalWeighting::ANGLE ? num_corners : 0);
+  parallel_for(0, num_faces, FACE_GRAIN, [&](size_t begin, size_t end) {
+    for (auto f = begin; f < end; ++f) {
+      auto first = offsets[f], last = offsets[f + 1] - 1;
+      float nx = 0, ny = 0, nz = 0;
+      for (auto c = first; c <= last; ++c) {
+        auto a = cv[c], b = cv[c == last ? first : c + 1];
+        nx += (raw.pos_y[a] - raw.pos_y[b]) * (raw.pos_z[a] + raw.pos_z[b]);
+        ny += (raw.pos_z[a] - raw.pos_z[b]) * (raw.pos_x[a] + raw.pos_x[b]);
+        nz += (raw.pos_x[a] - raw.pos_x[b]) * (raw.pos_y[a] + raw.pos_y[b]);
+        corner_face[c] = static_cast<uint32_t>(f);
+      }
+      auto len = sqrt(nx * nx + ny * ny + nz * nz);
+      auto inv = (len > 0) ? 1.0f / len : 0.0f;
+      fnx[f] = nx * inv;
+      fny[f] = ny * inv;
+      fnz[f] = nz * inv;
+      farea[f] = 0.5f * len;
+      if (weighting == NormalWeighting::ANGLE) {
+        for (auto c = first; c <= last; ++c) angle[c] = corner_angle(raw, first, last, c);
+      }
+    }
+  });
+
+  // 2. Corners of each vertex
+  ScratchVector<uint32_t> vertex_start, vertex_corners;
+  build_vertex_corners(raw, vertex_start, vertex_corners);
+
+  // Honour smoothing groups only if the file uses them
+  const auto *smoothing = raw.face_smoothing.size() == num_faces ? raw.face_smoothing.data() : nullptr;
+  if (smoothing) {
+    auto any = false;
+    for (size_t f = 0; f < num_faces && !any; ++f) any = smoothing[f] != 0;
+    if (!any) smoothing = nullptr;
+  }
+  const auto cos_crease = cos(crease_angle * 3.14159265358979f / 180.0f);
+
+  // 3. Gather. The normal stream is indexed by corner; duplicates point at the first copy.
+  raw.norm_x.assign(num_corners, 0);
+  raw.norm_y.assign(num_corners, 0);
+  raw.norm_z.assign(num_corners, 0);
+  raw.corner_normal.resize(num_corners);
+  parallel_for(0, num_vertices, VERTEX_GRAIN, [&](size_t begin, size_t end) {
+    for (auto v = begin; v < end; ++v) {
+      const auto s = vertex_start[v], e = vertex_start[v + 1];
+      for (auto i = s; i < e; ++i) {
+        const auto c = vertex_corners[i];
+        const auto f = corner_face[c];
+        float sx = 0, sy = 0, sz = 0;
+        for (auto j = s; j < e; ++j) {
+          const auto c2 = vertex_corners[j];
+          const auto f2 = corner_face[c2];
+          if (f2 != f) {
+            if (smoothing && (smoothing[f] == 0 || smoothing[f] != smoothing[f2])) continue;
+            if (fnx[f] * fnx[f2] + fny[f] * fny[f2] + fnz[f] * fnz[f2] < cos_crease) continue;
+          }
+          auto w = (weighting == NormalWeighting::AREA) ? farea[f2] : angle[c2];
+          sx += w * fnx[f2];
+          sy += w * fny[f2];
+          sz += w * fnz[f2];
+        }
+        auto len = sqrt(sx * sx + sy * sy + sz * sz);
+        if (len > 0) {
+          sx /= len, sy /= len, sz /= len;
+        } else {
+          sx = fnx[f], sy = fny[f], sz = fnz[f];
+        }
+        raw.norm_x[c] = sx;
+        raw.norm_y[c] = sy;
+        raw.norm_z[c] = sz;
+
+        // Share the index of an earlier corner of this vertex with a bitwise identical normal
+        raw.corner_normal[c] = static_cast<int32_t>(c);
+        for (auto j = s; j < i; ++j) {
+          const auto c2 = vertex_corners[j];
+          if (same_bits(raw.norm_x[c2], sx) && same_bits(raw.norm_y[c2], sy) && same_bits(raw.norm_z[c2], sz)) {
+            raw.corner_normal[c] = raw.corner_normal[c2];
+            break;
+          }
+        }
+      }
+    }
+  });
+}
+
+/*
+ * Tangents follow the MikkTSpace scheme:
+ * 1. Per face: tangent and bitangent from the UV gradients of its triangles,
+ *    plus handedness from the face winding in UV space.
+ * 2. Per vertex: each corner gathers the tangents of the faces around it that
+ *    share its normal, its UV and its handedness, projected into the plane of
+ *    its normal and weighted by corner angle, then orthonormalised.
+ * Like the normals, each corner writes only its own slot so that the work splits
+ * across threads without synchronisation.
+ */
+bool generate_tangents(RawMeshData &raw) {
+  using namespace std;
+
+  ArenaScope scope;
+
+  const auto num_faces = raw.num_faces();
+  const auto num_corners = raw.num_corners();
+  const auto num_vertices = raw.num_vertices();
+  if (raw.num_normals() == 0 || raw.num_tex_coords() == 0
+      || raw.corner_normal.size() != num_corners || raw.corner_tex.size() != num_corners) {
+    spdlog::error("  tangents need both normals and tex coords");
+    return false;
+  }
+  const auto *offsets = raw.face_offsets.data();
+  const auto *cv = raw.corner_vertex.data();
+  const auto *cn = raw.corner_normal.data();
+  const auto *ct = raw.corner_tex.data();
+  const auto *tris = raw.triangles.data();
+
+  // 1. Face tangent frames
+  ScratchVector<float> ftx(num_faces), fty(num_faces), ftz(num_faces);
+  ScratchVector<int8_t> fsign(num_faces);
+  ScratchVector<float> angle(num_corners);
+  ScratchVector<uint32_t> corner_face(num_corners);
+  parallel_for(0, num_faces, FACE_GRAIN, [&](size_t begin, size_t end) {
+    for (auto f = begin; f < end; ++f) {
+      auto first = offsets[f], last = offsets[f + 1] - 1;
+      for (auto c = first; c <= last; ++c) {
+        angle[c] = corner_angle(raw, first, last, c);
+        corner_face[c] = static_cast<uint32_t>(f);
+      }
+
+      // Triangulating a face of n corners always yields n - 2 triangles, so its triangles start here
+      auto t_begin = first - 2 * f, t_end = last + 1 - 2 * (f + 1);
+      float tx = 0, ty = 0, tz = 0, bx = 0, by = 0, bz = 0, nx = 0, ny = 0, nz = 0;
+      for (auto t = t_begin; t < t_end; ++t) {
+        auto c0 = tris[3 * t], c1 = tris[3 * t + 1], c2 = tris[3 * t + 2];
+        auto v0 = cv[c0], v1 = cv[c1], v2 = cv[c2];
+        float e1x = raw.pos_x[v1] - raw.pos_x[v0], e1y = raw.pos_y[v1] - raw.pos_y[v0], e1z = raw.pos_z[v1] - raw.pos_z[v0];
+        float e2x = raw.pos_x[v2] - raw.pos_x[v0], e2y = raw.pos_y[v2] - raw.pos_y[v0], e2z = raw.pos_z[v2] - raw.pos_z[v0];
+        float du1 = raw.tex_u[ct[c1]] - raw.tex_u[ct[c0]], dv1 = raw.tex_v[ct[c1]] - raw.tex_v[ct[c0]];
+        float du2 = raw.tex_u[ct[c2]] - raw.tex_u[ct[c0]], dv2 = raw.tex_v[ct[c2]] - raw.tex_v[ct[c0]];
+        nx += e1y * e2z - e1z * e2y;
+        ny += e1z * e2x - e1x * e2z;
+        nz += e1x * e2y - e1y * e2x;
+        auto det = du1 * dv2 - du2 * dv1;
+        if (fabs(det) < 1e-12f) continue;
+        auto r = 1.0f / det;
+        tx += (e1x * dv2 - e2x * dv1) * r;
+        ty += (e1y * dv2 - e2y * dv1) * r;
+        tz += (e1z * dv2 - e2z * dv1) * r;
+        bx += (e2x * du1 - e1x * du2) * r;
+        by += (e2y * du1 - e1y * du2) * r;
+        bz += (e2z * du1 - e1z * du2) * r;
+      }
+      ftx[f] = tx;
+      fty[f] = ty;
+      ftz[f] = tz;
+      // Orientation preserving when (n x t) points along b
+      auto cx = ny * tz - nz * ty, cy = nz * tx - nx * tz, cz = nx * ty - ny * tx;
+      fsign[f] = (cx * bx + cy * by + cz * bz) < 0 ? -1 : 1;
+    }
+  });
+
+  ScratchVector<uint32_t> vertex_start, vertex_corners;
+  build_vertex_corners(raw, vertex_start, vertex_corners);
+
+  // 2. Gather per corner
+  raw.tan_x.assign(num_corners, 0);
+  raw.tan_y.assign(num_corners, 0);
+  raw.tan_z.assign(num_corners, 0);
+  raw.tan_w.assign(num_corners, 0);
+  raw.corner_tangent.resize(num_corners);
+  parallel_for(0, num_vertices, VERTEX_GRAIN, [&](size_t begin, size_t end) {
+    for (auto v = begin; v < end; ++v) {
+      const auto s = vertex_start[v], e = vertex_start[v + 1];
+      for (auto i = s; i < e; ++i) {
+        const auto c = vertex_corners[i];
+        const auto f = corner_face[c];
+        const float nx = raw.norm_x[cn[c]], ny = raw.norm_y[cn[c]], nz = raw.norm_z[cn[c]];
+        float sx = 0, sy = 0, sz = 0;
+        for (auto j = s; j < e; ++j) {
+          const auto c2 = vertex_corners[j];
+          const auto f2 = corner_face[c2];
+          if (cn[c2] != cn[c] || ct[c2] != ct[c] || fsign[f2] != fsign[f]) continue;
+
+          // Project into the tangent plane of this corner's normal before accumulating
+          auto d = nx * ftx[f2] + ny * fty[f2] + nz * ftz[f2];
+          float px = ftx[f2] - d * nx, py = fty[f2] - d * ny, pz = ftz[f2] - d * nz;
+          auto len = sqrt(px * px + py * py + pz * pz);
+          if (len == 0) continue;
+          auto w = angle[c2] / len;
+          sx += w * px;
+          sy += w * py;
+          sz += w * pz;
+        }
+        // Orthonormalise against the normal, falling back to any perpendicular if UVs were degenerate
+        auto d = nx * sx + ny * sy + nz * sz;
+        sx -= d * nx, sy -= d * ny, sz -= d * nz;
+        auto len = sqrt(sx * sx + sy * sy + sz * sz);
+        if (len > 1e-12f) {
+          sx /= len, sy /= len, sz /= len;
+        } else if (fabs(nx) < 0.9f) {
+          len = sqrt(nz * nz + ny * ny);
+          sx = 0, sy = nz / len, sz = -ny / len;
+        } else {
+          len = sqrt(nz * nz + nx * nx);
+          sx = -nz / len, sy = 0, sz = nx / len;
+        }
+        const float sw = fsign[f];
+        raw.tan_x[c] = sx;
+        raw.tan_y[c] = sy;
+        raw.tan_z[c] = sz;
+        raw.tan_w[c] = sw;
+
+        raw.corner_tangent[c] = static_cast<int32_t>(c);
+        for (auto j = s; j < i; ++j) {
+          const auto c2 = vertex_corners[j];
+          if (same_bits(raw.tan_x[c2], sx) && same_bits(raw.tan_y[c2], sy)
+              && same_bits(raw.tan_z[c2], sz) && same_bits(raw.tan_w[c2], sw)) {
+            raw.corner_tangent[c] = raw.corner_tangent[c2];
+            break;
+          }
+        }
+      }
+    }
+  });
+  return true;
+}
@@ -0,0 +1,317 @@
+#include "meshlet.h"
+#include "arena.h"
+#include "culling.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+  // Spread the low 10 bits of v out to every third bit
+  inline uint32_t spread_bits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+  }
+
+  inline float dot3(const float *a, const float *b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+
+  /*
+   * Cluster the num_triangles triangles at tri_indices, rewriting them in cluster
+   * order, and append a Meshlet for each cluster. index_offset is the position of
+   * tri_indices in the EBO.
+   */
+  void cluster_range(const float *vertex_data, size_t stride,
+                     uint32_t *tri_indices, uint32_t num_triangles,
+                     uint32_t max_triangles, uint32_t submesh, uint32_t index_offset,
+                     std::vector<Meshlet> &meshlets) {
+    using namespace std;
+
+    // Working storage comes from the scratch arena of whichever thread clusters this range
+    ArenaScope scope;
+    const auto num_indices = 3 * static_cast<size_t>(num_triangles);
+    auto pos = [vertex_data, stride](uint32_t v) { return vertex_data + v * stride; };
+
+    // Centroid and unit normal of each triangle, zero for degenerate triangles
+    ScratchVector<float> centroid(3 * num_triangles), normal(3 * num_triangles);
+    float lo[3]{numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max()};
+    float hi[3]{-lo[0], -lo[1], -lo[2]};
+    for (uint32_t t = 0; t < num_triangles; ++t) {
+      const float *a = pos(tri_indices[3 * t]), *b = pos(tri_indices[3 * t + 1]), *c = pos(tri_indices[3 * t + 2]);
+      float e1[3]{b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      float e2[3]{c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+      float n[3]{e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      auto len = sqrt(dot3(n, n));
+      for (auto k = 0; k < 3; ++k) {
+        centroid[3 * t + k] = (a[k] + b[k] + c[k]) / 3.0f;
+        normal[3 * t + k] = len > 0 ? n[k] / len : 0;
+        lo[k] = min(lo[k], centroid[3 * t + k]);
+        hi[k] = max(hi[k], centroid[3 * t + k]);
+      }
+    }
+
+    // Renumber the range's vertices densely. Ranges usually reference a compact span
+    // of vertex ids, which can be looked up directly rather than searched.
+    const auto none = numeric_limits<uint32_t>::max();
+    auto id_lo = *min_element(tri_indices, tri_indices + num_indices);
+    auto id_hi = *max_element(tri_indices, tri_indices + num_indices);
+    ScratchVector<uint32_t> local(num_indices);
+    size_t num_vertices = 0;
+    if (id_hi - id_lo < 4 * num_indices) {
+      ScratchVector<uint32_t> id_to_local(id_hi - id_lo + 1, none);
+      for (size_t i = 0; i < num_indices; ++i) {
+        auto &id = id_to_local[tri_indices[i] - id_lo];
+        if (id == none) id = static_cast<uint32_t>(num_vertices++);
+        local[i] = id;
+      }
+    } else {
+      ScratchVector<uint32_t> vertices(tri_indices, tri_indices + num_indices);
+      sort(vertices.begin(), vertices.end());
+      vertices.erase(unique(vertices.begin(), vertices.end()), vertices.end());
+      num_vertices = vertices.size();
+      for (size_t i = 0; i < num_indices; ++i) {
+        local[i] = static_cast<uint32_t>(lower_bound(vertices.begin(), vertices.end(), tri_indices[i]) - vertices.begin());
+      }
+    }
+    ScratchVector<uint32_t> vertex_start(num_vertices + 1, 0);
+    for (size_t i = 0; i < num_indices; ++i) ++vertex_start[local[i] + 1];
+    for (size_t v = 0; v < num_vertices; ++v) vertex_start[v + 1] += vertex_start[v];
+    ScratchVector<uint32_t> vertex_tris(num_indices);
+    {
+      ScratchVector<uint32_t> cursor(vertex_start.begin(), vertex_start.end() - 1);
+      for (size_t i = 0; i < num_indices; ++i) vertex_tris[cursor[local[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // Seeds are taken in Morton order so that each new cluster starts next to the last
+    ScratchVector<uint32_t> morton(num_triangles), seeds(num_triangles);
+    for (uint32_t t = 0; t < num_triangles; ++t) {
+      uint32_t code = 0;
+      for (auto k = 0; k < 3; ++k) {
+        auto extent = hi[k] - lo[k];
+        auto q = extent > 0 ? static_cast<uint32_t>((centroid[3 * t + k] - lo[k]) / extent * 1023.0f) : 0;
+        code |= spread_bits(q) << k;
+      }
+      morton[t] = code;
+      seeds[t] = t;
+    }
+    sort(seeds.begin(), seeds.end(), [&morton](uint32_t a, uint32_t b) {
+      return morton[a] < morton[b] || (morton[a] == morton[b] && a < b);
+    });
+
+    // Grow clusters greedily: most vertices already in the cluster first, then
+    // nearest the cluster's centre and closest to its facing
+    ScratchVector<uint8_t> assigned(num_triangles, 0);
+    ScratchVector<uint32_t> vertex_cluster(num_vertices, none), frontier_cluster(num_triangles, none);
+    // Vertices each frontier triangle shares with the current cluster
+    ScratchVector<uint8_t> shared(num_triangles, 0);
+    ScratchVector<uint32_t> order, frontier, cluster_sizes;
+    order.reserve(num_triangles);
+    size_t next_seed = 0;
+    for (uint32_t cluster = 0; order.size() < num_triangles; ++cluster) {
+      frontier.clear();
+      float centre_sum[3]{0, 0, 0}, normal_sum[3]{0, 0, 0};
+      uint32_t size = 0;
+      while (size < max_triangles) {
+        auto best = none;
+        uint8_t best_shared = 0;
+        auto best_score = numeric_limits<float>::max();
+        if (size) {
+          float centre[3]{centre_sum[0] / size, centre_sum[1] / size, centre_sum[2] / size};
+          auto n_len = sqrt(dot3(normal_sum, normal_sum));
+          for (size_t i = 0; i < frontier.size();) {
+            auto t = frontier[i];
+            if (assigned[t]) {
+              frontier[i] = frontier.back();
+              frontier.pop_back();
+              continue;
+            }
+            ++i;
+            if (shared[t] < best_shared) continue;
+            float d[3]{centroid[3 * t] - centre[0], centroid[3 * t + 1] - centre[1], centroid[3 * t + 2] - centre[2]};
+            auto facing = n_len > 0 ? dot3(&normal[3 * t], normal_sum) / n_len : 1.0f;
+            auto score = dot3(d, d) * (2.0f - facing) * (2.0f - facing);
+            if (shared[t] > best_shared || score < best_score) {
+              best = t;
+              best_shared = shared[t];
+              best_score = score;
+            }
+          }
+        }
+        if (best == none) {
+          // Nothing connected is left so jump to the next unclustered triangle in Morton order
+          while (next_seed < num_triangles && assigned[seeds[next_seed]]) ++next_seed;
+          if (next_seed == num_triangles) break;
+          best = seeds[next_seed];
+        }
+
+        assigned[best] = 1;
+        order.push_back(best);
+        ++size;
+        for (auto k = 0; k < 3; ++k) {
+          centre_sum[k] += centroid[3 * best + k];
+          normal_sum[k] += normal[3 * best + k];
+        }
+        for (auto k = 0; k < 3; ++k) {
+          auto v = local[3 * best + k];
+          if (vertex_cluster[v] == cluster) continue;
+          vertex_cluster[v] = cluster;
+          for (auto j = vertex_start[v]; j < vertex_start[v + 1]; ++j) {
+            auto t = vertex_tris[j];
+            if (assigned[t]) continue;
+            if (frontier_cluster[t] != cluster) {
+              frontier_cluster[t] = cluster;
+              shared[t] = 0;
+              frontier.push_back(t);
+            }
+            ++shared[t];
+          }
+        }
+      }
+      cluster_sizes.push_back(size);
+    }
+
+    // Write the triangles back in cluster order
+    {
+      ScratchVector<uint32_t> original(tri_indices, tri_indices + num_indices);
+      for (size_t i = 0; i < order.size(); ++i) {
+        for (auto k = 0; k < 3; ++k) tri_indices[3 * i + k] = original[3 * order[i] + k];
+      }
+    }
+
+    // Bounds of each cluster
+    size_t first = 0;
+    for (auto size: cluster_sizes) {
+      Meshlet m;
+      m.index_offset = index_offset + static_cast<uint32_t>(3 * first);
+      m.index_count = 3 * size;
+      m.submesh = submesh;
+
+      float b_lo[3]{numeric_limits<float>::max(), numeric_limits<float>::max(), numeric_limits<float>::max()};
+      float b_hi[3]{-b_lo[0], -b_lo[1], -b_lo[2]};
+      for (size_t i = 3 * first; i < 3 * (first + size); ++i) {
+        const auto *p = pos(tri_indices[i]);
+        for (auto k = 0; k < 3; ++k) {
+          b_lo[k] = min(b_lo[k], p[k]);
+          b_hi[k] = max(b_hi[k], p[k]);
+        }
+      }
+      for (auto k = 0; k < 3; ++k) m.center[k] = (b_lo[k] + b_hi[k]) * 0.5f;
+      float r2 = 0;
+      for (size_t i = 3 * first; i < 3 * (first + size); ++i) {
+        const auto *p = pos(tri_indices[i]);
+        float d[3]{p[0] - m.center[0], p[1] - m.center[1], p[2] - m.center[2]};
+        r2 = max(r2, dot3(d, d));
+      }
+      m.radius = sqrt(r2);
+
+      // Normal cone. Degenerate triangles have no facing so they don't constrain it.
+      float axis[3]{0, 0, 0};
+      for (auto i = first; i < first + size; ++i) {
+        for (auto k = 0; k < 3; ++k) axis[k] += normal[3 * order[i] + k];
+      }
+      auto axis_len = sqrt(dot3(axis, axis));
+      auto min_dot = 1.0f;
+      if (axis_len > 0) {
+        for (auto k = 0; k < 3; ++k) axis[k] /= axis_len;
+        for (auto i = first; i < first + size; ++i) {
+          const auto *n = &normal[3 * order[i]];
+          if (n[0] != 0 || n[1] != 0 || n[2] != 0) min_dot = min(min_dot, dot3(n, axis));
+        }
+      }
+      for (auto k = 0; k < 3; ++k) m.cone_axis[k] = axis[k];
+      // Normals more than ~85 degrees from the axis can't be culled by the cone anyway
+      m.cone_cutoff = (axis_len > 0 && min_dot > 0.1f) ? sqrt(1.0f - min_dot * min_dot) : 1.0f;
+
+      meshlets.push_back(m);
+      first += size;
+    }
+  }
+}
+
+Meshlet::Meshlet()
+        : index_offset{0}, index_count{0}, submesh{0},
+          center{0, 0, 0}, radius{0},
+          cone_axis{0, 0, 0}, cone_cutoff{1.0f} {}
+
+void build_meshlets(const float *vertex_data, size_t stride,
+                    std::vector<uint32_t> &indices,
+                    const std::vector<SubMesh> &submeshes,
+                    uint32_t max_triangles,
+                    std::vector<Meshlet> &meshlets) {
+  using namespace std;
+
+  meshlets.clear();
+  if (!max_triangles) return;
+
+  // Submeshes own disjoint ranges of indices so they are clustered concurrently
+  vector<vector<Meshlet>> per_submesh(submeshes.size());
+  parallel_for(0, submeshes.size(), 1, [&](size_t begin, size_t end) {
+    for (auto s = begin; s < end; ++s) {
+      const auto &sm = submeshes[s];
+      cluster_range(vertex_data, stride, indices.data() + sm.index_offset, sm.index_count / 3,
+                    max_triangles, static_cast<uint32_t>(s), sm.index_offset, per_submesh[s]);
+    }
+  });
+  for (const auto &m: per_submesh) meshlets.insert(meshlets.end(), m.begin(), m.end());
+}
+
+MeshletDrawList::MeshletDrawList() : visible{0}, frustum_culled{0}, backface_culled{0} {}
+
+void cull_meshlets(const std::vector<Meshlet> &meshlets,
+                   const glm::mat4 &mvp,
+                   const glm::vec3 &eye,
+                   MeshletDrawList &draw_list) {
+  using namespace std;
+
+  draw_list.commands.clear();
+  draw_list.counts.clear();
+  draw_list.offsets.clear();
+  draw_list.visible = draw_list.frustum_culled = draw_list.backface_culled = 0;
+
+  // Clip planes in model space, inside where positive
+  float planes[6][4];
+  frustum_planes(mvp, planes);
+
+  for (const auto &m: meshlets) {
+    auto outside = false;
+    for (auto p = 0; p < 6 && !outside; ++p) {
+      outside = dot3(planes[p], m.center) + planes[p][3] < -m.radius;
+    }
+    if (outside) {
+      ++draw_list.frustum_culled;
+      continue;
+    }
+
+    // Every triangle faces away if the whole sphere sits inside the cone's back side
+    float d[3]{m.center[0] - eye.x, m.center[1] - eye.y, m.center[2] - eye.z};
+    if (dot3(d, m.cone_axis) >= m.cone_cutoff * sqrt(dot3(d, d)) + m.radius) {
+      ++draw_list.backface_culled;
+      continue;
+    }
+
+    ++draw_list.visible;
+    auto &commands = draw_list.commands;
+    if (!commands.empty() && commands.back().first_index + commands.back().count == m.index_offset) {
+      commands.back().count += m.index_count;
+    } else {
+      commands.push_back(DrawElementsIndirectCommand{m.index_count, 1, m.index_offset, 0, 0});
+    }
+  }
+
+  for (const auto &c: draw_list.commands) {
+    draw_list.counts.push_back(static_cast<GLsizei>(c.count));
+    draw_list.offsets.push_back(reinterpret_cast<const GLvoid *>(c.first_index * sizeof(GLuint)));
+  }
+}
+
+void draw_meshlets(const MeshletDrawList &draw_list) {
+  if (draw_list.counts.empty()) return;
+  glMultiDrawElements(GL_TRIANGLES, draw_list.counts.data(), GL_UNSIGNED_INT,
+                      draw_list.offsets.data(), static_cast<GLsizei>(draw_list.counts.size()));
+}
@@ -0,0 +1,383 @@
+#include "occlusion.h"
+#include "parallel.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace {
+  using simd::Float;
+  using simd::LANES;
+
+  // Screen tiles are square and a multiple of LANES wide
+  const int32_t TILE_SIZE = 32;
+
+  // Depth buffer rows are a multiple of this many pixels, a multiple of LANES whatever the instruction set
+  const uint32_t ROW_ALIGNMENT = 8;
+
+  /*
+   * An occluder triangle ready to rasterize. Edge function k is a[k] x + b[k] y + c[k]
+   * and is positive inside; window depth is the plane dz_dx x + dz_dy y + z0.
+   */
+  struct OccluderTriangle {
+    float a[3];
+    float b[3];
+    float c[3];
+    float dz_dx, dz_dy, z0;
+    // Pixel bounds on screen, half open
+    int32_t min_x, min_y, max_x, max_y;
+  };
+
+  // One occluder's triangles and the tiles they overlap, built on one thread so no locks are needed
+  struct OccluderBatch {
+    std::vector<OccluderTriangle> triangles;
+    std::vector<std::vector<uint32_t>> tiles;
+  };
+
+  double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // The point where the segment a-b crosses the near plane z = -w
+  glm::vec4 clip_near(const glm::vec4 &a, const glm::vec4 &b) {
+    auto da = a.z + a.w;
+    auto db = b.z + b.w;
+    return a + (da / (da - db)) * (b - a);
+  }
+
+  /*
+   * Project a clipped triangle to the screen and add it to the batch unless it
+   * covers no pixel centre. Both facings are kept since occluders needn't be closed.
+   */
+  void setup_triangle(const glm::vec4 *v[3], float width, float height, OccluderBatch &batch) {
+    float x[3], y[3], z[3];
+    for (auto i = 0; i < 3; ++i) {
+      auto inv_w = 1.0f / v[i]->w;
+      x[i] = (v[i]->x * inv_w * 0.5f + 0.5f) * width;
+      y[i] = (0.5f - v[i]->y * inv_w * 0.5f) * height;
+      z[i] = v[i]->z * inv_w * 0.5f + 0.5f;
+    }
+
+    OccluderTriangle tri;
+    for (auto k = 0; k < 3; ++k) {
+      auto i = (k + 1) % 3, j = (k + 2) % 3;
+      tri.a[k] = y[i] - y[j];
+      tri.b[k] = x[j] - x[i];
+      tri.c[k] = x[i] * y[j] - x[j] * y[i];
+    }
+    // Twice the signed area. Negating every edge makes either winding positive inside.
+    auto area = tri.a[0] * x[0] + tri.b[0] * y[0] + tri.c[0];
+    if (area == 0) return;
+    if (area < 0) {
+      for (auto k = 0; k < 3; ++k) {
+        tri.a[k] = -tri.a[k];
+        tri.b[k] = -tri.b[k];
+        tri.c[k] = -tri.c[k];
+      }
+      area = -area;
+    }
+    auto inv_area = 1.0f / area;
+    tri.dz_dx = (z[0] * tri.a[0] + z[1] * tri.a[1] + z[2] * tri.a[2]) * inv_area;
+    tri.dz_dy = (z[0] * tri.b[0] + z[1] * tri.b[1] + z[2] * tri.b[2]) * inv_area;
+    tri.z0 = (z[0] * tri.c[0] + z[1] * tri.c[1] + z[2] * tri.c[2]) * inv_area;
+
+    auto min_x = std::min(std::min(x[0], x[1]), x[2]), max_x = std::max(std::max(x[0], x[1]), x[2]);
+    auto min_y = std::min(std::min(y[0], y[1]), y[2]), max_y = std::max(std::max(y[0], y[1]), y[2]);
+    // Clamped as floats since clipping at the near plane can leave vertices far off screen
+    tri.min_x = static_cast<int32_t>(std::floor(std::max(min_x - 0.5f, 0.0f)));
+    tri.min_y = static_cast<int32_t>(std::floor(std::max(min_y - 0.5f, 0.0f)));
+    tri.max_x = static_cast<int32_t>(std::ceil(std::min(max_x + 0.5f, width)));
+    tri.max_y = static_cast<int32_t>(std::ceil(std::min(max_y + 0.5f, height)));
+    if (tri.min_x >= tri.max_x || tri.min_y >= tri.max_y) return;
+    batch.triangles.push_back(tri);
+  }
+
+  /*
+   * Keep the nearer of the triangle's depth and the buffer's in the part of the
+   * tile it covers, LANES pixels at a time. Rows are a multiple of LANES wide so
+   * whole lanes can always be loaded and stored.
+   */
+  void rasterize_in_tile(const OccluderTriangle &tri, int32_t tile_x0, int32_t tile_y0,
+                         int32_t tile_x1, int32_t tile_y1, float *depth, uint32_t width) {
+    const auto lanes = static_cast<int32_t>(LANES);
+    const auto x0 = std::max(tri.min_x, tile_x0) / lanes * lanes, x1 = std::min(tri.max_x, tile_x1);
+    const auto y0 = std::max(tri.min_y, tile_y0), y1 = std::min(tri.max_y, tile_y1);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    float lane_offset[LANES];
+    for (size_t l = 0; l < LANES; ++l) lane_offset[l] = static_cast<float>(l) + 0.5f;
+    const auto offsets = simd::load(lane_offset);
+    const Float a[3] = {simd::set1(tri.a[0]), simd::set1(tri.a[1]), simd::set1(tri.a[2])};
+    const auto dz_dx = simd::set1(tri.dz_dx);
+    const auto zero = simd::set1(0.0f), one = simd::set1(1.0f);
+
+    for (auto y = y0; y < y1; ++y) {
+      const auto py = y + 0.5f;
+      const Float row[3] = {simd::set1(tri.b[0] * py + tri.c[0]),
+                            simd::set1(tri.b[1] * py + tri.c[1]),
+                            simd::set1(tri.b[2] * py + tri.c[2])};
+      const auto z_row = simd::set1(tri.dz_dy * py + tri.z0);
+      auto *depth_row = depth + static_cast<size_t>(y) * width;
+
+      for (auto x = x0; x < x1; x += lanes) {
+        const auto px = simd::set1(static_cast<float>(x)) + offsets;
+        auto covered = (a[0] * px + row[0] >= zero) & (a[1] * px + row[1] >= zero)
+                       & (a[2] * px + row[2] >= zero);
+        if (!simd::any(covered)) continue;
+        auto z = simd::min(simd::max(dz_dx * px + z_row, zero), one);
+        auto old = simd::load(depth_row + x);
+        simd::store(depth_row + x, simd::select(covered, simd::min(z, old), old));
+      }
+    }
+  }
+
+  // The index ranges to draw mesh with as an occluder
+  const std::vector<SubMesh> &occluder_level(const Mesh &mesh, uint32_t max_triangles) {
+    const std::vector<SubMesh> *submeshes = &mesh.submeshes;
+    for (const auto &lod: mesh.lods) {
+      submeshes = &lod.submeshes;
+      size_t triangles = 0;
+      for (const auto &submesh: lod.submeshes) triangles += submesh.index_count / 3;
+      if (triangles <= max_triangles) break;
+    }
+    return *submeshes;
+  }
+}
+
+OcclusionOptions::OcclusionOptions()
+        : width{256}, height{128}, max_occluders{16}, min_occluder_size{0.1f}, occluder_triangles{1024} {}
+
+OcclusionStats::OcclusionStats()
+        : num_occluders{0}, num_occluder_triangles{0}, num_tested{0}, num_occluded{0}, raster_ms{0}, test_ms{0} {}
+
+OcclusionCuller::OcclusionCuller(const OcclusionOptions &options)
+        : options_{options}, view_projection_{1.0f}, eye_{0.0f}, focal_length_{1.0f} {
+  options_.width = std::max((options_.width + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT, ROW_ALIGNMENT);
+  options_.height = std::max(options_.height, 1u);
+
+  // Down to a single texel
+  auto levels = 1;
+  while (level_width(levels - 1) > 1 || level_height(levels - 1) > 1) ++levels;
+  levels_.resize(levels);
+  for (auto l = 0; l < levels; ++l) {
+    levels_[l].assign(static_cast<size_t>(level_width(l)) * level_height(l), 1.0f);
+  }
+}
+
+void OcclusionCuller::begin_frame(const glm::mat4 &view, const glm::mat4 &projection) {
+  view_projection_ = projection * view;
+  eye_ = glm::vec3(glm::inverse(view)[3]);
+  focal_length_ = projection[1][1];
+  candidates_.clear();
+  stats_ = OcclusionStats();
+  for (auto &level: levels_) std::fill(level.begin(), level.end(), 1.0f);
+}
+
+void OcclusionCuller::add_occluder(const Mesh &mesh, const glm::mat4 &model) {
+  if (mesh.vertex_data.empty() || mesh.indices.empty()) return;
+
+  // Height on screen of the bounding sphere, a fraction of the viewport's
+  const auto &b = mesh.bounds;
+  auto center = glm::vec3(model * glm::vec4(b.center[0], b.center[1], b.center[2], 1.0f));
+  auto scale = std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+                        glm::length(glm::vec3(model[2])));
+  auto radius = b.radius * scale;
+  auto distance = glm::length(center - eye_);
+  // Around the eye the object may fill the screen
+  auto size = distance > radius ? radius * focal_length_ / distance : std::numeric_limits<float>::max();
+  if (size < options_.min_occluder_size) return;
+
+  Candidate candidate;
+  candidate.mesh = &mesh;
+  candidate.model = model;
+  candidate.size = size;
+  candidates_.push_back(candidate);
+}
+
+void OcclusionCuller::render_occluders() {
+  auto start = std::chrono::steady_clock::now();
+
+  // Largest first
+  if (candidates_.size() > options_.max_occluders) {
+    std::nth_element(candidates_.begin(), candidates_.begin() + options_.max_occluders, candidates_.end(),
+                     [](const Candidate &a, const Candidate &b) { return a.size > b.size; });
+    candidates_.resize(options_.max_occluders);
+  }
+  stats_.num_occluders = candidates_.size();
+  if (candidates_.empty()) {
+    stats_.raster_ms = ms_since(start);
+    return;
+  }
+
+  const auto width = static_cast<float>(options_.width), height = static_cast<float>(options_.height);
+  const auto tiles_x = (static_cast<int32_t>(options_.width) + TILE_SIZE - 1) / TILE_SIZE;
+  const auto tiles_y = (static_cast<int32_t>(options_.height) + TILE_SIZE - 1) / TILE_SIZE;
+
+  // Transform, clip, set up and bin each occluder's triangles
+  std::vector<OccluderBatch> batches(candidates_.size());
+  parallel_for(0, candidates_.size(), 1, [&](size_t begin, size_t end) {
+    for (auto o = begin; o < end; ++o) {
+      const auto &mesh = *candidates_[o].mesh;
+      const auto mvp = view_projection_ * candidates_[o].model;
+      auto &batch = batches[o];
+      batch.tiles.resize(tiles_x * tiles_y);
+      for (const auto &submesh: occluder_level(mesh, options_.occluder_triangles)) {
+        for (auto i = submesh.index_offset; i + 2 < submesh.index_offset + submesh.index_count; i += 3) {
+          glm::vec4 clip[3];
+          for (auto k = 0; k < 3; ++k) {
+            const auto *p = &mesh.vertex_data[static_cast<size_t>(mesh.indices[i + k]) * mesh.stride];
+            clip[k] = mvp * glm::vec4(p[0], p[1], p[2], 1.0f);
+          }
+
+          // Whole triangles outside one clip plane are dropped; only the near plane needs real clipping
+          auto outside_all = [&clip](int32_t k, float sign) -> bool {
+            for (auto j = 0; j < 3; ++j) {
+              if (sign * clip[j][k] <= clip[j].w) return false;
+            }
+            return true;
+          };
+          if (outside_all(0, 1) || outside_all(0, -1) || outside_all(1, 1) || outside_all(1, -1) ||
+              outside_all(2, 1) || outside_all(2, -1)) {
+            continue;
+          }
+
+          auto first_triangle = batch.triangles.size();
+          int32_t num_behind = 0;
+          for (auto k = 0; k < 3; ++k) num_behind += clip[k].z < -clip[k].w;
+          if (!num_behind) {
+            const glm::vec4 *v[3] = {&clip[0], &clip[1], &clip[2]};
+            setup_triangle(v, width, height, batch);
+          } else {
+            glm::vec4 polygon[4];
+            int32_t n = 0;
+            for (auto k = 0; k < 3; ++k) {
+              const auto &p = clip[k], &q = clip[(k + 1) % 3];
+              auto p_in = p.z >= -p.w, q_in = q.z >= -q.w;
+              if (p_in) polygon[n++] = p;
+              if (p_in != q_in) polygon[n++] = clip_near(p, q);
+            }
+            for (auto k = 1; k + 1 < n; ++k) {
+              const glm::vec4 *fan[3] = {&polygon[0], &polygon[k], &polygon[k + 1]};
+              setup_triangle(fan, width, height, batch);
+            }
+          }
+
+          for (auto s = first_triangle; s < batch.triangles.size(); ++s) {
+            const auto &tri = batch.triangles[s];
+            for (auto ty = tri.min_y / TILE_SIZE; ty <= (tri.max_y - 1) / TILE_SIZE; ++ty) {
+              for (auto tx = tri.min_x / TILE_SIZE; tx <= (tri.max_x - 1) / TILE_SIZE; ++tx) {
+                batch.tiles[ty * tiles_x + tx].push_back(static_cast<uint32_t>(s));
+              }
+            }
+          }
+        }
+      }
+    }
+  });
+  for (const auto &batch: batches) stats_.num_occluder_triangles += batch.triangles.size();
+
+  // Tiles are independent since depth only ever takes the minimum, whatever the order
+  auto *depth = levels_[0].data();
+  parallel_for(0, static_cast<size_t>(tiles_x * tiles_y), 1, [&](size_t begin, size_t end) {
+    for (auto tile = begin; tile < end; ++tile) {
+      const auto tx = static_cast<int32_t>(tile % tiles_x), ty = static_cast<int32_t>(tile / tiles_x);
+      const auto x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+      const auto x1 = std::min(x0 + TILE_SIZE, static_cast<int32_t>(options_.width));
+      const auto y1 = std::min(y0 + TILE_SIZE, static_cast<int32_t>(options_.height));
+      for (const auto &batch: batches) {
+        for (auto s: batch.tiles[tile]) {
+          rasterize_in_tile(batch.triangles[s], x0, y0, x1, y1, depth, options_.width);
+        }
+      }
+    }
+  });
+
+  // Each texel of the pyramid is the farthest of the up to four below it
+  for (size_t l = 1; l < levels_.size(); ++l) {
+    const auto &below = levels_[l - 1];
+    auto &level = levels_[l];
+    const auto w = level_width(l), h = level_height(l);
+    const auto below_w = level_width(l - 1), below_h = level_height(l - 1);
+    for (uint32_t y = 0; y < h; ++y) {
+      const auto y0 = 2 * y, y1 = std::min(2 * y + 1, below_h - 1);
+      for (uint32_t x = 0; x < w; ++x) {
+        const auto x0 = 2 * x, x1 = std::min(2 * x + 1, below_w - 1);
+        level[y * w + x] = std::max(std::max(below[y0 * below_w + x0], below[y0 * below_w + x1]),
+                                    std::max(below[y1 * below_w + x0], below[y1 * below_w + x1]));
+      }
+    }
+  }
+  stats_.raster_ms = ms_since(start);
+}
+
+bool OcclusionCuller::test(const float min[3], const float max[3]) const {
+  const auto width = static_cast<float>(options_.width), height = static_cast<float>(options_.height);
+  auto min_x = std::numeric_limits<float>::max(), min_y = min_x, min_z = min_x;
+  auto max_x = -min_x, max_y = -min_x;
+  for (auto c = 0; c < 8; ++c) {
+    auto clip = view_projection_ * glm::vec4((c & 1) ? max[0] : min[0],
+                                             (c & 2) ? max[1] : min[1],
+                                             (c & 4) ? max[2] : min[2], 1.0f);
+    // Boxes reaching the near plane may cover any part of the screen
+    if (clip.z < -clip.w || clip.w <= 0) return true;
+    auto inv_w = 1.0f / clip.w;
+    auto x = (clip.x * inv_w * 0.5f + 0.5f) * width;
+    auto y = (0.5f - clip.y * inv_w * 0.5f) * height;
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+    min_z = std::min(min_z, clip.z * inv_w * 0.5f + 0.5f);
+  }
+  // Off screen boxes are for frustum culling to decide
+  if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height) return true;
+
+  // Every pixel the box's screen rectangle touches
+  auto x0 = static_cast<uint32_t>(std::max(min_x, 0.0f));
+  auto y0 = static_cast<uint32_t>(std::max(min_y, 0.0f));
+  auto x1 = static_cast<uint32_t>(std::min(max_x, width - 1));
+  auto y1 = static_cast<uint32_t>(std::min(max_y, height - 1));
+
+  // The finest level where the rectangle spans at most two texels each way
+  size_t l = 0;
+  while (l + 1 < levels_.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1)) ++l;
+  const auto &level = levels_[l];
+  const auto w = level_width(l);
+  auto farthest = 0.0f;
+  for (auto y = y0 >> l; y <= y1 >> l; ++y) {
+    for (auto x = x0 >> l; x <= x1 >> l; ++x) farthest = std::max(farthest, level[y * w + x]);
+  }
+  return min_z <= farthest;
+}
+
+size_t OcclusionCuller::cull(const ObjectBounds &bounds, std::vector<uint32_t> &visible) {
+  auto start = std::chrono::steady_clock::now();
+  stats_.num_tested = visible.size();
+  stats_.num_occluded = 0;
+  if (!stats_.num_occluders) {
+    stats_.test_ms = ms_since(start);
+    return 0;
+  }
+
+  std::vector<uint8_t> keep(visible.size());
+  parallel_for(0, visible.size(), 64, [&](size_t begin, size_t end) {
+    for (auto v = begin; v < end; ++v) {
+      auto i = visible[v];
+      const float min[3] = {bounds.center_x[i] - bounds.extent_x[i], bounds.center_y[i] - bounds.extent_y[i],
+                            bounds.center_z[i] - bounds.extent_z[i]};
+      const float max[3] = {bounds.center_x[i] + bounds.extent_x[i], bounds.center_y[i] + bounds.extent_y[i],
+                            bounds.center_z[i] + bounds.extent_z[i]};
+      keep[v] = test(min, max);
+    }
+  });
+  size_t kept = 0;
+  for (size_t v = 0; v < visible.size(); ++v) {
+    if (keep[v]) visible[kept++] = visible[v];
+  }
+  stats_.num_occluded = visible.size() - kept;
+  visible.resize(kept);
+  stats_.test_ms = ms_since(start);
+  return stats_.num_occluded;
+}
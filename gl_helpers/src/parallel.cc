@@ -0,0 +1,11 @@
+#include "parallel.h"
+#include "job_system.h"
+
+size_t num_worker_threads() {
+  return JobSystem::shared().num_threads();
+}
+
+void parallel_for(size_t begin, size_t end, size_t grain,
+                  const std::function<void(size_t, size_t)> &body) {
+  JobSystem::shared().parallel_for(begin, end, grain, body);
+}
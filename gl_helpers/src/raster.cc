@@ -0,0 +1,408 @@
+#include "raster.h"
+#include "parallel.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#include "spdlog/spdlog-inl.h"
+
+namespace {
+  using simd::Float;
+  using simd::Mask;
+  using simd::LANES;
+
+  // Screen tiles are square and a multiple of LANES wide
+  const int32_t TILE_SIZE = 64;
+
+  // Triangles set up together, each batch binning into its own lists so no locks are needed
+  const size_t BATCH_TRIANGLES = 4096;
+
+  // A vertex after the vertex stage, or one made by clipping
+  struct ClipVertex {
+    glm::vec4 position;
+    float varyings[MAX_VARYINGS];
+  };
+
+  /*
+   * A triangle ready to rasterize. Edge function i is a[i] x + b[i] y + c[i]
+   * and is positive inside; it is zero on the edge opposite vertex i, so
+   * dividing by the sum of all three gives vertex i's barycentric weight.
+   */
+  struct SetupTriangle {
+    float a[3];
+    float b[3];
+    float c[3];
+    float inv_area;
+    // Pixels exactly on a top or left edge are inside, as in GL and D3D
+    bool top_left[3];
+    // Window depth and 1 / clip w at each vertex
+    float z[3];
+    float inv_w[3];
+    // Pixel bounds on screen, half open
+    int32_t min_x, min_y, max_x, max_y;
+    // Offset of the vertices' varyings, each already multiplied by its inv_w, in Batch::varyings
+    uint32_t varyings;
+  };
+
+  struct Batch {
+    std::vector<SetupTriangle> triangles;
+    std::vector<float> varyings;
+    // Triangles, in draw order, that overlap each tile
+    std::vector<std::vector<uint32_t>> tiles;
+  };
+
+  inline uint32_t pack_colour(const glm::vec4 &c) {
+    uint32_t packed = 0;
+    for (auto k = 0; k < 4; ++k) {
+      auto f = std::min(std::max(c[k], 0.0f), 1.0f);
+      packed |= static_cast<uint32_t>(f * 255.0f + 0.5f) << (8 * k);
+    }
+    return packed;
+  }
+
+  inline uint8_t channel(uint32_t colour, int32_t k) {
+    return static_cast<uint8_t>((colour >> (8 * k)) & 0xff);
+  }
+
+  // The point where the segment a-b crosses the near plane z = -w
+  ClipVertex clip_near(const ClipVertex &a, const ClipVertex &b, uint32_t num_varyings) {
+    auto da = a.position.z + a.position.w;
+    auto db = b.position.z + b.position.w;
+    auto t = da / (da - db);
+    ClipVertex v;
+    v.position = a.position + t * (b.position - a.position);
+    for (uint32_t i = 0; i < num_varyings; ++i) {
+      v.varyings[i] = a.varyings[i] + t * (b.varyings[i] - a.varyings[i]);
+    }
+    return v;
+  }
+
+  // Project a clipped triangle to the screen and add it to the batch unless it is culled or covers no pixel centre
+  void setup_triangle(const ClipVertex *v[3], const RasterPipeline &pipeline,
+                      float width, float height, Batch &batch) {
+    float x[3], y[3], z[3], inv_w[3];
+    for (auto i = 0; i < 3; ++i) {
+      inv_w[i] = 1.0f / v[i]->position.w;
+      x[i] = (v[i]->position.x * inv_w[i] * 0.5f + 0.5f) * width;
+      y[i] = (0.5f - v[i]->position.y * inv_w[i] * 0.5f) * height;
+      z[i] = v[i]->position.z * inv_w[i] * 0.5f + 0.5f;
+    }
+
+    // With y down a counter clockwise, front facing, triangle has negative area
+    auto area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0 || (pipeline.cull_back_faces && area > 0)) return;
+    int32_t order[3] = {0, 1, 2};
+    if (area < 0) {
+      std::swap(order[1], order[2]);
+      area = -area;
+    }
+
+    SetupTriangle tri;
+    auto min_x = width, min_y = height, max_x = 0.0f, max_y = 0.0f;
+    for (auto i = 0; i < 3; ++i) {
+      min_x = std::min(min_x, x[i]);
+      min_y = std::min(min_y, y[i]);
+      max_x = std::max(max_x, x[i]);
+      max_y = std::max(max_y, y[i]);
+    }
+    // Pixels whose centres may be inside. Clamped as floats since clipping at the
+    // near plane can leave vertices far off screen.
+    tri.min_x = static_cast<int32_t>(std::floor(std::max(min_x - 0.5f, 0.0f)));
+    tri.min_y = static_cast<int32_t>(std::floor(std::max(min_y - 0.5f, 0.0f)));
+    tri.max_x = static_cast<int32_t>(std::ceil(std::min(max_x + 0.5f, width)));
+    tri.max_y = static_cast<int32_t>(std::ceil(std::min(max_y + 0.5f, height)));
+    if (tri.min_x >= tri.max_x || tri.min_y >= tri.max_y) return;
+
+    // Edge k runs between the two vertices other than k. The two triangles sharing
+    // an edge must get exactly negated functions so that they never both claim a
+    // pixel on it, or both miss it. The cross term is always computed with its
+    // vertices in the same order for that, whatever the compiler fuses.
+    for (auto k = 0; k < 3; ++k) {
+      auto i = order[(k + 1) % 3], j = order[(k + 2) % 3];
+      tri.a[k] = y[i] - y[j];
+      tri.b[k] = x[j] - x[i];
+      auto flip = x[j] < x[i] || (x[j] == x[i] && y[j] < y[i]);
+      auto p = flip ? j : i, q = flip ? i : j;
+      auto cross = x[p] * y[q] - x[q] * y[p];
+      tri.c[k] = flip ? -cross : cross;
+      tri.top_left[k] = (y[j] < y[i]) || (y[j] == y[i] && x[j] > x[i]);
+      tri.z[k] = z[order[k]];
+      tri.inv_w[k] = inv_w[order[k]];
+    }
+    tri.inv_area = 1.0f / area;
+
+    const auto nv = pipeline.num_varyings;
+    tri.varyings = static_cast<uint32_t>(batch.varyings.size());
+    for (auto k = 0; k < 3; ++k) {
+      const auto &src = *v[order[k]];
+      for (uint32_t i = 0; i < nv; ++i) batch.varyings.push_back(src.varyings[i] * tri.inv_w[k]);
+    }
+    batch.triangles.push_back(tri);
+  }
+
+  inline Mask inside(Float e, bool top_left) {
+    return top_left ? e >= simd::set1(0.0f) : e > simd::set1(0.0f);
+  }
+
+  // Draw the part of a triangle inside the tile
+  void rasterize_in_tile(const SetupTriangle &tri, const float *tri_varyings,
+                         const RasterPipeline &pipeline,
+                         int32_t tile_x0, int32_t tile_y0, int32_t tile_x1, int32_t tile_y1,
+                         FrameBuffer &frame) {
+    const auto x0 = std::max(tri.min_x, tile_x0), x1 = std::min(tri.max_x, tile_x1);
+    const auto y0 = std::max(tri.min_y, tile_y0), y1 = std::min(tri.max_y, tile_y1);
+    if (x0 >= x1 || y0 >= y1) return;
+
+    const auto nv = pipeline.num_varyings;
+    float lane_offset[LANES];
+    for (size_t l = 0; l < LANES; ++l) lane_offset[l] = static_cast<float>(l);
+    const auto offsets = simd::load(lane_offset);
+    const Float a[3] = {simd::set1(tri.a[0]), simd::set1(tri.a[1]), simd::set1(tri.a[2])};
+    const Float z[3] = {simd::set1(tri.z[0]), simd::set1(tri.z[1]), simd::set1(tri.z[2])};
+    const auto inv_area = simd::set1(tri.inv_area);
+    const auto zero = simd::set1(0.0f), one = simd::set1(1.0f);
+
+    float e_lane[3][LANES], depth_lane[LANES], z_lane[LANES];
+    float varyings[MAX_VARYINGS];
+    for (auto y = y0; y < y1; ++y) {
+      const auto py = y + 0.5f;
+      const Float row[3] = {simd::set1(tri.b[0] * py + tri.c[0]),
+                            simd::set1(tri.b[1] * py + tri.c[1]),
+                            simd::set1(tri.b[2] * py + tri.c[2])};
+      auto *depth_row = &frame.depth[static_cast<size_t>(y) * frame.width];
+      auto *colour_row = &frame.colour[static_cast<size_t>(y) * frame.width];
+
+      for (auto x = x0; x < x1; x += static_cast<int32_t>(LANES)) {
+        const auto n = std::min(static_cast<int32_t>(LANES), x1 - x);
+        const auto px = simd::set1(x + 0.5f) + offsets;
+        Float e[3];
+        for (auto k = 0; k < 3; ++k) e[k] = a[k] * px + row[k];
+        auto covered = inside(e[0], tri.top_left[0]) & inside(e[1], tri.top_left[1])
+                       & inside(e[2], tri.top_left[2]);
+        auto bits = simd::bits(covered) & ((1u << n) - 1);
+        if (!bits) continue;
+
+        // Window depth is linear on screen so needs no perspective correction
+        auto depth = (z[0] * e[0] + z[1] * e[1] + z[2] * e[2]) * inv_area;
+        auto in_range = (depth >= zero) & (depth <= one);
+        if (pipeline.depth_test) {
+          std::memcpy(depth_lane, depth_row + x, n * sizeof(float));
+          in_range = in_range & (depth < simd::load(depth_lane));
+        }
+        bits &= simd::bits(in_range);
+        if (!bits) continue;
+
+        for (auto k = 0; k < 3; ++k) simd::store(e_lane[k], e[k]);
+        simd::store(z_lane, depth);
+        for (size_t l = 0; l < LANES; ++l) {
+          if (!((bits >> l) & 1)) continue;
+          const float w0 = e_lane[0][l], w1 = e_lane[1][l], w2 = e_lane[2][l];
+          // Varyings were divided by w at setup; dividing by the interpolated 1 / w restores them
+          const auto inv = 1.0f / (w0 * tri.inv_w[0] + w1 * tri.inv_w[1] + w2 * tri.inv_w[2]);
+          for (uint32_t i = 0; i < nv; ++i) {
+            varyings[i] = (w0 * tri_varyings[i] + w1 * tri_varyings[nv + i] + w2 * tri_varyings[2 * nv + i]) * inv;
+          }
+          colour_row[x + l] = pack_colour(pipeline.fragment_shader(varyings));
+          if (pipeline.depth_test) depth_row[x + l] = z_lane[l];
+        }
+      }
+    }
+  }
+}
+
+FrameBuffer::FrameBuffer() : width{0}, height{0} {}
+
+FrameBuffer::FrameBuffer(uint32_t width, uint32_t height) : width{0}, height{0} {
+  resize(width, height);
+}
+
+void FrameBuffer::resize(uint32_t w, uint32_t h) {
+  width = w;
+  height = h;
+  colour.assign(static_cast<size_t>(w) * h, 0);
+  depth.assign(static_cast<size_t>(w) * h, 1.0f);
+}
+
+void FrameBuffer::clear(const glm::vec4 &c, float d) {
+  std::fill(colour.begin(), colour.end(), pack_colour(c));
+  std::fill(depth.begin(), depth.end(), d);
+}
+
+RasterPipeline::RasterPipeline() : num_varyings{0}, cull_back_faces{false}, depth_test{true} {}
+
+void rasterize(const RasterPipeline &pipeline,
+               const float *vertex_data, size_t stride, size_t num_vertices,
+               const uint32_t *indices, size_t num_indices,
+               FrameBuffer &frame) {
+  if (!frame.width || !frame.height || num_indices < 3) return;
+  if (pipeline.num_varyings > MAX_VARYINGS) {
+    spdlog::error("Too many varyings: {}, at most {}", pipeline.num_varyings, MAX_VARYINGS);
+    return;
+  }
+  const auto nv = pipeline.num_varyings;
+
+  // Vertex stage
+  std::vector<ClipVertex> vertices(num_vertices);
+  parallel_for(0, num_vertices, 1024, [&](size_t begin, size_t end) {
+    for (auto v = begin; v < end; ++v) {
+      vertices[v].position = pipeline.vertex_shader(vertex_data + v * stride, vertices[v].varyings);
+    }
+  });
+
+  // Clip, set up and bin batches of triangles
+  const auto tiles_x = (static_cast<int32_t>(frame.width) + TILE_SIZE - 1) / TILE_SIZE;
+  const auto tiles_y = (static_cast<int32_t>(frame.height) + TILE_SIZE - 1) / TILE_SIZE;
+  const auto num_triangles = num_indices / 3;
+  std::vector<Batch> batches((num_triangles + BATCH_TRIANGLES - 1) / BATCH_TRIANGLES);
+  const auto width = static_cast<float>(frame.width), height = static_cast<float>(frame.height);
+  parallel_for(0, batches.size(), 1, [&](size_t begin, size_t end) {
+    for (auto b = begin; b < end; ++b) {
+      auto &batch = batches[b];
+      batch.tiles.resize(tiles_x * tiles_y);
+      const auto first = b * BATCH_TRIANGLES, last = std::min(num_triangles, first + BATCH_TRIANGLES);
+      for (auto t = first; t < last; ++t) {
+        const ClipVertex *v[3] = {&vertices[indices[3 * t]], &vertices[indices[3 * t + 1]],
+                                  &vertices[indices[3 * t + 2]]};
+
+        // Whole triangles outside one clip plane are dropped. Only the near plane
+        // needs real clipping; beyond the others the tile bounds and depth range
+        // test do the work.
+        auto outside_all = [&v](int32_t k, float sign) -> bool {
+          for (auto i = 0; i < 3; ++i) {
+            if (sign * v[i]->position[k] <= v[i]->position.w) return false;
+          }
+          return true;
+        };
+        if (outside_all(0, 1) || outside_all(0, -1) || outside_all(1, 1) || outside_all(1, -1) ||
+            outside_all(2, 1) || outside_all(2, -1)) {
+          continue;
+        }
+
+        auto first_triangle = batch.triangles.size();
+        int32_t num_behind = 0;
+        for (auto i = 0; i < 3; ++i) num_behind += v[i]->position.z < -v[i]->position.w;
+        if (!num_behind) {
+          setup_triangle(v, pipeline, width, height, batch);
+        } else {
+          // Sutherland-Hodgman against the near plane; one triangle in gives at most a quad out
+          ClipVertex polygon[4];
+          int32_t n = 0;
+          for (auto i = 0; i < 3; ++i) {
+            const auto &p = *v[i], &q = *v[(i + 1) % 3];
+            auto p_in = p.position.z >= -p.position.w, q_in = q.position.z >= -q.position.w;
+            if (p_in) polygon[n++] = p;
+            if (p_in != q_in) polygon[n++] = clip_near(p, q, nv);
+          }
+          for (auto i = 1; i + 1 < n; ++i) {
+            const ClipVertex *fan[3] = {&polygon[0], &polygon[i], &polygon[i + 1]};
+            setup_triangle(fan, pipeline, width, height, batch);
+          }
+        }
+
+        for (auto s = first_triangle; s < batch.triangles.size(); ++s) {
+          const auto &tri = batch.triangles[s];
+          for (auto ty = tri.min_y / TILE_SIZE; ty <= (tri.max_y - 1) / TILE_SIZE; ++ty) {
+            for (auto tx = tri.min_x / TILE_SIZE; tx <= (tri.max_x - 1) / TILE_SIZE; ++tx) {
+              batch.tiles[ty * tiles_x + tx].push_back(static_cast<uint32_t>(s));
+            }
+          }
+        }
+      }
+    }
+  });
+
+  // Each tile draws its triangles batch by batch, so in the order they were given
+  parallel_for(0, static_cast<size_t>(tiles_x * tiles_y), 1, [&](size_t begin, size_t end) {
+    for (auto tile = begin; tile < end; ++tile) {
+      const auto tx = static_cast<int32_t>(tile % tiles_x), ty = static_cast<int32_t>(tile / tiles_x);
+      const auto x0 = tx * TILE_SIZE, y0 = ty * TILE_SIZE;
+      const auto x1 = std::min(x0 + TILE_SIZE, static_cast<int32_t>(frame.width));
+      const auto y1 = std::min(y0 + TILE_SIZE, static_cast<int32_t>(frame.height));
+      for (const auto &batch: batches) {
+        for (auto s: batch.tiles[tile]) {
+          const auto &tri = batch.triangles[s];
+          rasterize_in_tile(tri, batch.varyings.data() + tri.varyings, pipeline, x0, y0, x1, y1, frame);
+        }
+      }
+    }
+  });
+}
+
+bool write_ppm(const std::string &file_name, const FrameBuffer &frame) {
+  std::ofstream out(file_name, std::ios::binary);
+  if (!out.is_open()) {
+    spdlog::error("Couldn't open PPM file {}", file_name);
+    return false;
+  }
+  out << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+  std::vector<uint8_t> rgb(3 * frame.colour.size());
+  for (size_t i = 0; i < frame.colour.size(); ++i) {
+    for (auto k = 0; k < 3; ++k) rgb[3 * i + k] = channel(frame.colour[i], k);
+  }
+  out.write(reinterpret_cast<const char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+  if (!out.good()) {
+    spdlog::error("Couldn't write PPM file {}", file_name);
+    return false;
+  }
+  return true;
+}
+
+bool read_ppm(const std::string &file_name, FrameBuffer &frame) {
+  std::ifstream in(file_name, std::ios::binary);
+  if (!in.is_open()) {
+    spdlog::error("Couldn't open PPM file {}", file_name);
+    return false;
+  }
+
+  // Header fields are separated by whitespace and may be interleaved with # comments
+  auto next_field = [&in](uint32_t &value) -> bool {
+    while (in >> std::ws && in.peek() == '#') {
+      in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return static_cast<bool>(in >> value);
+  };
+  std::string magic;
+  uint32_t width, height, max_value;
+  in >> magic;
+  if (magic != "P6" || !next_field(width) || !next_field(height) || !next_field(max_value)) {
+    spdlog::error("  {} is not a binary PPM", file_name);
+    return false;
+  }
+  if (max_value != 255) {
+    spdlog::error("  {} has {} levels, only 8 bit PPMs are supported", file_name, max_value + 1);
+    return false;
+  }
+  in.get();
+
+  std::vector<uint8_t> rgb(3 * static_cast<size_t>(width) * height);
+  in.read(reinterpret_cast<char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+  if (in.gcount() != static_cast<std::streamsize>(rgb.size())) {
+    spdlog::error("  {} is truncated", file_name);
+    return false;
+  }
+  frame.resize(width, height);
+  for (size_t i = 0; i < frame.colour.size(); ++i) {
+    frame.colour[i] = rgb[3 * i] | (rgb[3 * i + 1] << 8) | (rgb[3 * i + 2] << 16) | 0xff000000u;
+  }
+  return true;
+}
+
+size_t count_differing_pixels(const FrameBuffer &a, const FrameBuffer &b, uint8_t tolerance) {
+  if (a.width != b.width || a.height != b.height) return std::max(a.colour.size(), b.colour.size());
+
+  size_t differing = 0;
+  for (size_t i = 0; i < a.colour.size(); ++i) {
+    for (auto k = 0; k < 3; ++k) {
+      if (std::abs(channel(a.colour[i], k) - channel(b.colour[i], k)) > tolerance) {
+        ++differing;
+        break;
+      }
+    }
+  }
+  return differing;
+}
@@ -0,0 +1,86 @@
+#include "render_thread.h"
+#include "gl_debug.h"
+
+RenderFrame::RenderFrame() : number{0} {}
+
+RenderThread::RenderThread(const std::function<void()> &make_current, const std::function<void()> &present)
+        : make_current_{make_current}, present_{present}, tasks_queued_{0}, tasks_done_{0}, stop_{false},
+          in_flight_{false, false}, frames_begun_{0}, frames_presented_{0} {
+  thread_ = std::thread(&RenderThread::loop, this);
+}
+
+RenderThread::~RenderThread() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  task_queued_.notify_one();
+  thread_.join();
+}
+
+void RenderThread::execute(const std::function<void()> &fn) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // Tasks run in order so this one is done once the count passes it
+  auto ticket = tasks_queued_++;
+  tasks_.push_back(Task{-1, &fn});
+  task_queued_.notify_one();
+  task_done_.wait(lock, [this, ticket]() { return tasks_done_ > ticket; });
+}
+
+RenderFrame &RenderThread::begin_frame() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto i = frames_begun_ % 2;
+  task_done_.wait(lock, [this, i]() { return !in_flight_[i]; });
+  auto &frame = frames_[i];
+  lock.unlock();
+
+  for (auto &list: frame.lists) list.reset();
+  frame.number = frames_begun_;
+  return frame;
+}
+
+void RenderThread::submit() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto i = frames_begun_ % 2;
+  in_flight_[i] = true;
+  ++frames_begun_;
+  ++tasks_queued_;
+  tasks_.push_back(Task{static_cast<int32_t>(i), nullptr});
+  task_queued_.notify_one();
+}
+
+uint64_t RenderThread::frames_presented() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return frames_presented_;
+}
+
+void RenderThread::loop() {
+  make_current_();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    task_queued_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+    if (tasks_.empty()) break;
+    auto task = tasks_.front();
+    tasks_.pop_front();
+    lock.unlock();
+
+    if (task.frame < 0) {
+      (*task.fn)();
+    } else {
+      {
+        GlDebugGroup group("Frame");
+        for (const auto &list: frames_[task.frame].lists) list.replay();
+      }
+      present_();
+    }
+
+    lock.lock();
+    if (task.frame >= 0) {
+      in_flight_[task.frame] = false;
+      ++frames_presented_;
+    }
+    ++tasks_done_;
+    task_done_.notify_all();
+  }
+}
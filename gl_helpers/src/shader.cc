@@ -1,5 +1,6 @@
 #include "shader.h"
 #include "gl_common.h"
+#include "gl_debug.h"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <spdlog/spdlog-inl.h>
@@ -29,6 +30,10 @@ Shader::~Shader() {
   glDeleteShader(id_);
 }
 
+void Shader::set_label(const std::string &label) const {
+  label_gl_object(GlObject::PROGRAM, id_, label);
+}
+
 // use/activate the shader
 void Shader::use() const {
   if (is_ready_) {
@@ -189,8 +194,14 @@ uint32_t compile_shader(GLenum type, const GLchar *const *source, std::string &c
   return 0;
 }
 
-uint32_t Shader::get_attribute_location(const std::string &attribute_name) {
-  if (!id_) return 0;
+int32_t Shader::get_attribute_location(const std::string &attribute_name) {
+  if (!id_) return -1;
 
   return glGetAttribLocation(id_,attribute_name.c_str());
 }
+
+int32_t Shader::get_uniform_location(const std::string &uniform_name) const {
+  if (!id_) return -1;
+
+  return get_uniform_loc_with_logging("location", id_, uniform_name.c_str());
+}
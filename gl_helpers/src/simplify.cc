@@ -0,0 +1,238 @@
+#include "simplify.h"
+#include "arena.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <tuple>
+
+namespace {
+  // Symmetric 4x4 plane quadric plus the total weight of the planes summed into it
+  struct Quadric {
+    double xx, xy, xz, xw, yy, yz, yw, zz, zw, ww;
+    double weight;
+  };
+
+  void add_plane(Quadric &q, double a, double b, double c, double d, double w) {
+    q.xx += w * a * a;
+    q.xy += w * a * b;
+    q.xz += w * a * c;
+    q.xw += w * a * d;
+    q.yy += w * b * b;
+    q.yz += w * b * c;
+    q.yw += w * b * d;
+    q.zz += w * c * c;
+    q.zw += w * c * d;
+    q.ww += w * d * d;
+    q.weight += w;
+  }
+
+  void add_quadric(Quadric &q, const Quadric &o) {
+    q.xx += o.xx;
+    q.xy += o.xy;
+    q.xz += o.xz;
+    q.xw += o.xw;
+    q.yy += o.yy;
+    q.yz += o.yz;
+    q.yw += o.yw;
+    q.zz += o.zz;
+    q.zw += o.zw;
+    q.ww += o.ww;
+    q.weight += o.weight;
+  }
+
+  // Mean squared distance of p from the planes in q, weighted by the areas of their triangles
+  double quadric_error(const Quadric &q, const float *p) {
+    double x = p[0], y = p[1], z = p[2];
+    auto e = x * x * q.xx + 2 * x * y * q.xy + 2 * x * z * q.xz + 2 * x * q.xw
+             + y * y * q.yy + 2 * y * z * q.yz + 2 * y * q.yw
+             + z * z * q.zz + 2 * z * q.zw
+             + q.ww;
+    return (q.weight > 0) ? std::fabs(e) / q.weight : 0;
+  }
+
+  // Unnormalised normal of the triangle (a, b, c)
+  inline void triangle_normal(const float *a, const float *b, const float *c, float *n) {
+    float e1[3]{b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    float e2[3]{c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+  }
+
+  struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    float cost;
+
+    bool operator<(const Collapse &o) const {
+      return std::tie(cost, from, to) < std::tie(o.cost, o.from, o.to);
+    }
+  };
+
+  const uint32_t MAX_PASSES = 64;
+}
+
+float simplify_mesh(const float *vertex_data, size_t num_vertices, size_t stride,
+                    const uint32_t *indices, size_t num_indices,
+                    size_t target_index_count, float max_error,
+                    std::vector<uint32_t> &result) {
+  using namespace std;
+
+  ArenaScope scope;
+  result.assign(indices, indices + num_indices);
+  if (target_index_count >= num_indices) return 0;
+  auto pos = [vertex_data, stride](uint32_t v) { return vertex_data + v * stride; };
+
+  // Group vertices by position. A position shared by several vertices is an attribute seam.
+  ScratchVector<uint32_t> by_position(num_vertices);
+  for (uint32_t v = 0; v < num_vertices; ++v) by_position[v] = v;
+  sort(by_position.begin(), by_position.end(), [&pos](uint32_t a, uint32_t b) {
+    return memcmp(pos(a), pos(b), 3 * sizeof(float)) < 0;
+  });
+  ScratchVector<uint32_t> position_id(num_vertices);
+  ScratchVector<uint8_t> locked(num_vertices, 0);
+  for (size_t i = 0, id = 0; i < num_vertices; ++id) {
+    auto j = i + 1;
+    while (j < num_vertices && memcmp(pos(by_position[i]), pos(by_position[j]), 3 * sizeof(float)) == 0) ++j;
+    for (auto k = i; k < j; ++k) {
+      position_id[by_position[k]] = static_cast<uint32_t>(id);
+      if (j - i > 1) locked[by_position[k]] = 1;
+    }
+    i = j;
+  }
+
+  // Edges used by other than two triangles, compared by position, are borders or non-manifold
+  {
+    ScratchVector<pair<uint64_t, uint32_t>> edges;
+    edges.reserve(num_indices);
+    for (size_t i = 0; i < num_indices; i += 3) {
+      for (auto e = 0; e < 3; ++e) {
+        auto a = result[i + e], b = result[i + (e + 1) % 3];
+        auto pa = position_id[a], pb = position_id[b];
+        auto key = (static_cast<uint64_t>(min(pa, pb)) << 32) | max(pa, pb);
+        edges.emplace_back(key, a);
+        edges.emplace_back(key, b);
+      }
+    }
+    sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();) {
+      auto j = i;
+      while (j < edges.size() && edges[j].first == edges[i].first) ++j;
+      // Each triangle contributes two entries per edge
+      if (j - i != 4) {
+        for (auto k = i; k < j; ++k) locked[edges[k].second] = 1;
+      }
+      i = j;
+    }
+  }
+
+  // Area weighted plane quadrics of the triangles around each vertex
+  ScratchVector<Quadric> quadrics(num_vertices);
+  memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+  for (size_t i = 0; i < num_indices; i += 3) {
+    const float *p0 = pos(result[i]), *p1 = pos(result[i + 1]), *p2 = pos(result[i + 2]);
+    float n[3];
+    triangle_normal(p0, p1, p2, n);
+    double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len == 0) continue;
+    double a = n[0] / len, b = n[1] / len, c = n[2] / len;
+    double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+    for (auto k = 0; k < 3; ++k) add_plane(quadrics[result[i + k]], a, b, c, d, len);
+  }
+
+  const auto target_triangles = target_index_count / 3;
+  const double max_error_sq = static_cast<double>(max_error) * max_error;
+  double worst = 0;
+  ScratchVector<uint32_t> remap(num_vertices);
+  ScratchVector<uint32_t> vertex_start, vertex_tris;
+  ScratchVector<Collapse> candidates;
+  ScratchVector<uint8_t> touched;
+
+  for (uint32_t pass = 0; pass < MAX_PASSES; ++pass) {
+    const auto num_triangles = result.size() / 3;
+    if (num_triangles <= target_triangles) break;
+
+    // Triangles around each vertex
+    vertex_start.assign(num_vertices + 1, 0);
+    for (auto v: result) ++vertex_start[v + 1];
+    for (size_t v = 0; v < num_vertices; ++v) vertex_start[v + 1] += vertex_start[v];
+    vertex_tris.resize(result.size());
+    {
+      ScratchVector<uint32_t> cursor(vertex_start.begin(), vertex_start.end() - 1);
+      for (size_t i = 0; i < result.size(); ++i) vertex_tris[cursor[result[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // Every directed edge whose source may be removed, cheapest first
+    candidates.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (auto e = 0; e < 3; ++e) {
+        auto a = result[i + e], b = result[i + (e + 1) % 3];
+        // The merged vertex carries the planes of both ends, so either collapse is costed against their sum
+        auto sum = quadrics[a];
+        add_quadric(sum, quadrics[b]);
+        if (!locked[a]) candidates.push_back(Collapse{a, b, static_cast<float>(quadric_error(sum, pos(b)))});
+        if (!locked[b]) candidates.push_back(Collapse{b, a, static_cast<float>(quadric_error(sum, pos(a)))});
+      }
+    }
+    sort(candidates.begin(), candidates.end());
+
+    // Apply independent collapses: once a vertex's neighbourhood changes it waits for the next pass
+    touched.assign(num_vertices, 0);
+    for (uint32_t v = 0; v < num_vertices; ++v) remap[v] = v;
+    size_t removed = 0, collapsed = 0;
+    for (const auto &c: candidates) {
+      if (c.cost > max_error_sq) break;
+      if (num_triangles - removed <= target_triangles) break;
+      if (touched[c.from] || touched[c.to]) continue;
+
+      // Reject collapses that would flip or degenerate a surviving triangle
+      auto ok = true;
+      size_t gone = 0;
+      for (auto k = vertex_start[c.from]; k < vertex_start[c.from + 1] && ok; ++k) {
+        const auto *tri = &result[3 * vertex_tris[k]];
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+          ++gone;
+          continue;
+        }
+        const float *p[3], *q[3];
+        for (auto j = 0; j < 3; ++j) {
+          p[j] = pos(tri[j]);
+          q[j] = (tri[j] == c.from) ? pos(c.to) : p[j];
+        }
+        float n0[3], n1[3];
+        triangle_normal(p[0], p[1], p[2], n0);
+        triangle_normal(q[0], q[1], q[2], n1);
+        auto d = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+        auto l0 = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+        auto l1 = n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2];
+        ok = d > 0 && d * d > 0.25f * l0 * l1;
+      }
+      if (!ok) continue;
+
+      remap[c.from] = c.to;
+      add_quadric(quadrics[c.to], quadrics[c.from]);
+      worst = max(worst, static_cast<double>(c.cost));
+      for (auto k = vertex_start[c.from]; k < vertex_start[c.from + 1]; ++k) {
+        const auto *tri = &result[3 * vertex_tris[k]];
+        touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+      }
+      touched[c.to] = 1;
+      removed += gone;
+      ++collapsed;
+    }
+    if (!collapsed) break;
+
+    // Remap and drop the triangles that collapsed to lines
+    size_t out = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      auto a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+      if (a == b || b == c || c == a) continue;
+      result[out++] = a;
+      result[out++] = b;
+      result[out++] = c;
+    }
+    result.resize(out);
+  }
+  return static_cast<float>(sqrt(worst));
+}
@@ -0,0 +1,369 @@
+#include "texture.h"
+#include "gl_debug.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "spdlog/spdlog-inl.h"
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace {
+  // GL's internal and pixel transfer formats for a number of 8 bit channels
+  void gl_formats(uint32_t channels, GLenum &internal_format, GLenum &format) {
+    switch (channels) {
+      case 1:
+        internal_format = GL_R8;
+        format = GL_RED;
+        break;
+      case 2:
+        internal_format = GL_RG8;
+        format = GL_RG;
+        break;
+      case 3:
+        internal_format = GL_RGB8;
+        format = GL_RGB;
+        break;
+      default:
+        internal_format = GL_RGBA8;
+        format = GL_RGBA;
+        break;
+    }
+  }
+
+  GLenum gl_compressed_format(BlockFormat format) {
+    switch (format) {
+      case BlockFormat::BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+      case BlockFormat::BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+      case BlockFormat::BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+      default:
+        return GL_COMPRESSED_RG_RGTC2;
+    }
+  }
+
+  // Channels of the images each format is chosen for
+  uint32_t format_channels(BlockFormat format) {
+    switch (format) {
+      case BlockFormat::BC1:
+        return 3;
+      case BlockFormat::BC3:
+        return 4;
+      case BlockFormat::BC4:
+        return 1;
+      default:
+        return 2;
+    }
+  }
+
+  inline bool has_texture_storage() {
+#ifdef __APPLE__
+    // GL 4.1 on macOS has no glTexStorage2D
+    return false;
+#else
+    return GLEW_ARB_texture_storage;
+#endif
+  }
+
+  // RGTC is core GL; S3TC is an extension that desktop drivers, macOS's included, provide
+  inline bool has_block_compression() {
+#ifdef __APPLE__
+    return true;
+#else
+    return GLEW_EXT_texture_compression_s3tc;
+#endif
+  }
+
+  std::string canonical_path(const std::string &file_name) {
+    char resolved[PATH_MAX];
+    return realpath(file_name.c_str(), resolved) ? std::string(resolved) : file_name;
+  }
+
+  /*
+   * What a cache is made from: the image's canonical path, then its size and
+   * modification time once it exists, so that a cache is only used for the
+   * same file in the same state.
+   */
+  std::string source_key(const std::string &file_name) {
+    auto key = canonical_path(file_name) + "|";
+    struct stat info;
+    if (stat(file_name.c_str(), &info) == 0) {
+      key += std::to_string(static_cast<int64_t>(info.st_size)) + "|" + std::to_string(static_cast<int64_t>(info.st_mtime));
+    }
+    return key;
+  }
+}
+
+TextureOptions::TextureOptions()
+        : budget_bytes{256 << 20}, upload_bytes_per_frame{16 << 20}, compress{true} {}
+
+TextureManager::TextureManager(const TextureOptions &options)
+        : options_{options}, compress_{options.compress && has_block_compression()},
+          pbos_{0, 0}, next_pbo_{0}, resident_bytes_{0}, frame_{0} {
+  if (options.compress && !compress_) {
+    spdlog::info("S3TC texture compression isn't supported; textures will be uncompressed");
+  }
+  glGenBuffers(2, pbos_);
+}
+
+TextureManager::~TextureManager() {
+  for (auto &e: entries_) {
+    // Decode jobs write into the entry, so let them finish first
+    if (e->job) JobSystem::shared().wait(e->job);
+    if (e->texture) glDeleteTextures(1, &e->texture);
+  }
+  glDeleteBuffers(2, pbos_);
+}
+
+TextureHandle TextureManager::request(const std::string &file_name) {
+  auto it = by_name_.find(file_name);
+  if (it != by_name_.end()) return it->second;
+
+  std::unique_ptr<Entry> entry(new Entry());
+  entry->file_name = file_name;
+  entry->state = UNLOADED;
+  entry->channels = 0;
+  entry->texture = 0;
+  entry->bytes = 0;
+  entry->last_used = frame_;
+  start_decode(*entry);
+
+  auto handle = static_cast<TextureHandle>(entries_.size());
+  entries_.push_back(std::move(entry));
+  by_name_[file_name] = handle;
+  return handle;
+}
+
+void TextureManager::update() {
+  GlDebugGroup group("Texture uploads");
+  auto &jobs = JobSystem::shared();
+
+  // Without worker threads nothing else runs the decodes
+  if (jobs.num_threads() == 1) {
+    for (auto &e: entries_) {
+      if (e->state == DECODING) jobs.wait(e->job);
+    }
+  }
+
+  // Upload the most recently wanted textures first
+  std::vector<Entry *> ready;
+  for (auto &e: entries_) {
+    if (e->state.load(std::memory_order_acquire) == DECODED) ready.push_back(e.get());
+  }
+  std::sort(ready.begin(), ready.end(), [](const Entry *a, const Entry *b) { return a->last_used > b->last_used; });
+  size_t uploaded = 0;
+  for (auto *e: ready) {
+    if (uploaded && uploaded >= options_.upload_bytes_per_frame) break;
+    upload(*e);
+    uploaded += e->bytes;
+  }
+
+  // Evict least recently drawn first. Anything drawn last frame or just uploaded stays even if over budget.
+  if (resident_bytes_ > options_.budget_bytes) {
+    std::vector<Entry *> resident;
+    for (auto &e: entries_) {
+      if (e->state == RESIDENT && e->last_used < frame_) resident.push_back(e.get());
+    }
+    std::sort(resident.begin(), resident.end(), [](const Entry *a, const Entry *b) { return a->last_used < b->last_used; });
+    for (size_t i = 0; i < resident.size() && resident_bytes_ > options_.budget_bytes; ++i) evict(*resident[i]);
+  }
+  ++frame_;
+}
+
+bool TextureManager::bind(TextureHandle handle, uint32_t unit) {
+  if (handle >= entries_.size()) return false;
+  auto &e = *entries_[handle];
+  e.last_used = frame_;
+  if (e.state == UNLOADED) start_decode(e);
+  if (e.state != RESIDENT) return false;
+
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, e.texture);
+  return true;
+}
+
+bool TextureManager::is_resident(TextureHandle handle) const {
+  return handle < entries_.size() && entries_[handle]->state == RESIDENT;
+}
+
+bool TextureManager::has_failed(TextureHandle handle) const {
+  return handle < entries_.size() && entries_[handle]->state == FAILED;
+}
+
+std::string TextureManager::cache_file_name(const std::string &file_name) const {
+  if (options_.cache_dir.empty()) return file_name + ".ktx2";
+  // Images of the same name in different directories get their own caches, told apart by a hash of the full path
+  const auto path = canonical_path(file_name);
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (auto c: path) hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ull;
+  auto slash = path.find_last_of("/\\");
+  auto base = slash == std::string::npos ? path : path.substr(slash + 1);
+  char suffix[20];
+  std::snprintf(suffix, sizeof(suffix), "-%016llx", static_cast<unsigned long long>(hash));
+  return options_.cache_dir + "/" + base + suffix + ".ktx2";
+}
+
+void TextureManager::start_decode(Entry &entry) {
+  entry.state = DECODING;
+  auto *e = &entry;
+  auto &jobs = JobSystem::shared();
+  entry.job = jobs.create_job([this, e]() {
+    auto ok = decode(*e);
+    e->state.store(ok ? DECODED : FAILED, std::memory_order_release);
+  });
+  jobs.run(entry.job);
+}
+
+bool TextureManager::decode(Entry &entry) const {
+  std::string cache, key;
+  if (compress_) {
+    // A cache made from the image as it is now is used as is. It stands in for the image if that has gone.
+    cache = cache_file_name(entry.file_name);
+    key = source_key(entry.file_name);
+    std::string cache_key;
+    struct stat info;
+    if (stat(cache.c_str(), &info) == 0 && read_ktx2(cache, entry.compressed_levels, &cache_key)
+        && (cache_key == key || (key.back() == '|' && cache_key.compare(0, key.size(), key) == 0))) {
+      entry.channels = format_channels(entry.compressed_levels[0].format);
+      return true;
+    }
+    entry.compressed_levels.clear();
+  }
+
+  std::vector<Image> levels(1);
+  if (!load_image(entry.file_name, levels[0])) return false;
+  build_mips(levels);
+  entry.channels = levels[0].channels;
+  if (!compress_) {
+    entry.levels.swap(levels);
+    return true;
+  }
+
+  const auto format = choose_block_format(levels[0]);
+  entry.compressed_levels.resize(levels.size());
+  for (size_t l = 0; l < levels.size(); ++l) compress_image(levels[l], format, entry.compressed_levels[l]);
+  entry.channels = format_channels(format);
+  if (!write_ktx2(cache, entry.compressed_levels, key)) {
+    spdlog::error("  {} will be compressed again on its next load", entry.file_name);
+  }
+  return true;
+}
+
+void TextureManager::upload(Entry &entry) {
+  const auto compressed = !entry.compressed_levels.empty();
+  const auto num_levels = static_cast<GLsizei>(compressed ? entry.compressed_levels.size() : entry.levels.size());
+  std::vector<const std::vector<uint8_t> *> data(num_levels);
+  std::vector<GLsizei> widths(num_levels), heights(num_levels);
+  for (GLsizei l = 0; l < num_levels; ++l) {
+    data[l] = compressed ? &entry.compressed_levels[l].blocks : &entry.levels[l].pixels;
+    widths[l] = static_cast<GLsizei>(compressed ? entry.compressed_levels[l].width : entry.levels[l].width);
+    heights[l] = static_cast<GLsizei>(compressed ? entry.compressed_levels[l].height : entry.levels[l].height);
+  }
+  GLenum internal_format, format;
+  gl_formats(entry.channels, internal_format, format);
+  if (compressed) internal_format = gl_compressed_format(entry.compressed_levels[0].format);
+
+  // All levels go through the PBO in one copy; GL reads them from it after this returns
+  size_t total = 0;
+  for (const auto *d: data) total += d->size();
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos_[next_pbo_]);
+  next_pbo_ = (next_pbo_ + 1) % 2;
+  // Respecifying the store orphans any data GL is still reading rather than waiting for it
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(total), nullptr, GL_STREAM_DRAW);
+  auto *dst = static_cast<uint8_t *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(total),
+                                                      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if (!dst) {
+    spdlog::error("Couldn't map pixel buffer for {}", entry.file_name);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return;
+  }
+  size_t offset = 0;
+  for (const auto *d: data) {
+    std::memcpy(dst + offset, d->data(), d->size());
+    offset += d->size();
+  }
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  glGenTextures(1, &entry.texture);
+  glBindTexture(GL_TEXTURE_2D, entry.texture);
+  label_gl_object(GlObject::TEXTURE, entry.texture, entry.file_name);
+  // Rows are tightly packed, which RGB and grey rows of odd widths aren't by GL's default
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  offset = 0;
+  if (has_texture_storage()) {
+#ifndef __APPLE__
+    glTexStorage2D(GL_TEXTURE_2D, num_levels, internal_format, widths[0], heights[0]);
+#endif
+    for (GLint l = 0; l < num_levels; ++l) {
+      auto pixels = reinterpret_cast<const GLvoid *>(offset);
+      if (compressed) {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, widths[l], heights[l], internal_format,
+                                  static_cast<GLsizei>(data[l]->size()), pixels);
+      } else {
+        glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, widths[l], heights[l], format, GL_UNSIGNED_BYTE, pixels);
+      }
+      offset += data[l]->size();
+    }
+  } else {
+    for (GLint l = 0; l < num_levels; ++l) {
+      auto pixels = reinterpret_cast<const GLvoid *>(offset);
+      if (compressed) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, l, internal_format, widths[l], heights[l], 0,
+                               static_cast<GLsizei>(data[l]->size()), pixels);
+      } else {
+        glTexImage2D(GL_TEXTURE_2D, l, static_cast<GLint>(internal_format), widths[l], heights[l],
+                     0, format, GL_UNSIGNED_BYTE, pixels);
+      }
+      offset += data[l]->size();
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  if (entry.channels == 1) {
+    // Grey images read as grey rather than red
+    GLint swizzle[]{GL_RED, GL_RED, GL_RED, GL_ONE};
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  } else if (entry.channels == 2) {
+    GLint swizzle[]{GL_RED, GL_RED, GL_RED, GL_GREEN};
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+  }
+
+  // Blocks take what they take; GL pads RGB texels to four bytes
+  entry.bytes = 0;
+  for (GLsizei l = 0; l < num_levels; ++l) {
+    entry.bytes += compressed ? data[l]->size()
+                              : static_cast<size_t>(widths[l]) * heights[l] * (entry.channels == 3 ? 4 : entry.channels);
+  }
+  resident_bytes_ += entry.bytes;
+
+  // The decoded copy isn't needed once GL has it
+  std::vector<Image>().swap(entry.levels);
+  std::vector<CompressedImage>().swap(entry.compressed_levels);
+  entry.last_used = std::max(entry.last_used, frame_);
+  entry.state = RESIDENT;
+}
+
+void TextureManager::evict(Entry &entry) {
+  glDeleteTextures(1, &entry.texture);
+  entry.texture = 0;
+  resident_bytes_ -= entry.bytes;
+  entry.bytes = 0;
+  entry.state = UNLOADED;
+}
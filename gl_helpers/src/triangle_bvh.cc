@@ -0,0 +1,251 @@
+#include "triangle_bvh.h"
+#include "parallel.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+  using simd::Float;
+  using simd::Mask;
+  using simd::LANES;
+
+  // Traversal stack depth; the BVH limits its depth to well under this
+  const uint32_t STACK_SIZE = 64;
+
+  // Up to LANES rays and their nearest hits so far
+  struct Packet {
+    Float ox, oy, oz;
+    Float dx, dy, dz;
+    Float inv_x, inv_y, inv_z;
+    Float best, u, v;
+    Mask active;
+    uint32_t triangle[LANES];
+
+    // Sum of the directions, for choosing which child to visit first
+    float dir_sum[3];
+  };
+
+  // Fill a packet from rays [first, first + n), n <= LANES. Unused lanes repeat the last ray, inactive.
+  void load_packet(const glm::vec3 *origins, const glm::vec3 *directions, size_t first, size_t n, Packet &packet) {
+    float f[9][LANES];
+    packet.dir_sum[0] = packet.dir_sum[1] = packet.dir_sum[2] = 0;
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      auto r = first + std::min(lane, n - 1);
+      const auto &o = origins[r];
+      const auto &d = directions[r];
+      f[0][lane] = o.x;
+      f[1][lane] = o.y;
+      f[2][lane] = o.z;
+      f[3][lane] = d.x;
+      f[4][lane] = d.y;
+      f[5][lane] = d.z;
+      f[6][lane] = 1.0f / d.x;
+      f[7][lane] = 1.0f / d.y;
+      f[8][lane] = 1.0f / d.z;
+      if (lane < n) {
+        packet.dir_sum[0] += d.x;
+        packet.dir_sum[1] += d.y;
+        packet.dir_sum[2] += d.z;
+      }
+      packet.triangle[lane] = NO_HIT;
+    }
+    packet.ox = simd::load(f[0]);
+    packet.oy = simd::load(f[1]);
+    packet.oz = simd::load(f[2]);
+    packet.dx = simd::load(f[3]);
+    packet.dy = simd::load(f[4]);
+    packet.dz = simd::load(f[5]);
+    packet.inv_x = simd::load(f[6]);
+    packet.inv_y = simd::load(f[7]);
+    packet.inv_z = simd::load(f[8]);
+    packet.best = simd::set1(std::numeric_limits<float>::max());
+    packet.u = packet.v = simd::set1(0);
+    packet.active = simd::from_bits((1u << n) - 1);
+  }
+
+  void store_hits(const Packet &packet, size_t n, RayHit *hits) {
+    float best[LANES], u[LANES], v[LANES];
+    simd::store(best, packet.best);
+    simd::store(u, packet.u);
+    simd::store(v, packet.v);
+    for (size_t lane = 0; lane < n; ++lane) {
+      auto &hit = hits[lane];
+      hit.triangle = packet.triangle[lane];
+      if (hit.triangle == NO_HIT) continue;
+      hit.u = u[lane];
+      hit.v = v[lane];
+      hit.distance = best[lane];
+    }
+  }
+
+  /*
+   * The range of t over which rays are between the planes lo and hi along one
+   * axis. A ray parallel to the planes that starts on one makes 0 * inf = NaN,
+   * which min and max treat differently on each ISA; it stays on the plane, so
+   * its range is the whole ray.
+   */
+  inline void slab(float lo, float hi, Float origin, Float inv, Float &near, Float &far) {
+    auto a = (simd::set1(lo) - origin) * inv, b = (simd::set1(hi) - origin) * inv;
+    auto ordered = (a <= a) & (b <= b);
+    near = simd::select(ordered, simd::min(a, b), simd::set1(-INFINITY));
+    far = simd::select(ordered, simd::max(a, b), simd::set1(INFINITY));
+  }
+
+  // Active rays that enter the node's box before their nearest hit
+  inline Mask packet_enters(const Packet &p, const BvhNode &node) {
+    Float x0, x1, y0, y1, z0, z1;
+    slab(node.min[0], node.max[0], p.ox, p.inv_x, x0, x1);
+    slab(node.min[1], node.max[1], p.oy, p.inv_y, y0, y1);
+    slab(node.min[2], node.max[2], p.oz, p.inv_z, z0, z1);
+    auto t0 = simd::max(simd::max(x0, y0), simd::max(z0, simd::set1(0)));
+    auto t1 = simd::min(simd::min(x1, y1), simd::min(z1, p.best));
+    return (t0 <= t1) & p.active;
+  }
+
+  // Moller-Trumbore against every ray of the packet, keeping nearer hits
+  inline void packet_triangle(Packet &p, const float *tri, uint32_t triangle) {
+    auto p0x = simd::set1(tri[0]), p0y = simd::set1(tri[1]), p0z = simd::set1(tri[2]);
+    auto e1x = simd::set1(tri[3]), e1y = simd::set1(tri[4]), e1z = simd::set1(tri[5]);
+    auto e2x = simd::set1(tri[6]), e2y = simd::set1(tri[7]), e2z = simd::set1(tri[8]);
+
+    auto px = p.dy * e2z - p.dz * e2y;
+    auto py = p.dz * e2x - p.dx * e2z;
+    auto pz = p.dx * e2y - p.dy * e2x;
+    auto det = e1x * px + e1y * py + e1z * pz;
+    auto inv_det = simd::set1(1.0f) / det;
+    auto tx = p.ox - p0x, ty = p.oy - p0y, tz = p.oz - p0z;
+    auto u = (tx * px + ty * py + tz * pz) * inv_det;
+    auto qx = ty * e1z - tz * e1y;
+    auto qy = tz * e1x - tx * e1z;
+    auto qz = tx * e1y - ty * e1x;
+    auto v = (p.dx * qx + p.dy * qy + p.dz * qz) * inv_det;
+    auto t = (e2x * qx + e2y * qy + e2z * qz) * inv_det;
+
+    const auto zero = simd::set1(0);
+    auto hit = p.active & (simd::abs(det) > simd::set1(1e-30f))
+               & (u >= zero) & (v >= zero) & (u + v <= simd::set1(1.0f))
+               & (t >= zero) & (t < p.best);
+    auto hit_bits = simd::bits(hit);
+    if (!hit_bits) return;
+    p.best = simd::select(hit, t, p.best);
+    p.u = simd::select(hit, u, p.u);
+    p.v = simd::select(hit, v, p.v);
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      if ((hit_bits >> lane) & 1) p.triangle[lane] = triangle;
+    }
+  }
+
+  void trace_packet(const TriangleBvh &tb, Packet &p) {
+    const auto &nodes = tb.bvh.nodes;
+    if (nodes.empty()) return;
+
+    uint32_t stack[STACK_SIZE];
+    uint32_t top = 0;
+    stack[top++] = 0;
+    while (top) {
+      auto node_index = stack[--top];
+      const auto &node = nodes[node_index];
+      if (!simd::any(packet_enters(p, node))) continue;
+
+      if (node.count) {
+        for (auto i = node.first; i < node.first + node.count; ++i) {
+          packet_triangle(p, &tb.triangles[9 * i], tb.bvh.indices[i]);
+        }
+        continue;
+      }
+
+      // Push the far child first. Near is judged along the axis separating the
+      // children most, by the direction the packet is mostly heading.
+      auto left = node_index + 1, right = node.first;
+      const auto &l = nodes[left];
+      const auto &r = nodes[right];
+      auto axis = 0;
+      auto widest = 0.0f;
+      float sep[3];
+      for (auto k = 0; k < 3; ++k) {
+        sep[k] = (r.min[k] + r.max[k]) - (l.min[k] + l.max[k]);
+        if (std::fabs(sep[k]) > widest) {
+          widest = std::fabs(sep[k]);
+          axis = k;
+        }
+      }
+      auto left_first = sep[axis] * p.dir_sum[axis] >= 0;
+      stack[top++] = left_first ? right : left;
+      stack[top++] = left_first ? left : right;
+    }
+  }
+}
+
+RayHit::RayHit() : triangle{NO_HIT}, u{0}, v{0}, distance{0} {}
+
+void build_triangle_bvh(const float *vertex_data, size_t stride,
+                        const uint32_t *indices, size_t num_indices,
+                        TriangleBvh &triangle_bvh) {
+  const auto num_triangles = num_indices / 3;
+  auto pos = [vertex_data, stride](uint32_t v) { return vertex_data + v * stride; };
+
+  ObjectBounds bounds;
+  bounds.resize(num_triangles);
+  parallel_for(0, num_triangles, 4096, [&](size_t begin, size_t end) {
+    for (auto t = begin; t < end; ++t) {
+      const float *a = pos(indices[3 * t]), *b = pos(indices[3 * t + 1]), *c = pos(indices[3 * t + 2]);
+      float lo[3], hi[3];
+      for (auto k = 0; k < 3; ++k) {
+        lo[k] = std::min(a[k], std::min(b[k], c[k]));
+        hi[k] = std::max(a[k], std::max(b[k], c[k]));
+      }
+      bounds.center_x[t] = (lo[0] + hi[0]) * 0.5f;
+      bounds.center_y[t] = (lo[1] + hi[1]) * 0.5f;
+      bounds.center_z[t] = (lo[2] + hi[2]) * 0.5f;
+      bounds.extent_x[t] = (hi[0] - lo[0]) * 0.5f;
+      bounds.extent_y[t] = (hi[1] - lo[1]) * 0.5f;
+      bounds.extent_z[t] = (hi[2] - lo[2]) * 0.5f;
+    }
+  });
+  build_bvh(bounds, triangle_bvh.bvh);
+
+  // Leaves' triangles side by side, ready for intersection
+  auto &triangles = triangle_bvh.triangles;
+  const auto &order = triangle_bvh.bvh.indices;
+  triangles.resize(9 * num_triangles);
+  parallel_for(0, num_triangles, 4096, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      auto t = order[i];
+      const float *a = pos(indices[3 * t]), *b = pos(indices[3 * t + 1]), *c = pos(indices[3 * t + 2]);
+      auto *out = &triangles[9 * i];
+      for (auto k = 0; k < 3; ++k) {
+        out[k] = a[k];
+        out[3 + k] = b[k] - a[k];
+        out[6 + k] = c[k] - a[k];
+      }
+    }
+  });
+}
+
+bool raycast(const TriangleBvh &triangle_bvh,
+             const glm::vec3 &origin, const glm::vec3 &direction,
+             RayHit &hit) {
+  Packet packet;
+  load_packet(&origin, &direction, 0, 1, packet);
+  trace_packet(triangle_bvh, packet);
+  store_hits(packet, 1, &hit);
+  return hit.triangle != NO_HIT;
+}
+
+void raycast(const TriangleBvh &triangle_bvh,
+             const glm::vec3 *origins, const glm::vec3 *directions, size_t count,
+             RayHit *hits) {
+  const auto num_packets = (count + LANES - 1) / LANES;
+  parallel_for(0, num_packets, 64, [&](size_t begin, size_t end) {
+    Packet packet;
+    for (auto p = begin; p < end; ++p) {
+      auto first = p * LANES;
+      auto n = std::min(LANES, count - first);
+      load_packet(origins, directions, first, n, packet);
+      trace_packet(triangle_bvh, packet);
+      store_hits(packet, n, hits + first);
+    }
+  });
+}
@@ -0,0 +1,41 @@
+#include "vertex_format.h"
+
+const uint32_t vertex_attribute::Position::COMPONENTS;
+const uint32_t vertex_attribute::Normal::COMPONENTS;
+const uint32_t vertex_attribute::TexCoord::COMPONENTS;
+const uint32_t vertex_attribute::Tangent::COMPONENTS;
+
+namespace {
+  struct FormatStride {
+    uint32_t &stride;
+
+    template<typename Format>
+    bool operator()(Format) const {
+      stride = Format::STRIDE;
+      return true;
+    }
+  };
+
+  struct EnableFormat {
+    const MeshLoadOptions &options;
+
+    template<typename Format>
+    bool operator()(Format) const {
+      Format::enable_attributes(options);
+      return true;
+    }
+  };
+}
+
+uint32_t vertex_stride(bool include_normals, bool include_textures, bool include_tangents) {
+  uint32_t stride = 0;
+  dispatch_vertex_format(include_normals, include_textures, include_tangents, FormatStride{stride});
+  return stride;
+}
+
+bool enable_vertex_attributes(const MeshLoadOptions &options,
+                              bool include_normals,
+                              bool include_textures,
+                              bool include_tangents) {
+  return dispatch_vertex_format(include_normals, include_textures, include_tangents, EnableFormat{options});
+}
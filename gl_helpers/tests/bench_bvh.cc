@@ -0,0 +1,91 @@
+/*
+ * Timings for the scene BVH.
+ *
+ * usage: bench_bvh [objects] [iterations]
+ *
+ * Objects (100K by default) are random boxes in a 1000 unit cube. Each stage
+ * reports the best of `iterations` runs.
+ */
+#include "bvh.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace {
+  // Best wall time, in milliseconds, of running fn iterations times
+  double time_best_ms(int32_t iterations, const std::function<void()> &fn) {
+    using namespace std::chrono;
+    auto best = 1e30;
+    for (auto i = 0; i < iterations; ++i) {
+      auto start = steady_clock::now();
+      fn();
+      auto ms = duration<double, std::milli>(steady_clock::now() - start).count();
+      if (ms < best) best = ms;
+    }
+    return best;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  auto num_objects = argc > 1 ? std::atoi(argv[1]) : 100000;
+  auto iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+
+  std::mt19937 rng{1};
+  std::uniform_real_distribution<float> position{-500.0f, 500.0f};
+  std::uniform_real_distribution<float> size{0.5f, 5.0f};
+  ObjectBounds bounds;
+  bounds.resize(num_objects);
+  for (auto i = 0; i < num_objects; ++i) {
+    Bounds b;
+    for (auto k = 0; k < 3; ++k) {
+      b.min[k] = position(rng);
+      b.max[k] = b.min[k] + size(rng);
+    }
+    bounds.set(i, b, glm::mat4{1.0f});
+  }
+  std::printf("objects: %d, iterations: %d\n", num_objects, iterations);
+
+  Bvh bvh;
+  auto build_ms = time_best_ms(iterations, [&]() { build_bvh(bounds, bvh); });
+  std::printf("  build             %10.3f ms  (%zu nodes)\n", build_ms, bvh.nodes.size());
+
+  auto refit_ms = time_best_ms(iterations, [&]() { refit_bvh(bounds, bvh); });
+  std::printf("  refit             %10.3f ms\n", refit_ms);
+
+  // A narrow and a wide view from the middle of the scene
+  std::vector<uint32_t> visible;
+  for (auto fov: {30.0f, 90.0f}) {
+    auto vp = glm::perspective(glm::radians(fov), 16.0f / 9.0f, 0.1f, 400.0f)
+              * glm::lookAt(glm::vec3{0, 0, 0}, glm::vec3{1, 0.1f, -1}, glm::vec3{0, 1, 0});
+    size_t culled = 0;
+    auto flat_ms = time_best_ms(iterations, [&]() { culled = frustum_cull(bounds, vp, visible); });
+    std::printf("  fov %2.0f flat (%s) %8.3f ms  %zu culled\n", fov, frustum_cull_path(), flat_ms, culled);
+    auto tree_ms = time_best_ms(iterations, [&]() { culled = bvh_frustum_cull(bvh, vp, visible); });
+    std::printf("  fov %2.0f bvh        %8.3f ms  %zu culled\n", fov, tree_ms, culled);
+  }
+
+  // Rays from random points towards random points
+  const size_t num_rays = 100000;
+  std::vector<glm::vec3> origins(num_rays), directions(num_rays);
+  for (size_t r = 0; r < num_rays; ++r) {
+    origins[r] = glm::vec3{position(rng), position(rng), position(rng)};
+    directions[r] = glm::normalize(glm::vec3{position(rng), position(rng), position(rng)} - origins[r]);
+  }
+  size_t hits = 0;
+  auto ray_ms = time_best_ms(iterations, [&]() {
+    hits = 0;
+    uint32_t object;
+    float distance;
+    for (size_t r = 0; r < num_rays; ++r) {
+      hits += bvh_raycast(bvh, origins[r], directions[r], object, distance);
+    }
+  });
+  std::printf("  raycast           %10.3f ms  %8.2f Mrays/s  (%zu hits)\n",
+              ray_ms, num_rays / (ray_ms * 1e3), hits);
+  return EXIT_SUCCESS;
+}
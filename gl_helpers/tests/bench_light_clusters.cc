@@ -0,0 +1,64 @@
+/*
+ * Timings for binning point lights into clusters.
+ *
+ * usage: bench_light_clusters [iterations]
+ *
+ * Lights of random radius are scattered through a box around the view, which
+ * looks into it from one side, and binned into the default 16 x 9 x 24 grid.
+ * For each light count the best of `iterations` runs is reported, with the
+ * average number of clusters each light reached.
+ */
+#include "light_clusters.h"
+#include "parallel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace {
+  // Best wall time, in milliseconds, of running fn iterations times
+  double time_best_ms(int32_t iterations, const std::function<void()> &fn) {
+    using namespace std::chrono;
+    auto best = 1e30;
+    for (auto i = 0; i < iterations; ++i) {
+      auto start = steady_clock::now();
+      fn();
+      auto ms = duration<double, std::milli>(steady_clock::now() - start).count();
+      if (ms < best) best = ms;
+    }
+    return best;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  auto iterations = argc > 1 ? std::atoi(argv[1]) : 20;
+
+  const auto view = glm::lookAt(glm::vec3{0, 5, 40}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
+  const auto projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> position(-40.0f, 40.0f), radius(1.0f, 8.0f), colour(0.0f, 1.0f);
+
+  std::printf("%zu worker threads\n", num_worker_threads());
+  for (size_t count = 64; count <= 16384; count *= 2) {
+    std::vector<PointLight> lights(count);
+    for (auto &light: lights) {
+      light.position = glm::vec3{position(rng), position(rng) * 0.25f, position(rng)};
+      light.radius = radius(rng);
+      light.colour = glm::vec3{colour(rng), colour(rng), colour(rng)};
+    }
+    LightClusterOptions options;
+    options.max_lights = static_cast<uint32_t>(count);
+    options.max_light_indices = 1u << 24;
+    LightClusters clusters(options);
+    auto ms = time_best_ms(iterations, [&]() {
+      clusters.assign(lights, view, projection);
+    });
+    std::printf("  %6zu lights  %9.3f ms  %8.1f ns/light  %6.1f clusters/light\n", count, ms, ms * 1e6 / count,
+                static_cast<double>(clusters.light_indices().size()) / count);
+  }
+  return EXIT_SUCCESS;
+}
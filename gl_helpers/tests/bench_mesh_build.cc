@@ -0,0 +1,121 @@
+/*
+ * Timings for the CPU side of the mesh build.
+ *
+ * usage: bench_mesh_build [obj_file] [copies] [iterations]
+ *
+ * The OBJ (african_head.obj by default) is parsed once and then replicated
+ * `copies` times so that the stages can be timed at scan-like sizes as well
+ * as at the size of the file itself. Each stage reports the best of
+ * `iterations` runs.
+ */
+#include "mesh_internal.h"
+#include "meshlet.h"
+#include "parallel.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+namespace {
+  // Best wall time, in milliseconds, of running fn iterations times
+  double time_best_ms(int32_t iterations, const std::function<void()> &fn) {
+    using namespace std::chrono;
+    auto best = 1e30;
+    for (auto i = 0; i < iterations; ++i) {
+      auto start = steady_clock::now();
+      fn();
+      auto ms = duration<double, std::milli>(steady_clock::now() - start).count();
+      if (ms < best) best = ms;
+    }
+    return best;
+  }
+
+  // Append `copies` copies of src's geometry to a new mesh
+  RawMeshData replicate(const RawMeshData &src, int32_t copies) {
+    RawMeshData dst;
+    for (auto k = 0; k < copies; ++k) {
+      auto v0 = static_cast<int32_t>(dst.num_vertices());
+      auto n0 = static_cast<int32_t>(dst.num_normals());
+      auto t0 = static_cast<int32_t>(dst.num_tex_coords());
+      auto c0 = static_cast<uint32_t>(dst.num_corners());
+      dst.pos_x.insert(dst.pos_x.end(), src.pos_x.begin(), src.pos_x.end());
+      dst.pos_y.insert(dst.pos_y.end(), src.pos_y.begin(), src.pos_y.end());
+      dst.pos_z.insert(dst.pos_z.end(), src.pos_z.begin(), src.pos_z.end());
+      dst.norm_x.insert(dst.norm_x.end(), src.norm_x.begin(), src.norm_x.end());
+      dst.norm_y.insert(dst.norm_y.end(), src.norm_y.begin(), src.norm_y.end());
+      dst.norm_z.insert(dst.norm_z.end(), src.norm_z.begin(), src.norm_z.end());
+      dst.tex_u.insert(dst.tex_u.end(), src.tex_u.begin(), src.tex_u.end());
+      dst.tex_v.insert(dst.tex_v.end(), src.tex_v.begin(), src.tex_v.end());
+      for (size_t c = 0; c < src.num_corners(); ++c) {
+        dst.corner_vertex.push_back(src.corner_vertex[c] + v0);
+        dst.corner_normal.push_back(src.corner_normal[c] < 0 ? -1 : src.corner_normal[c] + n0);
+        dst.corner_tex.push_back(src.corner_tex[c] < 0 ? -1 : src.corner_tex[c] + t0);
+      }
+      for (size_t f = 1; f < src.face_offsets.size(); ++f) dst.face_offsets.push_back(src.face_offsets[f] + c0);
+      for (auto t: src.triangles) dst.triangles.push_back(t + c0);
+      dst.face_smoothing.insert(dst.face_smoothing.end(), src.face_smoothing.begin(), src.face_smoothing.end());
+    }
+    return dst;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::string file_name = argc > 1 ? argv[1] : "african_head.obj";
+  auto copies = argc > 2 ? std::atoi(argv[2]) : 1;
+  auto iterations = argc > 3 ? std::atoi(argv[3]) : 10;
+
+  RawMeshData src;
+  auto parse_ms = time_best_ms(iterations, [&]() {
+    std::ifstream f(file_name);
+    src.clear();
+    if (!parse_raw_data(f, src, true, true)) std::exit(EXIT_FAILURE);
+  });
+  std::printf("%s: %zu vertices, %zu faces, %zu triangles\n",
+              file_name.c_str(), src.num_vertices(), src.num_faces(), src.num_triangles());
+  std::printf("threads: %zu, copies: %d, iterations: %d\n", num_worker_threads(), copies, iterations);
+  std::printf("  parse            %10.3f ms\n", parse_ms);
+
+  auto raw = replicate(src, copies);
+  const auto tris_m = static_cast<double>(raw.num_triangles()) / 1e6;
+  std::printf("  replicated to %zu triangles\n", raw.num_triangles());
+
+  auto normals_ms = time_best_ms(iterations, [&]() {
+    generate_normals(raw, NormalWeighting::ANGLE, 60.0f);
+  });
+  std::printf("  normals          %10.3f ms  %8.2f Mtri/s\n", normals_ms, tris_m / (normals_ms / 1e3));
+
+  auto tangents_ms = time_best_ms(iterations, [&]() {
+    generate_tangents(raw);
+  });
+  std::printf("  tangents         %10.3f ms  %8.2f Mtri/s\n", tangents_ms, tris_m / (tangents_ms / 1e3));
+
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  auto build_ms = time_best_ms(iterations, [&]() {
+    build_vertex_data(raw, vertex_data, indices, true, true, true);
+  });
+  std::printf("  dedup/interleave %10.3f ms  %8.2f Mtri/s  (%zu vertices)\n",
+              build_ms, tris_m / (build_ms / 1e3), vertex_data.size() / 12);
+
+  std::vector<SubMesh> submeshes;
+  build_vertex_data(raw, vertex_data, indices, false, false, false, &submeshes);
+  std::vector<Meshlet> meshlets;
+  auto meshlet_ms = time_best_ms(iterations, [&]() {
+    build_meshlets(vertex_data.data(), 3, indices, submeshes, 124, meshlets);
+  });
+  std::printf("  meshlets         %10.3f ms  %8.2f Mtri/s  (%zu meshlets)\n",
+              meshlet_ms, tris_m / (meshlet_ms / 1e3), meshlets.size());
+
+  // A camera in front of the copies, which all sit on top of one another
+  glm::mat4 mvp{1.0f};
+  mvp[2][2] = -1.0f;
+  MeshletDrawList draw_list;
+  auto cull_ms = time_best_ms(iterations, [&]() {
+    cull_meshlets(meshlets, mvp, glm::vec3{0, 0, 3}, draw_list);
+  });
+  std::printf("  meshlet cull     %10.3f ms  %zu visible, %zu back facing, %zu draws\n",
+              cull_ms, draw_list.visible, draw_list.backface_culled, draw_list.commands.size());
+  return EXIT_SUCCESS;
+}
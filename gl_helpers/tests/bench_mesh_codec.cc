@@ -0,0 +1,131 @@
+/*
+ * Timings for the mesh codec against reading the same mesh uncompressed.
+ *
+ * usage: bench_mesh_codec [obj_file] [copies] [iterations]
+ *
+ * The OBJ (african_head.obj by default) is loaded with normals and tex coords
+ * and replicated `copies` times. The raw vertex and index data are written to
+ * one file and the encoded mesh to another; reading the raw file and reading
+ * plus decoding the encoded one are then timed. Both reads come from the page
+ * cache, so this is the least the codec can win by. Each reports the best of
+ * `iterations` runs.
+ */
+#include "mesh_codec.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+
+namespace {
+  // Best wall time, in milliseconds, of running fn iterations times
+  double time_best_ms(int32_t iterations, const std::function<void()> &fn) {
+    using namespace std::chrono;
+    auto best = 1e30;
+    for (auto i = 0; i < iterations; ++i) {
+      auto start = steady_clock::now();
+      fn();
+      auto ms = duration<double, std::milli>(steady_clock::now() - start).count();
+      if (ms < best) best = ms;
+    }
+    return best;
+  }
+
+  // The full resolution triangles of `copies` copies of src, each offset along x by the width of the one before
+  Mesh replicate(const Mesh &src, int32_t copies) {
+    Mesh dst;
+    dst.stride = src.stride;
+    const auto num_vertices = static_cast<uint32_t>(src.vertex_data.size() / src.stride);
+    const auto width = src.bounds.max[0] - src.bounds.min[0];
+    for (auto k = 0; k < copies; ++k) {
+      const auto v0 = static_cast<uint32_t>(dst.vertex_data.size() / dst.stride);
+      for (size_t v = 0; v < num_vertices; ++v) {
+        const auto *p = &src.vertex_data[v * src.stride];
+        dst.vertex_data.insert(dst.vertex_data.end(), p, p + src.stride);
+        dst.vertex_data[dst.vertex_data.size() - dst.stride] += width * static_cast<float>(k);
+      }
+      SubMesh sm;
+      sm.index_offset = static_cast<uint32_t>(dst.indices.size());
+      sm.index_count = src.num_elements;
+      for (uint32_t i = 0; i < src.num_elements; ++i) dst.indices.push_back(src.indices[i] + v0);
+      dst.submeshes.push_back(sm);
+    }
+    dst.num_elements = static_cast<uint32_t>(dst.indices.size());
+    return dst;
+  }
+
+  bool read_file(const std::string &file_name, std::vector<char> &contents) {
+    std::ifstream in(file_name, std::ios::binary | std::ios::ate);
+    contents.resize(static_cast<size_t>(in.tellg()));
+    in.seekg(0);
+    return static_cast<bool>(in.read(contents.data(), static_cast<std::streamsize>(contents.size())));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::string file_name = argc > 1 ? argv[1] : "african_head.obj";
+  auto copies = argc > 2 ? std::atoi(argv[2]) : 16;
+  auto iterations = argc > 3 ? std::atoi(argv[3]) : 10;
+  const std::string raw_file = "bench_mesh_codec.raw";
+  const std::string encoded_file = "bench_mesh_codec.mesh";
+
+  MeshLoadOptions load_options;
+  load_options.include_normals = true;
+  load_options.include_textures = true;
+  load_options.upload = false;
+  Mesh src;
+  if (!load_obj(file_name, src, load_options)) return EXIT_FAILURE;
+  auto mesh = replicate(src, copies);
+  const auto raw_bytes = mesh.vertex_data.size() * sizeof(float) + mesh.indices.size() * sizeof(uint32_t);
+  std::printf("%s x %d: %zu vertices, %u triangles, %.1f MB raw\n", file_name.c_str(), copies,
+              mesh.vertex_data.size() / mesh.stride, mesh.num_elements / 3, raw_bytes / 1e6);
+
+  {
+    std::ofstream out(raw_file, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(mesh.vertex_data.data()),
+              static_cast<std::streamsize>(mesh.vertex_data.size() * sizeof(float)));
+    out.write(reinterpret_cast<const char *>(mesh.indices.data()),
+              static_cast<std::streamsize>(mesh.indices.size() * sizeof(uint32_t)));
+  }
+  std::vector<char> contents;
+  auto raw_ms = time_best_ms(iterations, [&]() {
+    read_file(raw_file, contents);
+  });
+  std::printf("  read raw          %10.3f ms  %8.2f GB/s\n", raw_ms, raw_bytes / (raw_ms * 1e6));
+
+  MeshCodecOptions exact;
+  exact.position_bits = 0;
+  exact.attribute_bits = 0;
+  MeshCodecOptions defaults;
+  MeshCodecOptions coarse;
+  coarse.position_bits = 12;
+  coarse.attribute_bits = 10;
+  const char *names[] = {"exact", "16/14 bits", "12/10 bits"};
+  const MeshCodecOptions *options[] = {&exact, &defaults, &coarse};
+  for (auto o = 0; o < 3; ++o) {
+    std::vector<uint8_t> encoded;
+    auto encode_ms = time_best_ms(1, [&]() {
+      encode_mesh(mesh, encoded, *options[o]);
+    });
+    {
+      std::ofstream out(encoded_file, std::ios::binary);
+      out.write(reinterpret_cast<const char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    }
+    Mesh decoded;
+    auto decode_ms = time_best_ms(iterations, [&]() {
+      decode_mesh(encoded.data(), encoded.size(), decoded);
+    });
+    auto load_ms = time_best_ms(iterations, [&]() {
+      read_file(encoded_file, contents);
+      decode_mesh(reinterpret_cast<const uint8_t *>(contents.data()), contents.size(), decoded);
+    });
+    std::printf("  %-10s %5.1f%%  encode %9.3f ms  decode %9.3f ms %6.2f GB/s  read+decode %9.3f ms\n",
+                names[o], 100.0 * encoded.size() / raw_bytes, encode_ms,
+                decode_ms, raw_bytes / (decode_ms * 1e6), load_ms);
+  }
+  std::remove(raw_file.c_str());
+  std::remove(encoded_file.c_str());
+  return EXIT_SUCCESS;
+}
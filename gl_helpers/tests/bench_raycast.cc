@@ -0,0 +1,91 @@
+/*
+ * Ray casting throughput against a mesh's triangle BVH.
+ *
+ * usage: bench_raycast [obj_file] [rays] [iterations]
+ *
+ * Rays (1M by default) are cast from a camera in front of the model
+ * (african_head.obj by default) through a square grid of pixels covering it,
+ * in pixel order as a renderer would. Each stage reports the best of
+ * `iterations` runs.
+ */
+#include "triangle_bvh.h"
+#include "mesh_internal.h"
+#include "simd.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+
+namespace {
+  // Best wall time, in milliseconds, of running fn iterations times
+  double time_best_ms(int32_t iterations, const std::function<void()> &fn) {
+    using namespace std::chrono;
+    auto best = 1e30;
+    for (auto i = 0; i < iterations; ++i) {
+      auto start = steady_clock::now();
+      fn();
+      auto ms = duration<double, std::milli>(steady_clock::now() - start).count();
+      if (ms < best) best = ms;
+    }
+    return best;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  std::string file_name = argc > 1 ? argv[1] : "african_head.obj";
+  auto num_rays = argc > 2 ? std::atoi(argv[2]) : 1000000;
+  auto iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+
+  std::ifstream in(file_name);
+  RawMeshData raw;
+  if (!parse_raw_data(in, raw, false, false)) {
+    std::fprintf(stderr, "Couldn't read %s\n", file_name.c_str());
+    return 1;
+  }
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  build_vertex_data(raw, vertex_data, indices, false, false, false);
+  const auto bounds = compute_bounds(vertex_data.data(), vertex_data.size() / 3, 3);
+  std::printf("%s: %zu triangles, %d rays, %zu lanes, iterations: %d\n", file_name.c_str(), indices.size() / 3,
+              num_rays, simd::LANES, iterations);
+
+  TriangleBvh triangle_bvh;
+  auto build_ms = time_best_ms(iterations, [&]() {
+    build_triangle_bvh(vertex_data.data(), 3, indices.data(), indices.size(), triangle_bvh);
+  });
+  std::printf("  build             %10.3f ms  (%zu nodes)\n", build_ms, triangle_bvh.bvh.nodes.size());
+
+  // A pinhole camera three radii in front of the model, looking down -z
+  const auto side = static_cast<int32_t>(std::sqrt(static_cast<float>(num_rays)));
+  num_rays = side * side;
+  const glm::vec3 center{bounds.center[0], bounds.center[1], bounds.center[2]};
+  const auto eye = center + glm::vec3{0, 0, 3 * bounds.radius};
+  std::vector<glm::vec3> origins(num_rays, eye);
+  std::vector<glm::vec3> directions(num_rays);
+  for (auto y = 0; y < side; ++y) {
+    for (auto x = 0; x < side; ++x) {
+      auto px = (2.0f * (x + 0.5f) / side - 1.0f) * bounds.radius;
+      auto py = (1.0f - 2.0f * (y + 0.5f) / side) * bounds.radius;
+      directions[y * side + x] = glm::vec3{center.x + px, center.y + py, center.z} - eye;
+    }
+  }
+
+  std::vector<RayHit> hits(num_rays);
+  auto single_ms = time_best_ms(iterations, [&]() {
+    for (auto i = 0; i < num_rays; ++i) raycast(triangle_bvh, origins[i], directions[i], hits[i]);
+  });
+  size_t num_hits = 0;
+  for (const auto &hit: hits) num_hits += hit.triangle != NO_HIT;
+  std::printf("  single rays       %10.3f ms  %8.2f Mrays/s  (%zu hits)\n", single_ms,
+              num_rays / (single_ms * 1000.0), num_hits);
+
+  auto packet_ms = time_best_ms(iterations, [&]() {
+    raycast(triangle_bvh, origins.data(), directions.data(), num_rays, hits.data());
+  });
+  std::printf("  packets           %10.3f ms  %8.2f Mrays/s\n", packet_ms, num_rays / (packet_ms * 1000.0));
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+#include "arena.h"
+
+#include <cstdint>
+
+TEST(TestArena, allocations_are_aligned_and_distinct) {
+  Arena arena(1024);
+  auto *a = static_cast<char *>(arena.allocate(3, 1));
+  auto *b = static_cast<char *>(arena.allocate(8, 8));
+  auto *c = static_cast<char *>(arena.allocate(16, 64));
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(b) % 8);
+  EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(c) % 64);
+  EXPECT_GE(b, a + 3);
+  EXPECT_GE(c, b + 8);
+  EXPECT_GE(arena.used(), 3u + 8u + 16u);
+}
+
+TEST(TestArena, grows_past_a_block) {
+  Arena arena(256);
+  auto *small = static_cast<char *>(arena.allocate(200, 1));
+  auto *large = static_cast<char *>(arena.allocate(1000, 1));
+  for (auto i = 0; i < 200; ++i) small[i] = 1;
+  for (auto i = 0; i < 1000; ++i) large[i] = 2;
+  EXPECT_EQ(1, small[199]);
+  EXPECT_GE(arena.capacity(), 1200u);
+}
+
+TEST(TestArena, rewind_releases_everything_since_the_mark) {
+  Arena arena(256);
+  arena.allocate(100, 1);
+  auto m = arena.mark();
+  auto *first = arena.allocate(50, 1);
+  arena.allocate(500, 1);
+  EXPECT_GT(arena.used(), m.used);
+  arena.rewind(m);
+  EXPECT_EQ(m.used, arena.used());
+  // The same space is handed out again
+  EXPECT_EQ(first, arena.allocate(50, 1));
+}
+
+TEST(TestArena, rewinding_to_empty_keeps_only_the_first_block) {
+  Arena arena(256);
+  auto empty = arena.mark();
+  for (auto i = 0; i < 10; ++i) arena.allocate(200, 1);
+  EXPECT_GT(arena.capacity(), 256u);
+  arena.rewind(empty);
+  EXPECT_EQ(0u, arena.used());
+  EXPECT_EQ(256u, arena.capacity());
+}
+
+TEST(TestArena, last_allocation_can_be_given_back) {
+  Arena arena(1024);
+  auto *a = arena.allocate(64, 1);
+  auto used = arena.used();
+  auto *b = arena.allocate(64, 1);
+  // Not the most recent, so nothing happens
+  arena.deallocate(a, 64);
+  EXPECT_GT(arena.used(), used);
+  arena.deallocate(b, 64);
+  EXPECT_EQ(used, arena.used());
+}
+
+TEST(TestArena, scopes_nest_and_report_their_peak) {
+  Arena arena(1 << 16);
+  arena.allocate(1000, 1);
+  {
+    ArenaScope outer(arena);
+    arena.allocate(2000, 1);
+    {
+      ArenaScope inner(arena);
+      arena.allocate(5000, 1);
+      EXPECT_EQ(5000u, inner.peak());
+    }
+    EXPECT_EQ(3000u, arena.used());
+    arena.allocate(100, 1);
+    EXPECT_EQ(7000u, outer.peak());
+  }
+  EXPECT_EQ(1000u, arena.used());
+  EXPECT_EQ(8000u, arena.peak());
+}
+
+TEST(TestArena, scratch_vectors_live_in_the_scratch_arena) {
+  auto &arena = scratch_arena();
+  auto before = arena.used();
+  {
+    ArenaScope scope;
+    ScratchVector<uint32_t> values;
+    for (uint32_t i = 0; i < 100000; ++i) values.push_back(i);
+    uint64_t sum = 0;
+    for (auto v: values) sum += v;
+    EXPECT_EQ(4999950000ull, sum);
+    EXPECT_GE(arena.used(), before + 100000 * sizeof(uint32_t));
+    EXPECT_GE(scope.peak(), 100000 * sizeof(uint32_t));
+  }
+  EXPECT_EQ(before, arena.used());
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
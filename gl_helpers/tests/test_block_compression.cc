@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include "block_compression.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+namespace {
+  Image make_image(uint32_t width, uint32_t height, uint32_t channels) {
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels.resize(static_cast<size_t>(width) * height * channels);
+    return image;
+  }
+
+  // Largest difference of any channel
+  int32_t max_error(const Image &a, const Image &b) {
+    int32_t worst = 0;
+    for (size_t i = 0; i < a.pixels.size(); ++i) worst = std::max(worst, std::abs(a.pixels[i] - b.pixels[i]));
+    return worst;
+  }
+}
+
+TEST(TestBlockCompression, solid_colour_is_nearly_exact) {
+  auto image = make_image(8, 4, 3);
+  for (size_t i = 0; i < image.pixels.size(); i += 3) {
+    image.pixels[i] = 200;
+    image.pixels[i + 1] = 100;
+    image.pixels[i + 2] = 50;
+  }
+  CompressedImage compressed;
+  compress_image(image, BlockFormat::BC1, compressed);
+  EXPECT_EQ(2 * 8u, compressed.blocks.size());
+
+  Image decoded;
+  decompress_image(compressed, decoded);
+  EXPECT_EQ(3u, decoded.channels);
+  // Only 565 quantisation is lost
+  EXPECT_LE(max_error(image, decoded), 4);
+}
+
+TEST(TestBlockCompression, gradient_keeps_close_to_the_source) {
+  auto image = make_image(13, 7, 3);
+  for (uint32_t y = 0; y < image.height; ++y) {
+    for (uint32_t x = 0; x < image.width; ++x) {
+      auto *px = image.pixels.data() + (y * image.width + x) * 3;
+      px[0] = static_cast<uint8_t>(x * 19);
+      px[1] = static_cast<uint8_t>(y * 36);
+      px[2] = static_cast<uint8_t>(128 + x * 4);
+    }
+  }
+  CompressedImage compressed;
+  compress_image(image, BlockFormat::BC1, compressed);
+  EXPECT_EQ(4u * 2u * 8u, compressed.blocks.size());
+
+  Image decoded;
+  decompress_image(compressed, decoded);
+  EXPECT_EQ(13u, decoded.width);
+  EXPECT_EQ(7u, decoded.height);
+  EXPECT_LE(max_error(image, decoded), 40);
+}
+
+TEST(TestBlockCompression, single_channel_blocks_hit_their_endpoints) {
+  auto image = make_image(4, 4, 2);
+  for (uint32_t i = 0; i < 16; ++i) {
+    image.pixels[2 * i] = i % 2 ? 10 : 250;
+    image.pixels[2 * i + 1] = static_cast<uint8_t>(i * 17);
+  }
+  CompressedImage compressed;
+  compress_image(image, BlockFormat::BC5, compressed);
+  EXPECT_EQ(16u, compressed.blocks.size());
+
+  Image decoded;
+  decompress_image(compressed, decoded);
+  EXPECT_EQ(2u, decoded.channels);
+  for (uint32_t i = 0; i < 16; ++i) EXPECT_EQ(image.pixels[2 * i], decoded.pixels[2 * i]);
+  // Eight evenly spaced levels over 0 to 255 are about 36 apart, so a texel is within half of that
+  EXPECT_LE(max_error(image, decoded), 19);
+}
+
+TEST(TestBlockCompression, alpha_is_kept_in_bc3) {
+  auto image = make_image(4, 4, 4);
+  for (uint32_t i = 0; i < 16; ++i) {
+    image.pixels[4 * i] = 255;
+    image.pixels[4 * i + 3] = i < 8 ? 0 : 255;
+  }
+  EXPECT_EQ(BlockFormat::BC3, choose_block_format(image));
+
+  CompressedImage compressed;
+  compress_image(image, BlockFormat::BC3, compressed);
+  Image decoded;
+  decompress_image(compressed, decoded);
+  EXPECT_EQ(0, max_error(image, decoded));
+}
+
+TEST(TestBlockCompression, formats_follow_the_channels) {
+  EXPECT_EQ(BlockFormat::BC4, choose_block_format(make_image(4, 4, 1)));
+  EXPECT_EQ(BlockFormat::BC5, choose_block_format(make_image(4, 4, 2)));
+  EXPECT_EQ(BlockFormat::BC1, choose_block_format(make_image(4, 4, 3)));
+  auto opaque = make_image(4, 4, 4);
+  for (size_t i = 3; i < opaque.pixels.size(); i += 4) opaque.pixels[i] = 255;
+  EXPECT_EQ(BlockFormat::BC1, choose_block_format(opaque));
+}
+
+TEST(TestBlockCompression, mip_chain_round_trips_through_ktx2) {
+  std::vector<Image> mips(1, make_image(16, 8, 3));
+  for (size_t i = 0; i < mips[0].pixels.size(); ++i) mips[0].pixels[i] = static_cast<uint8_t>(i * 7);
+  build_mips(mips);
+  std::vector<CompressedImage> levels(mips.size());
+  for (size_t l = 0; l < mips.size(); ++l) compress_image(mips[l], BlockFormat::BC1, levels[l]);
+
+  const std::string file_name = "test_block_compression.ktx2";
+  ASSERT_TRUE(write_ktx2(file_name, levels));
+  std::vector<CompressedImage> read;
+  ASSERT_TRUE(read_ktx2(file_name, read));
+  ASSERT_EQ(levels.size(), read.size());
+  for (size_t l = 0; l < levels.size(); ++l) {
+    EXPECT_EQ(levels[l].width, read[l].width);
+    EXPECT_EQ(levels[l].height, read[l].height);
+    EXPECT_EQ(BlockFormat::BC1, read[l].format);
+    EXPECT_EQ(levels[l].blocks, read[l].blocks);
+  }
+  std::string source_key = "stale";
+  ASSERT_TRUE(read_ktx2(file_name, read, &source_key));
+  EXPECT_TRUE(source_key.empty());
+
+  // A source key goes in the key/value data and leaves the levels as they were
+  const std::string key = "/textures/a/diffuse.tga|1234|5678";
+  ASSERT_TRUE(write_ktx2(file_name, levels, key));
+  ASSERT_TRUE(read_ktx2(file_name, read, &source_key));
+  EXPECT_EQ(key, source_key);
+  ASSERT_EQ(levels.size(), read.size());
+  for (size_t l = 0; l < levels.size(); ++l) EXPECT_EQ(levels[l].blocks, read[l].blocks);
+
+  // Cut short, the last level written, level 0, is missing
+  {
+    std::ifstream in(file_name, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size() - 8));
+  }
+  EXPECT_FALSE(read_ktx2(file_name, read));
+  std::remove(file_name.c_str());
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
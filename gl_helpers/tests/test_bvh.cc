@@ -0,0 +1,176 @@
+#include "gtest/gtest.h"
+#include "bvh.h"
+
+#include <algorithm>
+#include <random>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+class TestBvh : public ::testing::Test {
+public:
+  // Random boxes in a 200 unit cube
+  void SetUp() override {
+    std::mt19937 rng{11};
+    std::uniform_real_distribution<float> position{-100.0f, 100.0f};
+    std::uniform_real_distribution<float> size{0.1f, 4.0f};
+    bounds.resize(5000);
+    for (size_t i = 0; i < bounds.size(); ++i) {
+      Bounds b;
+      for (auto k = 0; k < 3; ++k) {
+        b.min[k] = position(rng);
+        b.max[k] = b.min[k] + size(rng);
+      }
+      bounds.set(i, b, glm::mat4{1.0f});
+    }
+  }
+
+  // Every node contains its children and every object is in exactly one leaf
+  void check_tree(const Bvh &bvh) {
+    std::vector<uint32_t> seen;
+    for (size_t n = 0; n < bvh.nodes.size(); ++n) {
+      const auto &node = bvh.nodes[n];
+      if (node.count) {
+        for (auto i = node.first; i < node.first + node.count; ++i) {
+          auto o = bvh.indices[i];
+          seen.push_back(o);
+          EXPECT_LE(node.min[0], bounds.center_x[o] - bounds.extent_x[o]);
+          EXPECT_GE(node.max[0], bounds.center_x[o] + bounds.extent_x[o]);
+          EXPECT_LE(node.min[2], bounds.center_z[o] - bounds.extent_z[o]);
+          EXPECT_GE(node.max[2], bounds.center_z[o] + bounds.extent_z[o]);
+        }
+        continue;
+      }
+      for (auto child: {bvh.nodes[n + 1], bvh.nodes[node.first]}) {
+        for (auto k = 0; k < 3; ++k) {
+          EXPECT_LE(node.min[k], child.min[k]);
+          EXPECT_GE(node.max[k], child.max[k]);
+        }
+      }
+    }
+    std::sort(seen.begin(), seen.end());
+    ASSERT_EQ(bounds.size(), seen.size());
+    for (uint32_t i = 0; i < seen.size(); ++i) EXPECT_EQ(i, seen[i]);
+  }
+
+  ObjectBounds bounds;
+};
+
+TEST_F(TestBvh, build_is_well_formed) {
+  Bvh bvh;
+  build_bvh(bounds, bvh);
+  check_tree(bvh);
+  for (const auto &node: bvh.nodes) EXPECT_LE(node.count, 4);
+}
+
+TEST_F(TestBvh, frustum_cull_matches_flat_cull) {
+  Bvh bvh;
+  build_bvh(bounds, bvh);
+
+  auto vp = glm::perspective(glm::radians(60.0f), 1.5f, 0.1f, 80.0f)
+            * glm::lookAt(glm::vec3{-20, 5, 0}, glm::vec3{40, 0, -10}, glm::vec3{0, 1, 0});
+  std::vector<uint32_t> flat, tree;
+  auto flat_culled = frustum_cull(bounds, vp, flat);
+  auto tree_culled = bvh_frustum_cull(bvh, vp, tree);
+  EXPECT_EQ(flat_culled, tree_culled);
+  std::sort(tree.begin(), tree.end());
+  EXPECT_EQ(flat, tree);
+  EXPECT_GT(flat_culled, 0);
+}
+
+TEST_F(TestBvh, raycast_finds_nearest_box) {
+  Bvh bvh;
+  build_bvh(bounds, bvh);
+
+  std::mt19937 rng{3};
+  std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+  auto hits = 0;
+  for (auto r = 0; r < 200; ++r) {
+    glm::vec3 origin{unit(rng) * 120, unit(rng) * 120, unit(rng) * 120};
+    auto direction = glm::normalize(glm::vec3{unit(rng), unit(rng), unit(rng)} - origin / 240.0f);
+
+    // Brute force nearest entry distance
+    auto best = std::numeric_limits<float>::max();
+    for (uint32_t o = 0; o < bounds.size(); ++o) {
+      float t0 = 0, t1 = best;
+      float c[3]{bounds.center_x[o], bounds.center_y[o], bounds.center_z[o]};
+      float e[3]{bounds.extent_x[o], bounds.extent_y[o], bounds.extent_z[o]};
+      float org[3]{origin.x, origin.y, origin.z}, dir[3]{direction.x, direction.y, direction.z};
+      for (auto k = 0; k < 3; ++k) {
+        auto a = (c[k] - e[k] - org[k]) / dir[k], b = (c[k] + e[k] - org[k]) / dir[k];
+        if (a > b) std::swap(a, b);
+        t0 = std::max(t0, a);
+        t1 = std::min(t1, b);
+      }
+      if (t0 <= t1) best = t0;
+    }
+
+    uint32_t object;
+    float distance;
+    auto hit = bvh_raycast(bvh, origin, direction, object, distance);
+    EXPECT_EQ(best != std::numeric_limits<float>::max(), hit);
+    if (hit) {
+      ++hits;
+      EXPECT_FLOAT_EQ(best, distance);
+    }
+  }
+  EXPECT_GT(hits, 0);
+}
+
+TEST_F(TestBvh, raycast_uses_hit_test) {
+  Bvh bvh;
+  build_bvh(bounds, bvh);
+
+  // Rays that only count objects with even indices
+  glm::vec3 origin{-150, 0, 0}, direction{1, 0, 0};
+  uint32_t object, any_object;
+  float distance, any_distance;
+  ASSERT_TRUE(bvh_raycast(bvh, origin, direction, any_object, any_distance));
+  auto hit = bvh_raycast(bvh, origin, direction, object, distance, [&](uint32_t o, float &t) {
+    return (o % 2) == 0;
+  });
+  if (hit) {
+    EXPECT_EQ(0, object % 2);
+    EXPECT_GE(distance, any_distance);
+  }
+}
+
+TEST_F(TestBvh, refit_follows_moved_objects) {
+  Bvh bvh;
+  build_bvh(bounds, bvh);
+
+  for (size_t i = 0; i < bounds.size(); i += 3) bounds.center_y[i] += 500;
+  refit_bvh(bounds, bvh);
+  check_tree(bvh);
+
+
+  auto vp = glm::perspective(glm::radians(60.0f), 1.0f, 1.0f, 200.0f)
+            * glm::lookAt(glm::vec3{0, 700, 0}, glm::vec3{0, 0, 0}, glm::vec3{0, 0, -1});
+  std::vector<uint32_t> flat, tree;
+  frustum_cull(bounds, vp, flat);
+  bvh_frustum_cull(bvh, vp, tree);
+  std::sort(tree.begin(), tree.end());
+  EXPECT_EQ(flat, tree);
+  // Only the raised objects are in view
+  ASSERT_FALSE(tree.empty());
+  for (auto o: tree) EXPECT_EQ(0, o % 3);
+}
+
+TEST_F(TestBvh, pick_ray_through_centre) {
+  auto view = glm::lookAt(glm::vec3{0, 0, 5}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
+  auto proj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+  glm::vec3 origin, direction;
+  pick_ray(400, 300, 800, 600, view, proj, origin, direction);
+  EXPECT_NEAR(0, direction.x, 1e-5);
+  EXPECT_NEAR(0, direction.y, 1e-5);
+  EXPECT_NEAR(-1, direction.z, 1e-5);
+  EXPECT_NEAR(4.9f, origin.z, 1e-3);
+
+  // Top of the window looks up
+  pick_ray(400, 0, 800, 600, view, proj, origin, direction);
+  EXPECT_GT(direction.y, 0);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
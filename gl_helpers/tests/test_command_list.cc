@@ -0,0 +1,78 @@
+#include "gtest/gtest.h"
+#include "command_list.h"
+
+TEST(TestCommandList, repeated_binds_are_dropped) {
+  CommandList list;
+  list.use_program(3);
+  list.bind_vertex_array(5);
+  list.use_program(3);
+  list.bind_vertex_array(5);
+  EXPECT_EQ(2u, list.num_commands());
+
+  list.use_program(4);
+  EXPECT_EQ(3u, list.num_commands());
+
+  // A reset list binds again since it may be replayed after anything
+  list.reset();
+  EXPECT_TRUE(list.empty());
+  list.use_program(4);
+  EXPECT_EQ(1u, list.num_commands());
+}
+
+TEST(TestCommandList, no_op_commands_are_skipped) {
+  CommandList list;
+  list.uniform(-1, glm::mat4{1.0f});
+  list.uniform(-1, 2);
+  list.draw_elements(GL_TRIANGLES, 0, 12);
+  list.multi_draw_elements(GL_TRIANGLES, nullptr, nullptr, 0);
+  list.update_buffer(1, 0, nullptr, 0);
+  EXPECT_TRUE(list.empty());
+  EXPECT_EQ(0u, list.size_bytes());
+}
+
+TEST(TestCommandList, commands_are_packed_on_eight_byte_boundaries) {
+  CommandList list;
+  list.point_size(5.0f);
+  EXPECT_EQ(0u, list.size_bytes() % 8);
+
+  auto before = list.size_bytes();
+  const uint8_t data[13] = {};
+  list.update_buffer(7, 4, data, sizeof(data));
+  EXPECT_EQ(0u, list.size_bytes() % 8);
+  EXPECT_GE(list.size_bytes() - before, sizeof(data));
+
+  const GLsizei counts[3] = {3, 6, 9};
+  const GLvoid *offsets[3] = {nullptr, nullptr, nullptr};
+  list.multi_draw_elements(GL_TRIANGLES, counts, offsets, 3);
+  EXPECT_EQ(0u, list.size_bytes() % 8);
+
+  list.bind_texture(2, GL_TEXTURE_BUFFER, 9);
+  EXPECT_EQ(0u, list.size_bytes() % 8);
+  EXPECT_EQ(4u, list.num_commands());
+}
+
+TEST(TestCommandList, recording_a_frame_again_allocates_nothing) {
+  CommandList list;
+  auto record = [&list]() {
+    for (uint32_t i = 0; i < 100; ++i) {
+      list.bind_vertex_array(i + 1);
+      list.uniform(0, glm::mat4{static_cast<float>(i)});
+      list.draw_elements(GL_TRIANGLES, 36, i * 36);
+    }
+  };
+  record();
+  auto capacity = list.capacity_bytes();
+  auto size = list.size_bytes();
+  EXPECT_EQ(300u, list.num_commands());
+
+  list.reset();
+  EXPECT_EQ(capacity, list.capacity_bytes());
+  record();
+  EXPECT_EQ(capacity, list.capacity_bytes());
+  EXPECT_EQ(size, list.size_bytes());
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,116 @@
+#include "gtest/gtest.h"
+#include "culling.h"
+#include "mesh_internal.h"
+
+#include <random>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+class TestCulling : public ::testing::Test {
+};
+
+namespace {
+  Bounds unit_box() {
+    Bounds b;
+    for (auto k = 0; k < 3; ++k) {
+      b.min[k] = -1;
+      b.max[k] = 1;
+    }
+    b.radius = std::sqrt(3.0f);
+    return b;
+  }
+}
+
+TEST_F(TestCulling, bounds_of_vertices) {
+  // Interleaved position and tex coord
+  std::vector<float> vertices{
+          -1, 0, 2, 9, 9,
+          3, -2, 2, 9, 9,
+          1, 4, -6, 9, 9
+  };
+  auto b = compute_bounds(vertices.data(), 3, 5);
+  EXPECT_EQ(-1, b.min[0]);
+  EXPECT_EQ(-2, b.min[1]);
+  EXPECT_EQ(-6, b.min[2]);
+  EXPECT_EQ(3, b.max[0]);
+  EXPECT_EQ(4, b.max[1]);
+  EXPECT_EQ(2, b.max[2]);
+  EXPECT_EQ(1, b.center[0]);
+  EXPECT_EQ(1, b.center[1]);
+  EXPECT_EQ(-2, b.center[2]);
+  // Furthest vertex is (3, -2, 2)
+  EXPECT_FLOAT_EQ(std::sqrt(29.0f), b.radius);
+}
+
+TEST_F(TestCulling, transformed_box_is_rotated_and_moved) {
+  Bounds local;
+  local.max[0] = 4;
+  local.max[1] = 2;
+  local.max[2] = 1;
+
+  // Quarter turn about z then a move along x
+  glm::mat4 model{1.0f};
+  model[0] = glm::vec4{0, 1, 0, 0};
+  model[1] = glm::vec4{-1, 0, 0, 0};
+  model[3] = glm::vec4{10, 0, 0, 1};
+
+  ObjectBounds bounds;
+  bounds.resize(1);
+  bounds.set(0, local, model);
+  EXPECT_FLOAT_EQ(9, bounds.center_x[0]);
+  EXPECT_FLOAT_EQ(2, bounds.center_y[0]);
+  EXPECT_FLOAT_EQ(0.5f, bounds.center_z[0]);
+  EXPECT_FLOAT_EQ(1, bounds.extent_x[0]);
+  EXPECT_FLOAT_EQ(2, bounds.extent_y[0]);
+  EXPECT_FLOAT_EQ(0.5f, bounds.extent_z[0]);
+}
+
+TEST_F(TestCulling, clip_space_cube) {
+  ObjectBounds bounds;
+  bounds.resize(3);
+  glm::mat4 model{1.0f};
+  bounds.set(0, unit_box(), model);
+  model[3] = glm::vec4{1.5f, 0, 0, 1};
+  bounds.set(1, unit_box(), model);
+  model[3] = glm::vec4{2.5f, 0, 0, 1};
+  bounds.set(2, unit_box(), model);
+
+  std::vector<uint32_t> visible;
+  EXPECT_EQ(1, frustum_cull(bounds, glm::mat4{1.0f}, visible));
+  ASSERT_EQ(2, visible.size());
+  EXPECT_EQ(0, visible[0]);
+  EXPECT_EQ(1, visible[1]);
+}
+
+TEST_F(TestCulling, simd_matches_scalar) {
+  std::mt19937 rng{7};
+  std::uniform_real_distribution<float> position{-50.0f, 50.0f};
+  std::uniform_real_distribution<float> size{0.1f, 3.0f};
+
+  // Not a multiple of any batch size so the padding is exercised too
+  const size_t n = 10007;
+  ObjectBounds bounds;
+  bounds.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    Bounds b;
+    for (auto k = 0; k < 3; ++k) {
+      b.min[k] = position(rng);
+      b.max[k] = b.min[k] + size(rng);
+    }
+    bounds.set(i, b, glm::mat4{1.0f});
+  }
+
+  auto vp = glm::perspective(glm::radians(60.0f), 1.5f, 0.1f, 40.0f)
+            * glm::lookAt(glm::vec3{0, 0, 0}, glm::vec3{1, 0.2f, -1}, glm::vec3{0, 1, 0});
+  std::vector<uint32_t> simd, scalar;
+  auto culled = frustum_cull(bounds, vp, simd);
+  EXPECT_EQ(culled, frustum_cull_scalar(bounds, vp, scalar));
+  EXPECT_EQ(scalar, simd);
+  EXPECT_GT(culled, 0);
+  EXPECT_LT(culled, n);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
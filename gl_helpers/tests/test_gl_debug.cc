@@ -0,0 +1,48 @@
+#include "gtest/gtest.h"
+#include "gl_debug.h"
+
+TEST(TestGlDebug, repeats_stop_after_the_limit) {
+  GlDebugFilter filter(3, 100);
+  EXPECT_EQ(GlDebugFilter::LOG, filter.accept(7, 0.0));
+  EXPECT_EQ(GlDebugFilter::LOG, filter.accept(7, 0.1));
+  EXPECT_EQ(GlDebugFilter::LOG_LAST, filter.accept(7, 0.2));
+  EXPECT_EQ(GlDebugFilter::DROP, filter.accept(7, 5.0));
+
+  // Other messages are counted on their own
+  EXPECT_EQ(GlDebugFilter::LOG, filter.accept(8, 5.0));
+  EXPECT_EQ(0u, filter.take_rate_dropped());
+}
+
+TEST(TestGlDebug, rate_limit_resets_each_second) {
+  GlDebugFilter filter(10, 2);
+  EXPECT_EQ(GlDebugFilter::LOG, filter.accept(1, 0.0));
+  EXPECT_EQ(GlDebugFilter::LOG, filter.accept(2, 0.5));
+  EXPECT_EQ(GlDebugFilter::DROP, filter.accept(3, 0.6));
+  EXPECT_EQ(GlDebugFilter::DROP, filter.accept(4, 0.9));
+  EXPECT_EQ(2u, filter.take_rate_dropped());
+  EXPECT_EQ(0u, filter.take_rate_dropped());
+
+  EXPECT_EQ(GlDebugFilter::LOG, filter.accept(3, 1.0));
+}
+
+TEST(TestGlDebug, rate_limited_messages_are_not_repeats) {
+  GlDebugFilter filter(1, 1);
+  EXPECT_EQ(GlDebugFilter::LOG_LAST, filter.accept(1, 0.0));
+  EXPECT_EQ(GlDebugFilter::DROP, filter.accept(2, 0.5));
+  // Dropped for the rate, so still logged once the window has passed
+  EXPECT_EQ(GlDebugFilter::LOG_LAST, filter.accept(2, 1.5));
+}
+
+TEST(TestGlDebug, calls_are_safe_without_a_debug_context) {
+  // Nothing is installed so these must do nothing
+  label_gl_object(GlObject::BUFFER, 1, "buffer", "vertices");
+  GlDebugGroup group("Pass");
+  GlDebugOptions options;
+  EXPECT_EQ(GlDebugSeverity::LOW, options.min_severity);
+  EXPECT_FALSE(options.synchronous);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
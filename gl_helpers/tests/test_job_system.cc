@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+#include "job_system.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+class TestJobSystem : public ::testing::Test {
+public:
+  TestJobSystem() : jobs{4} {}
+
+  JobSystem jobs;
+};
+
+TEST_F(TestJobSystem, parallel_for_visits_every_index_once) {
+  std::vector<std::atomic<int32_t>> visits(10007);
+  for (auto &v: visits) v = 0;
+  jobs.parallel_for(0, visits.size(), 16, [&visits](size_t begin, size_t end) {
+    EXPECT_LT(begin, end);
+    for (auto i = begin; i < end; ++i) ++visits[i];
+  });
+  for (const auto &v: visits) EXPECT_EQ(1, v.load());
+}
+
+TEST_F(TestJobSystem, parallel_for_keeps_to_the_grain) {
+  std::atomic<size_t> chunks{0};
+  jobs.parallel_for(100, 1100, 400, [&chunks](size_t begin, size_t end) {
+    ++chunks;
+    EXPECT_TRUE(end - begin >= 400 || end == 1100);
+  });
+  EXPECT_LE(chunks.load(), 3u);
+}
+
+TEST_F(TestJobSystem, nested_parallel_for_completes) {
+  std::atomic<size_t> total{0};
+  jobs.parallel_for(0, 64, 1, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i) {
+      jobs.parallel_for(0, 1000, 10, [&total](size_t b, size_t e) { total += e - b; });
+    }
+  });
+  EXPECT_EQ(64000u, total.load());
+}
+
+TEST_F(TestJobSystem, parent_finishes_after_its_children) {
+  std::atomic<int32_t> children_done{0};
+  auto parent = jobs.create_job([&]() {});
+  for (auto i = 0; i < 50; ++i) {
+    jobs.run(jobs.create_job([&children_done]() { ++children_done; }, parent));
+  }
+  jobs.run(parent);
+  jobs.wait(parent);
+  EXPECT_TRUE(JobSystem::is_finished(parent));
+  EXPECT_EQ(50, children_done.load());
+}
+
+TEST_F(TestJobSystem, children_made_while_running_are_waited_for) {
+  // The parent's function makes children, and they make more of the parent's children
+  std::atomic<int32_t> done{0};
+  JobHandle parent;
+  parent = jobs.create_job([&]() {
+    for (auto i = 0; i < 8; ++i) {
+      jobs.run(jobs.create_job([&]() {
+        for (auto k = 0; k < 8; ++k) jobs.run(jobs.create_job([&done]() { ++done; }, parent));
+      }, parent));
+    }
+  });
+  jobs.run(parent);
+  jobs.wait(parent);
+  EXPECT_EQ(64, done.load());
+}
+
+TEST_F(TestJobSystem, dependents_run_after_their_prerequisites) {
+  std::atomic<int32_t> step{0};
+  std::atomic<int32_t> seen_by_last{-1};
+  auto first = jobs.create_job([&]() { ++step; });
+  auto second = jobs.create_job([&]() { ++step; });
+  auto last = jobs.create_job([&]() { seen_by_last = step.load(); });
+  jobs.add_dependency(last, first);
+  jobs.add_dependency(last, second);
+  jobs.run(last);
+  EXPECT_FALSE(JobSystem::is_finished(last));
+  jobs.run(first);
+  jobs.run(second);
+  jobs.wait(last);
+  EXPECT_EQ(2, seen_by_last.load());
+
+  // A prerequisite that has already finished doesn't hold anything up
+  auto after = jobs.create_job([]() {});
+  jobs.add_dependency(after, first);
+  jobs.run(after);
+  jobs.wait(after);
+  EXPECT_TRUE(JobSystem::is_finished(after));
+}
+
+TEST_F(TestJobSystem, exceptions_are_rethrown_by_wait) {
+  auto job = jobs.create_job([]() { throw std::runtime_error("job"); });
+  jobs.run(job);
+  EXPECT_THROW(jobs.wait(job), std::runtime_error);
+  EXPECT_TRUE(JobSystem::is_finished(job));
+
+  // A child's exception reaches its parent, and the workers carry on
+  std::atomic<int32_t> done{0};
+  auto parent = jobs.create_job([]() {});
+  for (auto i = 0; i < 16; ++i) {
+    jobs.run(jobs.create_job([&done, i]() {
+      ++done;
+      if (i == 7) throw std::runtime_error("child");
+    }, parent));
+  }
+  jobs.run(parent);
+  EXPECT_THROW(jobs.wait(parent), std::runtime_error);
+  EXPECT_EQ(16, done.load());
+
+  EXPECT_THROW(jobs.parallel_for(0, 1000, 1, [](size_t b, size_t e) {
+    if (b <= 500 && 500 < e) throw std::out_of_range("body");
+  }), std::out_of_range);
+  std::atomic<size_t> total{0};
+  jobs.parallel_for(0, 1000, 1, [&total](size_t b, size_t e) { total += e - b; });
+  EXPECT_EQ(1000u, total.load());
+}
+
+TEST_F(TestJobSystem, wait_sleeps_until_a_long_job_finishes) {
+  std::atomic<bool> release{false};
+  auto slow = jobs.create_job([&release]() {
+    while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  });
+  auto after = jobs.create_job([]() {});
+  jobs.add_dependency(after, slow);
+  jobs.run(slow);
+  jobs.run(after);
+  std::thread releaser([&release]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    release = true;
+  });
+  jobs.wait(after);
+  EXPECT_TRUE(JobSystem::is_finished(slow));
+  releaser.join();
+}
+
+TEST(TestJobSystemSingleThread, jobs_run_on_the_waiting_thread) {
+  JobSystem jobs{1};
+  EXPECT_EQ(1u, jobs.num_threads());
+  std::atomic<size_t> total{0};
+  jobs.parallel_for(0, 1000, 1, [&total](size_t b, size_t e) { total += e - b; });
+  EXPECT_EQ(1000u, total.load());
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,173 @@
+#include "gtest/gtest.h"
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <random>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace {
+  glm::mat4 view() {
+    return glm::lookAt(glm::vec3{0, 2, 10}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
+  }
+
+  glm::mat4 projection() {
+    return glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+  }
+
+  std::vector<PointLight> random_lights(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> position(-30.0f, 30.0f), radius(0.5f, 6.0f);
+    std::vector<PointLight> lights(count);
+    for (auto &light: lights) {
+      light.position = glm::vec3{position(rng), position(rng) * 0.3f, position(rng)};
+      light.radius = radius(rng);
+    }
+    return lights;
+  }
+
+  // The lights of a cluster
+  std::vector<uint32_t> lights_of(const LightClusters &clusters, uint32_t cluster) {
+    const auto *range = &clusters.cluster_ranges()[2 * cluster];
+    return std::vector<uint32_t>(clusters.light_indices().begin() + range[0],
+                                 clusters.light_indices().begin() + range[0] + range[1]);
+  }
+
+  // The cluster the fragment shader would use for a view space point, as light_cluster_glsl finds it
+  bool cluster_of(const LightClusters &clusters, const glm::vec3 &p, uint32_t &cluster) {
+    auto clip = projection() * glm::vec4(p, 1.0f);
+    if (clip.w <= 0 || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w || std::fabs(clip.z) > clip.w) {
+      return false;
+    }
+    const auto &o = clusters.options();
+    auto tx = std::min(static_cast<uint32_t>((clip.x / clip.w * 0.5f + 0.5f) * o.tiles_x), o.tiles_x - 1);
+    auto ty = std::min(static_cast<uint32_t>((clip.y / clip.w * 0.5f + 0.5f) * o.tiles_y), o.tiles_y - 1);
+    cluster = clusters.cluster(tx, ty, clusters.slice(-p.z));
+    return true;
+  }
+}
+
+TEST(LightClusters, SlicesGrowExponentiallyFromNearToFar) {
+  LightClusters clusters;
+  clusters.assign({}, view(), projection());
+  const auto slices = clusters.options().slices;
+  EXPECT_EQ(clusters.slice(0.05f), 0u);
+  EXPECT_EQ(clusters.slice(0.1001f), 0u);
+  EXPECT_EQ(clusters.slice(99.9f), slices - 1);
+  EXPECT_EQ(clusters.slice(1000.0f), slices - 1);
+
+  // Each slice is deeper than the last by the same ratio
+  glm::vec3 min0, max0, min1, max1;
+  clusters.cluster_bounds(clusters.cluster(0, 0, 3), min0, max0);
+  clusters.cluster_bounds(clusters.cluster(0, 0, 4), min1, max1);
+  EXPECT_FLOAT_EQ(min0.z, max1.z);
+  EXPECT_NEAR(min0.z / max0.z, min1.z / max1.z, 1e-4f);
+  EXPECT_EQ(clusters.slice(-0.5f * (min0.z + max0.z)), 3u);
+
+  // The shader's slice from log depth agrees
+  auto depth_uniform = clusters.depth_uniform(1600, 900);
+  for (auto depth: {0.3f, 2.0f, 17.0f, 60.0f}) {
+    auto s = std::floor(std::log(depth) * depth_uniform.z + depth_uniform.w);
+    EXPECT_EQ(static_cast<uint32_t>(s), clusters.slice(depth));
+  }
+  EXPECT_EQ(depth_uniform.x, 1600.0f);
+  EXPECT_EQ(clusters.grid_uniform().z, static_cast<float>(slices));
+}
+
+TEST(LightClusters, EveryPointLitIsInAClusterListingTheLight) {
+  LightClusters clusters;
+  auto lights = random_lights(300, 1);
+  clusters.assign(lights, view(), projection());
+  ASSERT_EQ(clusters.num_lights(), lights.size());
+  EXPECT_EQ(clusters.num_dropped(), 0u);
+
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  size_t checked = 0;
+  for (uint32_t l = 0; l < lights.size(); ++l) {
+    auto center = glm::vec3(view() * glm::vec4(lights[l].position, 1.0f));
+    for (auto k = 0; k < 50; ++k) {
+      glm::vec3 offset{unit(rng), unit(rng), unit(rng)};
+      if (glm::length(offset) > 1.0f) continue;
+      uint32_t cluster;
+      if (!cluster_of(clusters, center + offset * lights[l].radius, cluster)) continue;
+      auto list = lights_of(clusters, cluster);
+      EXPECT_TRUE(std::binary_search(list.begin(), list.end(), l)) << "light " << l << " cluster " << cluster;
+      ++checked;
+    }
+  }
+  EXPECT_GT(checked, 1000u);
+}
+
+TEST(LightClusters, ListsHoldOnlyLightsTouchingTheClusterInOrder) {
+  LightClusters clusters;
+  auto lights = random_lights(200, 3);
+  clusters.assign(lights, view(), projection());
+
+  size_t total = 0;
+  for (uint32_t c = 0; c < clusters.num_clusters(); ++c) {
+    auto list = lights_of(clusters, c);
+    EXPECT_TRUE(std::is_sorted(list.begin(), list.end()));
+    EXPECT_TRUE(std::adjacent_find(list.begin(), list.end()) == list.end());
+    glm::vec3 min, max;
+    clusters.cluster_bounds(c, min, max);
+    for (auto l: list) {
+      const auto *data = &clusters.light_data()[8 * l];
+      glm::vec3 nearest{std::min(std::max(data[0], min.x), max.x), std::min(std::max(data[1], min.y), max.y),
+                        std::min(std::max(data[2], min.z), max.z)};
+      EXPECT_LE(glm::length(nearest - glm::vec3{data[0], data[1], data[2]}), data[3] * 1.0001f);
+    }
+    total += list.size();
+  }
+  EXPECT_EQ(total, clusters.light_indices().size());
+  EXPECT_GT(total, 0u);
+
+  // Binning again gives the same lists
+  auto indices = clusters.light_indices();
+  auto ranges = clusters.cluster_ranges();
+  clusters.assign(lights, view(), projection());
+  EXPECT_EQ(clusters.light_indices(), indices);
+  EXPECT_EQ(clusters.cluster_ranges(), ranges);
+}
+
+TEST(LightClusters, LightsOutOfViewAreInNoCluster) {
+  LightClusters clusters;
+  std::vector<PointLight> lights(3);
+  // Behind the eye, beyond the far plane and off to the side
+  lights[0].position = glm::vec3{0, 2, 15};
+  lights[1].position = glm::vec3{0, 0, -200};
+  lights[2].position = glm::vec3{200, 0, 0};
+  clusters.assign(lights, view(), projection());
+  EXPECT_TRUE(clusters.light_indices().empty());
+
+  // Light data is in view space
+  EXPECT_NEAR(clusters.light_data()[2], 5.0f, 0.1f);
+  EXPECT_EQ(clusters.light_data()[3], 1.0f);
+  EXPECT_EQ(clusters.light_data()[4], 1.0f);
+}
+
+TEST(LightClusters, LimitsDropLightsAndIndices) {
+  LightClusterOptions options;
+  options.max_lights = 50;
+  options.max_light_indices = 100;
+  LightClusters clusters(options);
+  // Around the eye, so every light reaches many clusters
+  std::vector<PointLight> lights(80);
+  for (auto &light: lights) {
+    light.position = glm::vec3{0, 2, 9};
+    light.radius = 3;
+  }
+  clusters.assign(lights, view(), projection());
+  EXPECT_EQ(clusters.num_lights(), 50u);
+  EXPECT_EQ(clusters.light_indices().size(), 100u);
+  EXPECT_GT(clusters.num_dropped(), 0u);
+  for (auto l: clusters.light_indices()) EXPECT_LT(l, 50u);
+  for (size_t c = 0; c < clusters.num_clusters(); ++c) {
+    EXPECT_LE(clusters.cluster_ranges()[2 * c] + clusters.cluster_ranges()[2 * c + 1], 100u);
+  }
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,169 @@
+#include "gtest/gtest.h"
+#include "mesh_bake.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <ftw.h>
+#include <sys/stat.h>
+
+namespace {
+  const char *const QUAD = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nf 1 2 3 4\n";
+  const char *const TRIANGLE = "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n";
+
+  void write_file(const std::string &file_name, const std::string &text) {
+    std::ofstream out(file_name);
+    out << text;
+  }
+
+  int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+    return std::remove(path);
+  }
+
+  std::vector<BakeStatus> statuses(const std::vector<BakeResult> &results) {
+    std::vector<BakeStatus> out;
+    for (const auto &result: results) out.push_back(result.status);
+    return out;
+  }
+
+  const std::vector<BakeStatus> ALL_BAKED{BakeStatus::BAKED, BakeStatus::BAKED};
+  const std::vector<BakeStatus> ALL_UP_TO_DATE{BakeStatus::UP_TO_DATE, BakeStatus::UP_TO_DATE};
+}
+
+/*
+ * Each test gets a fresh temporary directory holding an asset directory, with
+ * a quad at the top, a triangle in a sub directory and a file that isn't a
+ * mesh, and the name of an output directory beside it. All of it is removed
+ * afterwards.
+ */
+class MeshBake : public ::testing::Test {
+protected:
+  void SetUp() override {
+    char dir[] = "/tmp/test_mesh_bake.XXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(dir));
+    dir_ = dir;
+    assets = dir_ + "/assets";
+    baked = dir_ + "/baked";
+    mkdir(assets.c_str(), 0755);
+    mkdir((assets + "/props").c_str(), 0755);
+    write_file(assets + "/quad.obj", QUAD);
+    write_file(assets + "/props/triangle.obj", TRIANGLE);
+    write_file(assets + "/notes.txt", "not a mesh");
+  }
+
+  void TearDown() override {
+    if (!dir_.empty()) nftw(dir_.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+
+  std::string assets;
+  std::string baked;
+
+private:
+  std::string dir_;
+};
+
+TEST_F(MeshBake, BakesEverySourceIntoALoadableMesh) {
+  MeshBakeOptions options;
+  options.load.include_normals = true;
+  std::vector<BakeResult> results;
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ("props/triangle.obj", results[0].source);
+  EXPECT_EQ("props/triangle.mesh", results[0].output);
+  EXPECT_EQ("quad.obj", results[1].source);
+  EXPECT_EQ(ALL_BAKED, statuses(results));
+
+  MeshLoadOptions load;
+  load.include_normals = true;
+  load.upload = false;
+  Mesh quad, triangle;
+  ASSERT_TRUE(load_compressed_mesh(baked + "/quad.mesh", quad, load));
+  ASSERT_TRUE(load_compressed_mesh(baked + "/props/triangle.mesh", triangle, load));
+  EXPECT_EQ(6u, quad.num_elements);
+  EXPECT_EQ(4u, quad.vertex_data.size() / quad.stride);
+  EXPECT_EQ(6u, quad.stride);
+  EXPECT_EQ(3u, triangle.num_elements);
+  EXPECT_NEAR(1.0f, quad.bounds.max[1], 1e-4f);
+  EXPECT_GT(results[1].baked_bytes, 0u);
+  EXPECT_EQ(std::string(QUAD).size(), results[1].source_bytes);
+}
+
+TEST_F(MeshBake, OnlyChangedSourcesAreBakedAgain) {
+  MeshBakeOptions options;
+  std::vector<BakeResult> results;
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ(ALL_BAKED, statuses(results));
+
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ(ALL_UP_TO_DATE, statuses(results));
+
+  // Contents, not times, decide
+  write_file(assets + "/quad.obj", std::string(QUAD) + "v 0 0 1\n");
+  write_file(assets + "/props/triangle.obj", TRIANGLE);
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ((std::vector<BakeStatus>{BakeStatus::UP_TO_DATE, BakeStatus::BAKED}), statuses(results));
+
+  // A missing output is baked again
+  std::remove((baked + "/props/triangle.mesh").c_str());
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ((std::vector<BakeStatus>{BakeStatus::BAKED, BakeStatus::UP_TO_DATE}), statuses(results));
+
+  // Options that change the bake rebake everything; others don't
+  options.load.pos_attr = 3;
+  options.load.meshlet_triangles = 64;
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ(ALL_UP_TO_DATE, statuses(results));
+  options.codec.position_bits = 0;
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ(ALL_BAKED, statuses(results));
+
+  options.force = true;
+  ASSERT_TRUE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ(ALL_BAKED, statuses(results));
+}
+
+TEST_F(MeshBake, FailedSourcesAreReportedAndTriedAgain) {
+  write_file(assets + "/broken.obj", "f 1 2 3\n");
+  MeshBakeOptions options;
+  std::vector<BakeResult> results;
+  EXPECT_FALSE(bake_meshes(assets, baked, options, results));
+  ASSERT_EQ(3u, results.size());
+  EXPECT_EQ("broken.obj", results[0].source);
+  EXPECT_EQ((std::vector<BakeStatus>{BakeStatus::FAILED, BakeStatus::BAKED, BakeStatus::BAKED}), statuses(results));
+  std::ifstream output(baked + "/broken.mesh");
+  EXPECT_FALSE(output.is_open());
+
+  EXPECT_FALSE(bake_meshes(assets, baked, options, results));
+  EXPECT_EQ((std::vector<BakeStatus>{BakeStatus::FAILED, BakeStatus::UP_TO_DATE, BakeStatus::UP_TO_DATE}),
+            statuses(results));
+
+  EXPECT_FALSE(bake_meshes(assets + "/no_such_directory", baked, options, results));
+  EXPECT_TRUE(results.empty());
+}
+
+TEST_F(MeshBake, HashesSeeEveryByte) {
+  std::vector<uint8_t> data(100);
+  for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<uint8_t>(i * 7);
+  const auto hash = hash_bytes(data.data(), data.size());
+  for (auto i: {0, 7, 8, 63, 99}) {
+    data[i] ^= 0x80;
+    EXPECT_NE(hash, hash_bytes(data.data(), data.size())) << "byte " << i;
+    data[i] ^= 0x80;
+  }
+  EXPECT_EQ(hash, hash_bytes(data.data(), data.size()));
+  EXPECT_NE(hash, hash_bytes(data.data(), data.size() - 1));
+
+  MeshBakeOptions options;
+  const auto options_hash = hash_bake_options(options);
+  options.load.tx_attr = 5;
+  EXPECT_EQ(options_hash, hash_bake_options(options));
+  options.load.include_textures = true;
+  EXPECT_NE(options_hash, hash_bake_options(options));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
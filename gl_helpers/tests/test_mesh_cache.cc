@@ -0,0 +1,113 @@
+#include "gtest/gtest.h"
+#include "mesh_cache.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+  const std::string HEAD = "/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj";
+
+  MeshLoadOptions cpu_options() {
+    MeshLoadOptions options;
+    options.upload = false;
+    return options;
+  }
+}
+
+TEST(TestMeshCache, same_file_and_options_share_one_mesh) {
+  MeshCache cache;
+  auto a = cache.load(HEAD, cpu_options());
+  auto b = cache.load(HEAD, cpu_options());
+  ASSERT_TRUE(a != nullptr);
+  EXPECT_EQ(a.get(), b.get());
+
+  auto stats = cache.stats();
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_EQ(1u, stats.hits);
+  EXPECT_FLOAT_EQ(0.5f, stats.hit_rate());
+  EXPECT_EQ(1u, stats.meshes);
+  EXPECT_EQ(0u, stats.gpu_bytes);
+  EXPECT_GE(stats.cpu_bytes, a->vertex_data.size() * sizeof(float) + a->indices.size() * sizeof(uint32_t));
+}
+
+TEST(TestMeshCache, different_options_are_different_meshes) {
+  MeshCache cache;
+  auto plain = cache.load(HEAD, cpu_options());
+  auto options = cpu_options();
+  options.include_normals = true;
+  auto with_normals = cache.load(HEAD, options);
+  ASSERT_TRUE(plain != nullptr);
+  ASSERT_TRUE(with_normals != nullptr);
+  EXPECT_NE(plain.get(), with_normals.get());
+  EXPECT_EQ(3u, plain->stride);
+  EXPECT_EQ(6u, with_normals->stride);
+  EXPECT_EQ(2u, cache.stats().misses);
+}
+
+TEST(TestMeshCache, last_handle_releases_the_mesh) {
+  MeshCache cache;
+  {
+    auto mesh = cache.load(HEAD, cpu_options());
+    auto copy = mesh;
+    EXPECT_EQ(1u, cache.stats().meshes);
+  }
+  auto stats = cache.stats();
+  EXPECT_EQ(0u, stats.meshes);
+  EXPECT_EQ(0u, stats.cpu_bytes);
+
+  // Loaded again from the file
+  auto again = cache.load(HEAD, cpu_options());
+  EXPECT_TRUE(again != nullptr);
+  EXPECT_EQ(2u, cache.stats().misses);
+}
+
+TEST(TestMeshCache, released_meshes_leave_no_entries_behind) {
+  MeshCache cache;
+  auto options = cpu_options();
+  for (uint32_t i = 0; i < 4; ++i) {
+    // A different key each time
+    options.pos_attr = i;
+    auto mesh = cache.load(HEAD, options);
+    ASSERT_TRUE(mesh != nullptr);
+    EXPECT_EQ(1u, cache.stats().entries);
+  }
+  EXPECT_EQ(4u, cache.stats().misses);
+
+  // Reloading a released mesh reuses its key
+  options.pos_attr = 0;
+  auto held = cache.load(HEAD, options);
+  {
+    auto released = cache.load(HEAD, cpu_options());
+    EXPECT_EQ(held, released);
+  }
+  options.pos_attr = 1;
+  auto other = cache.load(HEAD, options);
+  EXPECT_EQ(2u, cache.stats().entries);
+  EXPECT_EQ(2u, cache.stats().meshes);
+}
+
+TEST(TestMeshCache, concurrent_requests_load_once) {
+  MeshCache cache;
+  std::vector<MeshHandle> meshes(8);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < meshes.size(); ++t) {
+    threads.emplace_back([&cache, &meshes, t]() { meshes[t] = cache.load(HEAD, cpu_options()); });
+  }
+  for (auto &t: threads) t.join();
+  for (const auto &m: meshes) EXPECT_EQ(meshes[0].get(), m.get());
+  EXPECT_EQ(1u, cache.stats().misses);
+  EXPECT_EQ(7u, cache.stats().hits);
+}
+
+TEST(TestMeshCache, failed_loads_are_not_kept) {
+  MeshCache cache;
+  EXPECT_TRUE(cache.load("no_such_file.obj", cpu_options()) == nullptr);
+  EXPECT_TRUE(cache.load("no_such_file.obj", cpu_options()) == nullptr);
+  EXPECT_EQ(2u, cache.stats().misses);
+  EXPECT_EQ(0u, cache.stats().meshes);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,175 @@
+#include "gtest/gtest.h"
+#include "mesh_chunks.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace {
+  const std::string HEAD = "/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj";
+  const std::string CHUNKS = "test_mesh_chunks.chunks";
+
+  // Sum of the areas of the triangles, which chunking must not change
+  double area(const std::vector<float> &positions, const std::vector<uint32_t> &indices) {
+    double total = 0;
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      const auto *a = &positions[indices[i] * 3], *b = &positions[indices[i + 1] * 3], *c = &positions[indices[i + 2] * 3];
+      double u[3], v[3];
+      for (auto k = 0; k < 3; ++k) {
+        u[k] = b[k] - a[k];
+        v[k] = c[k] - a[k];
+      }
+      double x = u[1] * v[2] - u[2] * v[1], y = u[2] * v[0] - u[0] * v[2], z = u[0] * v[1] - u[1] * v[0];
+      total += 0.5 * std::sqrt(x * x + y * y + z * z);
+    }
+    return total;
+  }
+
+  // Every chunk of CHUNKS is well formed; returns the triangles and area of them all
+  void check_chunks(uint32_t chunk_triangles, size_t &triangles, double &total_area) {
+    std::vector<ChunkInfo> chunks;
+    Bounds bounds;
+    ASSERT_TRUE(read_chunk_table(CHUNKS, chunks, bounds));
+    ASSERT_FALSE(chunks.empty());
+    triangles = 0;
+    total_area = 0;
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    for (const auto &chunk: chunks) {
+      EXPECT_LE(chunk.num_triangles, chunk_triangles);
+      ASSERT_TRUE(read_chunk(CHUNKS, chunk, positions, indices));
+      triangles += chunk.num_triangles;
+      total_area += area(positions, indices);
+
+      // Every vertex is used and inside the chunk's box, which is inside the whole mesh's
+      std::vector<bool> used(chunk.num_vertices, false);
+      for (auto i: indices) used[i] = true;
+      EXPECT_TRUE(std::all_of(used.begin(), used.end(), [](bool u) { return u; }));
+      for (size_t v = 0; v < chunk.num_vertices; ++v) {
+        for (auto k = 0; k < 3; ++k) {
+          EXPECT_GE(positions[v * 3 + k], chunk.bounds.min[k]);
+          EXPECT_LE(positions[v * 3 + k], chunk.bounds.max[k]);
+        }
+      }
+      for (auto k = 0; k < 3; ++k) {
+        EXPECT_GE(chunk.bounds.min[k], bounds.min[k]);
+        EXPECT_LE(chunk.bounds.max[k], bounds.max[k]);
+      }
+    }
+  }
+}
+
+TEST(TestMeshChunks, chunks_hold_every_triangle) {
+  Mesh mesh;
+  MeshLoadOptions load;
+  load.upload = false;
+  ASSERT_TRUE(load_obj(HEAD, mesh, load));
+
+  // Temporary files left by an interrupted build aren't read as part of this one
+  std::vector<std::string> stale;
+  for (auto i = 0; i < 64; ++i) {
+    for (auto kind: {".cell", ".split"}) {
+      stale.push_back(CHUNKS + kind + std::to_string(i) + ".tmp");
+      std::ofstream(stale.back(), std::ios::binary) << "stale triangles";
+    }
+  }
+
+  ChunkBuildOptions options;
+  options.chunk_triangles = 300;
+  ASSERT_TRUE(build_chunked_mesh(HEAD, CHUNKS, options));
+  for (const auto &name: stale) std::remove(name.c_str());
+  size_t triangles;
+  double total_area;
+  check_chunks(options.chunk_triangles, triangles, total_area);
+  EXPECT_EQ(mesh.indices.size() / 3, triangles);
+
+  std::vector<float> positions;
+  for (size_t v = 0; v < mesh.vertex_data.size(); v += mesh.stride) {
+    positions.insert(positions.end(), &mesh.vertex_data[v], &mesh.vertex_data[v] + 3);
+  }
+  EXPECT_NEAR(area(positions, mesh.indices), total_area, 1e-6 * total_area);
+  std::remove(CHUNKS.c_str());
+}
+
+TEST(TestMeshChunks, cells_bigger_than_memory_are_split_on_disk) {
+  ChunkBuildOptions options;
+  options.chunk_triangles = 100;
+  // Too little memory to hold more than a chunk's worth of any cell
+  options.memory_bytes = 4096;
+  ASSERT_TRUE(build_chunked_mesh(HEAD, CHUNKS, options));
+  size_t triangles;
+  double total_area;
+  check_chunks(options.chunk_triangles, triangles, total_area);
+
+  ChunkBuildOptions one_chunk;
+  ASSERT_TRUE(build_chunked_mesh(HEAD, CHUNKS, one_chunk));
+  std::vector<ChunkInfo> chunks;
+  Bounds bounds;
+  ASSERT_TRUE(read_chunk_table(CHUNKS, chunks, bounds));
+  EXPECT_EQ(1u, chunks.size());
+  EXPECT_EQ(triangles, chunks[0].num_triangles);
+  std::remove(CHUNKS.c_str());
+}
+
+TEST(TestMeshChunks, centres_on_adjacent_floats_still_split) {
+  // Triangle centres at x of 16777220 and 16777222, adjacent floats whose middle rounds down to the first
+  const std::string obj_file_name = "test_mesh_chunks_adjacent.obj";
+  {
+    std::ofstream out(obj_file_name);
+    out << "v 16777220 0 0\nv 16777220 1 0\nv 16777220 0 1\n";
+    out << "v 16777222 0 0\nv 16777222 1 0\nv 16777222 0 1\n";
+    // A triangle far along x widens the grid cells so that both runs share the first
+    out << "v 17825792 0 0\nv 17825792 1 0\nv 17825792 0 1\nf 7 8 9\n";
+    for (auto i = 0; i < 100; ++i) out << "f 1 2 3\nf 4 5 6\n";
+  }
+  ChunkBuildOptions options;
+  options.chunk_triangles = 16;
+  options.memory_bytes = 1024;
+  ASSERT_TRUE(build_chunked_mesh(obj_file_name, CHUNKS, options));
+  std::vector<ChunkInfo> chunks;
+  Bounds bounds;
+  ASSERT_TRUE(read_chunk_table(CHUNKS, chunks, bounds));
+  size_t triangles = 0;
+  for (const auto &chunk: chunks) {
+    EXPECT_LE(chunk.num_triangles, options.chunk_triangles);
+    triangles += chunk.num_triangles;
+  }
+  EXPECT_EQ(201u, triangles);
+  std::remove(CHUNKS.c_str());
+  std::remove(obj_file_name.c_str());
+}
+
+TEST(TestMeshChunks, polygons_and_relative_indices_are_fanned) {
+  const std::string obj = "test_mesh_chunks.obj";
+  {
+    std::ofstream out(obj);
+    out << "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+        << "f 1 2 3 4\n"
+        << "v 5 0 0\nv 6 0 0\nv 6 1 0\n"
+        << "f -3 -2 -1\n"
+        << "f 1 2 9\n";
+  }
+  ASSERT_TRUE(build_chunked_mesh(obj, CHUNKS));
+  size_t triangles;
+  double total_area;
+  check_chunks(ChunkBuildOptions().chunk_triangles, triangles, total_area);
+  // The face with an index out of range is dropped
+  EXPECT_EQ(3u, triangles);
+  EXPECT_NEAR(1.5, total_area, 1e-6);
+  std::remove(obj.c_str());
+  std::remove(CHUNKS.c_str());
+}
+
+TEST(TestMeshChunks, rejects_files_that_are_not_chunks) {
+  std::vector<ChunkInfo> chunks;
+  Bounds bounds;
+  EXPECT_FALSE(read_chunk_table(HEAD, chunks, bounds));
+  EXPECT_FALSE(read_chunk_table("no_such_file.chunks", chunks, bounds));
+  EXPECT_FALSE(build_chunked_mesh("no_such_file.obj", CHUNKS));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
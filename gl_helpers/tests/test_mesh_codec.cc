@@ -0,0 +1,207 @@
+#include "gtest/gtest.h"
+#include "mesh_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+  const std::string HEAD = "/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj";
+  const std::string ENCODED = "test_mesh_codec.mesh";
+
+  Mesh load_head(bool normals, bool textures) {
+    MeshLoadOptions options;
+    options.include_normals = normals;
+    options.include_textures = textures;
+    options.upload = false;
+    Mesh mesh;
+    EXPECT_TRUE(load_obj(HEAD, mesh, options));
+    return mesh;
+  }
+
+  // The vertex of each corner, which is what decoding must give back in place of the indices
+  std::vector<float> corners(const Mesh &mesh) {
+    std::vector<float> out;
+    for (uint32_t i = 0; i < mesh.num_elements; ++i) {
+      const auto *v = &mesh.vertex_data[mesh.indices[i] * mesh.stride];
+      out.insert(out.end(), v, v + mesh.stride);
+    }
+    return out;
+  }
+
+  // Largest difference of each vertex component across all corners
+  std::vector<float> max_errors(const Mesh &a, const Mesh &b) {
+    auto ca = corners(a), cb = corners(b);
+    std::vector<float> errors(a.stride, 0.0f);
+    EXPECT_EQ(ca.size(), cb.size());
+    for (size_t i = 0; i < std::min(ca.size(), cb.size()); ++i) {
+      auto &e = errors[i % a.stride];
+      e = std::max(e, std::fabs(ca[i] - cb[i]));
+    }
+    return errors;
+  }
+}
+
+TEST(MeshCodec, ExactRoundTripKeepsEveryCorner) {
+  auto mesh = load_head(true, true);
+  MeshCodecOptions options;
+  options.position_bits = 0;
+  options.attribute_bits = 0;
+  options.optimize_vertex_cache = false;
+  std::vector<uint8_t> encoded;
+  ASSERT_TRUE(encode_mesh(mesh, encoded, options));
+
+  Mesh decoded;
+  ASSERT_TRUE(decode_mesh(encoded.data(), encoded.size(), decoded));
+  EXPECT_EQ(decoded.stride, mesh.stride);
+  EXPECT_EQ(decoded.num_elements, mesh.num_elements);
+  EXPECT_EQ(corners(decoded), corners(mesh));
+  ASSERT_EQ(decoded.submeshes.size(), mesh.submeshes.size());
+  for (size_t s = 0; s < mesh.submeshes.size(); ++s) {
+    EXPECT_EQ(decoded.submeshes[s].name, mesh.submeshes[s].name);
+    EXPECT_EQ(decoded.submeshes[s].index_offset, mesh.submeshes[s].index_offset);
+    EXPECT_EQ(decoded.submeshes[s].index_count, mesh.submeshes[s].index_count);
+    EXPECT_EQ(decoded.submeshes[s].material_id, mesh.submeshes[s].material_id);
+  }
+  EXPECT_EQ(decoded.materials, mesh.materials);
+  EXPECT_EQ(decoded.material_libs, mesh.material_libs);
+  for (auto k = 0; k < 3; ++k) {
+    EXPECT_EQ(decoded.bounds.min[k], mesh.bounds.min[k]);
+    EXPECT_EQ(decoded.bounds.max[k], mesh.bounds.max[k]);
+  }
+}
+
+TEST(MeshCodec, QuantisedComponentsAreWithinHalfAStep) {
+  auto mesh = load_head(true, true);
+  MeshCodecOptions options;
+  options.optimize_vertex_cache = false;
+  std::vector<uint8_t> encoded;
+  ASSERT_TRUE(encode_mesh(mesh, encoded, options));
+  EXPECT_LT(encoded.size(), (mesh.vertex_data.size() + mesh.indices.size()) * sizeof(float) / 2);
+
+  Mesh decoded;
+  ASSERT_TRUE(decode_mesh(encoded.data(), encoded.size(), decoded));
+  auto errors = max_errors(mesh, decoded);
+  for (uint32_t c = 0; c < mesh.stride; ++c) {
+    auto lo = mesh.vertex_data[c], hi = lo;
+    for (size_t v = 0; v < mesh.vertex_data.size(); v += mesh.stride) {
+      lo = std::min(lo, mesh.vertex_data[v + c]);
+      hi = std::max(hi, mesh.vertex_data[v + c]);
+    }
+    const auto bits = c < 3 ? options.position_bits : options.attribute_bits;
+    const auto half_step = 0.5f * (hi - lo) / static_cast<float>((1u << bits) - 1);
+    EXPECT_LE(errors[c], half_step * 1.01f + 1e-6f) << "component " << c;
+  }
+}
+
+TEST(MeshCodec, CacheOrderKeepsTheTrianglesOfEachSubmesh) {
+  auto mesh = load_head(false, false);
+  MeshCodecOptions exact;
+  exact.position_bits = 0;
+  std::vector<uint8_t> unordered, ordered;
+  exact.optimize_vertex_cache = false;
+  ASSERT_TRUE(encode_mesh(mesh, unordered, exact));
+  exact.optimize_vertex_cache = true;
+  ASSERT_TRUE(encode_mesh(mesh, ordered, exact));
+  EXPECT_LT(ordered.size(), unordered.size());
+
+  Mesh decoded;
+  ASSERT_TRUE(decode_mesh(ordered.data(), ordered.size(), decoded));
+  ASSERT_EQ(decoded.submeshes.size(), mesh.submeshes.size());
+
+  // Each triangle as its corners' positions, rotated to start at the least
+  auto triangles = [](const Mesh &m, const SubMesh &sm) {
+    std::vector<std::vector<float>> out;
+    for (auto i = sm.index_offset; i < sm.index_offset + sm.index_count; i += 3) {
+      std::vector<std::vector<float>> c;
+      for (auto k = 0; k < 3; ++k) {
+        const auto *p = &m.vertex_data[m.indices[i + k] * m.stride];
+        c.emplace_back(p, p + 3);
+      }
+      auto first = std::min_element(c.begin(), c.end()) - c.begin();
+      std::vector<float> t;
+      for (auto k = 0; k < 3; ++k) t.insert(t.end(), c[(first + k) % 3].begin(), c[(first + k) % 3].end());
+      out.push_back(t);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+  };
+  for (size_t s = 0; s < mesh.submeshes.size(); ++s) {
+    EXPECT_EQ(triangles(decoded, decoded.submeshes[s]), triangles(mesh, mesh.submeshes[s]));
+  }
+}
+
+TEST(MeshCodec, LoadDropsAttributesNotAskedFor) {
+  auto mesh = load_head(true, true);
+  ASSERT_TRUE(save_compressed_mesh(ENCODED, mesh));
+
+  MeshLoadOptions options;
+  options.upload = false;
+  options.lod_ratios = {0.5f};
+  Mesh loaded;
+  ASSERT_TRUE(load_compressed_mesh(ENCODED, loaded, options));
+  EXPECT_EQ(loaded.stride, 3u);
+  EXPECT_EQ(loaded.num_elements, mesh.num_elements);
+  EXPECT_EQ(loaded.lods.size(), 2u);
+  EXPECT_GT(loaded.indices.size(), loaded.num_elements);
+
+  // The file has no tangents
+  options.include_normals = options.include_textures = options.include_tangents = true;
+  EXPECT_FALSE(load_compressed_mesh(ENCODED, loaded, options));
+  std::remove(ENCODED.c_str());
+  EXPECT_FALSE(load_compressed_mesh(ENCODED, loaded, options));
+}
+
+TEST(MeshCodec, DamagedDataIsRejected) {
+  auto mesh = load_head(false, true);
+  std::vector<uint8_t> encoded;
+  ASSERT_TRUE(encode_mesh(mesh, encoded));
+
+  Mesh decoded;
+  for (size_t size = 0; size < encoded.size(); size += 1 + size / 8) {
+    EXPECT_FALSE(decode_mesh(encoded.data(), size, decoded)) << "truncated to " << size;
+    EXPECT_TRUE(decoded.vertex_data.empty());
+  }
+
+  auto bad = encoded;
+  bad[0] = 'X';
+  EXPECT_FALSE(decode_mesh(bad.data(), bad.size(), decoded));
+}
+
+TEST(MeshCodec, IndicesBeyondTheNextNewVertexAreRejected) {
+  Mesh mesh;
+  mesh.stride = 3;
+  mesh.vertex_data = {0, 0, 0, 1, 0, 0, 0, 1, 0};
+  mesh.indices = {0, 1, 2};
+  mesh.num_elements = 3;
+  mesh.submeshes.resize(1);
+  mesh.submeshes[0].index_count = 3;
+  std::vector<uint8_t> encoded;
+  ASSERT_TRUE(encode_mesh(mesh, encoded));
+
+  // Three new vertices pack to one zero width group, the last byte
+  ASSERT_EQ(encoded.back(), 0);
+  Mesh decoded;
+  ASSERT_TRUE(decode_mesh(encoded.data(), encoded.size(), decoded));
+  EXPECT_EQ(decoded.indices, mesh.indices);
+
+  // Rewrite it as a group of eight bit values, the first pointing back before any vertex
+  encoded.back() = 4;
+  encoded.insert(encoded.end(), 16, 0);
+  encoded[encoded.size() - 16] = 1;
+  uint64_t index_bytes = 17;
+  std::memcpy(&encoded[encoded.size() - 17 - sizeof(index_bytes)], &index_bytes, sizeof(index_bytes));
+  EXPECT_FALSE(decode_mesh(encoded.data(), encoded.size(), decoded));
+
+  // Pointing at the first vertex from the second is fine
+  encoded[encoded.size() - 16] = 0;
+  encoded[encoded.size() - 15] = 1;
+  ASSERT_TRUE(decode_mesh(encoded.data(), encoded.size(), decoded));
+  EXPECT_EQ(decoded.indices, (std::vector<uint32_t>{0, 0, 1}));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
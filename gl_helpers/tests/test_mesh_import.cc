@@ -0,0 +1,275 @@
+#include "gtest/gtest.h"
+#include "mesh_import.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace {
+  const std::string HEAD = "/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj";
+  const std::string PLY = "test_mesh_import.ply";
+  const std::string GLB = "test_mesh_import.glb";
+
+  MeshLoadOptions cpu_options(bool normals, bool textures) {
+    MeshLoadOptions options;
+    options.include_normals = normals;
+    options.include_textures = textures;
+    options.upload = false;
+    return options;
+  }
+
+  // The vertex of each full resolution corner
+  std::vector<float> corners(const Mesh &mesh) {
+    std::vector<float> out;
+    for (uint32_t i = 0; i < mesh.num_elements; ++i) {
+      const auto *v = &mesh.vertex_data[mesh.indices[i] * mesh.stride];
+      out.insert(out.end(), v, v + mesh.stride);
+    }
+    return out;
+  }
+
+  template<typename T>
+  void put(std::string &out, T value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void write_file(const std::string &file_name, const std::string &contents) {
+    std::ofstream out(file_name, std::ios::binary);
+    out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+  }
+
+  // A .glb of json and bin, each padded to four bytes as the format wants
+  void write_glb(const std::string &file_name, std::string json, std::string bin) {
+    while (json.size() % 4) json.push_back(' ');
+    while (bin.size() % 4) bin.push_back(0);
+    std::string glb;
+    put<uint32_t>(glb, 0x46546C67);
+    put<uint32_t>(glb, 2);
+    put<uint32_t>(glb, static_cast<uint32_t>(12 + 8 + json.size() + 8 + bin.size()));
+    put<uint32_t>(glb, static_cast<uint32_t>(json.size()));
+    put<uint32_t>(glb, 0x4E4F534A);
+    glb += json;
+    put<uint32_t>(glb, static_cast<uint32_t>(bin.size()));
+    put<uint32_t>(glb, 0x004E4942);
+    glb += bin;
+    write_file(file_name, glb);
+  }
+
+  /*
+   * A unit quad in the xy plane facing +z, with tex coords, drawn by two nodes:
+   * one moved by (1, 2, 3) and one scaled by 2 about the y axis.
+   */
+  void write_quad_glb(const std::string &file_name) {
+    std::string bin;
+    const float positions[] = {0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0};
+    const float tex_coords[] = {0, 1, 1, 1, 1, 0, 0, 0};
+    const uint16_t indices[] = {0, 1, 2, 0, 2, 3};
+    for (auto p: positions) put(bin, p);
+    for (auto t: tex_coords) put(bin, t);
+    for (auto i: indices) put(bin, i);
+    write_glb(file_name, R"({
+      "asset": {"version": "2.0"},
+      "scene": 0,
+      "scenes": [{"nodes": [0, 1]}],
+      "nodes": [
+        {"mesh": 0, "translation": [1, 2, 3]},
+        {"mesh": 0, "scale": [2, 1, 1], "name": "wide \"quad\""}
+      ],
+      "meshes": [{"name": "quad", "primitives": [
+        {"attributes": {"POSITION": 0, "TEXCOORD_0": 1}, "indices": 2, "material": 0, "mode": 4}
+      ]}],
+      "materials": [{"name": "red"}],
+      "accessors": [
+        {"bufferView": 0, "componentType": 5126, "count": 4, "type": "VEC3", "min": [0, 0, 0], "max": [1, 1, 0]},
+        {"bufferView": 1, "componentType": 5126, "count": 4, "type": "VEC2"},
+        {"bufferView": 2, "componentType": 5123, "count": 6, "type": "SCALAR"}
+      ],
+      "bufferViews": [
+        {"buffer": 0, "byteOffset": 0, "byteLength": 48},
+        {"buffer": 0, "byteOffset": 48, "byteLength": 32},
+        {"buffer": 0, "byteOffset": 80, "byteLength": 12}
+      ],
+      "buffers": [{"byteLength": 92}]
+    })", bin);
+  }
+}
+
+TEST(MeshImport, PlyMatchesTheObjItWasWrittenFrom) {
+  Mesh obj;
+  ASSERT_TRUE(load_obj(HEAD, obj, cpu_options(true, true)));
+  ASSERT_EQ(obj.stride, 8u);
+
+  const auto num_vertices = obj.vertex_data.size() / obj.stride;
+  std::string ply = "ply\nformat binary_little_endian 1.0\ncomment written by the test\n";
+  ply += "element vertex " + std::to_string(num_vertices) + "\n";
+  for (auto name: {"x", "y", "z", "nx", "ny", "nz", "u", "v"}) ply += std::string("property float ") + name + "\n";
+  ply += "element face " + std::to_string(obj.num_elements / 3) + "\n";
+  ply += "property list uchar int vertex_indices\nend_header\n";
+  ply.append(reinterpret_cast<const char *>(obj.vertex_data.data()), obj.vertex_data.size() * sizeof(float));
+  for (uint32_t i = 0; i < obj.num_elements; i += 3) {
+    put<uint8_t>(ply, 3);
+    for (auto k = 0; k < 3; ++k) put<int32_t>(ply, static_cast<int32_t>(obj.indices[i + k]));
+  }
+  write_file(PLY, ply);
+
+  Mesh mesh;
+  ASSERT_TRUE(load_ply(PLY, mesh, cpu_options(true, true)));
+  EXPECT_EQ(mesh.stride, obj.stride);
+  EXPECT_EQ(mesh.vertex_data, obj.vertex_data);
+  EXPECT_EQ(corners(mesh), corners(obj));
+  ASSERT_EQ(mesh.submeshes.size(), 1u);
+  EXPECT_EQ(mesh.submeshes[0].name, PLY);
+
+  // Through the OBJ builder when tangents are wanted
+  auto options = cpu_options(true, true);
+  options.include_tangents = true;
+  ASSERT_TRUE(load_ply(PLY, mesh, options));
+  EXPECT_EQ(mesh.stride, 12u);
+  EXPECT_EQ(mesh.num_elements, obj.num_elements);
+  std::remove(PLY.c_str());
+}
+
+TEST(MeshImport, PlyFacesAreFannedAndOtherDataSkipped) {
+  std::string ply = "ply\nformat binary_little_endian 1.0\n"
+                    "element vertex 4\nproperty uchar red\nproperty double x\nproperty double y\nproperty double z\n"
+                    "element edge 1\nproperty list uchar int vertex_pair\n"
+                    "element face 1\nproperty int flags\nproperty list uchar uint vertex_indices\nend_header\n";
+  const double positions[] = {0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0};
+  for (auto v = 0; v < 4; ++v) {
+    put<uint8_t>(ply, 255);
+    for (auto k = 0; k < 3; ++k) put(ply, positions[v * 3 + k]);
+  }
+  put<uint8_t>(ply, 2);
+  put<int32_t>(ply, 0);
+  put<int32_t>(ply, 1);
+  put<int32_t>(ply, 7);
+  put<uint8_t>(ply, 4);
+  for (uint32_t i = 0; i < 4; ++i) put(ply, i);
+  write_file(PLY, ply);
+
+  Mesh mesh;
+  ASSERT_TRUE(load_ply(PLY, mesh, cpu_options(false, false)));
+  EXPECT_EQ(mesh.vertex_data, (std::vector<float>{0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0}));
+  EXPECT_EQ(mesh.num_elements, 6u);
+
+  // The file has no normals to read but they can be generated
+  auto options = cpu_options(true, false);
+  options.normal_mode = NormalMode::FROM_FILE;
+  EXPECT_FALSE(load_ply(PLY, mesh, options));
+  options.normal_mode = NormalMode::GENERATE_IF_MISSING;
+  ASSERT_TRUE(load_ply(PLY, mesh, options));
+  ASSERT_EQ(mesh.stride, 6u);
+  for (size_t v = 0; v < mesh.vertex_data.size(); v += 6) EXPECT_FLOAT_EQ(mesh.vertex_data[v + 5], 1.0f);
+  std::remove(PLY.c_str());
+}
+
+TEST(MeshImport, BadPlyFilesAreRejected) {
+  Mesh mesh;
+  write_file(PLY, "ply\nformat ascii 1.0\nelement vertex 1\nproperty float x\nend_header\n0\n");
+  EXPECT_FALSE(load_ply(PLY, mesh, cpu_options(false, false)));
+
+  // Claims more vertices than there are bytes
+  write_file(PLY, "ply\nformat binary_little_endian 1.0\nelement vertex 1000\nproperty float x\nproperty float y\n"
+                  "property float z\nelement face 0\nproperty list uchar int vertex_indices\nend_header\n");
+  EXPECT_FALSE(load_ply(PLY, mesh, cpu_options(false, false)));
+
+  // An index past the vertices
+  std::string ply = "ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\nproperty float y\n"
+                    "property float z\nelement face 1\nproperty list uchar int vertex_indices\nend_header\n";
+  for (auto k = 0; k < 9; ++k) put<float>(ply, 0);
+  put<uint8_t>(ply, 3);
+  for (auto i: {0, 1, 3}) put<int32_t>(ply, i);
+  write_file(PLY, ply);
+  EXPECT_FALSE(load_ply(PLY, mesh, cpu_options(false, false)));
+
+  std::remove(PLY.c_str());
+  EXPECT_FALSE(load_ply(PLY, mesh, cpu_options(false, false)));
+}
+
+TEST(MeshImport, GlbNodesPlaceTheirMeshes) {
+  write_quad_glb(GLB);
+  Mesh mesh;
+  ASSERT_TRUE(load_glb(GLB, mesh, cpu_options(false, true)));
+  ASSERT_EQ(mesh.stride, 5u);
+  EXPECT_EQ(mesh.num_elements, 12u);
+  ASSERT_EQ(mesh.submeshes.size(), 2u);
+  EXPECT_EQ(mesh.submeshes[0].name, "quad");
+  EXPECT_EQ(mesh.submeshes[0].material_id, 0);
+  EXPECT_EQ(mesh.materials, std::vector<std::string>{"red"});
+
+  // First copy moved, second stretched along x; V flipped for GL
+  const auto *v = mesh.vertex_data.data();
+  EXPECT_EQ(std::vector<float>(v, v + 5), (std::vector<float>{1, 2, 3, 0, 0}));
+  EXPECT_EQ(std::vector<float>(v + 10, v + 15), (std::vector<float>{2, 3, 3, 1, 1}));
+  EXPECT_EQ(std::vector<float>(v + 25, v + 30), (std::vector<float>{2, 0, 0, 1, 0}));
+  EXPECT_FLOAT_EQ(mesh.bounds.max[0], 2.0f);
+  EXPECT_FLOAT_EQ(mesh.bounds.max[2], 3.0f);
+
+  // No normals in the file, so they're generated
+  ASSERT_TRUE(load_glb(GLB, mesh, cpu_options(true, true)));
+  ASSERT_EQ(mesh.stride, 8u);
+  for (size_t i = 0; i < mesh.vertex_data.size(); i += 8) EXPECT_FLOAT_EQ(mesh.vertex_data[i + 5], 1.0f);
+  std::remove(GLB.c_str());
+}
+
+TEST(MeshImport, BadGlbFilesAreRejected) {
+  Mesh mesh;
+  write_glb(GLB, "{\"meshes\": [", "");
+  EXPECT_FALSE(load_glb(GLB, mesh, cpu_options(false, false)));
+
+  // An accessor reaching past its buffer view
+  std::string bin(36, 0);
+  write_glb(GLB, R"({"meshes": [{"primitives": [{"attributes": {"POSITION": 0}}]}],
+    "accessors": [{"bufferView": 0, "componentType": 5126, "count": 4, "type": "VEC3"}],
+    "bufferViews": [{"buffer": 0, "byteLength": 36}], "buffers": [{"byteLength": 36}]})", bin);
+  EXPECT_FALSE(load_glb(GLB, mesh, cpu_options(false, false)));
+
+  // The same with three vertices is a triangle
+  write_glb(GLB, R"({"meshes": [{"primitives": [{"attributes": {"POSITION": 0}}]}],
+    "accessors": [{"bufferView": 0, "componentType": 5126, "count": 3, "type": "VEC3"}],
+    "bufferViews": [{"buffer": 0, "byteLength": 36}], "buffers": [{"byteLength": 36}]})", bin);
+  ASSERT_TRUE(load_glb(GLB, mesh, cpu_options(false, false)));
+  EXPECT_EQ(mesh.num_elements, 3u);
+
+  // Indices that aren't whole numbers within their arrays
+  for (auto position: {"-1", "0.5", "1e300"}) {
+    write_glb(GLB, std::string(R"({"meshes": [{"primitives": [{"attributes": {"POSITION": )") + position + R"(}}]}],
+      "accessors": [{"bufferView": 0, "componentType": 5126, "count": 3, "type": "VEC3"}],
+      "bufferViews": [{"buffer": 0, "byteLength": 36}], "buffers": [{"byteLength": 36}]})", bin);
+    EXPECT_FALSE(load_glb(GLB, mesh, cpu_options(false, false))) << position;
+  }
+
+  // Nodes with two parents, or in a cycle, would be imported again and again
+  const std::string triangle = R"("meshes": [{"primitives": [{"attributes": {"POSITION": 0}}]}],
+    "accessors": [{"bufferView": 0, "componentType": 5126, "count": 3, "type": "VEC3"}],
+    "bufferViews": [{"buffer": 0, "byteLength": 36}], "buffers": [{"byteLength": 36}])";
+  for (auto nodes: {R"([{"children": [2]}, {"children": [2]}, {"mesh": 0}], "scenes": [{"nodes": [0, 1]}])",
+                    R"([{"children": [1]}, {"children": [0], "mesh": 0}], "scenes": [{"nodes": [0]}])",
+                    R"([{"mesh": 0}], "scenes": [{"nodes": [0]}], "scene": -1)"}) {
+    write_glb(GLB, "{" + triangle + R"(, "nodes": )" + nodes + "}", bin);
+    EXPECT_FALSE(load_glb(GLB, mesh, cpu_options(false, false))) << nodes;
+  }
+  write_glb(GLB, "{" + triangle + R"(, "nodes": [{"children": [1]}, {"mesh": 0}], "scenes": [{"nodes": [0]}]})", bin);
+  ASSERT_TRUE(load_glb(GLB, mesh, cpu_options(false, false)));
+  EXPECT_EQ(mesh.num_elements, 3u);
+
+  write_file(GLB, "glTF");
+  EXPECT_FALSE(load_glb(GLB, mesh, cpu_options(false, false)));
+  std::remove(GLB.c_str());
+}
+
+TEST(MeshImport, LoadMeshChoosesTheLoaderByExtension) {
+  write_quad_glb(GLB);
+  Mesh mesh;
+  ASSERT_TRUE(load_mesh(GLB, mesh, cpu_options(false, false)));
+  EXPECT_EQ(mesh.num_elements, 12u);
+  ASSERT_TRUE(load_mesh(HEAD, mesh, cpu_options(false, false)));
+  EXPECT_GT(mesh.num_elements, 12u);
+  std::remove(GLB.c_str());
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,120 @@
+#include "gtest/gtest.h"
+#include "meshlet.h"
+#include "mesh_internal.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+class TestMeshlet : public ::testing::Test {
+public:
+  void SetUp() override {
+    std::ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
+    ASSERT_TRUE(parse_raw_data(in, raw, false, false));
+    ASSERT_TRUE(build_vertex_data(raw, vertex_data, indices, false, false, false, &submeshes));
+  }
+
+  RawMeshData raw;
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  std::vector<SubMesh> submeshes;
+};
+
+namespace {
+  std::vector<std::array<uint32_t, 3>> sorted_triangles(const std::vector<uint32_t> &idx) {
+    std::vector<std::array<uint32_t, 3>> tris;
+    for (size_t i = 0; i < idx.size(); i += 3) tris.push_back({{idx[i], idx[i + 1], idx[i + 2]}});
+    std::sort(tris.begin(), tris.end());
+    return tris;
+  }
+}
+
+TEST_F(TestMeshlet, meshlets_cover_every_triangle_once) {
+  auto before = sorted_triangles(indices);
+
+  std::vector<Meshlet> meshlets;
+  build_meshlets(vertex_data.data(), 3, indices, submeshes, 124, meshlets);
+  ASSERT_FALSE(meshlets.empty());
+  EXPECT_EQ(before, sorted_triangles(indices));
+
+  uint32_t next = 0;
+  for (const auto &m: meshlets) {
+    EXPECT_EQ(next, m.index_offset);
+    EXPECT_LE(m.index_count, 3 * 124);
+    EXPECT_GT(m.index_count, 0);
+    next += m.index_count;
+  }
+  EXPECT_EQ(indices.size(), next);
+  // Clusters should mostly be full
+  EXPECT_LT(meshlets.size(), 2 * (indices.size() / 3) / 124 + 1);
+}
+
+TEST_F(TestMeshlet, bounds_contain_their_triangles) {
+  std::vector<Meshlet> meshlets;
+  build_meshlets(vertex_data.data(), 3, indices, submeshes, 64, meshlets);
+
+  for (const auto &m: meshlets) {
+    for (auto i = m.index_offset; i < m.index_offset + m.index_count; i += 3) {
+      const float *p[3];
+      for (auto k = 0; k < 3; ++k) {
+        p[k] = &vertex_data[3 * indices[i + k]];
+        auto dx = p[k][0] - m.center[0], dy = p[k][1] - m.center[1], dz = p[k][2] - m.center[2];
+        EXPECT_LE(std::sqrt(dx * dx + dy * dy + dz * dz), m.radius * 1.0001f);
+      }
+      if (m.cone_cutoff >= 1.0f) continue;
+      // Every facing normal is within the cone
+      auto n = glm::cross(glm::vec3{p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]},
+                          glm::vec3{p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]});
+      if (glm::length(n) == 0) continue;
+      auto d = glm::dot(glm::normalize(n), glm::vec3{m.cone_axis[0], m.cone_axis[1], m.cone_axis[2]});
+      EXPECT_GE(d, std::sqrt(1.0f - m.cone_cutoff * m.cone_cutoff) - 1e-4f);
+    }
+  }
+}
+
+TEST_F(TestMeshlet, culling_rejects_back_and_offscreen_clusters) {
+  // Small clusters for this small mesh so that their normal cones are narrow
+  std::vector<Meshlet> meshlets;
+  build_meshlets(vertex_data.data(), 3, indices, submeshes, 32, meshlets);
+
+  // The head faces +z. From in front nothing is off screen but the back of the head faces away.
+  glm::vec3 eye{0, 0, 3};
+  auto proj = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+  auto view = glm::lookAt(eye, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
+  MeshletDrawList list;
+  cull_meshlets(meshlets, proj * view, eye, list);
+  EXPECT_EQ(meshlets.size(), list.visible + list.frustum_culled + list.backface_culled);
+  EXPECT_EQ(0, list.frustum_culled);
+  EXPECT_GT(list.backface_culled, 0);
+  EXPECT_EQ(list.commands.size(), list.counts.size());
+  uint32_t drawn = 0;
+  for (const auto &c: list.commands) drawn += c.count;
+  EXPECT_LT(drawn, indices.size());
+
+  // Looking away everything is outside the frustum
+  auto away = glm::lookAt(eye, glm::vec3{0, 0, 6}, glm::vec3{0, 1, 0});
+  cull_meshlets(meshlets, proj * away, eye, list);
+  EXPECT_EQ(0, list.visible);
+  EXPECT_TRUE(list.commands.empty());
+}
+
+TEST_F(TestMeshlet, adjacent_visible_meshlets_merge) {
+  std::vector<Meshlet> meshlets(3);
+  for (uint32_t i = 0; i < 3; ++i) {
+    meshlets[i].index_offset = 6 * i;
+    meshlets[i].index_count = 6;
+    meshlets[i].radius = 1;
+  }
+  MeshletDrawList list;
+  cull_meshlets(meshlets, glm::mat4{1.0f}, glm::vec3{0, 0, 5}, list);
+  ASSERT_EQ(1, list.commands.size());
+  EXPECT_EQ(18, list.commands[0].count);
+  EXPECT_EQ(3, list.visible);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
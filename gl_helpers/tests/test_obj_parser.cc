@@ -2,6 +2,7 @@
 #include "mesh_internal.h"
 
 #include <fstream>
+#include <cmath>
 
 class TestObjLoader : public ::testing::Test {
 };
@@ -76,9 +77,103 @@ TEST_F(TestObjLoader, parse_2f_handles_empty_string) {
 
 TEST_F(TestObjLoader, parse_face_rejects_inconsistent_faces) {
   std::string txt = "1 2/2 3/3/3";
-  int32_t v[3], n[3], t[3];
-  auto actual = parse_face(txt, v, true, n, true, t);
+  RawMeshData raw;
+  raw.pos_x.resize(3);
+  auto actual = parse_face(txt, raw, true, true);
   EXPECT_FALSE(actual);
+  EXPECT_EQ(0, raw.num_corners());
+  EXPECT_EQ(0, raw.num_faces());
+}
+
+TEST_F(TestObjLoader, parse_face_accepts_polygons) {
+  std::string txt = "1 2 3 4 5";
+  RawMeshData raw;
+  raw.pos_x.resize(5);
+  auto actual = parse_face(txt, raw);
+  EXPECT_TRUE(actual);
+  EXPECT_EQ(1, raw.num_faces());
+  EXPECT_EQ((std::vector<int32_t>{0, 1, 2, 3, 4}), raw.corner_vertex);
+}
+
+TEST_F(TestObjLoader, parse_face_rejects_too_few_corners) {
+  std::string txt = "1 2";
+  RawMeshData raw;
+  raw.pos_x.resize(2);
+  auto actual = parse_face(txt, raw);
+  EXPECT_FALSE(actual);
+}
+
+TEST_F(TestObjLoader, parse_face_resolves_negative_indices) {
+  std::string txt = "-3/-2/-1 -2/-1/-1 -1/-1/-2";
+  RawMeshData raw;
+  raw.pos_x.resize(4);
+  raw.tex_u.resize(3);
+  raw.norm_x.resize(2);
+  auto actual = parse_face(txt, raw, true, true);
+  EXPECT_TRUE(actual);
+  EXPECT_EQ((std::vector<int32_t>{1, 2, 3}), raw.corner_vertex);
+  EXPECT_EQ((std::vector<int32_t>{1, 2, 2}), raw.corner_tex);
+  EXPECT_EQ((std::vector<int32_t>{1, 1, 0}), raw.corner_normal);
+}
+
+TEST_F(TestObjLoader, parse_face_rejects_relative_index_before_start) {
+  std::string txt = "-1 -2 -4";
+  RawMeshData raw;
+  raw.pos_x.resize(3);
+  auto actual = parse_face(txt, raw);
+  EXPECT_FALSE(actual);
+}
+
+TEST_F(TestObjLoader, parse_face_rejects_zero_index) {
+  std::string txt = "0 1 2";
+  RawMeshData raw;
+  raw.pos_x.resize(3);
+  auto actual = parse_face(txt, raw);
+  EXPECT_FALSE(actual);
+}
+
+namespace {
+  // Square with a notch cut into its top edge, in the z=0 plane
+  void make_notched_square(RawMeshData &raw) {
+    raw.pos_x = {0, 2, 2, 1, 0};
+    raw.pos_y = {0, 0, 2, 1, 2};
+    raw.pos_z = {0, 0, 0, 0, 0};
+    raw.corner_vertex = {0, 1, 2, 3, 4};
+    raw.corner_normal = {-1, -1, -1, -1, -1};
+    raw.corner_tex = {-1, -1, -1, -1, -1};
+    raw.face_offsets = {0, 5};
+  }
+
+  float triangle_area(const RawMeshData &raw, uint32_t a, uint32_t b, uint32_t c) {
+    auto va = raw.corner_vertex[a], vb = raw.corner_vertex[b], vc = raw.corner_vertex[c];
+    return 0.5f * ((raw.pos_x[vb] - raw.pos_x[va]) * (raw.pos_y[vc] - raw.pos_y[va])
+                   - (raw.pos_y[vb] - raw.pos_y[va]) * (raw.pos_x[vc] - raw.pos_x[va]));
+  }
+}
+
+TEST_F(TestObjLoader, triangulate_face_fans_by_default) {
+  RawMeshData raw;
+  make_notched_square(raw);
+  TriangulationScratch scratch;
+  triangulate_face(raw, 0, false, scratch);
+  EXPECT_EQ((std::vector<uint32_t>{0, 1, 2, 0, 2, 3, 0, 3, 4}), raw.triangles);
+}
+
+TEST_F(TestObjLoader, triangulate_face_ear_clips_concave_faces) {
+  RawMeshData raw;
+  make_notched_square(raw);
+  TriangulationScratch scratch;
+  triangulate_face(raw, 0, true, scratch);
+  ASSERT_EQ(3, raw.num_triangles());
+
+  // Every triangle keeps the face's winding and together they cover exactly its area
+  auto total = 0.0f;
+  for (size_t t = 0; t < raw.num_triangles(); ++t) {
+    auto area = triangle_area(raw, raw.triangles[3 * t], raw.triangles[3 * t + 1], raw.triangles[3 * t + 2]);
+    EXPECT_GT(area, 0.0f);
+    total += area;
+  }
+  EXPECT_FLOAT_EQ(3.0f, total);
 }
 
 
@@ -117,8 +212,8 @@ TEST_F(TestObjLoader, parse_face_elements_trims_leading_spaces) {
                                     true, &t);
   EXPECT_TRUE(actual);
   EXPECT_EQ(1, v);
-  EXPECT_EQ(2, n);
-  EXPECT_EQ(3, t);
+  EXPECT_EQ(2, t);
+  EXPECT_EQ(3, n);
 }
 
 TEST_F(TestObjLoader, parse_face_elements_trims_trailing_spaces) {
@@ -129,8 +224,29 @@ TEST_F(TestObjLoader, parse_face_elements_trims_trailing_spaces) {
                                     true, &t);
   EXPECT_TRUE(actual);
   EXPECT_EQ(1, v);
-  EXPECT_EQ(2, n);
-  EXPECT_EQ(3, t);
+  EXPECT_EQ(2, t);
+  EXPECT_EQ(3, n);
+}
+
+TEST_F(TestObjLoader, parse_face_elements_accepts_negative_indices) {
+  std::string txt = "-1/-2/-3";
+  int32_t v, t, n;
+  auto actual = parse_face_elements(txt, &v,
+                                    true, &n,
+                                    true, &t);
+  EXPECT_TRUE(actual);
+  EXPECT_EQ(-1, v);
+  EXPECT_EQ(-2, t);
+  EXPECT_EQ(-3, n);
+}
+
+TEST_F(TestObjLoader, parse_face_elements_rejects_embedded_minus) {
+  std::string txt = "1-2/3";
+  int32_t v, t, n;
+  auto actual = parse_face_elements(txt, &v,
+                                    false, &n,
+                                    true, &t);
+  EXPECT_FALSE(actual);
 }
 
 TEST_F(TestObjLoader, pfe_rejects_request_for_missing_norm_1) {
@@ -143,7 +259,7 @@ TEST_F(TestObjLoader, pfe_rejects_request_for_missing_norm_1) {
 }
 
 TEST_F(TestObjLoader, pfe_rejects_request_for_missing_norm_2) {
-  std::string txt = "1//2";
+  std::string txt = "1/2";
   int32_t v, t, n;
   auto actual = parse_face_elements(txt, &v,
                                     true, &n,
@@ -152,7 +268,7 @@ TEST_F(TestObjLoader, pfe_rejects_request_for_missing_norm_2) {
 }
 
 TEST_F(TestObjLoader, pfe_rejects_request_for_missing_tex_1) {
-  std::string txt = "1/2";
+  std::string txt = "1//2";
   int32_t v, t, n;
   auto actual = parse_face_elements(txt, &v,
                                     false, &n,
@@ -179,7 +295,7 @@ TEST_F(TestObjLoader, pfe_rejects_request_for_missing_tex_3) {
 }
 
 TEST_F(TestObjLoader, pfe_retrieves_tex_with_missing_norm) {
-  std::string txt = "1//3";
+  std::string txt = "1/3";
   int32_t v, t, n;
   auto actual = parse_face_elements(txt, &v,
                                     false, &n,
@@ -189,19 +305,268 @@ TEST_F(TestObjLoader, pfe_retrieves_tex_with_missing_norm) {
   EXPECT_EQ(3, t);
 }
 
+TEST_F(TestObjLoader, pfe_retrieves_norm_with_missing_tex) {
+  std::string txt = "1//3";
+  int32_t v, t, n;
+  auto actual = parse_face_elements(txt, &v,
+                                    true, &n,
+                                    false, &t);
+  EXPECT_TRUE(actual);
+  EXPECT_EQ(1, v);
+  EXPECT_EQ(3, n);
+}
+
 TEST_F(TestObjLoader, parse_real_file_ok) {
   using namespace std;
 
-  vector<tuple<float, float, float>> vertices;
-  vector<vector<tuple<int32_t, int32_t, int32_t>>> faces;
-  vector<tuple<float, float, float>> normals;
-  vector<tuple<float, float>> tex_coords;
+  RawMeshData raw;
+
+  ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
+  auto ok = parse_raw_data(in, raw, true, true);
+  EXPECT_TRUE(ok);
+}
+
+TEST_F(TestObjLoader, parse_raw_data_fills_flat_streams) {
+  using namespace std;
+
+  RawMeshData raw;
+
+  ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
+  auto ok = parse_raw_data(in, raw, true, true);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(raw.pos_x.size(), raw.pos_y.size());
+  EXPECT_EQ(raw.pos_x.size(), raw.pos_z.size());
+  EXPECT_EQ(raw.tex_u.size(), raw.tex_v.size());
+  EXPECT_EQ(raw.corner_vertex.size(), raw.corner_normal.size());
+  EXPECT_EQ(raw.corner_vertex.size(), raw.corner_tex.size());
+  EXPECT_EQ(raw.num_corners(), raw.face_offsets.back());
+  EXPECT_EQ(3 * raw.num_faces(), raw.num_corners());
+  EXPECT_EQ(raw.num_faces(), raw.num_triangles());
+}
+
+TEST_F(TestObjLoader, real_file_builds_with_normals_and_tex_coords) {
+  using namespace std;
+
+  RawMeshData raw;
 
   ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
-  auto ok = parse_raw_data(in, vertices, faces, true, &normals, true, &tex_coords);
+  ASSERT_TRUE(parse_raw_data(in, raw, true, true));
+
+  vector<float> vertex_data;
+  vector<uint32_t> indices;
+  auto ok = build_vertex_data(raw, vertex_data, indices, true, true);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(3 * raw.num_triangles(), indices.size());
+}
+
+TEST_F(TestObjLoader, build_vertex_data_shares_repeated_corners) {
+  RawMeshData raw;
+  raw.pos_x = {0, 1, 1, 0};
+  raw.pos_y = {0, 0, 1, 1};
+  raw.pos_z = {0, 0, 0, 0};
+  raw.corner_vertex = {0, 1, 2, 0, 2, 3};
+  raw.corner_normal = {-1, -1, -1, -1, -1, -1};
+  raw.corner_tex = {-1, -1, -1, -1, -1, -1};
+  raw.face_offsets = {0, 3, 6};
+  raw.triangles = {0, 1, 2, 3, 4, 5};
+
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  auto ok = build_vertex_data(raw, vertex_data, indices);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(12, vertex_data.size());
+  EXPECT_EQ((std::vector<uint32_t>{0, 1, 2, 0, 2, 3}), indices);
+}
+
+TEST_F(TestObjLoader, build_vertex_data_rejects_bad_index) {
+  RawMeshData raw;
+  raw.pos_x = {0, 1, 1};
+  raw.pos_y = {0, 0, 1};
+  raw.pos_z = {0, 0, 0};
+  raw.corner_vertex = {0, 1, 3};
+  raw.corner_normal = {-1, -1, -1};
+  raw.corner_tex = {-1, -1, -1};
+  raw.face_offsets = {0, 3};
+  raw.triangles = {0, 1, 2};
+
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  auto ok = build_vertex_data(raw, vertex_data, indices);
+  EXPECT_FALSE(ok);
+}
+
+namespace {
+  // Write txt to a temporary OBJ file and parse it
+  bool parse_text(const std::string &txt, RawMeshData &raw,
+                  bool include_normals = false, bool include_tex_coords = false) {
+    const char *path = "/tmp/utah_icg_test.obj";
+    {
+      std::ofstream out(path);
+      out << txt;
+    }
+    std::ifstream in(path);
+    return parse_raw_data(in, raw, include_normals, include_tex_coords);
+  }
+}
+
+TEST_F(TestObjLoader, parse_raw_data_records_groups_and_materials) {
+  RawMeshData raw;
+  auto ok = parse_text("mtllib a.mtl b.mtl\n"
+                       "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+                       "o box\n"
+                       "g top\n"
+                       "usemtl red\n"
+                       "s 1\n"
+                       "f 1 2 3\n"
+                       "usemtl blue\n"
+                       "s off\n"
+                       "f 1 3 4\n"
+                       "usemtl red\n"
+                       "f 1 2 4\n", raw);
+  EXPECT_TRUE(ok);
+  EXPECT_EQ((std::vector<std::string>{"a.mtl", "b.mtl"}), raw.material_libs);
+  EXPECT_EQ((std::vector<std::string>{"red", "blue"}), raw.materials);
+  EXPECT_EQ((std::vector<uint32_t>{1, 0, 0}), raw.face_smoothing);
+  ASSERT_EQ(3, raw.groups.size());
+  EXPECT_EQ("box", raw.groups[0].object);
+  EXPECT_EQ("top", raw.groups[0].group);
+  EXPECT_EQ(0, raw.groups[0].material_id);
+  EXPECT_EQ(0, raw.groups[0].first_triangle);
+  EXPECT_EQ(1, raw.groups[1].material_id);
+  EXPECT_EQ(1, raw.groups[1].first_triangle);
+  EXPECT_EQ(0, raw.groups[2].material_id);
+  EXPECT_EQ(2, raw.groups[2].first_triangle);
+}
+
+TEST_F(TestObjLoader, build_vertex_data_merges_runs_into_submeshes) {
+  RawMeshData raw;
+  ASSERT_TRUE(parse_text("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+                         "usemtl red\nf 1 2 3\n"
+                         "usemtl blue\nf 1 3 4\n"
+                         "usemtl red\nf 1 2 4\n", raw));
+
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  std::vector<SubMesh> submeshes;
+  auto ok = build_vertex_data(raw, vertex_data, indices, false, false, false, &submeshes);
   EXPECT_TRUE(ok);
+  ASSERT_EQ(2, submeshes.size());
+  EXPECT_EQ(0, submeshes[0].material_id);
+  EXPECT_EQ(0, submeshes[0].index_offset);
+  EXPECT_EQ(6, submeshes[0].index_count);
+  EXPECT_EQ(1, submeshes[1].material_id);
+  EXPECT_EQ(6, submeshes[1].index_offset);
+  EXPECT_EQ(3, submeshes[1].index_count);
+  EXPECT_EQ((std::vector<uint32_t>{0, 1, 2, 0, 1, 3, 0, 2, 3}), indices);
+}
+
+TEST_F(TestObjLoader, generate_normals_smooths_within_crease_angle) {
+  RawMeshData raw;
+  // Two faces folded 90 degrees along the edge x=0
+  ASSERT_TRUE(parse_text("v 0 0 0\nv 0 1 0\nv 1 0 0\nv 0 0 1\n"
+                         "f 1 3 2\n"
+                         "f 1 2 4\n", raw));
+
+  generate_normals(raw, NormalWeighting::AREA, 180.0f);
+  // Corners on the shared edge share a normal half way between the faces
+  EXPECT_EQ(raw.corner_normal[0], raw.corner_normal[3]);
+  auto n = raw.corner_normal[0];
+  EXPECT_NEAR(0.7071f, raw.norm_x[n], 1e-4);
+  EXPECT_NEAR(0.0f, raw.norm_y[n], 1e-4);
+  EXPECT_NEAR(0.7071f, raw.norm_z[n], 1e-4);
+}
+
+TEST_F(TestObjLoader, generate_normals_splits_at_crease) {
+  RawMeshData raw;
+  ASSERT_TRUE(parse_text("v 0 0 0\nv 0 1 0\nv 1 0 0\nv 0 0 1\n"
+                         "f 1 3 2\n"
+                         "f 1 2 4\n", raw));
+
+  generate_normals(raw, NormalWeighting::ANGLE, 60.0f);
+  EXPECT_NE(raw.corner_normal[0], raw.corner_normal[3]);
+  // Each face keeps its own flat normal
+  for (auto c = 0; c < 3; ++c) {
+    auto n = raw.corner_normal[c];
+    EXPECT_FLOAT_EQ(0.0f, raw.norm_x[n]);
+    EXPECT_FLOAT_EQ(0.0f, raw.norm_y[n]);
+    EXPECT_FLOAT_EQ(1.0f, raw.norm_z[n]);
+  }
 }
 
+TEST_F(TestObjLoader, generate_normals_respects_smoothing_groups) {
+  RawMeshData raw;
+  ASSERT_TRUE(parse_text("v 0 0 0\nv 0 1 0\nv 1 0 0\nv 0 0 1\n"
+                         "s 1\nf 1 3 2\n"
+                         "s 2\nf 1 2 4\n", raw));
+
+  generate_normals(raw, NormalWeighting::AREA, 180.0f);
+  EXPECT_NE(raw.corner_normal[0], raw.corner_normal[3]);
+}
+
+TEST_F(TestObjLoader, real_file_builds_with_generated_normals) {
+  using namespace std;
+
+  RawMeshData raw;
+
+  ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
+  ASSERT_TRUE(parse_raw_data(in, raw, false, true));
+  generate_normals(raw, NormalWeighting::ANGLE, 60.0f);
+
+  vector<float> vertex_data;
+  vector<uint32_t> indices;
+  EXPECT_TRUE(build_vertex_data(raw, vertex_data, indices, true, true));
+  for (size_t v = 0; v < vertex_data.size(); v += 8) {
+    auto len = sqrt(vertex_data[v + 3] * vertex_data[v + 3]
+                    + vertex_data[v + 4] * vertex_data[v + 4]
+                    + vertex_data[v + 5] * vertex_data[v + 5]);
+    EXPECT_NEAR(1.0f, len, 1e-4);
+  }
+}
+
+TEST_F(TestObjLoader, generate_tangents_follows_u_direction) {
+  RawMeshData raw;
+  ASSERT_TRUE(parse_text("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+                         "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+                         "vn 0 0 1\n"
+                         "f 1/1/1 2/2/1 3/3/1 4/4/1\n", raw, true, true));
+
+  ASSERT_TRUE(generate_tangents(raw));
+  for (size_t c = 0; c < raw.num_corners(); ++c) {
+    auto t = raw.corner_tangent[c];
+    EXPECT_NEAR(1.0f, raw.tan_x[t], 1e-5);
+    EXPECT_NEAR(0.0f, raw.tan_y[t], 1e-5);
+    EXPECT_NEAR(0.0f, raw.tan_z[t], 1e-5);
+    EXPECT_EQ(1.0f, raw.tan_w[t]);
+  }
+}
+
+TEST_F(TestObjLoader, generate_tangents_keeps_mirrored_uvs_apart) {
+  RawMeshData raw;
+  // Two quads sharing the edge x=1. The second mirrors the first in U but reuses its tex coords on that edge.
+  ASSERT_TRUE(parse_text("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 0\nv 2 1 0\n"
+                         "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+                         "vn 0 0 1\n"
+                         "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+                         "f 2/2/1 5/1/1 6/4/1 3/3/1\n", raw, true, true));
+
+  ASSERT_TRUE(generate_tangents(raw));
+  // Corner 1 and 4 are both vertex 2 with the same normal and tex coord, but opposite handedness
+  EXPECT_NE(raw.corner_tangent[1], raw.corner_tangent[4]);
+  EXPECT_EQ(1.0f, raw.tan_w[raw.corner_tangent[1]]);
+  EXPECT_EQ(-1.0f, raw.tan_w[raw.corner_tangent[4]]);
+
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  ASSERT_TRUE(build_vertex_data(raw, vertex_data, indices, true, true, true));
+  // Without tangents the shared edge would collapse to 6 vertices
+  EXPECT_EQ(8 * 12, vertex_data.size());
+}
+
+TEST_F(TestObjLoader, generate_tangents_needs_tex_coords) {
+  RawMeshData raw;
+  ASSERT_TRUE(parse_text("v 0 0 0\nv 1 0 0\nv 1 1 0\nvn 0 0 1\nf 1//1 2//1 3//1\n", raw, true, false));
+  EXPECT_FALSE(generate_tangents(raw));
+}
 
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,221 @@
+#include "gtest/gtest.h"
+#include "occlusion.h"
+#include "mesh_internal.h"
+#include "raster.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace {
+  const uint32_t WIDTH = 256;
+  const uint32_t HEIGHT = 128;
+
+  glm::mat4 view() {
+    return glm::lookAt(glm::vec3{0, 0, 5}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
+  }
+
+  glm::mat4 projection() {
+    return glm::perspective(glm::radians(45.0f), (float) WIDTH / (float) HEIGHT, 0.1f, 100.0f);
+  }
+
+  /*
+   * A square in the plane through origin spanned by u and v, each of its sides
+   * cut into n, as one submesh. With coarse set it has a second level of
+   * detail, the same square as two triangles.
+   */
+  Mesh square(const glm::vec3 &origin, const glm::vec3 &u, const glm::vec3 &v, uint32_t n, bool coarse = false) {
+    Mesh mesh;
+    mesh.stride = 3;
+    for (uint32_t j = 0; j <= n; ++j) {
+      for (uint32_t i = 0; i <= n; ++i) {
+        auto p = origin + u * (float) i / (float) n + v * (float) j / (float) n;
+        mesh.vertex_data.insert(mesh.vertex_data.end(), {p.x, p.y, p.z});
+      }
+    }
+    for (uint32_t j = 0; j < n; ++j) {
+      for (uint32_t i = 0; i < n; ++i) {
+        auto a = j * (n + 1) + i;
+        mesh.indices.insert(mesh.indices.end(), {a, a + 1, a + n + 2, a, a + n + 2, a + n + 1});
+      }
+    }
+    mesh.num_elements = static_cast<uint32_t>(mesh.indices.size());
+    mesh.submeshes.resize(1);
+    mesh.submeshes[0].index_count = mesh.num_elements;
+    mesh.bounds = compute_bounds(mesh.vertex_data.data(), mesh.vertex_data.size() / 3, 3);
+    if (coarse) {
+      mesh.lods.resize(2);
+      mesh.lods[0].submeshes = mesh.submeshes;
+      mesh.lods[1].submeshes.resize(1);
+      mesh.lods[1].submeshes[0].index_offset = mesh.num_elements;
+      mesh.lods[1].submeshes[0].index_count = 6;
+      auto last = (n + 1) * (n + 1) - 1;
+      mesh.indices.insert(mesh.indices.end(), {0, n, last, 0, last, last - n});
+    }
+    return mesh;
+  }
+
+  // A 4 x 4 wall facing the camera at z = 0
+  Mesh wall(uint32_t n = 1, bool coarse = false) {
+    return square(glm::vec3{-2, -2, 0}, glm::vec3{4, 0, 0}, glm::vec3{0, 4, 0}, n, coarse);
+  }
+
+  bool visible(const OcclusionCuller &culler, const glm::vec3 &center, float half) {
+    const float min[3] = {center.x - half, center.y - half, center.z - half};
+    const float max[3] = {center.x + half, center.y + half, center.z + half};
+    return culler.test(min, max);
+  }
+}
+
+TEST(Occlusion, NothingIsOccludedWithoutOccluders) {
+  OcclusionCuller culler;
+  culler.begin_frame(view(), projection());
+  culler.render_occluders();
+  EXPECT_EQ(culler.stats().num_occluders, 0u);
+  EXPECT_TRUE(visible(culler, glm::vec3{0, 0, -10}, 0.5f));
+
+  ObjectBounds bounds;
+  bounds.resize(1);
+  bounds.set(0, wall().bounds, glm::mat4{1.0f});
+  std::vector<uint32_t> objects{0};
+  EXPECT_EQ(culler.cull(bounds, objects), 0u);
+  EXPECT_EQ(objects.size(), 1u);
+}
+
+TEST(Occlusion, WallHidesOnlyWhatIsWhollyBehindIt) {
+  OcclusionOptions options;
+  options.width = WIDTH;
+  options.height = HEIGHT;
+  OcclusionCuller culler(options);
+  auto mesh = wall();
+  culler.begin_frame(view(), projection());
+  culler.add_occluder(mesh, glm::mat4{1.0f});
+  culler.render_occluders();
+  EXPECT_EQ(culler.stats().num_occluders, 1u);
+  EXPECT_EQ(culler.stats().num_occluder_triangles, 2u);
+
+  EXPECT_FALSE(visible(culler, glm::vec3{0, 0, -3}, 0.5f));
+  EXPECT_FALSE(visible(culler, glm::vec3{0.5f, -0.5f, -20}, 2.0f));
+  // In front
+  EXPECT_TRUE(visible(culler, glm::vec3{0, 0, 1}, 0.5f));
+  // Poking out past the side
+  EXPECT_TRUE(visible(culler, glm::vec3{3.5f, 0, -3}, 0.5f));
+  // Off to the side altogether
+  EXPECT_TRUE(visible(culler, glm::vec3{5, 0, -3}, 0.5f));
+  // The wall itself
+  EXPECT_TRUE(visible(culler, glm::vec3{0, 0, 0}, 2.0f));
+
+  // The same depth as the rasterizer gives
+  FrameBuffer frame{WIDTH, HEIGHT};
+  RasterPipeline pipeline;
+  auto mvp = projection() * view();
+  pipeline.vertex_shader = [&mvp](const float *p, float *) { return mvp * glm::vec4(p[0], p[1], p[2], 1.0f); };
+  pipeline.fragment_shader = [](const float *) { return glm::vec4{1.0f}; };
+  rasterize(pipeline, mesh.vertex_data.data(), 3, 4, mesh.indices.data(), 6, frame);
+  const auto &depth = culler.level(0);
+  size_t covered = 0;
+  for (size_t i = 0; i < depth.size(); ++i) {
+    EXPECT_NEAR(depth[i], frame.depth[i], 1e-5f) << "pixel " << i;
+    covered += depth[i] < 1.0f;
+  }
+  EXPECT_GT(covered, 0u);
+}
+
+TEST(Occlusion, OccludersThroughTheNearPlaneAreClipped) {
+  OcclusionCuller culler;
+  // A floor from behind the camera to far in front
+  auto floor = square(glm::vec3{-50, -1, 50}, glm::vec3{100, 0, 0}, glm::vec3{0, 0, -100}, 4);
+  culler.begin_frame(view(), projection());
+  culler.add_occluder(floor, glm::mat4{1.0f});
+  culler.render_occluders();
+  EXPECT_EQ(culler.stats().num_occluders, 1u);
+  EXPECT_GT(culler.stats().num_occluder_triangles, 0u);
+
+  EXPECT_FALSE(visible(culler, glm::vec3{0, -3, -5}, 0.5f));
+  EXPECT_TRUE(visible(culler, glm::vec3{0, 1, -5}, 0.5f));
+  // Reaching the near plane
+  EXPECT_TRUE(visible(culler, glm::vec3{0, -3, 5}, 0.5f));
+}
+
+TEST(Occlusion, PyramidTexelsAreTheFarthestBelow) {
+  OcclusionOptions options;
+  options.width = 100;
+  options.height = 37;
+  OcclusionCuller culler(options);
+  EXPECT_EQ(culler.options().width, 104u);
+  auto mesh = wall(3);
+  culler.begin_frame(view(), projection());
+  culler.add_occluder(mesh, glm::rotate(glm::mat4{1.0f}, 0.3f, glm::vec3{0, 1, 0}));
+  culler.render_occluders();
+
+  ASSERT_GT(culler.num_levels(), 1u);
+  EXPECT_EQ(culler.level_width(culler.num_levels() - 1), 1u);
+  EXPECT_EQ(culler.level_height(culler.num_levels() - 1), 1u);
+  for (size_t l = 1; l < culler.num_levels(); ++l) {
+    const auto &below = culler.level(l - 1), &level = culler.level(l);
+    const auto below_w = culler.level_width(l - 1), w = culler.level_width(l);
+    for (uint32_t y = 0; y < culler.level_height(l - 1); ++y) {
+      for (uint32_t x = 0; x < below_w; ++x) {
+        EXPECT_GE(level[(y / 2) * w + x / 2], below[y * below_w + x]) << "level " << l;
+      }
+    }
+  }
+  EXPECT_EQ(culler.level(culler.num_levels() - 1)[0], 1.0f);
+}
+
+TEST(Occlusion, OccludersAreChosenBySizeAndDrawnCoarse) {
+  OcclusionOptions options;
+  options.max_occluders = 1;
+  options.occluder_triangles = 4;
+  OcclusionCuller culler(options);
+  auto near_wall = wall(8, true);
+  auto far_wall = wall(8, true);
+  auto tiny = square(glm::vec3{0, 0, 0}, glm::vec3{0.01f, 0, 0}, glm::vec3{0, 0.01f, 0}, 1);
+
+  culler.begin_frame(view(), projection());
+  culler.add_occluder(tiny, glm::mat4{1.0f});
+  culler.add_occluder(far_wall, glm::translate(glm::mat4{1.0f}, glm::vec3{0, 0, -20}));
+  culler.add_occluder(near_wall, glm::translate(glm::mat4{1.0f}, glm::vec3{3, 0, 0}));
+  culler.render_occluders();
+  EXPECT_EQ(culler.stats().num_occluders, 1u);
+  EXPECT_EQ(culler.stats().num_occluder_triangles, 2u);
+
+  // Only the near wall was drawn
+  EXPECT_FALSE(visible(culler, glm::vec3{3, 0, -3}, 0.5f));
+  EXPECT_TRUE(visible(culler, glm::vec3{0, 0, -30}, 0.5f));
+
+  // Meshes with no CPU copy can't be drawn
+  near_wall.vertex_data.clear();
+  culler.begin_frame(view(), projection());
+  culler.add_occluder(near_wall, glm::mat4{1.0f});
+  culler.render_occluders();
+  EXPECT_EQ(culler.stats().num_occluders, 0u);
+}
+
+TEST(Occlusion, CullKeepsTheOrderOfWhatIsLeft) {
+  OcclusionCuller culler;
+  auto mesh = wall();
+  Bounds box;
+  for (auto k = 0; k < 3; ++k) {
+    box.min[k] = -0.5f;
+    box.max[k] = 0.5f;
+  }
+  box.radius = std::sqrt(0.75f);
+  const glm::vec3 centers[] = {{0, 0, 2}, {0, 0, -3}, {4, 0, -3}, {-0.5f, 0.5f, -6}, {0, 0, 0}};
+  ObjectBounds bounds;
+  bounds.resize(5);
+  for (auto i = 0; i < 5; ++i) bounds.set(i, box, glm::translate(glm::mat4{1.0f}, centers[i]));
+
+  culler.begin_frame(view(), projection());
+  culler.add_occluder(mesh, glm::mat4{1.0f});
+  culler.render_occluders();
+  std::vector<uint32_t> objects{0, 1, 2, 3, 4};
+  EXPECT_EQ(culler.cull(bounds, objects), 2u);
+  EXPECT_EQ(objects, (std::vector<uint32_t>{0, 2, 4}));
+  EXPECT_EQ(culler.stats().num_tested, 5u);
+  EXPECT_EQ(culler.stats().num_occluded, 2u);
+  EXPECT_GE(culler.stats().test_ms, 0.0);
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
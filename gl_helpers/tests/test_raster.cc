@@ -0,0 +1,157 @@
+#include "gtest/gtest.h"
+#include "raster.h"
+#include "mesh_internal.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace {
+  // Positions go straight through as clip space; colour is a constant
+  RasterPipeline flat_pipeline(const glm::vec4 &colour) {
+    RasterPipeline pipeline;
+    pipeline.vertex_shader = [](const float *v, float *) { return glm::vec4{v[0], v[1], v[2], 1.0f}; };
+    pipeline.fragment_shader = [colour](const float *) { return colour; };
+    return pipeline;
+  }
+
+  const glm::vec4 RED{1, 0, 0, 1};
+  const glm::vec4 GREEN{0, 1, 0, 1};
+}
+
+TEST(TestRaster, triangles_sharing_edges_shade_each_pixel_once) {
+  // A fan of triangles about an off centre point covering the whole of an odd sized frame
+  std::vector<float> vertices{0.13f, -0.27f, 0};
+  std::vector<uint32_t> indices;
+  const float rim[][2] = {{-1, -1}, {0.2f, -1}, {1, -1}, {1, 0.31f}, {1, 1}, {-0.45f, 1}, {-1, 1}, {-1, -0.6f}};
+  for (auto i = 0; i < 8; ++i) {
+    vertices.insert(vertices.end(), {rim[i][0], rim[i][1], 0});
+    indices.insert(indices.end(), {0u, static_cast<uint32_t>(1 + i), static_cast<uint32_t>(1 + (i + 1) % 8)});
+  }
+
+  FrameBuffer frame{67, 45};
+  std::atomic<size_t> fragments{0};
+  auto pipeline = flat_pipeline(RED);
+  pipeline.depth_test = false;
+  pipeline.fragment_shader = [&fragments](const float *) {
+    ++fragments;
+    return RED;
+  };
+  rasterize(pipeline, vertices.data(), 3, vertices.size() / 3, indices.data(), indices.size(), frame);
+  EXPECT_EQ(67u * 45u, fragments.load());
+}
+
+TEST(TestRaster, depth_test_keeps_nearest_in_either_order) {
+  const std::vector<float> far_quad{-1, -1, 0.5f, 1, -1, 0.5f, 1, 1, 0.5f, -1, 1, 0.5f};
+  const std::vector<float> near_quad{-0.5f, -0.5f, -0.5f, 0.5f, -0.5f, -0.5f, 0.5f, 0.5f, -0.5f, -0.5f, 0.5f, -0.5f};
+  const std::vector<uint32_t> indices{0, 1, 2, 0, 2, 3};
+
+  FrameBuffer near_last{32, 32}, near_first{32, 32};
+  rasterize(flat_pipeline(RED), far_quad.data(), 3, 4, indices.data(), 6, near_last);
+  rasterize(flat_pipeline(GREEN), near_quad.data(), 3, 4, indices.data(), 6, near_last);
+  rasterize(flat_pipeline(GREEN), near_quad.data(), 3, 4, indices.data(), 6, near_first);
+  rasterize(flat_pipeline(RED), far_quad.data(), 3, 4, indices.data(), 6, near_first);
+
+  EXPECT_EQ(0u, count_differing_pixels(near_last, near_first));
+  EXPECT_EQ(0xff00ff00u, near_first.colour[16 * 32 + 16]);
+  EXPECT_EQ(0xff0000ffu, near_first.colour[0]);
+  EXPECT_FLOAT_EQ(0.25f, near_first.depth[16 * 32 + 16]);
+}
+
+TEST(TestRaster, clockwise_triangles_are_culled_when_asked) {
+  const std::vector<float> vertices{-1, -1, 0, 1, -1, 0, 0, 1, 0};
+  const std::vector<uint32_t> counter_clockwise{0, 1, 2}, clockwise{0, 2, 1};
+
+  auto pipeline = flat_pipeline(RED);
+  pipeline.cull_back_faces = true;
+  FrameBuffer front{16, 16}, back{16, 16}, blank{16, 16};
+  rasterize(pipeline, vertices.data(), 3, 3, counter_clockwise.data(), 3, front);
+  rasterize(pipeline, vertices.data(), 3, 3, clockwise.data(), 3, back);
+  EXPECT_GT(count_differing_pixels(front, blank), 0u);
+  EXPECT_EQ(0u, count_differing_pixels(back, blank));
+}
+
+TEST(TestRaster, varyings_are_perspective_correct) {
+  // A floor receding from the camera and crossing the near plane, red from 0 to 1 along x
+  const std::vector<float> vertices{-4, -1, 1, 4, -1, 1, 4, -1, -40, -4, -1, -40};
+  const std::vector<uint32_t> indices{0, 1, 2, 0, 2, 3};
+  const auto mvp = glm::perspective(glm::radians(60.0f), 1.0f, 0.5f, 100.0f);
+
+  RasterPipeline pipeline;
+  pipeline.num_varyings = 1;
+  pipeline.vertex_shader = [&mvp](const float *v, float *out) {
+    out[0] = (v[0] + 4) / 8;
+    return mvp * glm::vec4{v[0], v[1], v[2], 1.0f};
+  };
+  pipeline.fragment_shader = [](const float *in) { return glm::vec4{in[0], 0, 0, 1}; };
+  FrameBuffer frame{64, 64};
+  frame.clear(glm::vec4{0, 0, 1, 1});
+  rasterize(pipeline, vertices.data(), 3, 4, indices.data(), 6, frame);
+
+  // Unprojecting each pixel centre at its depth finds the point on the floor it shows
+  const auto unproject = glm::inverse(mvp);
+  size_t checked = 0;
+  for (uint32_t y = 0; y < frame.height; ++y) {
+    for (uint32_t x = 0; x < frame.width; ++x) {
+      auto i = y * frame.width + x;
+      if (frame.depth[i] == 1.0f) continue;
+      glm::vec4 ndc{(x + 0.5f) / 32 - 1, 1 - (y + 0.5f) / 32, frame.depth[i] * 2 - 1, 1};
+      auto p = unproject * ndc;
+      auto expected = (p.x / p.w + 4) / 8;
+      EXPECT_NEAR(expected * 255, static_cast<float>(frame.colour[i] & 0xff), 1.5f) << x << ", " << y;
+      ++checked;
+    }
+  }
+  EXPECT_GT(checked, 64u * 16u);
+}
+
+TEST(TestRaster, ppm_round_trip) {
+  FrameBuffer frame{5, 3};
+  for (size_t i = 0; i < frame.colour.size(); ++i) frame.colour[i] = 0xff000000u | static_cast<uint32_t>(i * 0x030507);
+  const std::string file_name = "test_raster_round_trip.ppm";
+  ASSERT_TRUE(write_ppm(file_name, frame));
+  FrameBuffer read;
+  ASSERT_TRUE(read_ppm(file_name, read));
+  std::remove(file_name.c_str());
+  EXPECT_EQ(5u, read.width);
+  EXPECT_EQ(3u, read.height);
+  EXPECT_EQ(0u, count_differing_pixels(frame, read));
+  read.colour[7] ^= 0x10;
+  EXPECT_EQ(1u, count_differing_pixels(frame, read));
+  EXPECT_EQ(0u, count_differing_pixels(frame, read, 0x10));
+}
+
+TEST(TestRaster, head_renders_the_same_every_time) {
+  std::ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
+  RawMeshData raw;
+  ASSERT_TRUE(parse_raw_data(in, raw, false, false));
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  ASSERT_TRUE(build_vertex_data(raw, vertex_data, indices, false, false, false));
+
+  // Shaded by depth so that hidden surfaces showing through would change the image
+  const auto mvp = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f)
+                   * glm::lookAt(glm::vec3{0, 0, 3}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0});
+  RasterPipeline pipeline;
+  pipeline.num_varyings = 1;
+  pipeline.vertex_shader = [&mvp](const float *v, float *out) {
+    out[0] = (v[2] + 1) * 0.5f;
+    return mvp * glm::vec4{v[0], v[1], v[2], 1.0f};
+  };
+  pipeline.fragment_shader = [](const float *in) { return glm::vec4{in[0], in[0], in[0], 1}; };
+
+  FrameBuffer first{200, 150}, second{200, 150}, blank{200, 150};
+  rasterize(pipeline, vertex_data.data(), 3, vertex_data.size() / 3, indices.data(), indices.size(), first);
+  rasterize(pipeline, vertex_data.data(), 3, vertex_data.size() / 3, indices.data(), indices.size(), second);
+  EXPECT_EQ(0u, count_differing_pixels(first, second));
+  // The head fills a good part of the middle of the frame
+  EXPECT_GT(count_differing_pixels(first, blank), 200u * 150u / 8);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
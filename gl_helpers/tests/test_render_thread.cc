@@ -0,0 +1,67 @@
+#include "gtest/gtest.h"
+#include "render_thread.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+TEST(TestRenderThread, execute_runs_on_the_render_thread) {
+  std::thread::id current;
+  RenderThread renderer([&current]() { current = std::this_thread::get_id(); }, []() {});
+
+  std::thread::id first, second;
+  renderer.execute([&first]() { first = std::this_thread::get_id(); });
+  renderer.execute([&second]() { second = std::this_thread::get_id(); });
+  EXPECT_NE(std::this_thread::get_id(), first);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(current, first);
+}
+
+TEST(TestRenderThread, every_frame_is_presented_in_order) {
+  std::vector<uint64_t> presented;
+  {
+    uint64_t replaying = 0;
+    RenderThread renderer([]() {}, [&presented, &replaying]() { presented.push_back(replaying++); });
+    for (uint64_t i = 0; i < 10; ++i) {
+      auto &frame = renderer.begin_frame();
+      EXPECT_EQ(i, frame.number);
+      frame.lists.resize(2);
+      renderer.submit();
+    }
+    // Runs after the frames already submitted
+    renderer.execute([&presented]() { EXPECT_EQ(10u, presented.size()); });
+    EXPECT_EQ(10u, renderer.frames_presented());
+  }
+  ASSERT_EQ(10u, presented.size());
+  for (uint64_t i = 0; i < 10; ++i) EXPECT_EQ(i, presented[i]);
+}
+
+TEST(TestRenderThread, next_frame_is_recorded_while_one_is_presented) {
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::atomic<int> presents{0};
+  RenderThread renderer([]() {}, [released, &presents]() {
+    // The first frame is held up until the test lets it go
+    if (presents++ == 0) released.wait();
+  });
+
+  auto *first = &renderer.begin_frame();
+  renderer.submit();
+  // The other frame is free to record into while the first is held
+  auto *second = &renderer.begin_frame();
+  EXPECT_NE(first, second);
+  renderer.submit();
+
+  // A third must wait for the first to be done with
+  auto third = std::async(std::launch::async, [&renderer]() { return &renderer.begin_frame(); });
+  EXPECT_EQ(std::future_status::timeout, third.wait_for(std::chrono::milliseconds(50)));
+  release.set_value();
+  EXPECT_EQ(first, third.get());
+  renderer.submit();
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,131 @@
+#include "gtest/gtest.h"
+#include "simplify.h"
+#include "mesh_internal.h"
+
+#include <algorithm>
+#include <fstream>
+
+class TestSimplify : public ::testing::Test {
+};
+
+namespace {
+  /*
+   * A flat n x n grid of quads in z=0 with positions and a u coordinate.
+   * When seam is set the column x = n/2 is duplicated with a different u,
+   * splitting the grid into two UV charts.
+   */
+  void make_grid(uint32_t n, bool seam, std::vector<float> &vertices, std::vector<uint32_t> &indices) {
+    const auto stride = 4;
+    auto add = [&vertices](float x, float y, float u) {
+      vertices.push_back(x);
+      vertices.push_back(y);
+      vertices.push_back(0);
+      vertices.push_back(u);
+    };
+    for (uint32_t y = 0; y <= n; ++y) {
+      for (uint32_t x = 0; x <= n; ++x) add(x, y, x);
+    }
+    const auto seam_base = static_cast<uint32_t>(vertices.size() / stride);
+    if (seam) {
+      for (uint32_t y = 0; y <= n; ++y) add(n / 2, y, 100);
+    }
+    auto at = [n, seam, seam_base](uint32_t x, uint32_t y, bool right_chart) {
+      return (seam && x == n / 2 && right_chart) ? seam_base + y : y * (n + 1) + x;
+    };
+    for (uint32_t y = 0; y < n; ++y) {
+      for (uint32_t x = 0; x < n; ++x) {
+        auto right = x >= n / 2;
+        auto a = at(x, y, right), b = at(x + 1, y, right), c = at(x + 1, y + 1, right), d = at(x, y + 1, right);
+        indices.insert(indices.end(), {a, b, c, a, c, d});
+      }
+    }
+  }
+}
+
+TEST_F(TestSimplify, flat_grid_reduces_with_no_error) {
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices, result;
+  make_grid(20, false, vertices, indices);
+
+  auto error = simplify_mesh(vertices.data(), vertices.size() / 4, 4,
+                             indices.data(), indices.size(),
+                             indices.size() / 4, 1.0f, result);
+  EXPECT_LE(result.size(), indices.size() / 4);
+  EXPECT_EQ(0, result.size() % 3);
+  EXPECT_NEAR(0.0f, error, 1e-5);
+}
+
+TEST_F(TestSimplify, borders_and_seams_are_kept) {
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices, result;
+  make_grid(20, true, vertices, indices);
+
+  simplify_mesh(vertices.data(), vertices.size() / 4, 4,
+                indices.data(), indices.size(),
+                0, 1.0f, result);
+  EXPECT_LT(result.size(), indices.size());
+  // Every vertex on the outer border and both sides of the seam survives
+  auto used = [&result](uint32_t v) { return std::find(result.begin(), result.end(), v) != result.end(); };
+  for (uint32_t i = 0; i <= 20; ++i) {
+    EXPECT_TRUE(used(i));
+    EXPECT_TRUE(used(20 * 21 + i));
+    EXPECT_TRUE(used(i * 21));
+    EXPECT_TRUE(used(i * 21 + 20));
+    EXPECT_TRUE(used(i * 21 + 10));
+    EXPECT_TRUE(used(21 * 21 + i));
+  }
+}
+
+TEST_F(TestSimplify, target_above_input_is_a_copy) {
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices, result;
+  make_grid(4, false, vertices, indices);
+
+  auto error = simplify_mesh(vertices.data(), vertices.size() / 4, 4,
+                             indices.data(), indices.size(),
+                             indices.size(), 1.0f, result);
+  EXPECT_EQ(indices, result);
+  EXPECT_EQ(0.0f, error);
+}
+
+TEST_F(TestSimplify, lod_chain_for_real_file) {
+  using namespace std;
+
+  RawMeshData raw;
+  ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
+  ASSERT_TRUE(parse_raw_data(in, raw, true, true));
+
+  vector<float> vertex_data;
+  vector<uint32_t> indices;
+  vector<SubMesh> submeshes;
+  ASSERT_TRUE(build_vertex_data(raw, vertex_data, indices, true, true, false, &submeshes));
+  const auto full = indices.size();
+
+  vector<MeshLod> lods;
+  build_lods(vertex_data, 8, indices, submeshes, {0.5f, 0.25f, 0.1f, 0.02f}, lods);
+  ASSERT_EQ(5, lods.size());
+  EXPECT_EQ(full, lods[0].submeshes[0].index_count);
+  for (size_t l = 1; l < lods.size(); ++l) {
+    const auto &sm = lods[l].submeshes[0];
+    EXPECT_LT(sm.index_count, lods[l - 1].submeshes[0].index_count);
+    EXPECT_GE(lods[l].error, lods[l - 1].error);
+    EXPECT_LE(sm.index_offset + sm.index_count, indices.size());
+  }
+  EXPECT_LE(lods[1].submeshes[0].index_count, full / 2 + 3);
+}
+
+TEST_F(TestSimplify, select_lod_coarsens_with_distance) {
+  Mesh mesh;
+  mesh.lods.resize(3);
+  mesh.lods[1].error = 0.01f;
+  mesh.lods[2].error = 0.1f;
+
+  EXPECT_EQ(0, select_lod(mesh, 1.0f, 1000.0f));
+  EXPECT_EQ(1, select_lod(mesh, 20.0f, 1000.0f));
+  EXPECT_EQ(2, select_lod(mesh, 200.0f, 1000.0f));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+#include "texture.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+  std::vector<uint8_t> tga_header(uint8_t image_type, uint16_t width, uint16_t height, uint8_t bits,
+                                  uint8_t descriptor = 0) {
+    std::vector<uint8_t> h(18, 0);
+    h[2] = image_type;
+    h[12] = width & 0xff;
+    h[13] = width >> 8;
+    h[14] = height & 0xff;
+    h[15] = height >> 8;
+    h[16] = bits;
+    h[17] = descriptor;
+    return h;
+  }
+}
+
+TEST(TestTexture, decodes_bottom_up_tga_as_rgb) {
+  auto tga = tga_header(2, 2, 2, 24);
+  // BGR, bottom row first
+  const uint8_t pixels[]{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  tga.insert(tga.end(), pixels, pixels + sizeof(pixels));
+
+  Image image;
+  ASSERT_TRUE(decode_tga(tga.data(), tga.size(), image));
+  EXPECT_EQ(2u, image.width);
+  EXPECT_EQ(2u, image.height);
+  EXPECT_EQ(3u, image.channels);
+  std::vector<uint8_t> expected{3, 2, 1, 6, 5, 4, 9, 8, 7, 12, 11, 10};
+  EXPECT_EQ(expected, image.pixels);
+}
+
+TEST(TestTexture, top_down_tga_is_flipped) {
+  auto tga = tga_header(3, 1, 3, 8, 0x20);
+  const uint8_t pixels[]{10, 20, 30};
+  tga.insert(tga.end(), pixels, pixels + sizeof(pixels));
+
+  Image image;
+  ASSERT_TRUE(decode_tga(tga.data(), tga.size(), image));
+  EXPECT_EQ(1u, image.channels);
+  std::vector<uint8_t> expected{30, 20, 10};
+  EXPECT_EQ(expected, image.pixels);
+}
+
+TEST(TestTexture, decodes_run_length_encoded_tga) {
+  auto tga = tga_header(10, 3, 2, 32);
+  // A run of four pixels crossing the row end, then two literal pixels
+  const uint8_t packets[]{0x83, 1, 2, 3, 4,
+                          0x01, 5, 6, 7, 8, 9, 10, 11, 12};
+  tga.insert(tga.end(), packets, packets + sizeof(packets));
+
+  Image image;
+  ASSERT_TRUE(decode_tga(tga.data(), tga.size(), image));
+  EXPECT_EQ(4u, image.channels);
+  std::vector<uint8_t> expected{3, 2, 1, 4, 3, 2, 1, 4, 3, 2, 1, 4,
+                                3, 2, 1, 4, 7, 6, 5, 8, 11, 10, 9, 12};
+  EXPECT_EQ(expected, image.pixels);
+}
+
+TEST(TestTexture, rejects_bad_tga) {
+  Image image;
+  auto truncated = tga_header(2, 4, 4, 24);
+  truncated.resize(truncated.size() + 10);
+  EXPECT_FALSE(decode_tga(truncated.data(), truncated.size(), image));
+
+  auto colour_mapped = tga_header(1, 1, 1, 8);
+  colour_mapped[1] = 1;
+  colour_mapped.push_back(0);
+  EXPECT_FALSE(decode_tga(colour_mapped.data(), colour_mapped.size(), image));
+
+  auto rle_truncated = tga_header(10, 4, 1, 24);
+  rle_truncated.push_back(0x03);
+  rle_truncated.push_back(1);
+  EXPECT_FALSE(decode_tga(rle_truncated.data(), rle_truncated.size(), image));
+}
+
+TEST(TestTexture, decodes_ppm_with_comments) {
+  std::string ppm = "P6\n# made by hand\n2 1\n255\n";
+  const char pixels[]{1, 2, 3, 4, 5, 6};
+  ppm.append(pixels, sizeof(pixels));
+
+  Image image;
+  ASSERT_TRUE(decode_ppm(reinterpret_cast<const uint8_t *>(ppm.data()), ppm.size(), image));
+  EXPECT_EQ(2u, image.width);
+  EXPECT_EQ(1u, image.height);
+  EXPECT_EQ(3u, image.channels);
+  std::vector<uint8_t> expected{1, 2, 3, 4, 5, 6};
+  EXPECT_EQ(expected, image.pixels);
+
+  std::string short_ppm = "P5 4 4 255\n1234";
+  EXPECT_FALSE(decode_ppm(reinterpret_cast<const uint8_t *>(short_ppm.data()), short_ppm.size(), image));
+}
+
+TEST(TestTexture, mips_halve_down_to_one_texel) {
+  std::vector<Image> levels(1);
+  auto &base = levels[0];
+  base.width = 5;
+  base.height = 3;
+  base.channels = 1;
+  base.pixels.assign(15, 0);
+  // Top left 2x2 block of the bottom two rows
+  base.pixels[0] = 100;
+  base.pixels[1] = 200;
+  base.pixels[5] = 40;
+  base.pixels[6] = 60;
+
+  build_mips(levels);
+  ASSERT_EQ(3u, levels.size());
+  EXPECT_EQ(2u, levels[1].width);
+  EXPECT_EQ(1u, levels[1].height);
+  EXPECT_EQ(1u, levels[2].width);
+  EXPECT_EQ(1u, levels[2].height);
+  EXPECT_EQ(100, levels[1].pixels[0]);
+  EXPECT_EQ(0, levels[1].pixels[1]);
+  EXPECT_EQ(50, levels[2].pixels[0]);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
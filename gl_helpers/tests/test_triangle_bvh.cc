@@ -0,0 +1,152 @@
+#include "gtest/gtest.h"
+#include "triangle_bvh.h"
+#include "mesh_internal.h"
+
+#include <cmath>
+#include <fstream>
+#include <random>
+
+class TestTriangleBvh : public ::testing::Test {
+public:
+  void SetUp() override {
+    std::ifstream in("/Users/dave/CLionProjects/utah_icg/gl_helpers/tests/african_head.obj");
+    ASSERT_TRUE(parse_raw_data(in, raw, false, false));
+    ASSERT_TRUE(build_vertex_data(raw, vertex_data, indices, false, false, false));
+    build_triangle_bvh(vertex_data.data(), 3, indices.data(), indices.size(), triangle_bvh);
+
+    // Rays from a sphere around the head aimed at random points inside it, so most hit
+    std::mt19937 rng{5};
+    std::uniform_real_distribution<float> unit{-1.0f, 1.0f};
+    for (auto i = 0; i < 2000; ++i) {
+      glm::vec3 from{unit(rng), unit(rng), unit(rng)};
+      glm::vec3 to{unit(rng) * 0.5f, unit(rng) * 0.5f, unit(rng) * 0.5f};
+      origins.push_back(glm::normalize(from) * 3.0f);
+      directions.push_back(to - origins.back());
+    }
+  }
+
+  // Nearest hit found by testing every triangle
+  bool brute_force(const glm::vec3 &o, const glm::vec3 &d, uint32_t &triangle, float &distance) {
+    triangle = NO_HIT;
+    distance = 1e30f;
+    for (size_t t = 0; t < indices.size() / 3; ++t) {
+      auto p0 = position(indices[3 * t]);
+      auto e1 = position(indices[3 * t + 1]) - p0;
+      auto e2 = position(indices[3 * t + 2]) - p0;
+      auto p = glm::cross(d, e2);
+      auto det = glm::dot(e1, p);
+      if (std::fabs(det) < 1e-30f) continue;
+      auto s = o - p0;
+      auto u = glm::dot(s, p) / det;
+      auto q = glm::cross(s, e1);
+      auto v = glm::dot(d, q) / det;
+      auto dist = glm::dot(e2, q) / det;
+      if (u < 0 || v < 0 || u + v > 1 || dist < 0 || dist >= distance) continue;
+      distance = dist;
+      triangle = t;
+    }
+    return triangle != NO_HIT;
+  }
+
+  glm::vec3 position(uint32_t v) const {
+    return {vertex_data[3 * v], vertex_data[3 * v + 1], vertex_data[3 * v + 2]};
+  }
+
+  RawMeshData raw;
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  TriangleBvh triangle_bvh;
+  std::vector<glm::vec3> origins;
+  std::vector<glm::vec3> directions;
+};
+
+TEST_F(TestTriangleBvh, every_triangle_is_in_one_leaf) {
+  const auto num_triangles = indices.size() / 3;
+  ASSERT_EQ(num_triangles, triangle_bvh.bvh.indices.size());
+  ASSERT_EQ(9 * num_triangles, triangle_bvh.triangles.size());
+  std::vector<bool> seen(num_triangles, false);
+  for (auto t: triangle_bvh.bvh.indices) {
+    EXPECT_FALSE(seen[t]);
+    seen[t] = true;
+  }
+}
+
+TEST_F(TestTriangleBvh, single_rays_match_brute_force) {
+  size_t hits = 0;
+  for (size_t i = 0; i < origins.size(); ++i) {
+    uint32_t expected;
+    float expected_distance;
+    auto expect_hit = brute_force(origins[i], directions[i], expected, expected_distance);
+    RayHit hit;
+    ASSERT_EQ(expect_hit, raycast(triangle_bvh, origins[i], directions[i], hit));
+    if (!expect_hit) continue;
+    ++hits;
+    // Ties between triangles sharing an edge may go either way; the distance may not
+    EXPECT_NEAR(expected_distance, hit.distance, 1e-5f);
+  }
+  EXPECT_GT(hits, origins.size() / 2);
+}
+
+TEST_F(TestTriangleBvh, packets_match_single_rays) {
+  std::vector<RayHit> hits(origins.size());
+  raycast(triangle_bvh, origins.data(), directions.data(), origins.size(), hits.data());
+  for (size_t i = 0; i < origins.size(); ++i) {
+    RayHit hit;
+    raycast(triangle_bvh, origins[i], directions[i], hit);
+    ASSERT_EQ(hit.triangle, hits[i].triangle);
+    if (hit.triangle == NO_HIT) continue;
+    EXPECT_FLOAT_EQ(hit.distance, hits[i].distance);
+    EXPECT_FLOAT_EQ(hit.u, hits[i].u);
+    EXPECT_FLOAT_EQ(hit.v, hits[i].v);
+  }
+}
+
+TEST_F(TestTriangleBvh, barycentrics_give_the_hit_point) {
+  for (size_t i = 0; i < origins.size(); ++i) {
+    RayHit hit;
+    if (!raycast(triangle_bvh, origins[i], directions[i], hit)) continue;
+    auto t = hit.triangle;
+    auto on_triangle = (1.0f - hit.u - hit.v) * position(indices[3 * t])
+                       + hit.u * position(indices[3 * t + 1])
+                       + hit.v * position(indices[3 * t + 2]);
+    auto on_ray = origins[i] + hit.distance * directions[i];
+    EXPECT_NEAR(0.0f, glm::length(on_triangle - on_ray), 1e-4f);
+  }
+}
+
+TEST(TestTriangleBvhFaces, rays_along_a_box_face_hit_on_every_isa) {
+  // A unit square at z = 0.5, so its box is flat in z and its sides are box faces
+  const std::vector<float> vertex_data{0, 0, 0.5f, 1, 0, 0.5f, 1, 1, 0.5f, 0, 1, 0.5f};
+  const std::vector<uint32_t> indices{0, 1, 2, 0, 2, 3};
+  TriangleBvh triangle_bvh;
+  build_triangle_bvh(vertex_data.data(), 3, indices.data(), indices.size(), triangle_bvh);
+
+  // Rays with a zero direction component starting on a face plane take 0 * inf, which mustn't decide the test
+  std::vector<glm::vec3> origins, directions;
+  for (auto side: {0.0f, 1.0f}) {
+    for (auto zero: {0.0f, -0.0f}) {
+      origins.emplace_back(side, 0.3f, -1.0f);
+      directions.emplace_back(zero, zero, 1.0f);
+      origins.emplace_back(0.3f, side, 2.0f);
+      directions.emplace_back(zero, zero, -1.0f);
+    }
+  }
+  std::vector<RayHit> hits(origins.size());
+  raycast(triangle_bvh, origins.data(), directions.data(), origins.size(), hits.data());
+  for (size_t i = 0; i < origins.size(); ++i) {
+    RayHit hit;
+    ASSERT_TRUE(raycast(triangle_bvh, origins[i], directions[i], hit)) << "ray " << i;
+    EXPECT_FLOAT_EQ(1.5f, hit.distance);
+    EXPECT_NE(NO_HIT, hits[i].triangle) << "ray " << i;
+    EXPECT_FLOAT_EQ(1.5f, hits[i].distance);
+  }
+
+  // Just outside a face is still a miss
+  RayHit hit;
+  EXPECT_FALSE(raycast(triangle_bvh, glm::vec3(1.001f, 0.3f, -1.0f), glm::vec3(0, 0, 1), hit));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
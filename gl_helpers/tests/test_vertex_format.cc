@@ -0,0 +1,116 @@
+#include "gtest/gtest.h"
+#include "vertex_format.h"
+#include "mesh_internal.h"
+
+using namespace vertex_attribute;
+
+namespace {
+  // Records the format dispatch_vertex_format picked
+  struct FormatOf {
+    uint32_t &stride;
+    uint32_t &num_attributes;
+
+    template<typename Format>
+    bool operator()(Format) const {
+      stride = Format::STRIDE;
+      num_attributes = Format::NUM_ATTRIBUTES;
+      return true;
+    }
+  };
+
+  // Lists the attribute offsets of a format in order
+  struct Offsets {
+    std::vector<uint32_t> offsets;
+
+    template<typename Attribute>
+    void operator()(Attribute, uint32_t offset) {
+      offsets.push_back(offset);
+    }
+  };
+}
+
+TEST(VertexFormat, StrideAndOffsetsFollowTheAttributeList) {
+  typedef VertexFormat<Position, Normal, TexCoord, Tangent> Full;
+  static_assert(Full::STRIDE == 12, "stride");
+  static_assert(Full::offset<Position>() == 0, "position");
+  static_assert(Full::offset<Normal>() == 3, "normal");
+  static_assert(Full::offset<TexCoord>() == 6, "tex coord");
+  static_assert(Full::offset<Tangent>() == 8, "tangent");
+  static_assert(VertexFormat<Position, TexCoord>::offset<TexCoord>() == 3, "tex coord without normals");
+  static_assert(VertexFormat<Position, TexCoord>::has<TexCoord>(), "has");
+  static_assert(!VertexFormat<Position, TexCoord>::has<Normal>(), "hasn't");
+
+  Offsets offsets;
+  Full::for_each_attribute(offsets);
+  EXPECT_EQ((std::vector<uint32_t>{0, 3, 6, 8}), offsets.offsets);
+}
+
+TEST(VertexFormat, DispatchPicksTheFormatOfTheFlags) {
+  uint32_t stride = 0, num_attributes = 0;
+  FormatOf format{stride, num_attributes};
+  ASSERT_TRUE(dispatch_vertex_format(false, false, false, format));
+  EXPECT_EQ(3u, stride);
+  EXPECT_EQ(1u, num_attributes);
+  ASSERT_TRUE(dispatch_vertex_format(true, false, false, format));
+  EXPECT_EQ(6u, stride);
+  ASSERT_TRUE(dispatch_vertex_format(false, true, false, format));
+  EXPECT_EQ(5u, stride);
+  ASSERT_TRUE(dispatch_vertex_format(true, true, false, format));
+  EXPECT_EQ(8u, stride);
+  ASSERT_TRUE(dispatch_vertex_format(true, true, true, format));
+  EXPECT_EQ(12u, stride);
+  EXPECT_EQ(4u, num_attributes);
+
+  // Tangents only follow normals and tex coords
+  EXPECT_FALSE(dispatch_vertex_format(true, false, true, format));
+  EXPECT_EQ(0u, vertex_stride(false, true, true));
+  EXPECT_EQ(8u, vertex_stride(true, true, false));
+}
+
+TEST(VertexFormat, BuiltVerticesInterleaveInFormatOrder) {
+  RawMeshData raw;
+  raw.pos_x = {0, 1, 0};
+  raw.pos_y = {0, 0, 1};
+  raw.pos_z = {0, 0, 0};
+  raw.norm_x = {0};
+  raw.norm_y = {0};
+  raw.norm_z = {1};
+  raw.tex_u = {0.25f, 0.5f};
+  raw.tex_v = {0.75f, 1.0f};
+  // Two triangles over the same vertices, the second with other tex coords
+  raw.corner_vertex = {0, 1, 2, 0, 1, 2};
+  raw.corner_normal = {0, 0, 0, 0, 0, 0};
+  raw.corner_tex = {0, 0, 0, 1, 1, 0};
+  raw.face_offsets = {0, 3, 6};
+  raw.triangles = {0, 1, 2, 3, 4, 5};
+
+  std::vector<float> vertex_data;
+  std::vector<uint32_t> indices;
+  ASSERT_TRUE(build_vertex_data(raw, vertex_data, indices, true, true, false));
+  typedef VertexFormat<Position, Normal, TexCoord> Format;
+  ASSERT_EQ(5 * Format::STRIDE, vertex_data.size());
+  EXPECT_EQ((std::vector<uint32_t>{0, 1, 2, 3, 4, 2}), indices);
+
+  const auto *v = &vertex_data[4 * Format::STRIDE];
+  EXPECT_EQ(1.0f, v[Format::offset<Position>()]);
+  EXPECT_EQ(1.0f, v[Format::offset<Normal>() + 2]);
+  EXPECT_EQ(0.5f, v[Format::offset<TexCoord>()]);
+  EXPECT_EQ(1.0f, v[Format::offset<TexCoord>() + 1]);
+
+  // Without tex coords the corners collapse back onto the three vertices
+  ASSERT_TRUE(build_vertex_data(raw, vertex_data, indices, true, false, false));
+  EXPECT_EQ(3 * (VertexFormat<Position, Normal>::STRIDE), vertex_data.size());
+  EXPECT_EQ((std::vector<uint32_t>{0, 1, 2, 0, 1, 2}), indices);
+
+  raw.corner_tangent = {0, 0, 0, 0, 0, 0};
+  raw.tan_x = {1};
+  raw.tan_y = {0};
+  raw.tan_z = {0};
+  raw.tan_w = {1};
+  EXPECT_FALSE(build_vertex_data(raw, vertex_data, indices, false, true, true));
+}
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,95 @@
+/*
+ * Bake a directory of OBJ, PLY and glB meshes into .mesh files, so that
+ * loading them at run time never parses text, dedups vertices or generates
+ * normals. Only sources that changed, or were baked with other options,
+ * since the last bake into the same output directory are baked again.
+ *
+ * usage: mesh_bake [-n] [-t] [-g] [-f] [-p bits] [-a bits] asset_dir output_dir
+ *   -n  include normals, generated for files that have none
+ *   -t  include tex coords
+ *   -g  include tangents; needs -n and -t
+ *   -f  bake every source, even those that are up to date
+ *   -p  bits a position component is quantised to, 0 to keep floats (default 16)
+ *   -a  as -p, for normals, tex coords and tangents (default 14)
+ *
+ * Prints each source with what happened to it and the time it took, then totals.
+ */
+#include "mesh_bake.h"
+#include "parallel.h"
+
+#include "spdlog/spdlog-inl.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+  int usage(const char *name) {
+    spdlog::critical("usage: {} [-n] [-t] [-g] [-f] [-p bits] [-a bits] asset_dir output_dir", name);
+    return EXIT_FAILURE;
+  }
+
+  const char *status_name(BakeStatus status) {
+    switch (status) {
+      case BakeStatus::BAKED:
+        return "baked";
+      case BakeStatus::UP_TO_DATE:
+        return "up to date";
+      default:
+        return "FAILED";
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  MeshBakeOptions options;
+  std::vector<std::string> dirs;
+  for (auto i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "-n") == 0) {
+      options.load.include_normals = true;
+    } else if (std::strcmp(argv[i], "-t") == 0) {
+      options.load.include_textures = true;
+    } else if (std::strcmp(argv[i], "-g") == 0) {
+      options.load.include_tangents = true;
+    } else if (std::strcmp(argv[i], "-f") == 0) {
+      options.force = true;
+    } else if (std::strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      options.codec.position_bits = static_cast<uint32_t>(std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+      options.codec.attribute_bits = static_cast<uint32_t>(std::atoi(argv[++i]));
+    } else if (argv[i][0] == '-') {
+      return usage(argv[0]);
+    } else {
+      dirs.emplace_back(argv[i]);
+    }
+  }
+  if (dirs.size() != 2) {
+    return usage(argv[0]);
+  }
+
+  // Loaders report every stage of every file; only problems are wanted here
+  spdlog::set_level(spdlog::level::warn);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<BakeResult> results;
+  auto ok = bake_meshes(dirs[0], dirs[1], options, results);
+  const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  size_t baked = 0, up_to_date = 0, failed = 0, source_bytes = 0, baked_bytes = 0;
+  double busy_ms = 0;
+  for (const auto &result: results) {
+    std::printf("  %-10s %10.3f ms  %9zu KB -> %9zu KB  %s\n", status_name(result.status), result.ms,
+                (result.source_bytes + 1023) / 1024, (result.baked_bytes + 1023) / 1024, result.source.c_str());
+    if (result.status == BakeStatus::BAKED) ++baked;
+    else if (result.status == BakeStatus::UP_TO_DATE) ++up_to_date;
+    else ++failed;
+    source_bytes += result.source_bytes;
+    baked_bytes += result.baked_bytes;
+    busy_ms += result.ms;
+  }
+  std::printf("%zu baked, %zu up to date, %zu failed; %zu KB -> %zu KB\n", baked, up_to_date, failed,
+              (source_bytes + 1023) / 1024, (baked_bytes + 1023) / 1024);
+  std::printf("%.3f ms on %zu worker threads, %.3f ms of work\n", ms, num_worker_threads(), busy_ms);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
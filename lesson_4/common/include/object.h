@@ -3,6 +3,12 @@
 
 #include <vector>
 #include "shader.h"
+#include "command_list.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "meshlet.h"
+#include "light_clusters.h"
+#include "raster.h"
 
 #ifdef __APPLE__
 #include "OpenGL/gl3.h"
@@ -14,25 +20,97 @@
 
 #include <memory>
 
+// First of the three texture units the light cluster textures are bound to, see LightClusterBuffers::record_bind
+const uint32_t LIGHT_TEXTURE_UNIT = 0;
+
+// Where an Object's mesh is kept and drawn
+enum class RenderBackend {
+  OPENGL,
+  // On the CPU by the software rasterizer, for machines without a GPU
+  SOFTWARE
+};
+
 class Object {
 public:
+  // Load file_name through the shared MeshCache, with normals if include_normals and the shader takes them
   Object(const std::string& file_name,
          bool include_normals,
-         bool include_tex_coords);
-
-  ~Object();
+         RenderBackend backend = RenderBackend::OPENGL);
 
+  // Clear the frame and draw this object
   void main_loop();
 
+  // Draw into the current frame
+  void draw();
+
+  /*
+   * Record the draw into list for replay on the GL thread. Touches no GL so
+   * different objects may be recorded on different threads at once.
+   */
+  void record(CommandList &list);
+
+  // Draw into frame with the software rasterizer. Needs RenderBackend::SOFTWARE.
+  void draw(FrameBuffer &frame);
+
+  inline const Bounds &bounds() const { return mesh_->bounds; }
+
+  // The mesh drawn, with its vertex data kept on the CPU for occlusion culling
+  inline const Mesh &mesh() const { return *mesh_; }
+
+  inline const glm::mat4 &model() const { return model_; }
+
+  /*
+   * Nearest hit of the world space ray origin + t * direction on the mesh's
+   * triangles, with distance in units of direction.
+   */
+  bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const;
+
+  // Camera and viewport used to place the object and to pick its level of detail
+  void set_model(const glm::mat4 &model) { model_ = model; }
+  void set_view(const glm::mat4 &view) { view_ = view; }
+  void set_projection(const glm::mat4 &projection) { projection_ = projection; }
+  void set_viewport(int32_t width, int32_t height);
+
+  // The light_grid and light_depth uniforms of the clusters the frame's lights are in
+  void set_light_clusters(const glm::vec4 &grid, const glm::vec4 &depth) {
+    light_grid_ = grid;
+    light_depth_ = depth;
+  }
+
 private:
-  void destroy_buffers();
   void init_shader();
+  void init_software_pipeline(bool include_normals);
+
+  // The level of detail to draw for the current camera and viewport
+  size_t select_level() const;
 
-  GLuint vao_;
-  GLuint vbo_;
-  GLuint ebo_;
-  GLuint num_elements_;
+  RenderBackend backend_;
+
+  // Shared with every other Object of the same file, never null
+  MeshHandle mesh_;
   std::shared_ptr<Shader> shader_;
+  int32_t mvp_location_;
+  int32_t model_view_location_;
+  int32_t light_grid_location_;
+  int32_t light_depth_location_;
+  glm::mat4 model_;
+  glm::mat4 view_;
+  glm::mat4 projection_;
+  int32_t viewport_height_;
+  glm::vec4 light_grid_;
+  glm::vec4 light_depth_;
+
+  // Meshlets that survived culling this frame
+  MeshletDrawList draw_list_;
+
+  // What draw records and replays straight away
+  CommandList commands_;
+
+  // Software rendering: the shaders as functors, the matrices they read and the indices of this frame's draws
+  RasterPipeline pipeline_;
+  glm::mat4 model_view_;
+  glm::mat4 mvp_;
+  std::vector<uint32_t> frame_indices_;
 };
 
 #endif //UTAH_ICG_OBJECT_H
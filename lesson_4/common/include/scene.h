@@ -0,0 +1,110 @@
+#ifndef UTAH_ICG_SCENE_H
+#define UTAH_ICG_SCENE_H
+
+#include "object.h"
+#include "bvh.h"
+#include "occlusion.h"
+
+#include <memory>
+#include <vector>
+
+/*
+ * The objects drawn each frame. Objects whose bounds are wholly outside the
+ * view frustum are skipped, found through a BVH over the objects that is
+ * rebuilt when objects are added and refit when they move. Of those left, the
+ * largest on screen are drawn into a software depth buffer as occluders and
+ * objects whose bounds are wholly behind them are skipped too.
+ *
+ * The scene's point lights are binned into clusters of the view frustum each
+ * frame and the lists are uploaded for the objects' shaders. The software
+ * rasterizer path is unlit.
+ */
+class Scene {
+public:
+  Scene();
+
+  void add_object(const std::shared_ptr<Object> &object);
+
+  void set_view(const glm::mat4 &view);
+
+  void set_projection(const glm::mat4 &projection);
+
+  void set_viewport(int32_t width, int32_t height);
+
+  // Lights may change every frame; they are binned again each time the scene is recorded
+  void set_lights(const std::vector<PointLight> &lights) { lights_ = lights; }
+
+  inline const std::vector<PointLight> &lights() const { return lights_; }
+
+  // Make the GL buffers the light lists are uploaded to. Must be called on the GL thread.
+  bool create_light_buffers();
+
+  inline const LightClusters &light_clusters() const { return light_clusters_; }
+
+  // Clear the frame, cull and draw what is left
+  void render();
+
+  /*
+   * Record what render draws into lists, for replay on the GL thread, without
+   * touching GL. The objects are recorded in parallel, a run of them to each list.
+   */
+  void record(std::vector<CommandList> &lists);
+
+  // render into frame with the software rasterizer. Objects must use RenderBackend::SOFTWARE.
+  void render(FrameBuffer &frame);
+
+  /*
+   * Find the object under window pixel (x, y) of a width x height window, y down.
+   * @return true if there is one, setting object to its index in objects().
+   */
+  bool pick(float x, float y, float width, float height, uint32_t &object);
+
+  inline const std::vector<std::shared_ptr<Object>> &objects() const { return objects_; }
+
+  // Indices into objects() of those drawn by the last render
+  inline const std::vector<uint32_t> &visible() const { return visible_; }
+
+  // Objects skipped by the last render, outside the frustum or occluded
+  inline size_t num_culled() const { return num_culled_; }
+
+  // Objects in the frustum skipped by the last render because others hid them
+  inline size_t num_occluded() const { return occlusion_.stats().num_occluded; }
+
+  // Occluders, objects occluded and time spent by the last render's occlusion culling
+  inline const OcclusionStats &occlusion_stats() const { return occlusion_.stats(); }
+
+  // On by default
+  void set_occlusion_culling(bool enabled) { occlusion_culling_ = enabled; }
+
+private:
+  // Bring the world bounds and the BVH up to date with the objects
+  void update_bounds();
+
+  // Find the objects to draw this frame, in visible_
+  void cull();
+
+  std::vector<std::shared_ptr<Object>> objects_;
+  glm::mat4 view_;
+  glm::mat4 projection_;
+  int32_t viewport_width_;
+  int32_t viewport_height_;
+
+  ObjectBounds bounds_;
+  Bvh bvh_;
+  bool bvh_dirty_;
+  std::vector<uint32_t> visible_;
+  size_t num_culled_;
+
+  OcclusionCuller occlusion_;
+  bool occlusion_culling_;
+
+  std::vector<PointLight> lights_;
+  LightClusters light_clusters_;
+  // Shared so that scenes can be moved; owned by the GL thread
+  std::shared_ptr<LightClusterBuffers> light_buffers_;
+
+  // What render records and replays straight away
+  std::vector<CommandList> lists_;
+};
+
+#endif //UTAH_ICG_SCENE_H
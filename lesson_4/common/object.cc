@@ -1,14 +1,11 @@
 #include "object.h"
 #include "spdlog/spdlog-inl.h"
 #include "mesh.h"
+#include "triangle_bvh.h"
 #include "gl_common.h"
+#include "gl_debug.h"
 
-GLenum glerr;
-#define CHECK_GL_ERROR(txt)   \
-if ((glerr = glGetError()) != GL_NO_ERROR){ \
-spdlog::critical("GL Error {} : {:x}", txt, glerr); \
-throw std::runtime_error("GLR"); \
-} \
+#include <algorithm>
 
 namespace {
   const char *vs_source[] = {
@@ -16,72 +13,222 @@ namespace {
 #version 410 core
 
 layout(location=0) in vec3 pos;
+in vec3 normal;
 
-out vec4 colour;
+uniform mat4 mvp;
+uniform mat4 model_view;
+
+out vec3 view_position;
+out vec3 view_normal;
 
 void main() {
-  gl_Position = vec4(pos, 1.0);
+  gl_Position = mvp * vec4(pos, 1.0);
+  view_position = (model_view * vec4(pos, 1.0)).xyz;
+  // Models are only scaled uniformly so the model view matrix turns normals too
+  view_normal = mat3(model_view) * normal;
 }
 )"};
 
-  const GLchar *fs_source[] = {R"(
-#version 410 core
+  // Light every surface gets in the software shader, as AMBIENT in fs_main
+  const float AMBIENT_LEVEL = 0.1f;
+
+  // The software path has no light clusters, so a light from just above the eye stands in for them
+  const glm::vec3 SOFTWARE_LIGHT_DIRECTION = glm::normalize(glm::vec3(0.0f, 0.5f, 1.0f));
+
+  // Goes after the version line and the clustered lighting functions
+  const char *fs_main = R"(
+in vec3 view_position;
+in vec3 view_normal;
 
 layout (location=0) out vec4 frag_colour;
 
+const vec3 AMBIENT = vec3(0.1);
+
 void main() {
-  frag_colour=vec4(1,1,1,1);
+  // Meshes without normals are lit as if they faced the eye
+  vec3 normal = dot(view_normal, view_normal) > 0.0 ? normalize(view_normal) : vec3(0.0, 0.0, 1.0);
+  frag_colour = vec4(AMBIENT + cluster_lighting(view_position, normal), 1.0);
 }
-)"};
+)";
 }
 
 
 Object::Object(const std::string &file_name,
                bool include_normals,
-               bool include_tex_coords) {
-  init_shader();
-  if (!shader_->is_good()) {
-    return;
+               RenderBackend backend)
+        : backend_{backend}, mesh_{std::make_shared<Mesh>()}, mvp_location_{-1}, model_view_location_{-1},
+          light_grid_location_{-1}, light_depth_location_{-1}, model_{1.0f}, view_{1.0f}, projection_{1.0f},
+          viewport_height_{600}, light_grid_{0.0f}, light_depth_{0.0f}, model_view_{1.0f}, mvp_{1.0f} {
+  MeshLoadOptions options;
+  if (backend_ == RenderBackend::SOFTWARE) {
+    init_software_pipeline(include_normals);
+    options.upload = false;
+    options.include_normals = include_normals;
+  } else {
+    init_shader();
+    if (!shader_->is_good()) {
+      return;
+    }
+
+    auto pos_attr = shader_->get_attribute_location("pos");
+    if (pos_attr == -1) {
+      spdlog::error("Invalid attribute location pos:{}", pos_attr);
+      return;
+    }
+    options.pos_attr = static_cast<uint32_t>(pos_attr);
+    auto norm_attr = shader_->get_attribute_location("normal");
+    if (include_normals && norm_attr != -1) {
+      options.include_normals = true;
+      options.norm_attr = static_cast<uint32_t>(norm_attr);
+    }
+    // Occluders are drawn from the CPU copy
+    options.keep_vertex_data = true;
   }
 
-  auto pos_attr = shader_->get_attribute_location("pos");
-  if (pos_attr == -1) {
-    spdlog::error("Invalid attribute location pos:{}", pos_attr);
-    return;
-  }
+  options.lod_ratios = {0.5f, 0.25f, 0.1f, 0.02f};
+  options.meshlet_triangles = 124;
+  options.build_triangle_bvh = true;
+  auto mesh = MeshCache::shared().load(file_name, options);
+  if (mesh) mesh_ = mesh;
+}
+
+
+void Object::main_loop() {
+  glClearColor(0.0, 0.0, 0.0, 1.0);
+  glClear(GL_COLOR_BUFFER_BIT);
+  draw();
+}
 
-  uint32_t norm_attr = 0, tx_attr = 0;
-  load_obj(file_name, vao_, vbo_, ebo_,
-           num_elements_, pos_attr,
-           false, norm_attr,
-           false, tx_attr);
+void Object::draw() {
+  GlDebugGroup group("Object");
+  commands_.reset();
+  record(commands_);
+  commands_.replay();
 }
 
+void Object::record(CommandList &list) {
+  if (!shader_ || !shader_->is_good() || !mesh_->vao) return;
+  list.bind_vertex_array(mesh_->vao);
+  list.use_program(shader_->id());
+  auto mvp = projection_ * view_ * model_;
+  list.uniform(mvp_location_, mvp);
+  list.uniform(model_view_location_, view_ * model_);
+  list.uniform(light_grid_location_, light_grid_);
+  list.uniform(light_depth_location_, light_depth_);
+  list.point_size(5.0f);
+
+  auto level = select_level();
+
+  // At full resolution only the meshlets that may be visible are drawn
+  if (level == 0 && !mesh_->meshlets.empty()) {
+    auto eye_in_model = glm::vec3(glm::inverse(model_) * glm::inverse(view_)[3]);
+    cull_meshlets(mesh_->meshlets, mvp, eye_in_model, draw_list_);
+    list.multi_draw_elements(GL_TRIANGLES, draw_list_.counts.data(), draw_list_.offsets.data(),
+                             draw_list_.counts.size());
+    return;
+  }
+  const auto &submeshes = mesh_->lods.empty() ? mesh_->submeshes : mesh_->lods[level].submeshes;
 
-Object::~Object() {
-  destroy_buffers();
+  // Every submesh shares the one VAO so each is just a draw over its range of the EBO
+  for (const auto &submesh: submeshes) {
+    list.draw_elements(GL_TRIANGLES, submesh.index_count, submesh.index_offset);
+  }
 }
 
+void Object::draw(FrameBuffer &frame) {
+  if (backend_ != RenderBackend::SOFTWARE) {
+    spdlog::error("Object wasn't loaded for software rendering");
+    return;
+  }
+  viewport_height_ = static_cast<int32_t>(frame.height);
+  model_view_ = view_ * model_;
+  mvp_ = projection_ * model_view_;
+  auto level = select_level();
+
+  // The same ranges of the same indices as the GL path draws, gathered into one list
+  frame_indices_.clear();
+  const auto *indices = mesh_->indices.data();
+  if (level == 0 && !mesh_->meshlets.empty()) {
+    auto eye_in_model = glm::vec3(glm::inverse(model_) * glm::inverse(view_)[3]);
+    cull_meshlets(mesh_->meshlets, mvp_, eye_in_model, draw_list_);
+    for (const auto &command: draw_list_.commands) {
+      frame_indices_.insert(frame_indices_.end(), indices + command.first_index,
+                            indices + command.first_index + command.count);
+    }
+  } else {
+    const auto &submeshes = mesh_->lods.empty() ? mesh_->submeshes : mesh_->lods[level].submeshes;
+    for (const auto &submesh: submeshes) {
+      frame_indices_.insert(frame_indices_.end(), indices + submesh.index_offset,
+                            indices + submesh.index_offset + submesh.index_count);
+    }
+  }
+  rasterize(pipeline_, mesh_->vertex_data.data(), mesh_->stride, mesh_->vertex_data.size() / mesh_->stride,
+            frame_indices_.data(), frame_indices_.size(), frame);
+}
 
-void Object::main_loop() {
-  glClearColor(0.0, 0.0, 0.0, 1.0);
-  glClear(GL_COLOR_BUFFER_BIT);
+size_t
+Object::select_level() const {
+  // Distance from the eye to the object's origin picks the level of detail
+  auto eye = glm::inverse(view_)[3];
+  auto distance = glm::length(glm::vec3(model_[3]) - glm::vec3(eye));
+  auto pixel_scale = viewport_height_ * projection_[1][1] * 0.5f;
+  return select_lod(*mesh_, distance, pixel_scale);
+}
 
-  glBindVertexArray(vao_);
+void
+Object::set_viewport(int32_t width, int32_t height) {
+  // The viewport itself is set by whoever records the frame
+  viewport_height_ = height;
+}
 
-  shader_->use();
-  glPointSize(5.0f);
-  glDrawElements(GL_TRIANGLES, num_elements_, GL_UNSIGNED_INT, (void *) nullptr);
+bool
+Object::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float &distance) const {
+  if (!mesh_->triangle_bvh) return false;
+
+  // Into model space. direction isn't renormalised so distances along it carry over unchanged.
+  const auto to_model = glm::inverse(model_);
+  const auto model_origin = glm::vec3(to_model * glm::vec4(origin, 1.0f));
+  const auto model_direction = glm::vec3(to_model * glm::vec4(direction, 0.0f));
+  RayHit hit;
+  if (!::raycast(*mesh_->triangle_bvh, model_origin, model_direction, hit)) return false;
+  distance = hit.distance;
+  return true;
 }
 
 void
 Object::init_shader() {
+  auto fs = std::string("#version 410 core\n") + light_cluster_glsl() + fs_main;
+  const char *fs_source[] = {fs.c_str()};
   shader_ = std::make_shared<Shader>(vs_source, fs_source);
+  shader_->set_label("Object");
+  mvp_location_ = shader_->get_uniform_location("mvp");
+  model_view_location_ = shader_->get_uniform_location("model_view");
+  light_grid_location_ = shader_->get_uniform_location("light_grid");
+  light_depth_location_ = shader_->get_uniform_location("light_depth");
+
+  // The light textures are always bound to the same units
+  shader_->use();
+  shader_->set_uniform("light_data", static_cast<int32_t>(LIGHT_TEXTURE_UNIT));
+  shader_->set_uniform("light_clusters", static_cast<int32_t>(LIGHT_TEXTURE_UNIT + 1));
+  shader_->set_uniform("light_indices", static_cast<int32_t>(LIGHT_TEXTURE_UNIT + 2));
 }
 
 void
-Object::destroy_buffers() {
-  glDeleteBuffers(1, &vbo_);
-  glDeleteBuffers(1, &ebo_);
-  glDeleteBuffers(1, &vao_);
+Object::init_software_pipeline(bool include_normals) {
+  // vs_source and fs_main as functors, with the varying view_normal; positions are followed by normals if loaded
+  pipeline_.num_varyings = 3;
+  pipeline_.vertex_shader = [this, include_normals](const float *vertex, float *view_normal) {
+    const auto normal = include_normals ? glm::mat3(model_view_) * glm::vec3(vertex[3], vertex[4], vertex[5])
+                                        : glm::vec3(0.0f);
+    view_normal[0] = normal.x;
+    view_normal[1] = normal.y;
+    view_normal[2] = normal.z;
+    return mvp_ * glm::vec4(vertex[0], vertex[1], vertex[2], 1.0f);
+  };
+  pipeline_.fragment_shader = [](const float *view_normal) {
+    auto normal = glm::vec3(view_normal[0], view_normal[1], view_normal[2]);
+    normal = glm::dot(normal, normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+    const auto diffuse = std::max(glm::dot(normal, SOFTWARE_LIGHT_DIRECTION), 0.0f);
+    return glm::vec4(glm::vec3(AMBIENT_LEVEL + diffuse), 1.0f);
+  };
 }
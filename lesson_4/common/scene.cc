@@ -0,0 +1,126 @@
+#include "scene.h"
+#include "gl_debug.h"
+#include "parallel.h"
+
+#include <algorithm>
+
+namespace {
+  // Enough objects to each list that recording one is worth a job
+  const size_t OBJECTS_PER_LIST = 16;
+}
+
+Scene::Scene()
+        : view_{1.0f}, projection_{1.0f}, viewport_width_{0}, viewport_height_{0}, bvh_dirty_{true}, num_culled_{0},
+          occlusion_culling_{true} {}
+
+void Scene::add_object(const std::shared_ptr<Object> &object) {
+  object->set_view(view_);
+  object->set_projection(projection_);
+  objects_.push_back(object);
+  bvh_dirty_ = true;
+}
+
+void Scene::set_view(const glm::mat4 &view) {
+  view_ = view;
+  for (const auto &object: objects_) object->set_view(view);
+}
+
+void Scene::set_projection(const glm::mat4 &projection) {
+  projection_ = projection;
+  for (const auto &object: objects_) object->set_projection(projection);
+}
+
+void Scene::set_viewport(int32_t width, int32_t height) {
+  viewport_width_ = width;
+  viewport_height_ = height;
+  for (const auto &object: objects_) object->set_viewport(width, height);
+}
+
+bool Scene::create_light_buffers() {
+  light_buffers_ = std::make_shared<LightClusterBuffers>();
+  if (light_buffers_->create(light_clusters_.options())) return true;
+  light_buffers_.reset();
+  return false;
+}
+
+void Scene::render() {
+  GlDebugGroup group("Scene");
+  for (auto &list: lists_) list.reset();
+  record(lists_);
+  for (const auto &list: lists_) list.replay();
+}
+
+void Scene::record(std::vector<CommandList> &lists) {
+  cull();
+
+  // The first list sets up the frame, the rest hold the objects in order
+  auto num_lists = std::min(num_worker_threads(), (visible_.size() + OBJECTS_PER_LIST - 1) / OBJECTS_PER_LIST);
+  if (lists.size() < num_lists + 1) lists.resize(num_lists + 1);
+  for (auto &list: lists) list.reset();
+
+  if (viewport_width_ > 0 && viewport_height_ > 0) lists[0].viewport(0, 0, viewport_width_, viewport_height_);
+  lists[0].clear_colour(glm::vec4{0.0f, 0.0f, 0.0f, 1.0f});
+  if (visible_.empty()) return;
+
+  light_clusters_.assign(lights_, view_, projection_);
+  if (light_buffers_) {
+    light_buffers_->record_upload(light_clusters_, lists[0]);
+    light_buffers_->record_bind(lists[0], LIGHT_TEXTURE_UNIT);
+  }
+  auto grid = light_clusters_.grid_uniform();
+  auto depth = light_clusters_.depth_uniform(viewport_width_, viewport_height_);
+  for (auto i: visible_) objects_[i]->set_light_clusters(grid, depth);
+
+  auto per_list = (visible_.size() + num_lists - 1) / num_lists;
+  parallel_for(0, num_lists, 1, [this, &lists, per_list](size_t begin, size_t end) {
+    for (auto l = begin; l < end; ++l) {
+      auto last = std::min(visible_.size(), (l + 1) * per_list);
+      for (auto i = l * per_list; i < last; ++i) objects_[visible_[i]]->record(lists[l + 1]);
+    }
+  });
+}
+
+void Scene::render(FrameBuffer &frame) {
+  frame.clear(glm::vec4{0.0f, 0.0f, 0.0f, 1.0f});
+  cull();
+
+  for (auto i: visible_) objects_[i]->draw(frame);
+}
+
+bool Scene::pick(float x, float y, float width, float height, uint32_t &object) {
+  update_bounds();
+  glm::vec3 origin, direction;
+  pick_ray(x, y, width, height, view_, projection_, origin, direction);
+  float distance;
+  // Boxes only narrow the search; the object picked is the one whose triangles the ray hits first
+  return bvh_raycast(bvh_, origin, direction, object, distance,
+                     [this, &origin, &direction](uint32_t i, float &d) {
+                       return objects_[i]->raycast(origin, direction, d);
+                     });
+}
+
+void Scene::cull() {
+  update_bounds();
+  num_culled_ = bvh_frustum_cull(bvh_, projection_ * view_, visible_);
+
+  // Every object left may be an occluder; the culler keeps the largest
+  occlusion_.begin_frame(view_, projection_);
+  if (!occlusion_culling_ || visible_.empty()) return;
+  for (auto i: visible_) occlusion_.add_occluder(objects_[i]->mesh(), objects_[i]->model());
+  occlusion_.render_occluders();
+  num_culled_ += occlusion_.cull(bounds_, visible_);
+}
+
+void Scene::update_bounds() {
+  // Objects may have moved since the last frame so their world bounds are refreshed every time
+  bounds_.resize(objects_.size());
+  for (size_t i = 0; i < objects_.size(); ++i) {
+    bounds_.set(i, objects_[i]->bounds(), objects_[i]->model());
+  }
+  if (bvh_dirty_) {
+    build_bvh(bounds_, bvh_);
+    bvh_dirty_ = false;
+  } else {
+    refit_bvh(bounds_, bvh_);
+  }
+}
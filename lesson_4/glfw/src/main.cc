@@ -7,14 +7,37 @@
  */
 
 #include "object.h"
+#include "scene.h"
+#include "gl_debug.h"
+#include "render_thread.h"
 
 #include "spdlog/spdlog-inl.h"
 
 #include "main.h"
 
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <random>
+
 void special_keyboard_handler(GLFWwindow *window, int key, int scancode, int action, int mods) {}
 
-void mouse_handler(GLFWwindow *window, int button, int action, int mods) {}
+void mouse_handler(GLFWwindow *window, int button, int action, int mods) {
+  auto scene = static_cast<Scene *>(glfwGetWindowUserPointer(window));
+  if (!scene || button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+
+  // Cursor positions are in window coordinates, which differ from pixels on high DPI displays
+  double x, y;
+  int32_t width, height;
+  glfwGetCursorPos(window, &x, &y);
+  glfwGetWindowSize(window, &width, &height);
+  uint32_t object;
+  if (scene->pick((float) x, (float) y, (float) width, (float) height, object)) {
+    spdlog::info("Picked object {}", object);
+  } else {
+    spdlog::info("Nothing picked");
+  }
+}
 
 void drag_handler(int32_t x,
                   int32_t y) {
@@ -24,7 +47,12 @@ void mouse_motion_handler(int32_t x,
                           int32_t y) {
 }
 
-void framebuffer_size_callback(GLFWwindow *window, int32_t width, int32_t height) {}
+void framebuffer_size_callback(GLFWwindow *window, int32_t width, int32_t height) {
+  auto scene = static_cast<Scene *>(glfwGetWindowUserPointer(window));
+  if (!scene || height == 0) return;
+  scene->set_viewport(width, height);
+  scene->set_projection(glm::perspective(glm::radians(45.0f), (float) width / (float) height, 0.1f, 100.0f));
+}
 
 void window_reshape_handler(GLFWwindow *window, int32_t width, int32_t height) {}
 
@@ -40,6 +68,9 @@ int main(int argc, char *argv[]) {
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
   glfwWindowHint(GLFW_DOUBLEBUFFER, GL_TRUE);
+#ifdef UTAH_ICG_GL_DEBUG
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
 
 
   // Window creation
@@ -51,32 +82,79 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
-  // Create window with graphics context
-  glfwMakeContextCurrent(window);
-
+  {
+    // The graphics context belongs to the render thread. This thread handles input and records frames.
+    RenderThread renderer([window]() { glfwMakeContextCurrent(window); },
+                          [window]() { glfwSwapBuffers(window); });
+    renderer.execute([]() {
 #ifndef __APPLE__
-  // Need context before we do this.
-  GLenum err = glewInit();
-  if( GLEW_OK != err) {
-    spdlog::critical("Error: {}", (const char *)glewGetErrorString(err));
-  }
+      // Need context before we do this.
+      GLenum err = glewInit();
+      if (GLEW_OK != err) {
+        spdlog::critical("Error: {}", (const char *) glewGetErrorString(err));
+      }
 #endif
-
-  glfwSwapInterval(1); // Enable vsync
-
-  glfwSetWindowSizeCallback(window, window_reshape_handler);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-  glfwSetKeyCallback(window, special_keyboard_handler);
-
-
-  Object obj{argv[1], true, true};
-
-  while (!glfwWindowShouldClose(window)) {
-    obj.main_loop();
-
-    idle_handler();
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+      install_gl_debug();
+
+      glfwSwapInterval(1); // Enable vsync
+    });
+
+    glfwSetWindowSizeCallback(window, window_reshape_handler);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, special_keyboard_handler);
+    glfwSetMouseButtonCallback(window, mouse_handler);
+
+
+    // One object per file named on the command line, side by side along x. Loading makes GL objects.
+    Scene scene;
+    renderer.execute([&scene, argc, argv]() {
+      for (auto i = 1; i < argc; ++i) {
+        auto obj = std::make_shared<Object>(argv[i], true);
+        obj->set_model(glm::translate(glm::mat4{1.0f}, glm::vec3{2.5f * (i - 1), 0, 0}));
+        scene.add_object(obj);
+      }
+      scene.create_light_buffers();
+    });
+
+    // Coloured lights scattered around the objects, which circle them as the frames go by
+    std::vector<PointLight> lights(512);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    const auto span = 2.5f * std::max(argc - 2, 0);
+    for (auto &light: lights) {
+      light.position = glm::vec3{(span + 4.0f) * unit(rng) - 2.0f, 3.0f * unit(rng) - 1.5f, 4.0f * unit(rng) - 2.0f};
+      light.radius = 0.5f + unit(rng);
+      light.colour = glm::vec3{unit(rng), unit(rng), unit(rng)} * 0.5f;
+    }
+    const auto centre = glm::vec3{0.5f * span, 0, 0};
+    scene.set_view(glm::lookAt(glm::vec3{0, 0, 3}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0}));
+    glfwSetWindowUserPointer(window, &scene);
+    int32_t width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    framebuffer_size_callback(window, width, height);
+
+    // Frame n + 1 is recorded while the render thread is still submitting frame n
+    while (!glfwWindowShouldClose(window)) {
+      auto spin = glm::rotate(glm::mat4{1.0f}, 0.5f * (float) glfwGetTime(), glm::vec3{0, 1, 0});
+      auto moved = lights;
+      for (auto &light: moved) light.position = centre + glm::vec3(spin * glm::vec4(light.position - centre, 1.0f));
+      scene.set_lights(moved);
+
+      auto &frame = renderer.begin_frame();
+      scene.record(frame.lists);
+      renderer.submit();
+      const auto &occlusion = scene.occlusion_stats();
+      spdlog::debug("Drew {} objects, culled {} of which {} occluded by {} occluders in {:.3f} + {:.3f} ms",
+                    scene.visible().size(), scene.num_culled(), occlusion.num_occluded, occlusion.num_occluders,
+                    occlusion.raster_ms, occlusion.test_ms);
+
+      idle_handler();
+      glfwPollEvents();
+    }
+
+    // Meshes and shaders are deleted with the scene, which must happen where the context is
+    glfwSetWindowUserPointer(window, nullptr);
+    renderer.execute([&scene]() { scene = Scene(); });
   }
 
   glfwTerminate();
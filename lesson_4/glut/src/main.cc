@@ -7,6 +7,7 @@
  */
 
 #include "object.h"
+#include "gl_debug.h"
 
 #include "main.h"
 #include "spdlog/spdlog-inl.h"
@@ -64,6 +65,9 @@ int main(int argc, char *argv[]) {
 #ifndef __APPLE__
   glutInitContextVersion( 4, 1 );
   glutInitContextProfile( GLUT_CORE_PROFILE );
+#ifdef UTAH_ICG_GL_DEBUG
+  glutInitContextFlags( GLUT_DEBUG );
+#endif
 #endif
 
 
@@ -92,6 +96,7 @@ int main(int argc, char *argv[]) {
       spdlog::critical("Error: {}", (const char *)glewGetErrorString(err));
   }
 #endif
+  install_gl_debug();
 
   // Callbacks - AFTER Window Creation!
   glutKeyboardFunc(keyboard_handler);
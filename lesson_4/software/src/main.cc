@@ -0,0 +1,52 @@
+/*
+ * Lecture 4 tutorial without a GPU.
+ * Render the same scene as the GLFW front end with the software rasterizer
+ * and write it to an image, for machines with no display and for reference
+ * images to compare GL's output against.
+ *
+ * usage: test_software output.ppm [width height] file.obj...
+ */
+
+#include "object.h"
+#include "scene.h"
+
+#include "spdlog/spdlog-inl.h"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    spdlog::critical("usage: {} output.ppm [width height] file.obj...", argv[0]);
+    return EXIT_FAILURE;
+  }
+  std::string output = argv[1];
+  auto first_obj = 2;
+  int32_t width = 800, height = 600;
+  if (argc > 4 && std::strtol(argv[2], nullptr, 10) > 0 && std::strtol(argv[3], nullptr, 10) > 0) {
+    width = std::atoi(argv[2]);
+    height = std::atoi(argv[3]);
+    first_obj = 4;
+  }
+
+  // One object per file named on the command line, side by side along x
+  Scene scene;
+  for (auto i = first_obj; i < argc; ++i) {
+    auto obj = std::make_shared<Object>(argv[i], true, RenderBackend::SOFTWARE);
+    obj->set_model(glm::translate(glm::mat4{1.0f}, glm::vec3{2.5f * (i - first_obj), 0, 0}));
+    scene.add_object(obj);
+  }
+  scene.set_view(glm::lookAt(glm::vec3{0, 0, 3}, glm::vec3{0, 0, 0}, glm::vec3{0, 1, 0}));
+  scene.set_viewport(width, height);
+  scene.set_projection(glm::perspective(glm::radians(45.0f), (float) width / (float) height, 0.1f, 100.0f));
+
+  FrameBuffer frame{static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+  scene.render(frame);
+  const auto &occlusion = scene.occlusion_stats();
+  spdlog::info("Drew {} objects, culled {} of which {} occluded by {} occluders in {:.3f} + {:.3f} ms",
+               scene.visible().size(), scene.num_culled(), occlusion.num_occluded, occlusion.num_occluders,
+               occlusion.raster_ms, occlusion.test_ms);
+  return write_ppm(output, frame) ? EXIT_SUCCESS : EXIT_FAILURE;
+}